@@ -60,6 +60,7 @@ Defines.
 #define ASF_UNKNOWN_PTS ((uint32_t)(-1))
 #define ASF_MAX_CONSECUTIVE_CORRUPTED_PACKETS 100
 #define ASF_MAX_SEARCH_PACKETS 1000
+#define ASF_INDEX_READ_ENTRIES 256 /* Number of simple index entries read at once */
 
 #define ASF_SKIP_GUID(ctx, size, n) (size -= 16, SKIP_GUID(ctx,n))
 #define ASF_SKIP_U8(ctx, size, n)   (size -= 1, SKIP_U8(ctx,n))
@@ -151,6 +152,7 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
       uint32_t num_entries;
       int64_t  time_interval; /* in uS */
       bool     incomplete;    /* The index does not go to the end of the file */
+      uint32_t *packets;      /**< Packet number of each entry, loaded when opening */
    } simple_index;
 
 } VC_CONTAINER_TRACK_MODULE_T;
@@ -187,6 +189,10 @@ typedef struct VC_CONTAINER_MODULE_T
       uint64_t specifiers_offset;                  /* The file address of the first specifier. */
       uint32_t block_count;                        /* The number of index blocks */
       uint64_t blocks_offset;                      /* The file address of the first block */
+      uint32_t entries_num;                        /* The number of entries in all the blocks */
+      uint64_t *positions;                         /* Offset relative to the start of the data of
+                                                    * each entry, ASF_TRACKS_MAX per entry.
+                                                    * UINT64_MAX if the track isn't indexed */
    } top_level_index;
 
    /* A pointer to the track (in the tracks array) which is to be used with a simple index.
@@ -758,13 +764,20 @@ static VC_CONTAINER_STATUS_T asf_read_object_ext_stream_properties( VC_CONTAINER
    return status;
 }
 
+/** Number of bytes between the current position and the end of the stream */
+static int64_t asf_bytes_left( VC_CONTAINER_T *p_ctx )
+{
+   int64_t left = p_ctx->priv->io->size - STREAM_POSITION(p_ctx);
+   return left > 0 ? left : 0;
+}
+
 /** Reads an ASF simple index object */
 static VC_CONTAINER_STATUS_T asf_read_object_simple_index( VC_CONTAINER_T *p_ctx, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = 0;
-   uint64_t time_interval, index_duration;
-   uint32_t count;
+   uint64_t time_interval, index_duration, packets_size;
+   uint32_t count, entry, entries;
    unsigned int i;
 
    ASF_SKIP_GUID(p_ctx, size, "File ID");
@@ -781,6 +794,11 @@ static VC_CONTAINER_STATUS_T asf_read_object_simple_index( VC_CONTAINER_T *p_ctx
       LOG_DEBUG(p_ctx, "invalid number of entries in the index (%i, %"PRIi64")", count, size / 6);
       count = (uint32_t)(size / 6);
    }
+   if(p_ctx->priv->io->size > 0 && count > asf_bytes_left(p_ctx) / 6)
+   {
+      LOG_DEBUG(p_ctx, "index goes past the end of the stream (%i entries)", count);
+      count = (uint32_t)(asf_bytes_left(p_ctx) / 6);
+   }
 
    /* Find the track corresponding to this index */
    for(i = 0; i < p_ctx->tracks_num; i++)
@@ -813,24 +831,46 @@ static VC_CONTAINER_STATUS_T asf_read_object_simple_index( VC_CONTAINER_T *p_ctx
    LOG_DEBUG(p_ctx, "index covers %fS on %fS",
       (float)index_duration / 1E6, (float)module->duration / 1E6);
 
-#if defined(ENABLE_CONTAINERS_LOG_FORMAT) && defined(ENABLE_CONTAINERS_LOG_FORMAT_VERBOSE)
-   for(i = 0; i < count; i++)
-   {
-      LOG_FORMAT(p_ctx, "Entry: %u", i);
-      ASF_SKIP_U32(p_ctx, size, "Packet Number");
-      ASF_SKIP_U16(p_ctx, size, "Packet Count");
-      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) break;
+   /* Keep the packet numbers in memory so seeking doesn't need to read the index again.
+    * If that's not possible we just do without the index. */
+   packets_size = (uint64_t)count * sizeof(*track_module->simple_index.packets);
+   if(packets_size <= SIZE_MAX)
+      track_module->simple_index.packets = malloc((size_t)packets_size);
+   if(!track_module->simple_index.packets)
+   {
+      LOG_DEBUG(p_ctx, "can't store the index (%i entries), ignoring it", count);
+      track_module->simple_index.offset = 0;
+      track_module->simple_index.num_entries = 0;
+      track_module->simple_index.incomplete = false;
+      return VC_CONTAINER_SUCCESS;
    }
-   size = i * 6;
-#else
-   size = CACHE_BYTES(p_ctx, count * 6);
+
+   for(entry = 0; entry < count; )
+   {
+      uint8_t buffer[ASF_INDEX_READ_ENTRIES * 6], *p;
+
+      entries = MIN(count - entry, ASF_INDEX_READ_ENTRIES);
+      entries = READ_BYTES(p_ctx, buffer, entries * 6) / 6;
+      if(!entries) break;
+
+      for(p = buffer; entries; entries--, entry++, p += 6)
+      {
+         uint32_t packet = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+#if defined(ENABLE_CONTAINERS_LOG_FORMAT) && defined(ENABLE_CONTAINERS_LOG_FORMAT_VERBOSE)
+         LOG_FORMAT(p_ctx, "Entry: %u, Packet Number: %u", entry, packet);
 #endif
+         /* Entries must be in packet order for the index to be searched by bisection */
+         if(entry && packet < track_module->simple_index.packets[entry - 1]) break;
+         track_module->simple_index.packets[entry] = packet;
+      }
+      if(entries) break;
+   }
 
    /* Check that the index is complete */
-   if(size / 6 != count )
+   if(entry != count)
    {
-      LOG_DEBUG(p_ctx, "index is incomplete (%i entries on %i)", (int)size / 6, count);
-      track_module->simple_index.num_entries = (uint32_t)(size / 6);
+      LOG_DEBUG(p_ctx, "index is incomplete (%i entries on %i)", entry, count);
+      track_module->simple_index.num_entries = entry;
       track_module->simple_index.incomplete = true;
    }
 
@@ -849,8 +889,10 @@ static VC_CONTAINER_STATUS_T asf_read_object_simple_index( VC_CONTAINER_T *p_ctx
 /** Reads an ASF index object */
 static VC_CONTAINER_STATUS_T asf_read_object_index( VC_CONTAINER_T *p_ctx, int64_t size )
 {
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    uint32_t i, specifiers_count, blocks_count;
    uint32_t best_specifier_type[ASF_TRACKS_MAX] = {0};
+   uint8_t *offsets = 0;
 
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
 
@@ -876,7 +918,8 @@ static VC_CONTAINER_STATUS_T asf_read_object_index( VC_CONTAINER_T *p_ctx, int64
       uint32_t index_type = (uint32_t)ASF_READ_U16(p_ctx, size, "Index Type");
 
       /* Find the track index for this stream */
-      unsigned track = module->stream_number_to_index[stream_id];
+      unsigned track = stream_id < sizeof(module->stream_number_to_index) ?
+         module->stream_number_to_index[stream_id] : ASF_TRACKS_MAX;
 
       if ((track < ASF_TRACKS_MAX) &&
          (index_type > best_specifier_type[track]))
@@ -900,30 +943,76 @@ static VC_CONTAINER_STATUS_T asf_read_object_index( VC_CONTAINER_T *p_ctx, int64
 
    /* The blocks start here */
    module->top_level_index.blocks_offset = STREAM_POSITION(p_ctx);
+   if(!module->top_level_index.entry_time_interval) return STREAM_STATUS(p_ctx);
 
-   /* Index blocks */
-#if !(defined(ENABLE_CONTAINERS_LOG_FORMAT) && defined(ENABLE_CONTAINERS_LOG_FORMAT_VERBOSE))
-   blocks_count = 0; /* Don't log the index. Note we'll get a warning on unprocessed data */
-#endif
-   /* coverity[dead_error_condition] Code needs to stay there for debugging purposes */
+   /* Index blocks. We keep the positions of the entries for the specifiers we use in memory
+    * so seeking doesn't need to read the index again. An index we can't trust or can't
+    * store is dropped altogether. */
    for(i = 0; i < blocks_count; i++)
    {
+      uint64_t block_positions[ASF_TRACKS_MAX] = {0}, *positions;
       uint32_t j, k, count = ASF_READ_U32(p_ctx, size, "Index Entry Count");
+      uint64_t offsets_size = (uint64_t)count * specifiers_count * 4;
+
+      if(size < 0 || STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
+      { status = VC_CONTAINER_ERROR_CORRUPTED; goto error; }
+      if(size < specifiers_count * INT64_C(8) + (int64_t)offsets_size ||
+         (p_ctx->priv->io->size > 0 && asf_bytes_left(p_ctx) < specifiers_count * INT64_C(8) + (int64_t)offsets_size))
+      { status = VC_CONTAINER_ERROR_CORRUPTED; goto error; }
 
       for(j = 0; j < specifiers_count; j++)
       {
-         ASF_SKIP_U64(p_ctx, size, "Block Positions");
+         uint64_t block_position = ASF_READ_U64(p_ctx, size, "Block Positions");
+         for(k = 0; k < ASF_TRACKS_MAX; k++)
+            if(module->top_level_index.active_specifiers[k] == j)
+               block_positions[k] = block_position;
       }
-      for(j = 0; j < count; j++)
+      if(!count || !specifiers_count) continue;
+
+      status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      if((uint64_t)module->top_level_index.entries_num + count > UINT32_MAX ||
+         (uint64_t)module->top_level_index.entries_num + count >
+            SIZE_MAX / sizeof(*positions) / ASF_TRACKS_MAX || offsets_size > SIZE_MAX)
+         goto error;
+      positions = realloc(module->top_level_index.positions,
+         (size_t)(module->top_level_index.entries_num + count) * sizeof(*positions) * ASF_TRACKS_MAX);
+      if(!positions) goto error;
+      module->top_level_index.positions = positions;
+      offsets = malloc((size_t)offsets_size);
+      if(!offsets) goto error;
+
+      if(ASF_READ_BYTES(p_ctx, size, offsets, (size_t)offsets_size) != (size_t)offsets_size)
+      { status = STREAM_STATUS(p_ctx); goto error; }
+      status = VC_CONTAINER_SUCCESS;
+
+      positions += module->top_level_index.entries_num * ASF_TRACKS_MAX;
+      for(j = 0; j < count; j++, positions += ASF_TRACKS_MAX)
       {
-         for(k = 0; k < specifiers_count; k++)
+         for(k = 0; k < ASF_TRACKS_MAX; k++)
          {
-            ASF_SKIP_U32(p_ctx, size, "Offsets");
+            uint64_t specifier = module->top_level_index.active_specifiers[k];
+            uint8_t *p = offsets + (j * specifiers_count + specifier) * 4;
+
+            positions[k] = UINT64_MAX;
+            if(k >= p_ctx->tracks_num || specifier >= specifiers_count) continue;
+            positions[k] = block_positions[k] +
+               (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
          }
       }
+      module->top_level_index.entries_num += count;
+      free(offsets);
+      offsets = 0;
    }
 
    return STREAM_STATUS(p_ctx);
+
+ error:
+   LOG_DEBUG(p_ctx, "can't use the index (%i), ignoring it", status);
+   free(offsets);
+   free(module->top_level_index.positions);
+   module->top_level_index.positions = 0;
+   module->top_level_index.entries_num = 0;
+   return VC_CONTAINER_SUCCESS;
 }
 
 /** Reads an ASF index parameters object */
@@ -1637,8 +1726,7 @@ static VC_CONTAINER_STATUS_T asf_reader_read( VC_CONTAINER_T *p_ctx,
 static VC_CONTAINER_STATUS_T asf_reader_index_find_time( VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_TRACK_MODULE_T* track_module, int64_t time, uint32_t *packet_num, bool forward )
 {
-   VC_CONTAINER_STATUS_T status;
-   uint32_t entry, previous_packet_num;
+   uint32_t entry, low, high;
    bool eos = false;
 
    /* Default to beginning of file in case of error */
@@ -1652,35 +1740,34 @@ static VC_CONTAINER_STATUS_T asf_reader_index_find_time( VC_CONTAINER_T *p_ctx,
    if(!track_module->simple_index.time_interval) return VC_CONTAINER_ERROR_CORRUPTED;
 
    entry = time / track_module->simple_index.time_interval;
-   LOG_DEBUG(p_ctx, "entry: %i, offset: %"PRIi64", interv: %"PRIi64, entry,
-             track_module->simple_index.offset, track_module->simple_index.time_interval);
+   LOG_DEBUG(p_ctx, "entry: %i, interv: %"PRIi64, entry, track_module->simple_index.time_interval);
    if(entry >= track_module->simple_index.num_entries)
    {
       entry = track_module->simple_index.num_entries - 1;
       eos = true;
    }
 
-   /* Fetch the entry from the index */
-   status = SEEK(p_ctx, track_module->simple_index.offset + 6 * entry);
-   if(status != VC_CONTAINER_SUCCESS) return status;
-   *packet_num = READ_U32(p_ctx, "Packet Number");
-   if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) return STREAM_STATUS(p_ctx);
+   *packet_num = track_module->simple_index.packets[entry];
 
    /* When asking for the following keyframe we need to find the next entry with a greater
-    * packet number */
-   previous_packet_num = *packet_num;
-   while(!eos && forward && previous_packet_num == *packet_num)
+    * packet number. Entries are in packet order so we can bisect. */
+   if(!eos && forward)
    {
-      if(++entry == track_module->simple_index.num_entries) {eos = true; break;}
-      status = SEEK(p_ctx, track_module->simple_index.offset + 6 * entry);
-      if(status != VC_CONTAINER_SUCCESS) break;
-      *packet_num = READ_U32(p_ctx, "Packet Number");
-      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) break;
+      low = entry + 1;
+      high = track_module->simple_index.num_entries;
+      while(low < high)
+      {
+         uint32_t middle = low + (high - low) / 2;
+         if(track_module->simple_index.packets[middle] > *packet_num) high = middle;
+         else low = middle + 1;
+      }
+      if(low == track_module->simple_index.num_entries) eos = true;
+      else *packet_num = track_module->simple_index.packets[low];
    }
 
    if(eos && track_module->simple_index.incomplete) return VC_CONTAINER_ERROR_INCOMPLETE_DATA;
    else if(eos) return VC_CONTAINER_ERROR_EOS;
-   else return STREAM_STATUS(p_ctx);
+   else return VC_CONTAINER_SUCCESS;
 }
 
 #if 0
@@ -1762,78 +1849,29 @@ static VC_CONTAINER_STATUS_T seek_by_top_level_index(
    VC_CONTAINER_SEEK_MODE_T mode,
    VC_CONTAINER_SEEK_FLAGS_T flags)
 {
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
-   unsigned index;
-   uint64_t time = 0;
-   uint64_t block_address = module->top_level_index.blocks_offset;
+   unsigned int stream;
+   uint64_t entry;
    uint64_t track_positions[ASF_TRACKS_MAX];
 
-   VC_CONTAINER_PARAM_UNUSED(mode);
-   LOG_DEBUG(p_ctx, "seek_by_top_level_index");
+   /* Work out the target time and the index entry dealing with it */
+   uint64_t track_time = *p_time + module->preroll + module->time_offset;
+   entry = track_time / module->top_level_index.entry_time_interval;
 
-   for (index = 0; index < ASF_TRACKS_MAX; ++index)
-   {
-      /* Set all to a stupid value */
-      track_positions[index] = UINT64_MAX;
-   }
+   VC_CONTAINER_PARAM_UNUSED(mode);
+   LOG_DEBUG(p_ctx, "seek_by_top_level_index entry %"PRIu64, entry);
 
-   /* Loop through the index blocks to find the one(s) that deal with the time(s) in question.
-      * Note that most ASF files only have one index block. */
-   for (index = 0; index < module->top_level_index.block_count; ++index)
+   for (stream = 0; stream < ASF_TRACKS_MAX; ++stream)
    {
-      uint64_t block_duration, block_position;
-      uint32_t index_entry_count, stream;
-      LOG_DEBUG(p_ctx, "looking for index blocks at offset %"PRIu64, block_address);
-      status = SEEK(p_ctx, block_address);
-      if(status != VC_CONTAINER_SUCCESS) return status;
+      uint64_t position = UINT64_MAX;
 
-      /* Read the number of entries for this index block. */
-      index_entry_count = READ_U32(p_ctx, "Index Entry Count");
+      /* The positions were loaded with the index so no I/O is needed here */
+      if (entry < module->top_level_index.entries_num)
+         position = module->top_level_index.positions[entry * ASF_TRACKS_MAX + stream];
 
-      /* Turn into a duration */
-      block_duration = (uint64_t)index_entry_count * module->top_level_index.entry_time_interval;
-
-      /* Go through each stream */
-      for (stream = 0; stream < p_ctx->tracks_num; ++stream)
-      {
-         /* Work out the track's target time */
-         uint64_t track_time = *p_time + module->preroll + module->time_offset;
-
-         /* Have we the correct index block for the seek time? */
-         if ((time <= track_time) && (track_time < time + block_duration))
-         {
-            /* We have the correct index block for the seek time. Work out where in it. */
-            uint32_t block_index = (track_time - time) / module->top_level_index.entry_time_interval;
-            uint64_t active_specifier = module->top_level_index.active_specifiers[stream];
-            uint64_t new_position;
-
-            /* Read the Block Positions value for the correct specifier */
-            status = SEEK(p_ctx,
-               block_address + INT64_C(4)
-               + active_specifier * INT64_C(8));
-            if (status != VC_CONTAINER_SUCCESS)
-            {
-               return status;
-            }
-            block_position = READ_U32(p_ctx, "Block Position");
-
-            /* Read the target address for the stream */
-            status = SEEK(p_ctx, block_address + 4                                        /* skip index entry count */
-               + (UINT64_C(8) * module->top_level_index.specifiers_count)                 /* block positions */
-               + (UINT64_C(4) * module->top_level_index.specifiers_count * block_index)   /* prior index entries */
-               + (UINT64_C(4) * active_specifier));                                       /* correct specifier */
-            LOG_DEBUG(p_ctx, "reading at %"PRIu64, STREAM_POSITION(p_ctx));
-
-            new_position = module->data_offset + block_position + (uint64_t)READ_U32(p_ctx, "Offset");
-            LOG_DEBUG(p_ctx, "actual address for stream %"PRIu32" = %"PRIu64, stream, new_position);
-            track_positions[stream] = new_position;
-         }
-      }
-
-      /* Work out where the next block is */
-      block_address += (UINT64_C(8) * module->top_level_index.specifiers_count)
-            +  (UINT64_C(4) * module->top_level_index.specifiers_count * index_entry_count);
+      /* Set any track without a position to a stupid value */
+      track_positions[stream] = position == UINT64_MAX ? UINT64_MAX : module->data_offset + position;
+      LOG_DEBUG(p_ctx, "actual address for stream %u = %"PRIu64, stream, track_positions[stream]);
    }
 
    return seek_to_positions(p_ctx, track_positions, p_time, flags, 0, 0);
@@ -2015,7 +2053,7 @@ static VC_CONTAINER_STATUS_T asf_reader_seek( VC_CONTAINER_T *p_ctx, int64_t *p_
 
    /* Prefer the top-level index to the simple index - it has byte offsets not packet offsets,
    * and is likely to have separate tables for every track */
-   if (module->top_level_index.block_count)
+   if (module->top_level_index.entries_num)
    {
       status = seek_by_top_level_index(p_ctx, p_time, mode, flags);
    }
@@ -2107,8 +2145,12 @@ static VC_CONTAINER_STATUS_T asf_reader_close( VC_CONTAINER_T *p_ctx )
    p_ctx->meta_num = 0;
 */
    for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      free(p_ctx->tracks[i]->priv->module->simple_index.packets);
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
+   }
    p_ctx->tracks_num = 0;
+   free(module->top_level_index.positions);
    free(module);
    return VC_CONTAINER_SUCCESS;
 }
@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "containers/core/containers_utils.h"
 #include "containers/core/containers_logging.h"
 #include "containers/core/containers_waveformat.h"
+#include "containers/core/containers_uri.h"
 
 /******************************************************************************
 Defines.
@@ -55,6 +56,9 @@ Defines.
  
 #define AVI_TRACKS_MAX 16 /*< We won't try to handle streams with more tracks than this */
 
+#define AVI_INDEX_ENTRIES_INCREMENT 256 /*< Growth step of the index we build ourselves */
+#define AVI_INDEX_PEEK_SIZE 128 /*< Amount of chunk data we look at to detect keyframes */
+
 #define AVI_TWOCC(a,b) ((a) | (b << 8))
 
 #define AVI_SYNC_CHUNK(ctx)                               \
@@ -111,6 +115,51 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
    AVI_TRACK_CHUNK_STATE_T chunk;
 } VC_CONTAINER_TRACK_MODULE_T;
 
+/** Chunk counters of a track at a given point in the 'movi' data */
+typedef struct AVI_INDEX_COUNTER_T
+{
+   uint64_t index;       /**< Number of chunks of the track before this point */
+   uint64_t offs;        /**< Number of bytes of the track before this point */
+   uint64_t last_position; /**< Offset of the last chunk of the track before this point */
+   uint32_t last_size;   /**< Size of that chunk */
+} AVI_INDEX_COUNTER_T;
+
+/** Entry of the index we build for files without 'idx1' or 'indx'. The
+    counters array is sized for the actual number of tracks. */
+typedef struct AVI_INDEX_ENTRY_T
+{
+   uint64_t position;    /**< Offset of the chunk (or of the 'dd' chunk preceding it) */
+   unsigned track;       /**< Track the chunk belongs to */
+   AVI_INDEX_COUNTER_T counters[1]; /**< Counters of all the tracks before that chunk */
+} AVI_INDEX_ENTRY_T;
+
+/** Index built by scanning the 'movi' data, either by a background thread
+    using its own i/o or on demand when seeking. */
+typedef struct AVI_INDEX_T
+{
+   VC_CONTAINER_IO_T *io;          /**< i/o used by the builder thread */
+   VCOS_THREAD_T thread;
+   VCOS_MUTEX_T lock;              /**< Protects everything below */
+   VCOS_EVENT_T event;             /**< Signalled when the scan progresses */
+   bool background;                /**< The index can be built in the background */
+   bool threaded;                  /**< The index is being built in the background */
+   bool abort;                     /**< Request for the builder thread to stop */
+   bool waiting;                   /**< A seek is waiting for the scan to progress */
+   bool done;                      /**< The whole data has been scanned */
+
+   unsigned tracks_num;
+   int ref_track;                  /**< Track indexed when there is no video track */
+   uint64_t position;              /**< Offset of the next chunk to scan */
+   uint64_t dd_position;           /**< Offset of a pending 'dd' chunk (0 if none) */
+   unsigned dd_track;              /**< Track of the pending 'dd' chunk */
+   AVI_INDEX_COUNTER_T counters[AVI_TRACKS_MAX]; /**< Counters at the scan position */
+
+   uint8_t *entries;
+   size_t entry_size;
+   unsigned int entries_num;
+   unsigned int entries_max;
+} AVI_INDEX_T;
+
 typedef struct VC_CONTAINER_MODULE_T
 { 
    VC_CONTAINER_TRACK_T *tracks[AVI_TRACKS_MAX];
@@ -120,6 +169,7 @@ typedef struct VC_CONTAINER_MODULE_T
    uint64_t index_offset;          /**< Offset to the start of index data e.g. 
                                         the data in a 'idx1' list */
    uint32_t index_size;            /**< Size of the chunk containing index data */
+   AVI_INDEX_T *built_index;       /**< Index built from the data when the file has none */
    AVI_TRACK_STREAM_STATE_T state;
 } VC_CONTAINER_MODULE_T;
 
@@ -192,13 +242,18 @@ static int64_t avi_stream_ticks_to_us(VC_CONTAINER_TRACK_MODULE_T *track_module,
    return time;
 }
 
-static int64_t avi_calculate_chunk_time(VC_CONTAINER_TRACK_MODULE_T *track_module)
+static int64_t avi_calculate_time(VC_CONTAINER_TRACK_MODULE_T *track_module, uint64_t index, uint64_t offs)
 {
    if (track_module->sample_size == 0)
-      return track_module->time_start + avi_stream_ticks_to_us(track_module, track_module->chunk.index);
+      return track_module->time_start + avi_stream_ticks_to_us(track_module, index);
    else
       return track_module->time_start + avi_stream_ticks_to_us(track_module, 
-         ((track_module->chunk.offs + (track_module->sample_size >> 1)) / track_module->sample_size));
+         ((offs + (track_module->sample_size >> 1)) / track_module->sample_size));
+}
+
+static int64_t avi_calculate_chunk_time(VC_CONTAINER_TRACK_MODULE_T *track_module)
+{
+   return avi_calculate_time(track_module, track_module->chunk.index, track_module->chunk.offs);
 }
 
 static VC_CONTAINER_STATUS_T avi_read_stream_header_list(VC_CONTAINER_T *p_ctx, VC_CONTAINER_TRACK_T *track,
@@ -880,6 +935,430 @@ static VC_CONTAINER_STATUS_T avi_scan_super_index_chunk(VC_CONTAINER_T *p_ctx, u
    return status;
 }
 
+/*****************************************************************************
+Index built from the data for files which have neither 'idx1' nor 'indx'
+ *****************************************************************************/
+
+static bool avi_index_is_keyframe(VC_CONTAINER_FOURCC_T codec, const uint8_t *data, uint32_t size)
+{
+   bool has_config = false;
+   uint32_t i;
+
+   if (!size) return false;
+
+   switch (codec)
+   {
+   case VC_CONTAINER_CODEC_MP1V:
+   case VC_CONTAINER_CODEC_MP2V:
+      for (i = 0; i + 5 < size; i++)
+      {
+         if (data[i] || data[i+1] || data[i+2] != 1) continue;
+         if (data[i+3] == 0x00) return ((data[i+5] >> 3) & 0x7) == 1; /* Picture coding type */
+         if (data[i+3] == 0xB3 || data[i+3] == 0xB8) has_config = true;
+      }
+      return has_config;
+   case VC_CONTAINER_CODEC_MP4V:
+      for (i = 0; i + 4 < size; i++)
+      {
+         if (data[i] || data[i+1] || data[i+2] != 1) continue;
+         if (data[i+3] == 0xB6) return (data[i+4] >> 6) == 0; /* vop_coding_type */
+         if (data[i+3] == 0xB0 || data[i+3] == 0xB3 || (data[i+3] & 0xF0) == 0x20) has_config = true;
+      }
+      return has_config;
+   case VC_CONTAINER_CODEC_H264:
+      for (i = 0; i + 3 < size; i++)
+      {
+         if (data[i] || data[i+1] || data[i+2] != 1) continue;
+         if ((data[i+3] & 0x1F) == 5) return true; /* IDR slice */
+         if ((data[i+3] & 0x1F) == 1) return has_config;
+         if ((data[i+3] & 0x1F) == 7) has_config = true; /* SPS */
+      }
+      return has_config;
+   case VC_CONTAINER_CODEC_H263:
+      if (size < 5 || data[0] || data[1] || (data[2] & 0xFC) != 0x80) return false;
+      if (((data[4] >> 2) & 0x7) == 0x7) return true; /* PLUSPTYPE, don't bother */
+      return !((data[4] >> 1) & 0x1); /* Picture coding type */
+   case VC_CONTAINER_CODEC_DIV3:
+   case VC_CONTAINER_CODEC_DIV4:
+      return (data[0] >> 6) == 0;
+   default:
+      /* MJPEG and anything we don't know about is considered intra only */
+      return true;
+   }
+}
+
+static AVI_INDEX_ENTRY_T *avi_index_entry(AVI_INDEX_T *index, unsigned int entry)
+{
+   return (AVI_INDEX_ENTRY_T *)(index->entries + entry * index->entry_size);
+}
+
+static int64_t avi_index_time(VC_CONTAINER_T *p_ctx, unsigned track, const AVI_INDEX_COUNTER_T *counters)
+{
+   return avi_calculate_time(p_ctx->tracks[track]->priv->module,
+      counters[track].index, counters[track].offs);
+}
+
+/* Tells whether an entry is a suitable starting point for the given track */
+static bool avi_index_entry_is_usable(VC_CONTAINER_T *p_ctx, AVI_INDEX_ENTRY_T *entry, unsigned track)
+{
+   return p_ctx->tracks[track]->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO ||
+      entry->track == track;
+}
+
+/* Scans the next chunk of the data and adds it to the index if it is a
+   keyframe. Called either from the builder thread with its own i/o or
+   from the seek with the container's i/o. */
+static VC_CONTAINER_STATUS_T avi_index_scan_chunk(VC_CONTAINER_T *p_ctx, VC_CONTAINER_IO_T *io,
+   AVI_INDEX_T *index)
+{
+   uint8_t data[8 + AVI_INDEX_PEEK_SIZE];
+   VC_CONTAINER_FOURCC_T chunk_id;
+   uint64_t position = index->position, next;
+   uint32_t chunk_size;
+   uint16_t data_type, track_num = 0;
+   bool is_data = false, add_entry = false;
+   size_t size;
+
+   if (vc_container_io_seek(io, position) != VC_CONTAINER_SUCCESS)
+      return VC_CONTAINER_ERROR_EOS;
+   size = vc_container_io_read(io, data, sizeof(data));
+   if (size < 8)
+      return VC_CONTAINER_ERROR_EOS;
+
+   chunk_id = VC_FOURCC(data[0], data[1], data[2], data[3]);
+   chunk_size = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+   next = (position + 8 + chunk_size + 1) & ~UINT64_C(1);
+
+   /* Need to exit if a zero sized chunk encountered so we don't loop forever. */
+   if (chunk_size == 0 && chunk_id == 0)
+      return VC_CONTAINER_ERROR_EOS;
+
+   if (size >= 12 &&
+       ((chunk_id == VC_FOURCC('L','I','S','T') &&
+        (VC_FOURCC(data[8], data[9], data[10], data[11]) == VC_FOURCC('r','e','c',' ') ||
+         VC_FOURCC(data[8], data[9], data[10], data[11]) == VC_FOURCC('m','o','v','i'))) ||
+       (chunk_id == VC_FOURCC('R','I','F','F') &&
+         VC_FOURCC(data[8], data[9], data[10], data[11]) == VC_FOURCC('A','V','I','X'))))
+   {
+      next = position + 12; /* Step into the LIST / RIFF */
+   }
+   else if ((uint32_t)chunk_id >> 16 == AVI_TWOCC('d','c') ||
+            (uint32_t)chunk_id >> 16 == AVI_TWOCC('d','b') ||
+            (uint32_t)chunk_id >> 16 == AVI_TWOCC('d','d') ||
+            (uint32_t)chunk_id >> 16 == AVI_TWOCC('w','b'))
+   {
+      avi_track_from_chunk_id(chunk_id, &data_type, &track_num);
+      is_data = avi_check_track(p_ctx, data_type, track_num) == VC_CONTAINER_SUCCESS &&
+         data_type != AVI_TWOCC('d','d');
+
+      if (is_data && index->ref_track < 0)
+      {
+         VC_CONTAINER_ES_FORMAT_T *format = p_ctx->tracks[track_num]->format;
+         add_entry = format->es_type == VC_CONTAINER_ES_TYPE_VIDEO &&
+            avi_index_is_keyframe(format->codec, data + 8, MIN(chunk_size, size - 8));
+      }
+      else if (is_data)
+         add_entry = track_num == index->ref_track;
+   }
+
+   if (index->threaded) vcos_mutex_lock(&index->lock);
+
+   if (add_entry && index->entries_num == index->entries_max)
+   {
+      unsigned int entries_max = index->entries_max + AVI_INDEX_ENTRIES_INCREMENT;
+      uint8_t *entries = realloc(index->entries, entries_max * index->entry_size);
+      if (!entries)
+      {
+         if (index->threaded) vcos_mutex_unlock(&index->lock);
+         return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      }
+      index->entries = entries;
+      index->entries_max = entries_max;
+   }
+
+   if (add_entry)
+   {
+      AVI_INDEX_ENTRY_T *entry = avi_index_entry(index, index->entries_num++);
+      entry->position = position;
+      if (index->dd_position && index->dd_track == track_num)
+         entry->position = index->dd_position;
+      entry->track = track_num;
+      memcpy(entry->counters, index->counters, index->tracks_num * sizeof(*entry->counters));
+   }
+
+   if (is_data)
+   {
+      index->counters[track_num].index++;
+      index->counters[track_num].offs += chunk_size;
+      index->counters[track_num].last_position = position;
+      if (index->dd_position && index->dd_track == track_num)
+         index->counters[track_num].last_position = index->dd_position;
+      index->counters[track_num].last_size = chunk_size;
+   }
+
+   /* Remember 'dd' chunks as they need to be read along with the chunk that follows */
+   index->dd_position = 0;
+   if ((uint32_t)chunk_id >> 16 == AVI_TWOCC('d','d'))
+   {
+      index->dd_position = position;
+      index->dd_track = track_num;
+   }
+
+   index->position = next;
+   if (index->waiting) vcos_event_signal(&index->event);
+
+   if (index->threaded) vcos_mutex_unlock(&index->lock);
+   return VC_CONTAINER_SUCCESS;
+}
+
+static void *avi_index_thread(void *argv)
+{
+   VC_CONTAINER_T *p_ctx = argv;
+   AVI_INDEX_T *index = p_ctx->priv->module->built_index;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   bool abort = false;
+
+   while (!abort && status == VC_CONTAINER_SUCCESS)
+   {
+      status = avi_index_scan_chunk(p_ctx, index->io, index);
+
+      vcos_mutex_lock(&index->lock);
+      abort = index->abort;
+      vcos_mutex_unlock(&index->lock);
+   }
+
+   vcos_mutex_lock(&index->lock);
+   LOG_DEBUG(p_ctx, "index built with %u entries (%i)", index->entries_num, status);
+   index->done = true;
+   vcos_event_signal(&index->event);
+   vcos_mutex_unlock(&index->lock);
+   return NULL;
+}
+
+/* Tells whether the index is complete enough to seek to the given time */
+static bool avi_index_covers(VC_CONTAINER_T *p_ctx, AVI_INDEX_T *index, unsigned track,
+   int64_t time, VC_CONTAINER_SEEK_FLAGS_T flags)
+{
+   unsigned int i;
+
+   if (index->done) return true;
+   if (avi_index_time(p_ctx, track, index->counters) <= time) return false;
+   if (!(flags & VC_CONTAINER_SEEK_FLAG_FORWARD)) return true;
+
+   /* When seeking forward we also need a usable entry past the seek time */
+   for (i = index->entries_num; i > 0; i--)
+   {
+      AVI_INDEX_ENTRY_T *entry = avi_index_entry(index, i - 1);
+      if (!avi_index_entry_is_usable(p_ctx, entry, track)) continue;
+      return avi_index_time(p_ctx, track, entry->counters) > time;
+   }
+   return false;
+}
+
+/* Looks up the entry to seek to. The index lock needs to be held. */
+static AVI_INDEX_ENTRY_T *avi_index_find(VC_CONTAINER_T *p_ctx, AVI_INDEX_T *index, unsigned track,
+   int64_t time, VC_CONTAINER_SEEK_FLAGS_T flags)
+{
+   AVI_INDEX_ENTRY_T *entry;
+   unsigned int start = 0, end = index->entries_num, mid;
+
+   /* Find the first entry past the seek time */
+   while (start < end)
+   {
+      mid = start + (end - start) / 2;
+      entry = avi_index_entry(index, mid);
+      if (avi_index_time(p_ctx, track, entry->counters) > time) end = mid;
+      else start = mid + 1;
+   }
+
+   if (flags & VC_CONTAINER_SEEK_FLAG_FORWARD)
+   {
+      for (mid = start; mid < index->entries_num; mid++)
+      {
+         entry = avi_index_entry(index, mid);
+         if (avi_index_entry_is_usable(p_ctx, entry, track)) return entry;
+      }
+   }
+
+   /* Like with the legacy index, fall back to the last keyframe before the seek time */
+   for (; start > 0; start--)
+   {
+      entry = avi_index_entry(index, start - 1);
+      if (avi_index_entry_is_usable(p_ctx, entry, track)) return entry;
+   }
+   return NULL;
+}
+
+/* Starts scanning the data in the background with a separate i/o. This is only
+   done once we first need the index so playback without seeking never pays for it. */
+static void avi_index_start_thread(VC_CONTAINER_T *p_ctx)
+{
+   VC_CONTAINER_IO_T *io = p_ctx->priv->io;
+   AVI_INDEX_T *index = p_ctx->priv->module->built_index;
+   VC_CONTAINER_STATUS_T status;
+
+   index->background = false;
+   index->io = vc_container_io_open(io->uri, VC_CONTAINER_IO_MODE_READ, &status);
+   if (!index->io)
+      return;
+
+   if (vcos_mutex_create(&index->lock, "avi_index_lock") != VCOS_SUCCESS)
+      goto error_lock;
+   if (vcos_event_create(&index->event, "avi_index_event") != VCOS_SUCCESS)
+      goto error_event;
+   index->threaded = true;
+   if (vcos_thread_create(&index->thread, "avi_index", NULL, avi_index_thread, p_ctx) != VCOS_SUCCESS)
+      goto error_thread;
+
+   return;
+
+ error_thread:
+   index->threaded = false;
+   vcos_event_delete(&index->event);
+ error_event:
+   vcos_mutex_delete(&index->lock);
+ error_lock:
+   vc_container_io_close(index->io);
+   index->io = NULL;
+}
+
+static VC_CONTAINER_STATUS_T avi_index_seek(VC_CONTAINER_T *p_ctx, unsigned seek_track_num,
+   int64_t *time, VC_CONTAINER_SEEK_FLAGS_T flags, uint64_t *pos)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   AVI_INDEX_T *index = module->built_index;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   AVI_INDEX_ENTRY_T *entry;
+   unsigned int i;
+
+   if (index->background && !index->done)
+      avi_index_start_thread(p_ctx);
+
+   if (index->threaded)
+   {
+      vcos_mutex_lock(&index->lock);
+      while (!avi_index_covers(p_ctx, index, seek_track_num, *time, flags))
+      {
+         index->waiting = true;
+         vcos_mutex_unlock(&index->lock);
+         vcos_event_wait(&index->event);
+         vcos_mutex_lock(&index->lock);
+      }
+      index->waiting = false;
+   }
+   else
+   {
+      while (status == VC_CONTAINER_SUCCESS &&
+             !avi_index_covers(p_ctx, index, seek_track_num, *time, flags))
+         status = avi_index_scan_chunk(p_ctx, p_ctx->priv->io, index);
+      if (status != VC_CONTAINER_SUCCESS)
+         index->done = true;
+   }
+
+   entry = avi_index_find(p_ctx, index, seek_track_num, *time, flags);
+   if (entry)
+   {
+      for (i = 0; i < p_ctx->tracks_num; i++)
+      {
+         VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+         track_module->chunk.index = entry->counters[i].index;
+         track_module->chunk.offs = entry->counters[i].offs;
+         track_module->chunk.time_pos = avi_calculate_chunk_time(track_module);
+         track_module->chunk.local_state.data_offset = entry->position;
+         track_module->chunk.local_state.current_track_num = i;
+      }
+      *pos = entry->position;
+   }
+   else
+   {
+      /* Nothing before the seek time, start from the beginning of the data */
+      *pos = module->data_offset + 4;
+   }
+
+   if (index->threaded) vcos_mutex_unlock(&index->lock);
+
+   *time = p_ctx->tracks[seek_track_num]->priv->module->chunk.time_pos;
+
+   for (i = 0; i < p_ctx->tracks_num && entry; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      AVI_INDEX_COUNTER_T *counter = &entry->counters[i];
+
+      if (i == seek_track_num || p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+         continue;
+
+      /* Every chunk of a non-video track is a keyframe so start from the one
+         which covers the seek time if it comes before the entry */
+      if (counter->index && avi_calculate_time(track_module, counter->index - 1,
+            counter->offs - counter->last_size) <= *time)
+      {
+         track_module->chunk.index = counter->index - 1;
+         track_module->chunk.offs = counter->offs - counter->last_size;
+         track_module->chunk.time_pos = avi_calculate_chunk_time(track_module);
+         track_module->chunk.local_state.data_offset = counter->last_position;
+      }
+      track_module->chunk.flags = VC_CONTAINER_PACKET_FLAG_KEYFRAME;
+   }
+
+   p_ctx->tracks[seek_track_num]->priv->module->chunk.flags = VC_CONTAINER_PACKET_FLAG_KEYFRAME;
+   return VC_CONTAINER_SUCCESS;
+}
+
+static void avi_index_stop(VC_CONTAINER_T *p_ctx)
+{
+   AVI_INDEX_T *index = p_ctx->priv->module->built_index;
+
+   if (!index) return;
+
+   if (index->threaded)
+   {
+      vcos_mutex_lock(&index->lock);
+      index->abort = true;
+      vcos_mutex_unlock(&index->lock);
+      vcos_thread_join(&index->thread, NULL);
+      vcos_event_delete(&index->event);
+      vcos_mutex_delete(&index->lock);
+      vc_container_io_close(index->io);
+   }
+
+   free(index->entries);
+   free(index);
+   p_ctx->priv->module->built_index = NULL;
+}
+
+/* Sets up the building of an index for a file which doesn't have one. Local
+   files get scanned in the background with a separate i/o from the first seek
+   onwards, otherwise the scanning happens on demand when seeking. */
+static VC_CONTAINER_STATUS_T avi_index_start(VC_CONTAINER_T *p_ctx)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_IO_T *io = p_ctx->priv->io;
+   AVI_INDEX_T *index;
+   const char *scheme;
+   unsigned int i;
+
+   if (!p_ctx->tracks_num) return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   index = malloc(sizeof(*index));
+   if (!index) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(index, 0, sizeof(*index));
+   index->tracks_num = p_ctx->tracks_num;
+   index->entry_size = sizeof(AVI_INDEX_ENTRY_T) +
+      (p_ctx->tracks_num - 1) * sizeof(AVI_INDEX_COUNTER_T);
+   index->position = module->data_offset + 4;
+
+   /* Keyframes of video tracks are indexed, otherwise every chunk of the first track */
+   index->ref_track = 0;
+   for (i = 0; i < p_ctx->tracks_num; i++)
+      if (p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+         index->ref_track = -1;
+   module->built_index = index;
+
+   scheme = io->uri_parts ? vc_uri_scheme(io->uri_parts) : "";
+   index->background = io->uri && (!scheme || !strcasecmp(scheme, "file"));
+   return VC_CONTAINER_SUCCESS;
+}
+
 static VC_CONTAINER_STATUS_T avi_read_dd_chunk( VC_CONTAINER_T *p_ctx,
    AVI_TRACK_STREAM_STATE_T *p_state, uint16_t data_type, uint32_t chunk_size,
    uint16_t track_num )
@@ -1111,9 +1590,13 @@ static VC_CONTAINER_STATUS_T avi_reader_read( VC_CONTAINER_T *p_ctx,
          p_state->extra_chunk_data_offs += len;
       }
 
-      /* Now try to read data into buffer */
+      /* Now try to read data into buffer (no copy is only possible when
+         there is no extra data in front of it) */
       len = MIN(buffer_size, p_state->chunk_data_left);
-      READ_BYTES(p_ctx, data, len);
+      if (!size)
+         READ_PACKET_BYTES(p_ctx, p_packet, len, flags);
+      else
+         READ_BYTES(p_ctx, data, len);
       size += len;
       p_state->chunk_data_left -= len;
       p_packet->size = size;
@@ -1247,15 +1730,22 @@ static VC_CONTAINER_STATUS_T avi_reader_seek( VC_CONTAINER_T *p_ctx, int64_t *p_
       if (!module->index_offset)
       {
          /* If there is no index and we are seeking to 0 we can assume the
-            correct location is the start of the data. Otherwise we are unable
-            to seek to a specified non-zero location without an index */
-         if (*p_offset != INT64_C(0))
+            correct location is the start of the data. Otherwise we need to
+            use the index we are building from the data itself */
+         if (*p_offset != INT64_C(0) && module->built_index)
+         {
+            LOG_DEBUG(p_ctx, "seeking using the index built from the data");
+            status = avi_index_seek(p_ctx, seek_track_num, p_offset, flags, &pos);
+            if (status != VC_CONTAINER_SUCCESS) goto error;
+         }
+         else if (*p_offset != INT64_C(0))
          {
             LOG_DEBUG(p_ctx, "failed to find the legacy index, unable to seek");
             status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
             goto error;
          }
-         pos = module->data_offset;
+         else
+            pos = module->data_offset + 4;
       }
       else
       {
@@ -1318,6 +1808,7 @@ static VC_CONTAINER_STATUS_T avi_reader_close( VC_CONTAINER_T *p_ctx )
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;   
    unsigned int i;
 
+   avi_index_stop(p_ctx);
    for(i = 0; i < p_ctx->tracks_num; i++)
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
    p_ctx->tracks = NULL;
@@ -1475,6 +1966,12 @@ VC_CONTAINER_STATUS_T avi_reader_open( VC_CONTAINER_T *p_ctx )
             p_ctx->capabilities |= VC_CONTAINER_CAPS_HAS_INDEX;
             p_ctx->capabilities |= VC_CONTAINER_CAPS_DATA_HAS_KEYFRAME_FLAG;
          }
+         else
+         {
+            /* No index at all, we'll have to build one from the data */
+            LOG_DEBUG(p_ctx, "no index found, indexing the data");
+            avi_index_start(p_ctx);
+         }
    
          /* Seek back to the start of the data */
          SEEK(p_ctx, module->data_offset);
@@ -1503,6 +2000,7 @@ VC_CONTAINER_STATUS_T avi_reader_open( VC_CONTAINER_T *p_ctx )
 
 error:
    LOG_DEBUG(p_ctx, "error opening stream (%i)", status);
+   if (module) avi_index_stop(p_ctx);
    for(i = 0; i < p_ctx->tracks_num; i++)
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
    p_ctx->tracks = NULL;
@@ -66,6 +66,15 @@ Defines.
 #define AVI_AUDIO_CHUNK_SIZE_LIMIT 16384 /*< Watermark limit for data chunks when 'dwSampleSize'
                                              is non-zero */
 
+#define AVI_SUPER_INDEX_MAX_ENTRIES 256  /*< Number of entries reserved in the super index ('indx'),
+                                             i.e. maximum number of RIFF chunks in a file */
+#ifndef AVI_RIFF_MAX_SIZE
+#define AVI_RIFF_MAX_SIZE (INT64_C(1) << 30) /*< Size above which we start a new 'AVIX' RIFF chunk.
+                                                 Keeping the first one under 1GB keeps the file
+                                                 playable by readers without OpenDML support */
+#endif
+#define AVI_DMLH_SIZE 248
+
 #define AVI_END_CHUNK(ctx)                                            \
    do {                                                               \
       if(STREAM_POSITION(ctx) & 1) WRITE_U8(ctx, 0, "AVI_END_CHUNK"); \
@@ -84,9 +93,14 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
                                    chunks for this track  */
    uint32_t sample_size;      /**< i.e. 'dwSampleSize' in 'strh' */
    uint32_t max_chunk_size;   /**< largest chunk written so far */
-   uint64_t index_offset;     /**< Offset to the start of an OpenDML index for this track 
-                                   i.e. 'indx' */
-   uint32_t index_size;       /**< Size of the OpenDML index for this track i.e. 'indx' */
+   uint32_t riff_chunk_index; /**< chunk_index at the start of the current RIFF chunk */
+   uint32_t riff_chunk_offs;  /**< chunk_offs at the start of the current RIFF chunk */
+   unsigned int num_indices;  /**< Number of standard indices ('ix##') written so far */
+   struct {
+      uint64_t offset;        /**< Offset to the start of the standard index */
+      uint32_t size;          /**< Size of the standard index chunk */
+      uint32_t duration;      /**< Duration of the data covered by the standard index */
+   } indices[AVI_SUPER_INDEX_MAX_ENTRIES]; /**< Entries of the OpenDML super index ('indx') */
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -98,8 +112,14 @@ typedef struct VC_CONTAINER_MODULE_T
 
    uint32_t header_list_offset;           /**< Offset to the header list chunk ('hdrl') */
    uint32_t header_list_size;             /**< Size of the header list chunk ('hdrl') */
-   uint32_t data_offset;                  /**< Offset to the start of data packets i.e. 
-                                               the data in the AVI RIFF 'movi' list */
+   int64_t riff_offset;                   /**< Offset to the current RIFF chunk ('AVI ' or 'AVIX') */
+   unsigned int riff_count;               /**< Number of RIFF chunks completed so far */
+   int64_t riff_index_start;              /**< Offset in the temporary I/O of the first index 
+                                               entry of the current RIFF chunk */
+   uint32_t legacy_index_entries;         /**< Number of entries in the legacy index i.e. 
+                                               number of chunks in the first RIFF chunk */
+   int64_t data_offset;                   /**< Offset to the start of data packets i.e. 
+                                               the data in the current 'movi' list */
    uint64_t data_size;                    /**< Size of the chunk containing data packets */
    uint32_t index_offset;                 /**< Offset to the start of index data e.g. 
                                                the data in an 'idx1' list */                                          
@@ -350,17 +370,19 @@ static VC_CONTAINER_STATUS_T avi_write_super_index_chunk(VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[index_track_num]->priv->module;
    VC_CONTAINER_FOURCC_T chunk_id; 
-   uint32_t num_indices = 1; /* FIXME: support for multiple RIFF chunks (AVIX) */
+   uint32_t num_indices = track_module->num_indices;
    unsigned int i;
 
+   /* We always reserve space for the maximum number of entries so the
+      header list keeps the same size when we rewrite it */
    if(module->null_io.refcount)
    {
       /* Assume that we're not actually writing the data, just want know the index chunk size */
-      WRITE_BYTES(p_ctx, NULL, 8 + 24 + num_indices * (int64_t)AVI_SUPER_INDEX_ENTRY_SIZE);
+      WRITE_BYTES(p_ctx, NULL, 8 + 24 + AVI_SUPER_INDEX_MAX_ENTRIES * (int64_t)AVI_SUPER_INDEX_ENTRY_SIZE);
       return STREAM_STATUS(p_ctx);
    }
   
-   if (track_module->index_offset)
+   if (num_indices)
       WRITE_FOURCC(p_ctx, VC_FOURCC('i','n','d','x'), "Chunk ID");
    else
       WRITE_FOURCC(p_ctx, VC_FOURCC('J','U','N','K'), "Chunk ID");
@@ -377,15 +399,12 @@ static VC_CONTAINER_STATUS_T avi_write_super_index_chunk(VC_CONTAINER_T *p_ctx,
    WRITE_U32(p_ctx, 0, "dwReserved1");
    WRITE_U32(p_ctx, 0, "dwReserved2");
    
-   for (i = 0; i < num_indices; ++i)
+   for (i = 0; i < AVI_SUPER_INDEX_MAX_ENTRIES; ++i)
    {  
-      uint64_t index_offset = track_module->index_offset;
-      uint32_t chunk_size = track_module->index_size;  
-      uint32_t length = track_module->sample_size ? 
-         track_module->chunk_offs : track_module->chunk_index;
-      WRITE_U64(p_ctx, index_offset, "qwOffset");
-      WRITE_U32(p_ctx, chunk_size, "dwSize");
-      WRITE_U32(p_ctx, length, "dwDuration");
+      int in_use = i < num_indices;
+      WRITE_U64(p_ctx, in_use ? track_module->indices[i].offset : 0, "qwOffset");
+      WRITE_U32(p_ctx, in_use ? track_module->indices[i].size : 0, "dwSize");
+      WRITE_U32(p_ctx, in_use ? track_module->indices[i].duration : 0, "dwDuration");
    }
 
    AVI_END_CHUNK(p_ctx);
@@ -470,7 +489,9 @@ static VC_CONTAINER_STATUS_T avi_write_avi_header_chunk(VC_CONTAINER_T *p_ctx)
          if (track->format->type->video.frame_rate_num)
             frame_interval = track->format->type->video.frame_rate_den * UINT64_C(1000000) / 
                               track->format->type->video.frame_rate_num;
-         num_chunks = track_module->chunk_index;
+         /* With OpenDML files this only covers the first RIFF chunk */
+         num_chunks = track_module->num_indices > 1 ?
+            track_module->indices[0].duration : track_module->chunk_index;
          max_video_chunk_size = track_module->max_chunk_size;
          break;
       }
@@ -499,6 +520,33 @@ static VC_CONTAINER_STATUS_T avi_write_avi_header_chunk(VC_CONTAINER_T *p_ctx)
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T avi_write_odml_header_list(VC_CONTAINER_T *p_ctx)
+{
+   uint32_t total_frames = 0;
+   unsigned int i;
+
+   for (i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if (p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+      {
+         total_frames = p_ctx->tracks[i]->priv->module->chunk_index;
+         break;
+      }
+   }
+
+   WRITE_FOURCC(p_ctx, VC_FOURCC('L','I','S','T'), "Chunk ID");
+   WRITE_U32(p_ctx, 4 + 8 + AVI_DMLH_SIZE, "LIST Size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('o','d','m','l'), "Chunk ID");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('d','m','l','h'), "Chunk ID");
+   WRITE_U32(p_ctx, AVI_DMLH_SIZE, "Chunk Size");
+   WRITE_U32(p_ctx, total_frames, "dwTotalFrames");
+   for (i = 4; i < AVI_DMLH_SIZE; i += 4)
+      WRITE_U32(p_ctx, 0, "dwFuture");
+
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T avi_write_header_list( VC_CONTAINER_T *p_ctx, uint32_t header_list_size )
 {
@@ -532,7 +580,8 @@ static VC_CONTAINER_STATUS_T avi_write_header_list( VC_CONTAINER_T *p_ctx, uint3
       if (status != VC_CONTAINER_SUCCESS) return status;
    }
 
-   return status;
+   /* Write the OpenDML extended header list ('odml') */
+   return avi_write_odml_header_list(p_ctx);
 }
 
 /*****************************************************************************/
@@ -569,14 +618,16 @@ static VC_CONTAINER_STATUS_T avi_write_legacy_index_chunk( VC_CONTAINER_T *p_ctx
    VC_CONTAINER_STATUS_T status;
    uint32_t chunk_offset = 4;
    unsigned int track_num;
+   /* The legacy index only covers the first RIFF chunk */
+   uint32_t num_chunks = module->riff_count ? module->legacy_index_entries : avi_num_chunks(p_ctx);
 
-   vc_container_assert(8 + avi_num_chunks(p_ctx) * INT64_C(16) <= (int64_t)ULONG_MAX);
+   vc_container_assert(8 + num_chunks * INT64_C(16) <= (int64_t)UINT32_MAX);
 
    if(module->null_io.refcount)
    {
       /* Assume that we're not actually writing the data, 
          just want know the index size */
-      WRITE_BYTES(p_ctx, NULL, 8 + avi_num_chunks(p_ctx) * (int64_t)AVI_INDEX_ENTRY_SIZE);
+      WRITE_BYTES(p_ctx, NULL, 8 + num_chunks * (int64_t)AVI_INDEX_ENTRY_SIZE);
       return STREAM_STATUS(p_ctx);
    }
       
@@ -588,7 +639,7 @@ static VC_CONTAINER_STATUS_T avi_write_legacy_index_chunk( VC_CONTAINER_T *p_ctx
    /* Scan through all written entries, convert to appropriate index format */
    vc_container_io_seek(module->temp_io.io, INT64_C(0));
    
-   while((status = STREAM_STATUS(p_ctx)) == VC_CONTAINER_SUCCESS)
+   while((status = STREAM_STATUS(p_ctx)) == VC_CONTAINER_SUCCESS && num_chunks--)
    {      
       VC_CONTAINER_FOURCC_T chunk_id;
       uint32_t chunk_size, flags;
@@ -625,10 +676,10 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
    VC_CONTAINER_STATUS_T status;
    VC_CONTAINER_FOURCC_T chunk_id; 
    int64_t base_offset = module->data_offset + 12;
-   uint32_t num_chunks = track_module->chunk_index;
-   uint32_t chunk_offset = 4;
+   uint32_t num_chunks = track_module->chunk_index - track_module->riff_chunk_index;
+   uint32_t chunk_offset = 8; /* Offsets point to the chunk data, relative to the first chunk */
 
-   vc_container_assert(32 + num_chunks * (int64_t)AVI_STD_INDEX_ENTRY_SIZE <= (int64_t)ULONG_MAX);
+   vc_container_assert(32 + num_chunks * (int64_t)AVI_STD_INDEX_ENTRY_SIZE <= (int64_t)UINT32_MAX);
 
    if(module->null_io.refcount)
    {
@@ -637,8 +688,14 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
       return STREAM_STATUS(p_ctx);
    }
 
-   track_module->index_offset = STREAM_POSITION(p_ctx);
-   track_module->index_size = index_size ? (index_size - 8) : 0;
+   /* Keep track of this index so it can be referenced from the super index */
+   if (track_module->num_indices >= AVI_SUPER_INDEX_MAX_ENTRIES)
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   track_module->indices[track_module->num_indices].offset = STREAM_POSITION(p_ctx);
+   track_module->indices[track_module->num_indices].size = index_size + 8;
+   track_module->indices[track_module->num_indices].duration = track_module->sample_size ?
+      track_module->chunk_offs - track_module->riff_chunk_offs : num_chunks;
+   track_module->num_indices++;
 
    avi_index_chunk_id_from_track_num(&chunk_id, index_track_num);
    WRITE_FOURCC(p_ctx, chunk_id, "Chunk ID");
@@ -653,8 +710,8 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
    WRITE_U64(p_ctx, base_offset, "qwBaseOffset");
    WRITE_U32(p_ctx, 0, "dwReserved");
 
-   /* Scan through all written entries, convert to appropriate index format */
-   vc_container_io_seek(module->temp_io.io, INT64_C(0));
+   /* Scan through all entries written in this RIFF chunk, convert to appropriate index format */
+   vc_container_io_seek(module->temp_io.io, module->riff_index_start);
    
    while(STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS)
    {      
@@ -664,12 +721,14 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_chunk( VC_CONTAINER_T *p_c
       status = avi_read_index_entry(p_ctx, &track_num, &chunk_size);
       if (status != VC_CONTAINER_SUCCESS) break;
          
-      if(track_num != index_track_num) continue;
-   
-      WRITE_U32(p_ctx, chunk_offset, "dwOffset");
-      WRITE_U32(p_ctx, chunk_size, "dwSize");
+      if(track_num == index_track_num)
+      {
+         WRITE_U32(p_ctx, chunk_offset, "dwOffset");
+         WRITE_U32(p_ctx, chunk_size, "dwSize");
+      }
 
-      chunk_offset += ((chunk_size + 1) & ~(1 | AVI_INDEX_DELTAFRAME)) + 12;
+      /* Chunks from other tracks are interleaved with ours */
+      chunk_offset += ((chunk_size + 1) & ~(1 | AVI_INDEX_DELTAFRAME)) + 8;
    }
    
    AVI_END_CHUNK(p_ctx);
@@ -723,6 +782,90 @@ static VC_CONTAINER_STATUS_T avi_write_standard_index_data( VC_CONTAINER_T *p_ct
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T avi_finish_riff( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   int64_t end;
+
+   /* Write standard index data before finalising the size of the 'movi' list */
+   status = avi_write_standard_index_data(p_ctx);
+   if (status != VC_CONTAINER_SUCCESS)
+   {
+      module->index_status = status;
+      LOG_DEBUG(p_ctx, "warning, writing standard index data failed, file will be malformed");
+   }
+
+   module->data_size = STREAM_POSITION(p_ctx) - module->data_offset - 8;
+
+   /* Only the first RIFF chunk gets a legacy index */
+   if (!module->riff_count)
+   {
+      module->legacy_index_entries = avi_num_chunks(p_ctx);
+      status = avi_write_legacy_index_data(p_ctx);
+      if (status != VC_CONTAINER_SUCCESS)
+      {
+         module->index_status = status;
+         LOG_DEBUG(p_ctx, "warning, writing legacy index data failed, file will be malformed");
+      }
+   }
+
+   /* Rewrite the RIFF chunk size */
+   end = STREAM_POSITION(p_ctx);
+   SEEK(p_ctx, module->riff_offset + 4);
+   WRITE_U32(p_ctx, end - module->riff_offset - 8, "fileSize");
+   if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_DEBUG(p_ctx, "warning, rewriting 'fileSize' failed, file will be malformed");
+   }
+
+   /* Rewrite the 'movi' list size */
+   if (module->data_offset)
+   {
+      SEEK(p_ctx, module->data_offset + 4);
+      WRITE_U32(p_ctx, module->data_size, "Chunk Size");
+      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
+      {
+         LOG_DEBUG(p_ctx, "warning, rewriting 'movi' list size failed, file will be malformed");
+      }
+   }
+
+   SEEK(p_ctx, end);
+   module->riff_count++;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T avi_start_riff( VC_CONTAINER_T *p_ctx, int64_t index_start )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   unsigned int i;
+
+   /* Index entries for this RIFF chunk will be appended to the temporary I/O */
+   module->riff_index_start = index_start;
+   vc_container_io_seek(module->temp_io.io, module->riff_index_start);
+   for (i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      track_module->riff_chunk_index = track_module->chunk_index;
+      track_module->riff_chunk_offs = track_module->chunk_offs;
+   }
+
+   /* Write an OpenDML 'AVIX' RIFF chunk and start its 'movi' list */
+   module->riff_offset = STREAM_POSITION(p_ctx);
+   WRITE_FOURCC(p_ctx, VC_FOURCC('R','I','F','F'), "RIFF ID");
+   WRITE_U32(p_ctx, 0, "fileSize");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('A','V','I','X'), "fileType");
+
+   module->data_offset = STREAM_POSITION(p_ctx);
+   WRITE_FOURCC(p_ctx, VC_FOURCC('L','I','S','T'), "Chunk ID");
+   WRITE_U32(p_ctx, 0, "LIST Size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','o','v','i'), "Chunk ID");
+
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************/
 static int64_t avi_calculate_file_size( VC_CONTAINER_T *p_ctx, 
    VC_CONTAINER_PACKET_T *p_packet )
@@ -811,13 +954,27 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
    }
 
    /* Check we are not about to go over the limit of total number of chunks */
-   if (avi_num_chunks(p_ctx) == (uint32_t)ULONG_MAX) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   if (avi_num_chunks(p_ctx) == UINT32_MAX) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
 
-    if(STREAM_SEEKABLE(p_ctx))
-    {
-       /* Check we are not about to go over the maximum file size */
-       if (avi_calculate_file_size(p_ctx, p_packet) >= (int64_t)ULONG_MAX) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
-    }
+   if(STREAM_SEEKABLE(p_ctx))
+   {
+      /* Check we are not about to go over the maximum size of a RIFF chunk */
+      int64_t riff_size = avi_calculate_file_size(p_ctx, p_packet) - module->riff_offset;
+
+      /* If we are, and we're at a chunk boundary, carry on into a new 'AVIX' RIFF chunk */
+      if (riff_size >= AVI_RIFF_MAX_SIZE && !module->chunk_data_written &&
+          module->temp_io.io->offset != module->riff_index_start)
+      {
+         int64_t index_end = module->temp_io.io->offset;
+         if (module->riff_count + 1 >= AVI_SUPER_INDEX_MAX_ENTRIES)
+            return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+         if ((status = avi_finish_riff(p_ctx)) != VC_CONTAINER_SUCCESS) return status;
+         if ((status = avi_start_riff(p_ctx, index_end)) != VC_CONTAINER_SUCCESS) return status;
+         riff_size = avi_calculate_file_size(p_ctx, p_packet) - module->riff_offset;
+      }
+
+      if (riff_size >= (int64_t)UINT32_MAX) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   }
 
    /* FIXME: are we expected to handle this case or should it be picked up by the above layer? */
    vc_container_assert(!(module->chunk_data_written && (p_packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)));
@@ -850,8 +1007,9 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
       {
          /* If the output stream can seek we can fix up the frame size later, and if the
           * packet holds the whole frame we won't need to, so write data straight out. */
+         VC_CONTAINER_IO_VEC_T payload = { p_packet->data, p_packet->size };
          WRITE_U32(p_ctx, chunk_size, "Chunk Size");
-         WRITE_BYTES(p_ctx, p_packet->data, p_packet->size);
+         WRITEV_BYTES(p_ctx, &payload, 1);
       }
       else
       {
@@ -881,7 +1039,8 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
       }
       else
       {
-         WRITE_BYTES(p_ctx, p_packet->data, p_packet->size);
+         VC_CONTAINER_IO_VEC_T payload = { p_packet->data, p_packet->size };
+         WRITEV_BYTES(p_ctx, &payload, 1);
       }
       module->chunk_data_written += p_packet->size;
    }
@@ -896,8 +1055,9 @@ static VC_CONTAINER_STATUS_T avi_writer_write( VC_CONTAINER_T *p_ctx,
    {
       if(module->frame_packet.size > 0)
       {
+         VC_CONTAINER_IO_VEC_T payload = { module->frame_packet.data, module->frame_packet.size };
          WRITE_U32(p_ctx, module->frame_packet.size, "Chunk Size");
-         WRITE_BYTES(p_ctx, module->frame_packet.data, module->frame_packet.size);
+         WRITEV_BYTES(p_ctx, &payload, 1);
          p_packet->size = module->frame_packet.size;
          module->frame_packet.size = 0;
       }
@@ -961,39 +1121,12 @@ static VC_CONTAINER_STATUS_T avi_writer_close( VC_CONTAINER_T *p_ctx )
 
    if(STREAM_SEEKABLE(p_ctx))
    {
-      uint32_t filesize;
-
-      /* Write standard index data before finalising the size of the 'movi' list */
-      status = avi_write_standard_index_data(p_ctx);
-      if (status != VC_CONTAINER_SUCCESS)
-      {
-         module->index_status = status;
-         LOG_DEBUG(p_ctx, "warning, writing standard index data failed, file will be malformed");
-      }
-
-      /* FIXME: support for multiple RIFF chunks (AVIX) */
-      module->data_size = STREAM_POSITION(p_ctx) - module->data_offset - 8;
-
-      /* Now write the legacy index */
-      status = avi_write_legacy_index_data(p_ctx);
-      if (status != VC_CONTAINER_SUCCESS)
-      {
-         module->index_status = status;
-         LOG_DEBUG(p_ctx, "warning, writing legacy index data failed, file will be malformed");
-      }
+      /* Write the indices and finalise the sizes of the last RIFF chunk */
+      status = avi_finish_riff(p_ctx);
 
       /* If we can, do the necessary fixups for values not know at the
        time of writing chunk headers */
 
-      /* Rewrite the AVI RIFF chunk size */
-      filesize = (uint32_t)STREAM_POSITION(p_ctx);
-      SEEK(p_ctx, 4);
-      WRITE_U32(p_ctx, filesize, "fileSize");
-      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
-      {
-         LOG_DEBUG(p_ctx, "warning, rewriting 'fileSize' failed, file will be malformed");
-      }   
-
       /* Rewrite the header list chunk ('hdrl') */
       SEEK(p_ctx, module->header_list_offset);
       status = avi_write_header_list(p_ctx, module->header_list_size);
@@ -1001,14 +1134,6 @@ static VC_CONTAINER_STATUS_T avi_writer_close( VC_CONTAINER_T *p_ctx )
       {
          LOG_DEBUG(p_ctx, "warning, rewriting 'hdrl' failed, file will be malformed");
       }
-
-      /* Rewrite the AVI RIFF 'movi' list size */
-      SEEK(p_ctx, module->data_offset + 4);
-      WRITE_U32(p_ctx, module->data_size, "Chunk Size");
-      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
-      {
-         LOG_DEBUG(p_ctx, "warning, rewriting 'movi' list size failed, file will be malformed");
-      }
    }
 
    vc_container_writer_extraio_delete(p_ctx, &module->null_io);
@@ -156,7 +156,7 @@ static VC_CONTAINER_STATUS_T binary_reader_read( VC_CONTAINER_T *p_ctx,
       return VC_CONTAINER_SUCCESS;
 
    size = MIN(module->block_size, packet->buffer_size);
-   size = READ_BYTES(p_ctx, packet->data, size);
+   size = READ_PACKET_BYTES(p_ctx, packet, size, flags);
    module->block_size -= size;
    packet->size = size;
 
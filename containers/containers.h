@@ -302,6 +302,9 @@ typedef struct VC_CONTAINER_PACKET_T
    void *user_data;            /**< Field reserved for use by the client */
    void *framework_data;       /**< Field reserved for use by the framework */
 
+   uint8_t *buffer;            /**< Caller's buffer while data points at the reader's data.
+                                    Only valid with VC_CONTAINER_PACKET_FLAG_REFERENCE. */
+
 } VC_CONTAINER_PACKET_T;
 
 /** \name Container Packet Flags
@@ -314,6 +317,7 @@ typedef struct VC_CONTAINER_PACKET_T
 #define VC_CONTAINER_PACKET_FLAG_DISCONTINUITY  0x08   /**< Packet comes after a discontinuity in the stream. Decoders might have to be flushed */
 #define VC_CONTAINER_PACKET_FLAG_ENCRYPTED      0x10   /**< Packet contains DRM encrypted data */
 #define VC_CONTAINER_PACKET_FLAG_CONFIG         0x20   /**< Packet contains stream specific config data */
+#define VC_CONTAINER_PACKET_FLAG_REFERENCE      0x40   /**< Packet data is a reference to the reader's data which needs releasing */
 /* @} */
 
 /** \name Special Unknown Time Value
@@ -489,6 +493,8 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
 #define VC_CONTAINER_READ_FLAG_SKIP   2
 /** Force the container to read data from the specified track */
 #define VC_CONTAINER_READ_FLAG_FORCE_TRACK 4
+/** Ask the container to point the packet at the data instead of copying it (when possible) */
+#define VC_CONTAINER_READ_FLAG_NO_COPY 8
 /* @} */
 
 /** Reads a data packet from a container reader.
@@ -504,6 +510,14 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
  * \ref VC_CONTAINER_READ_FLAG_SKIP will instruct the reader to skip the next packet. In this case
  * it isn't necessary for the caller to pass a pointer to a \ref VC_CONTAINER_PACKET_T structure
  * unless the \ref VC_CONTAINER_READ_FLAG_INFO is also given.\n
+ * \ref VC_CONTAINER_READ_FLAG_NO_COPY will instruct the reader to avoid copying the data into the
+ * packet buffer if it can give direct access to it instead (e.g. files opened with the mmap:
+ * scheme). In that case the data pointer of the packet is changed to point at the read-only
+ * data, the caller's buffer is kept in the buffer field of the packet and the packet is flagged with
+ * \ref VC_CONTAINER_PACKET_FLAG_REFERENCE. The packet buffer is still used when the reader
+ * can't do this so it must always be provided. \ref vc_container_packet_release gives the
+ * caller's buffer back to the packet. A packet which still holds a reference when it is passed
+ * to a read is released first.\n
  * A combination of all these flags can be used.
  *
  * \param  context   Pointer to the context of the reader to use
@@ -515,6 +529,39 @@ typedef uint32_t VC_CONTAINER_READ_FLAGS_T;
 VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *context,
    VC_CONTAINER_PACKET_T *packet, VC_CONTAINER_READ_FLAGS_T flags );
 
+/** Reads several data packets from a container reader in one go.
+ * This is equivalent to calling \ref vc_container_read once for each packet of the array but
+ * has a lower overhead per packet, which matters when the packets are small (e.g. audio frames).
+ * Each packet needs to be partially filled before the call (buffer, buffer_size, and track when
+ * \ref VC_CONTAINER_READ_FLAG_FORCE_TRACK is used). \ref VC_CONTAINER_READ_FLAG_INFO and
+ * \ref VC_CONTAINER_READ_FLAG_SKIP are not supported.\n
+ * Reading stops at the first error. The packets read before the error are still valid.
+ *
+ * \param  context       Pointer to the context of the reader to use
+ * \param  packets       Array of VC_CONTAINER_PACKET_T structures describing the data packets
+ * \param  packets_num   Number of packets in the array
+ * \param  packets_read  Number of packets actually read will be filled here
+ * \param  flags         Flags controlling the read operation
+ * \return               the status of the operation (VC_CONTAINER_SUCCESS if all the packets were read)
+ */
+VC_CONTAINER_STATUS_T vc_container_read_batch( VC_CONTAINER_T *context,
+   VC_CONTAINER_PACKET_T *packets, unsigned int packets_num, unsigned int *packets_read,
+   VC_CONTAINER_READ_FLAGS_T flags );
+
+/** Releases the data of a packet read with \ref VC_CONTAINER_READ_FLAG_NO_COPY.
+ * This needs to be called once the data of a packet flagged with
+ * \ref VC_CONTAINER_PACKET_FLAG_REFERENCE isn't needed anymore, and in any case before the
+ * reader is closed. The data pointer of the packet is set back to the caller's buffer.
+ * Each reference must be released only once, through the packet it was returned in (not a
+ * copy of it). Packets which aren't references are left untouched.
+ *
+ * \param  context   Pointer to the context of the reader the packet was read from
+ * \param  packet    Pointer to the VC_CONTAINER_PACKET_T structure describing the data packet
+ * \return           the status of the operation
+ */
+VC_CONTAINER_STATUS_T vc_container_packet_release( VC_CONTAINER_T *context,
+   VC_CONTAINER_PACKET_T *packet );
+
 /** Writes a data packet to a container writer.
  *
  * \param  context   Pointer to the context of the writer to use
@@ -670,8 +717,9 @@ typedef enum
    VC_CONTAINER_CONTROL_SET_IO_BUFFER_FULL_CALLBACK,
 
    /** Set the I/O read buffer size to be used.\n
+    * For cached I/O this overrides the adaptive sizing of the read cache.\n
     * Arguments:\n
-    *   arg1= uint32_t: New buffer size in bytes*/
+    *   arg1= uint32_t: New buffer size in bytes (0 to go back to adaptive sizing) */
    VC_CONTAINER_CONTROL_IO_SET_READ_BUFFER_SIZE,
 
    /** Set the timeout on I/O read operations, if applicable.\n
@@ -717,6 +765,42 @@ typedef enum
     *   arg2= VC_CONTAINER_FOURCC_T: codec variant to output */
    VC_CONTAINER_CONTROL_TRACK_PACKETIZE,
 
+   /** Enable or disable reading ahead of the current position in the background.
+    * Arguments:\n
+    *   arg1= uint32_t: number of cache areas to prefetch (0 disables read-ahead) */
+   VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD,
+
+   /** Request a writer to output a fragmented stream. Samples are written out in
+    * self-contained fragments as they come in so the stream stays playable while it
+    * is being recorded. This needs to be set before the first packet is written.
+    * Arguments:\n
+    *   arg1= uint32_t: maximum duration of a fragment in milliseconds (0 disables fragmentation)
+    *   arg2= uint32_t: combination of VC_CONTAINER_FRAGMENT_FLAG_* */
+   VC_CONTAINER_CONTROL_SET_FRAGMENTED,
+
+   /** Request a writer to reserve space at the start of the stream for its index so
+    * it can be written in front of the data (e.g. moov box in front of the mdat box).
+    * Streams written this way can be played progressively without fetching their end
+    * first. If the index doesn't fit in the reserved space, it is written at the end of
+    * the stream as usual. This needs to be set before the first packet is written.
+    * Arguments:\n
+    *   arg1= uint32_t: number of bytes to reserve (0 to disable) */
+   VC_CONTAINER_CONTROL_RESERVE_INDEX_SPACE,
+
+   /** Request a reader to build an exact seek index by scanning the headers of every
+    * frame in the stream. Nothing is decoded but the whole stream is read, so this can
+    * take a while on large or remote streams. The read position is left unchanged.
+    * Readers which already have an exact index return success straight away.
+    * Arguments: none */
+   VC_CONTAINER_CONTROL_BUILD_SEEK_INDEX,
+
+   /** Request a reader to save the seek index it has built to a sidecar file next to
+    * the media (<media>.vcidx) when it is closed, so the next time the media is opened
+    * seeking is accurate straight away. Only local files are supported.
+    * Arguments:\n
+    *   arg1= uint32_t: non-zero to save the index, 0 not to (the default) */
+   VC_CONTAINER_CONTROL_SAVE_SEEK_INDEX,
+
    /** Private user extensions must be above this number */
    VC_CONTAINER_CONTROL_USER_EXTENSIONS = 0x1000
 
@@ -727,6 +811,10 @@ typedef enum
  */
 #define VC_CONTAINER_READ_TIMEOUT_BLOCK   (uint32_t)(-1)
 
+/** Flags used with the VC_CONTAINER_CONTROL_SET_FRAGMENTED control */
+#define VC_CONTAINER_FRAGMENT_FLAG_KEYFRAME  0x1 /**< Also start a new fragment at each video keyframe */
+#define VC_CONTAINER_FRAGMENT_FLAG_INDEX     0x2 /**< Write a segment index in front of each fragment */
+
 /** Extensible control function for container readers and writers.
  * This function takes a variable number of arguments which will depend on the specific operation.
  *
@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef VC_CONTAINERS_REMUX_H
+#define VC_CONTAINERS_REMUX_H
+
+/** \file containers_remux.h
+ * Public API for remuxing a batch of streams in parallel
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "containers/containers.h"
+
+/** \defgroup VcContainerRemuxApi Remux API
+ *  API for remuxing a batch of streams in parallel */
+/* @{ */
+
+/** Default size of the buffer each job uses to read packets */
+#define VC_CONTAINER_REMUX_BUFFER_SIZE (256*1024)
+
+/** Maximum number of jobs which can be run in parallel */
+#define VC_CONTAINER_REMUX_THREADS_MAX 256
+
+/** Definition of a remuxing job */
+typedef struct VC_CONTAINER_REMUX_JOB_T
+{
+   const char *input;             /**< URI of the stream to read from */
+   const char *output;            /**< URI of the stream to write to */
+
+   VC_CONTAINER_STATUS_T status;  /**< Result of the job, filled in by the engine */
+   unsigned int tracks_num;       /**< Number of tracks written, filled in by the engine */
+   uint64_t packets;              /**< Number of packets written, filled in by the engine */
+   uint64_t bytes;                /**< Number of bytes written, filled in by the engine */
+
+   void *user_data;               /**< Field reserved for use by the client */
+
+} VC_CONTAINER_REMUX_JOB_T;
+
+/** Type definition for the callback signalling that a job is finished.
+ * This is called from the worker thread which ran the job. */
+typedef void (*VC_CONTAINER_REMUX_DONE_FUNC_T)(VC_CONTAINER_REMUX_JOB_T *job, void *userdata);
+
+/** Parameters of a remuxing batch */
+typedef struct VC_CONTAINER_REMUX_PARAMS_T
+{
+   unsigned int threads;          /**< Number of jobs run in parallel (0 for 1) */
+   uint32_t buffer_size;          /**< Size of the packet buffer of each job (0 for the default) */
+   bool packetize;                /**< Packetize the tracks which aren't framed */
+
+   VC_CONTAINER_REMUX_DONE_FUNC_T pf_done; /**< Called each time a job is finished (optional) */
+   void *done_userdata;           /**< Passed to pf_done */
+
+} VC_CONTAINER_REMUX_PARAMS_T;
+
+/** Remuxes a batch of streams.
+ * Each job copies all the tracks of its input which the output supports into its output.
+ * Jobs are handed out to a pool of worker threads, each of them running one job at a time,
+ * from opening the reader to closing the writer. Apart from the reader and writer themselves,
+ * the memory used by a job is limited to its packet buffer. Packets bigger than the buffer are
+ * written in several parts.
+ * A job only succeeds if its writer could also be closed without error. The output of a job
+ * which failed once its output was created is removed when it is a local file.
+ * This blocks until all the jobs are finished.
+ *
+ * \param  jobs      Array of jobs to run
+ * \param  jobs_num  Number of jobs in the array
+ * \param  params    Parameters of the batch (NULL for the defaults)
+ * \return           VC_CONTAINER_SUCCESS if all the jobs succeeded, otherwise the status of
+ *                   the first job which failed
+ */
+VC_CONTAINER_STATUS_T vc_container_remux( VC_CONTAINER_REMUX_JOB_T *jobs, unsigned int jobs_num,
+   const VC_CONTAINER_REMUX_PARAMS_T *params );
+
+/* @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VC_CONTAINERS_REMUX_H */
@@ -179,25 +179,49 @@ error:
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_close( VC_CONTAINER_T *p_ctx )
 {
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS, io_status;
    unsigned int i;
 
    if(!p_ctx)
       return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
 
+   if(p_ctx->priv->references)
+      LOG_ERROR(p_ctx, "closing with %u packets still referencing its data", p_ctx->priv->references);
+
    for(i = 0; i < p_ctx->tracks_num; i++)
       if(p_ctx->tracks[i]->priv->packetizer)
          vc_packetizer_close(p_ctx->tracks[i]->priv->packetizer);
    if(p_ctx->priv->packetizer_buffer) free(p_ctx->priv->packetizer_buffer);
    if(p_ctx->priv->drm_filter) vc_container_filter_close(p_ctx->priv->drm_filter);
-   if(p_ctx->priv->pf_close) p_ctx->priv->pf_close(p_ctx);
-   if(p_ctx->priv->io) vc_container_io_close(p_ctx->priv->io);
+   if(p_ctx->priv->pf_close) status = p_ctx->priv->pf_close(p_ctx);
+   if(p_ctx->priv->io)
+   {
+      /* A writer's data might only be known to have failed to reach the storage now */
+      io_status = vc_container_io_close(p_ctx->priv->io);
+      if(status == VC_CONTAINER_SUCCESS) status = io_status;
+   }
    if(p_ctx->priv->module_handle) vc_container_unload(p_ctx);
    for(i = 0; i < p_ctx->meta_num; i++) free(p_ctx->meta[i]);
    if(p_ctx->meta_num) free(p_ctx->meta);
    p_ctx->meta_num = 0;
    free(p_ctx);
 
-   return VC_CONTAINER_SUCCESS;
+   return status;
+}
+
+/*****************************************************************************/
+static void container_packet_drop_reference( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packet )
+{
+   if(!(p_packet->flags & VC_CONTAINER_PACKET_FLAG_REFERENCE))
+      return;
+
+   /* A reference still held by the packet is released so we read into the caller's
+    * buffer. Without any reference given out, the flag is only stale (packets don't
+    * need initialising before a read). */
+   if(p_ctx->priv->references)
+      vc_container_packet_release(p_ctx, p_packet);
+   else
+      p_packet->flags &= ~VC_CONTAINER_PACKET_FLAG_REFERENCE;
 }
 
 /*****************************************************************************/
@@ -253,6 +277,8 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
       return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
    if(!p_packet && (flags & VC_CONTAINER_READ_FLAG_INFO))
       return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+   if(p_packet)
+      container_packet_drop_reference(p_ctx, p_packet);
    if(p_packet && !p_packet->data && !(flags & (VC_CONTAINER_READ_FLAG_INFO | VC_CONTAINER_READ_FLAG_SKIP)))
       return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
    if((flags & VC_CONTAINER_READ_FLAG_FORCE_TRACK) &&
@@ -263,6 +289,10 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
    if(!p_packet)
       p_packet = &p_ctx->priv->packetizer_packet;
 
+   /* The DRM filter decrypts the data in place so it needs its own copy */
+   if(p_ctx->priv->drm_filter)
+      flags &= ~VC_CONTAINER_READ_FLAG_NO_COPY;
+
    /* Simple/Fast case first */
    if(!p_ctx->priv->packetizing)
    {
@@ -332,6 +362,9 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
    if(status != VC_CONTAINER_SUCCESS)
       return status;
 
+   if(p_packet->flags & VC_CONTAINER_PACKET_FLAG_REFERENCE)
+      p_ctx->priv->references++;
+
    if(p_packet && p_packet->dts > p_ctx->position)
       p_ctx->position = p_packet->dts;
    if(p_packet && p_packet->pts > p_ctx->position)
@@ -340,6 +373,72 @@ VC_CONTAINER_STATUS_T vc_container_read( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PAC
    return VC_CONTAINER_SUCCESS;
 }
 
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_read_batch( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packets,
+   unsigned int packets_num, unsigned int *p_packets_read, uint32_t flags )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i;
+
+   if(!p_packets || !p_packets_read)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+   *p_packets_read = 0;
+   if(flags & (VC_CONTAINER_READ_FLAG_INFO | VC_CONTAINER_READ_FLAG_SKIP))
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   for(i = 0; i < packets_num; i++)
+      container_packet_drop_reference(p_ctx, &p_packets[i]);
+
+   /* Use the generic path when the reader can't do any better or when
+    * packets need to go through a packetizer or a filter */
+   if(flags || !p_ctx->priv->pf_read_batch || p_ctx->priv->packetizing || p_ctx->priv->drm_filter)
+   {
+      for(i = 0; i < packets_num && status == VC_CONTAINER_SUCCESS; i++)
+      {
+         status = vc_container_read(p_ctx, &p_packets[i], flags);
+         if(status == VC_CONTAINER_SUCCESS)
+            *p_packets_read = i + 1;
+      }
+      return status;
+   }
+
+   for(i = 0; i < packets_num; i++)
+      if(!p_packets[i].data)
+         return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   status = p_ctx->priv->pf_read_batch(p_ctx, p_packets, packets_num, p_packets_read);
+
+   for(i = 0; i < *p_packets_read; i++)
+   {
+      if(p_packets[i].dts > p_ctx->position)
+         p_ctx->position = p_packets[i].dts;
+      if(p_packets[i].pts > p_ctx->position)
+         p_ctx->position = p_packets[i].pts;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_packet_release( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packet )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+
+   if(!p_packet)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+   if(!(p_packet->flags & VC_CONTAINER_PACKET_FLAG_REFERENCE))
+      return VC_CONTAINER_SUCCESS;
+
+   /* The caller's buffer is given back even if the count is off so it's safe to read again */
+   if(p_ctx->priv->references) p_ctx->priv->references--;
+   else status = VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   p_packet->flags &= ~VC_CONTAINER_PACKET_FLAG_REFERENCE;
+   p_packet->data = p_packet->buffer;
+   p_packet->buffer = NULL;
+   return status;
+}
+
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_write( VC_CONTAINER_T *p_ctx, VC_CONTAINER_PACKET_T *p_packet )
 {
@@ -31,6 +31,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Utility functions to provide a byte stream out of a list of container packets
  */
 
+#include "containers/core/containers_startcode.h"
+
 typedef struct VC_CONTAINER_BYTESTREAM_T
 {
    VC_CONTAINER_PACKET_T *first;  /**< first packet in the chain */
@@ -326,6 +328,51 @@ STATIC_INLINE VC_CONTAINER_STATUS_T packet_get_byte( VC_CONTAINER_BYTESTREAM_T *
    return bytestream_get( stream, data, 1 );
 }
 
+/* Search for the 00 00 01 start code prefix, one packet at a time */
+STATIC_INLINE VC_CONTAINER_STATUS_T bytestream_find_startcode_prefix( VC_CONTAINER_PACKET_T *packet,
+   size_t offset, size_t *search_offset )
+{
+   size_t position = *search_offset, found;
+   unsigned int zeros = 0; /* Zero bytes (up to 2) at the end of the data searched so far */
+
+   for( ; packet != NULL; packet = packet->next, offset = 0 )
+   {
+      const uint8_t *data = packet->data + offset;
+      size_t size = packet->size - offset;
+
+      if( !size )
+         continue;
+
+      /* Check for a start code straddling the previous packet(s) */
+      if( zeros == 2 && data[0] == 1 )
+      {
+         *search_offset = position - 2;
+         return VC_CONTAINER_SUCCESS;
+      }
+      if( zeros && size > 1 && data[0] == 0 && data[1] == 1 )
+      {
+         *search_offset = position - 1;
+         return VC_CONTAINER_SUCCESS;
+      }
+
+      if( vc_container_find_startcodes( data, size, &found, 1 ) )
+      {
+         *search_offset = position + found;
+         return VC_CONTAINER_SUCCESS;
+      }
+
+      if( size == 1 )
+         zeros = data[0] ? 0 : MIN(zeros + 1, 2);
+      else
+         zeros = data[size - 1] ? 0 : data[size - 2] ? 1 : 2;
+      position += size;
+   }
+
+   /* Any trailing zeros could still be the start of a start code */
+   *search_offset = position - zeros;
+   return VC_CONTAINER_ERROR_EOS; /* No luck in finding the start code */
+}
+
 STATIC_INLINE VC_CONTAINER_STATUS_T bytestream_find_startcode( VC_CONTAINER_BYTESTREAM_T *stream,
    size_t *search_offset, const uint8_t *startcode, unsigned int length )
 {
@@ -347,6 +394,9 @@ STATIC_INLINE VC_CONTAINER_STATUS_T bytestream_find_startcode( VC_CONTAINER_BYTE
       start_offset -= (packet->size - offset);
    }
 
+   if( length == 3 && !startcode[0] && !startcode[1] && startcode[2] == 1 )
+      return bytestream_find_startcode_prefix( packet, offset + start_offset, search_offset );
+
    /* Start the search for the start code.
     * To make things simple we try to find a match one byte at a time. */
    for( offset += start_offset;
@@ -25,11 +25,30 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _VIDEOCORE
+# include <sys/types.h>
+# include <sys/stat.h>
+#endif
 
 #include "containers/containers.h"
+#include "containers/core/containers_common.h"
 #include "containers/core/containers_index.h"
+#include "containers/core/containers_uri.h"
+
+#define INDEX_SEGMENT_BITS_MIN 4   // smallest segment is 16 entries
+#define INDEX_SEGMENT_BITS_MAX 12  // largest segment is 4096 entries
+#define INDEX_SEGMENTS_INCREMENT 16
+
+#define INDEX_SIDECAR_EXTENSION ".vcidx"
+#define INDEX_SIDECAR_MAGIC     VC_FOURCC('v','c','i','x')
+#define INDEX_SIDECAR_VERSION   2
+#define INDEX_SIDECAR_HEADER_SIZE 40
+#define INDEX_SIDECAR_HASH_SIZE 4096 // bytes at the start of the media which get hashed
+#define INDEX_SIDECAR_ENTRY_SIZE 16
+#define INDEX_SIDECAR_BATCH     256 // entries read or written at once
 
 typedef struct {
    int64_t file_offset;
@@ -37,50 +56,38 @@ typedef struct {
 } VC_CONTAINER_INDEX_POS_T;
 
 struct  VC_CONTAINER_INDEX_T {
-   int len;                           // log2 of length of entry array
-   int next;                          // next array entry to write into
-   int gap;                           // log2 of the passes through entry array to build the full list
-   int mgap;                          // len-gap, stored for convenience
-   int count;                         // number of calls to index_add since last entry added
-   int max_count;                     // log2 of the number of calls to discard between each entry added
+   int bits;                          // log2 of the number of entries in a segment
+   int next;                          // next entry to write into
+   int saved;                         // number of entries already in the sidecar file
+   int segments_num;                  // number of allocated segments
+   int segments_max;                  // size of the segment table
    int64_t max_time;                  // time of the latest entry
-   VC_CONTAINER_INDEX_POS_T entry[0]; // array of position/time pairs   
+   VC_CONTAINER_INDEX_POS_T **segment; // table of segments of position/time pairs
 };
 
-// We have a fixed length list, and when it is full we want to discard half the entries.
-// This is done without coping data by mapping the entry number to the index to the array,
-// in the following way:
-// Length is a power of two, so the entry number is a fixed constant bit width.  The highest gap
-// bits are used as a direct offset into the array (o), the lowest mgap bits are right shifted by
-// gap to increment this (S).  Each time we double the number of passes through the actual array.
-// So if len=3, we start off with mgap=3, gap=0, we have a single pass with the trivial mapping:
-// |S|S|S|  [0 1 2 3 4 5 6 7]
-// when this is full we change to mgap=2, gap=1, so we iterate this way:
-// |o|S|S|  [0 2 4 6] [1 3 5 7]
-// when this is full we change to mgap=1, gap=2
-// |o|o|S|  [0 4] [1 5] [2 6] [3 7]  
-// when this is full we change to this, which is equivalent to where we started
-// |o|o|o|  [0] [1] [2] [3] [4] [5] [6] [7]
-
-#define ENTRY(x, i) ((x)->gap == 0 ? (i) : ((i)>>(x)->mgap) + (((i) & ((1<<(x)->mgap)-1)) << (x)->gap))
+// Entries are stored in a two-level table. The segments all have the same power of two
+// length and are allocated as the index grows, so adding entries never moves the existing
+// ones and the index keeps its full resolution however long the stream is.
+
+#define ENTRY(x, i) (&(x)->segment[(i) >> (x)->bits][(i) & ((1 << (x)->bits) - 1)])
 
 VC_CONTAINER_STATUS_T vc_container_index_create( VC_CONTAINER_INDEX_T **index, int length )
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
    VC_CONTAINER_INDEX_T *id = NULL;
-   int len = 0;
+   int bits = 0;
 
-   if(length < 16) length = 16;
-   if(length > 4096) length = 4096;
    while((length >>= 1) != 0)
-      len++;
+      bits++;
+   if(bits < INDEX_SEGMENT_BITS_MIN) bits = INDEX_SEGMENT_BITS_MIN;
+   if(bits > INDEX_SEGMENT_BITS_MAX) bits = INDEX_SEGMENT_BITS_MAX;
 
-   id = malloc(sizeof(VC_CONTAINER_INDEX_T) + (sizeof(VC_CONTAINER_INDEX_POS_T)<<len));
+   id = malloc(sizeof(VC_CONTAINER_INDEX_T));
    if(id == NULL) { goto error; }
    
    memset(id, 0, sizeof(VC_CONTAINER_INDEX_T));
 
-   id->len = id->mgap = len;
+   id->bits = bits;
 
    *index = id;
    return VC_CONTAINER_SUCCESS;
@@ -94,54 +101,60 @@ VC_CONTAINER_STATUS_T vc_container_index_free( VC_CONTAINER_INDEX_T *index )
    if(index == NULL)
       return VC_CONTAINER_ERROR_FAILED;
 
+   while(index->segments_num)
+      free(index->segment[--index->segments_num]);
+   free(index->segment);
    free(index);
    return VC_CONTAINER_SUCCESS;
 }
 
-VC_CONTAINER_STATUS_T vc_container_index_add( VC_CONTAINER_INDEX_T *index, int64_t time, int64_t file_offset )
+static VC_CONTAINER_STATUS_T index_append( VC_CONTAINER_INDEX_T *index, int64_t time, int64_t file_offset )
 {
-   if(index == NULL)
-      return VC_CONTAINER_ERROR_FAILED;
-
-   // reject entries if they are in part of the time covered
-   if(index->next != 0 && time <= index->max_time)
-      return VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_INDEX_POS_T *entry;
 
-   index->count++;
-   if(index->count == (1<<index->max_count))
+   if((index->next >> index->bits) == index->segments_num)
    {
-      int entry;
-      if(index->next == (1<<index->len))
+      // New entry doesn't fit, add a segment (growing the segment table if needed)
+      if(index->segments_num == index->segments_max)
       {
-         // New entry doesn't fit, we discard every other index record
-         // by changing how we map index positions to array entry indexes.
-         index->next >>= 1;
-         index->gap++;
-         index->mgap--;
-         index->max_count++;
-
-         if(index->gap == index->len)
-         {
-            index->gap = 0;
-            index->mgap = index->len;
-         }
+         int segments_max = index->segments_max + INDEX_SEGMENTS_INCREMENT;
+         VC_CONTAINER_INDEX_POS_T **segment = realloc(index->segment, segments_max * sizeof(*segment));
+         if(segment == NULL)
+            return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         index->segment = segment;
+         index->segments_max = segments_max;
       }
 
-      entry = ENTRY(index, index->next);
-
-      index->entry[entry].file_offset = file_offset;
-      index->entry[entry].time = time;
-      index->count = 0;
-      index->next++;
-      index->max_time = time;
+      index->segment[index->segments_num] = malloc(sizeof(VC_CONTAINER_INDEX_POS_T) << index->bits);
+      if(index->segment[index->segments_num] == NULL)
+         return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      index->segments_num++;
    }
 
+   entry = ENTRY(index, index->next);
+   entry->file_offset = file_offset;
+   entry->time = time;
+   index->next++;
+   index->max_time = time;
    return VC_CONTAINER_SUCCESS;
 }
 
+VC_CONTAINER_STATUS_T vc_container_index_add( VC_CONTAINER_INDEX_T *index, int64_t time, int64_t file_offset )
+{
+   if(index == NULL)
+      return VC_CONTAINER_ERROR_FAILED;
+
+   // reject entries if they are in part of the time covered
+   if(index->next != 0 && time <= index->max_time)
+      return VC_CONTAINER_SUCCESS;
+
+   return index_append(index, time, file_offset);
+}
+
 VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int later, int64_t *time, int64_t *file_offset, int *past )
 {
-   int guess, start, end, entry;
+   int guess, start, end;
+   VC_CONTAINER_INDEX_POS_T *entry;
 
    if(index == NULL || index->next == 0)
       return VC_CONTAINER_ERROR_FAILED;
@@ -155,7 +168,7 @@ VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int l
    {
       int64_t gtime;
       guess = (start+end)>>1;
-      gtime = index->entry[ENTRY(index, guess)].time;
+      gtime = ENTRY(index, guess)->time;
 
       if(*time < gtime)
          end = guess;
@@ -165,18 +178,18 @@ VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int l
          break;
    }
 
-   if (*time != index->entry[ENTRY(index, guess)].time)
+   if (*time != ENTRY(index, guess)->time)
    {
       if(later)
       {
-         if(*time <= index->entry[ENTRY(index, start)].time)
+         if(*time <= ENTRY(index, start)->time)
             guess = start;
          else
             guess = end;
       }
       else
       {
-         if(*time >= index->entry[ENTRY(index, end)].time)
+         if(*time >= ENTRY(index, end)->time)
             guess = end;
          else
             guess = start;
@@ -184,9 +197,202 @@ VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int l
    }
 
    entry = ENTRY(index, guess);
-   *time = index->entry[entry].time;
-   *file_offset = index->entry[entry].file_offset;
+   *time = entry->time;
+   *file_offset = entry->file_offset;
 
    return VC_CONTAINER_SUCCESS;
 }
 
+/* Sidecar files are only used next to local files */
+static char *index_sidecar_uri( VC_CONTAINER_IO_T *io )
+{
+   const char *scheme;
+   char *uri;
+
+   if(!io || !io->uri || !io->uri_parts || io->size <= 0)
+      return NULL;
+   scheme = vc_uri_scheme(io->uri_parts);
+   if(scheme && strcasecmp(scheme, "file"))
+      return NULL;
+
+   uri = malloc(strlen(io->uri) + sizeof(INDEX_SIDECAR_EXTENSION));
+   if(uri)
+      sprintf(uri, "%s%s", io->uri, INDEX_SIDECAR_EXTENSION);
+   return uri;
+}
+
+static void index_write_le64( uint8_t *data, uint64_t value )
+{
+   unsigned int i;
+   for(i = 0; i < 8; i++, value >>= 8)
+      data[i] = (uint8_t)value;
+}
+
+static uint64_t index_read_le64( const uint8_t *data )
+{
+   uint64_t value = 0;
+   int i;
+   for(i = 7; i >= 0; i--)
+      value = (value << 8) | data[i];
+   return value;
+}
+
+/* Identifies the media a sidecar was saved for by its modification time and a
+   hash (FNV-1a) of its first bytes. The read position of the media is preserved. */
+static VC_CONTAINER_STATUS_T index_media_signature( VC_CONTAINER_IO_T *io, uint64_t *mtime, uint64_t *hash )
+{
+   uint8_t data[INDEX_SIDECAR_HASH_SIZE];
+   int64_t position = io->offset;
+   VC_CONTAINER_STATUS_T status;
+   size_t size, i;
+#ifndef _VIDEOCORE
+   const char *path = vc_uri_path(io->uri_parts);
+   struct stat st;
+
+   if(!path || stat(path, &st))
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+   *mtime = (uint64_t)st.st_mtime;
+#else
+   *mtime = 0;
+#endif
+
+   status = vc_container_io_seek(io, INT64_C(0));
+   if(status != VC_CONTAINER_SUCCESS)
+      return status;
+   size = vc_container_io_read(io, data, sizeof(data));
+   status = vc_container_io_seek(io, position);
+   if(status != VC_CONTAINER_SUCCESS)
+      return status;
+
+   *hash = UINT64_C(14695981039346656037);
+   for(i = 0; i < size; i++)
+      *hash = (*hash ^ data[i]) * UINT64_C(1099511628211);
+   return VC_CONTAINER_SUCCESS;
+}
+
+VC_CONTAINER_STATUS_T vc_container_index_load( VC_CONTAINER_INDEX_T **index, VC_CONTAINER_IO_T *io, int length )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_NOT_FOUND;
+   uint8_t data[INDEX_SIDECAR_BATCH * INDEX_SIDECAR_ENTRY_SIZE];
+   VC_CONTAINER_INDEX_T *id = NULL;
+   VC_CONTAINER_IO_T *sidecar = NULL;
+   char *uri = index_sidecar_uri(io);
+   uint64_t count, i, j, batch, mtime, hash;
+
+   if(!uri)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   if(index_media_signature(io, &mtime, &hash) != VC_CONTAINER_SUCCESS)
+   {
+      free(uri);
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+   }
+   sidecar = vc_container_io_open(uri, VC_CONTAINER_IO_MODE_READ, &status);
+   free(uri);
+   if(!sidecar)
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   // The sidecar is only valid for the exact same media
+   status = VC_CONTAINER_ERROR_FORMAT_INVALID;
+   if(vc_container_io_read(sidecar, data, INDEX_SIDECAR_HEADER_SIZE) != INDEX_SIDECAR_HEADER_SIZE ||
+      index_read_le64(data) != ((uint64_t)INDEX_SIDECAR_VERSION << 32 | INDEX_SIDECAR_MAGIC) ||
+      index_read_le64(data + 8) != (uint64_t)io->size ||
+      index_read_le64(data + 16) != mtime || index_read_le64(data + 24) != hash)
+      goto error;
+   count = index_read_le64(data + 32);
+   if(!count || count > INT32_MAX ||
+      (sidecar->size && (uint64_t)sidecar->size != INDEX_SIDECAR_HEADER_SIZE + count * INDEX_SIDECAR_ENTRY_SIZE))
+      goto error;
+
+   status = vc_container_index_create(&id, length);
+   if(status != VC_CONTAINER_SUCCESS)
+      goto error;
+
+   for(i = 0; i < count; i += batch)
+   {
+      batch = MIN(count - i, INDEX_SIDECAR_BATCH);
+      if(vc_container_io_read(sidecar, data, batch * INDEX_SIDECAR_ENTRY_SIZE) != batch * INDEX_SIDECAR_ENTRY_SIZE)
+      { status = VC_CONTAINER_ERROR_FORMAT_INVALID; goto error; }
+
+      for(j = 0; j < batch; j++)
+      {
+         int64_t time = (int64_t)index_read_le64(data + j * INDEX_SIDECAR_ENTRY_SIZE);
+         int64_t file_offset = (int64_t)index_read_le64(data + j * INDEX_SIDECAR_ENTRY_SIZE + 8);
+
+         if((id->next && time <= id->max_time) || file_offset < 0 || file_offset > io->size)
+         { status = VC_CONTAINER_ERROR_FORMAT_INVALID; goto error; }
+         status = index_append(id, time, file_offset);
+         if(status != VC_CONTAINER_SUCCESS)
+            goto error;
+      }
+   }
+
+   id->saved = id->next;
+   vc_container_io_close(sidecar);
+   *index = id;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   if(id) vc_container_index_free(id);
+   vc_container_io_close(sidecar);
+   return status;
+}
+
+VC_CONTAINER_STATUS_T vc_container_index_save( VC_CONTAINER_INDEX_T *index, VC_CONTAINER_IO_T *io )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS, close_status;
+   uint8_t data[INDEX_SIDECAR_BATCH * INDEX_SIDECAR_ENTRY_SIZE];
+   VC_CONTAINER_IO_T *sidecar;
+   uint64_t mtime, hash;
+   char *uri;
+   int i, j, batch;
+
+   if(index == NULL)
+      return VC_CONTAINER_ERROR_FAILED;
+
+   // Nothing new since the sidecar was loaded or written, or nothing worth
+   // saving beyond the start of the stream
+   if(index->next <= index->saved || index->next < 2)
+      return VC_CONTAINER_SUCCESS;
+
+   uri = index_sidecar_uri(io);
+   if(!uri)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   status = index_media_signature(io, &mtime, &hash);
+   if(status != VC_CONTAINER_SUCCESS)
+   {
+      free(uri);
+      return status;
+   }
+   sidecar = vc_container_io_open(uri, VC_CONTAINER_IO_MODE_WRITE, &status);
+   free(uri);
+   if(!sidecar)
+      return status;
+
+   index_write_le64(data, (uint64_t)INDEX_SIDECAR_VERSION << 32 | INDEX_SIDECAR_MAGIC);
+   index_write_le64(data + 8, (uint64_t)io->size);
+   index_write_le64(data + 16, mtime);
+   index_write_le64(data + 24, hash);
+   index_write_le64(data + 32, (uint64_t)index->next);
+   if(vc_container_io_write(sidecar, data, INDEX_SIDECAR_HEADER_SIZE) != INDEX_SIDECAR_HEADER_SIZE)
+      status = VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   for(i = 0; i < index->next && status == VC_CONTAINER_SUCCESS; i += batch)
+   {
+      batch = MIN(index->next - i, INDEX_SIDECAR_BATCH);
+      for(j = 0; j < batch; j++)
+      {
+         index_write_le64(data + j * INDEX_SIDECAR_ENTRY_SIZE, (uint64_t)ENTRY(index, i + j)->time);
+         index_write_le64(data + j * INDEX_SIDECAR_ENTRY_SIZE + 8, (uint64_t)ENTRY(index, i + j)->file_offset);
+      }
+      if(vc_container_io_write(sidecar, data, batch * INDEX_SIDECAR_ENTRY_SIZE) != (size_t)batch * INDEX_SIDECAR_ENTRY_SIZE)
+         status = VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   }
+
+   /* Buffered data is only written on close so this is where most failures show up */
+   close_status = vc_container_io_close(sidecar);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = close_status;
+   if(status == VC_CONTAINER_SUCCESS)
+      index->saved = index->next;
+   return status;
+}
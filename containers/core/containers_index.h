@@ -32,17 +32,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * index of file offsets and times, and is able to suggest a file position
  * to seek to achieve a given time target.  Useful for container formats
  * that don't include an index.
+ * The index grows as needed without ever dropping entries and can be saved
+ * to a sidecar file next to the media so it doesn't need rebuilding the
+ * next time the media is opened.
  */
 
 #include "containers/containers.h" 
+#include "containers/core/containers_io.h"
 
 struct VC_CONTAINER_INDEX_T;
 typedef struct VC_CONTAINER_INDEX_T VC_CONTAINER_INDEX_T;
 
 /**
- * Creates an index with a suggested number of entries.
+ * Creates an empty index.
  * @param  index   Pointer to created index will be filled here on success.
- * @param  length  Suggested length of index.
+ * @param  length  Suggested number of entries to allocate at once as the index grows.
  * @return         Status code
  */
 VC_CONTAINER_STATUS_T vc_container_index_create( VC_CONTAINER_INDEX_T **index, int length );
@@ -57,8 +61,8 @@ VC_CONTAINER_STATUS_T vc_container_index_free( VC_CONTAINER_INDEX_T *index );
 
 
 /**
- * Adds an entry to the index.  If the index is full then some stored records will be
- * discarded.
+ * Adds an entry to the index.  Entries which aren't later than the last entry
+ * added are ignored.
  * @param index        Pointer to a valid index.
  * @param time         Timestamp of new index entry.
  * @param file_offset  File offset for new index entry.
@@ -79,4 +83,28 @@ VC_CONTAINER_STATUS_T vc_container_index_add( VC_CONTAINER_INDEX_T *index, int64
  */
 VC_CONTAINER_STATUS_T vc_container_index_get( VC_CONTAINER_INDEX_T *index, int later, int64_t *time, int64_t *file_offset, int *past );
 
+
+/**
+ * Creates an index from the sidecar file previously saved for a media.
+ * The sidecar is only used if it was saved for a media of the same size, modification
+ * time and first bytes.
+ * @param  index   Pointer to created index will be filled here on success.
+ * @param  io      i/o of the media the index refers to.
+ * @param  length  Suggested number of entries to allocate at once as the index grows.
+ * @return         Status code, VC_CONTAINER_ERROR_NOT_FOUND if there is no sidecar file.
+ */
+VC_CONTAINER_STATUS_T vc_container_index_load( VC_CONTAINER_INDEX_T **index, VC_CONTAINER_IO_T *io, int length );
+
+
+/**
+ * Saves an index to a sidecar file next to the media. Readers only do this when
+ * asked to through VC_CONTAINER_CONTROL_SAVE_SEEK_INDEX. Nothing is written if no
+ * entries were added since the index was loaded or last saved, or if the index
+ * only has a single entry. Only local files get a sidecar.
+ * @param index  Pointer to valid index.
+ * @param io     i/o of the media the index refers to.
+ * @return       Status code.
+ */
+VC_CONTAINER_STATUS_T vc_container_index_save( VC_CONTAINER_INDEX_T *index, VC_CONTAINER_IO_T *io );
+
 #endif /* VC_CONTAINERS_WRITER_UTILS_H */
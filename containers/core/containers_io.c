@@ -28,7 +28,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 
+#include "vcos.h"
 #include "containers/containers.h"
 #include "containers/core/containers_io.h"
 #include "containers/core/containers_common.h"
@@ -39,10 +41,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAX_NUM_MEMORY_AREAS 4
 #define NUM_TMP_MEMORY_AREAS 2
 #define MEM_CACHE_READ_MAX_SIZE (32*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_READ_MIN_SIZE (4*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_READ_GROW_MAX_SIZE (1024*1024) /* Needs to be a power of 2 */
+#define MEM_CACHE_SEQUENTIAL_REFILLS 4 /* Sequential refills before the read cache grows */
+#define MEM_CACHE_RANDOM_REFILLS 2 /* Random refills before the read cache shrinks */
 #define MEM_CACHE_WRITE_MAX_SIZE (128*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_TMP_MAX_SIZE (32*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_ALIGNMENT (1*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_AREA_READ_MAX_SIZE (4*1024*1024) /* Needs to be a power of 2 */
+#define MAX_NUM_READ_AHEAD_AREAS 4
+#define IO_MODULES_HASH_SIZE 32 /* Needs to be a power of 2 */
+#define IO_MODULES_PROBE_MAX 16
+#define WRITEV_DIRECT_MIN_SIZE (32*1024) /* Smaller buffers are cheaper to copy into the write cache */
+#define WRITEV_MAX_VECS 16
 
 typedef struct VC_CONTAINER_IO_PRIVATE_CACHE_T
 {
@@ -78,33 +89,58 @@ typedef struct VC_CONTAINER_IO_PRIVATE_T
 
    int64_t actual_offset;
 
+   int64_t refill_end;                /**< End of the data fetched by the last refill */
+   unsigned int sequential_refills;   /**< Number of consecutive sequential refills */
+   unsigned int random_refills;       /**< Number of consecutive random refills */
+   unsigned int cache_size_override;  /**< Read cache size requested by the user (0 if adaptive) */
+
    struct VC_CONTAINER_IO_ASYNC_T *async_io;
+   struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead;
+
+   VC_CONTAINER_IO_MODE_T mode;
+   unsigned int mem_alignment;        /**< Alignment of the cache memory areas */
+   VC_CONTAINER_STATUS_T write_status; /**< First error hit while flushing written data */
 
 } VC_CONTAINER_IO_PRIVATE_T;
 
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
+                                                 VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_null_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_mem_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
+                                                 VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_net_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_pktfile_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_http_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_uring_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
+                                                 VC_CONTAINER_IO_MODE_T mode );
 static VC_CONTAINER_STATUS_T io_seek_not_seekable(VC_CONTAINER_IO_T *p_ctx, int64_t offset);
 
 static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, uint8_t *data, size_t size );
 static int32_t vc_container_io_cache_write( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const uint8_t *data, size_t size );
+static size_t vc_container_io_cache_writev( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const VC_CONTAINER_IO_VEC_T *vec, unsigned int count );
 static VC_CONTAINER_STATUS_T vc_container_io_cache_seek( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset );
 static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
 static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int complete );
+static size_t vc_container_io_read_stream( VC_CONTAINER_IO_T *p_ctx, int64_t offset,
+   uint8_t *buffer, size_t size );
+static size_t vc_container_io_writev_stream( VC_CONTAINER_IO_T *p_ctx,
+   const VC_CONTAINER_IO_VEC_T *vec, unsigned int count );
+static unsigned int vc_container_io_cache_round_size( uint32_t size );
+static uint8_t *vc_container_io_mem_alloc( size_t size, unsigned int alignment );
+static void vc_container_io_mem_free( uint8_t *mem );
 
 static struct VC_CONTAINER_IO_ASYNC_T *async_io_start( VC_CONTAINER_IO_T *io, int num_areas, VC_CONTAINER_STATUS_T * );
 static VC_CONTAINER_STATUS_T async_io_stop( struct VC_CONTAINER_IO_ASYNC_T *ctx );
@@ -114,6 +150,224 @@ static VC_CONTAINER_STATUS_T async_io_wait_complete( struct VC_CONTAINER_IO_ASYN
 static void async_io_stats_initialise( struct VC_CONTAINER_IO_ASYNC_T *ctx, int enable );
 static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINER_WRITE_STATS_T *stats );
 
+static VC_CONTAINER_STATUS_T read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int depth );
+static void read_ahead_stop( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static size_t read_ahead_read( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int64_t offset,
+                               uint8_t *buffer, size_t size );
+
+/*****************************************************************************
+ * Registry of i/o modules.
+ * Each URI scheme handled by a module has an entry in a hash table so opening
+ * an i/o only probes the modules which can actually deal with its URI.
+ *****************************************************************************/
+typedef struct VC_CONTAINER_IO_MODULE_ENTRY_T
+{
+   struct VC_CONTAINER_IO_MODULE_ENTRY_T *next; /**< Next entry, by decreasing priority */
+   const char *name;
+   const char *scheme; /**< Scheme handled by this entry (NULL for any URI) */
+   int priority;
+   VC_CONTAINER_IO_MODULE_OPEN_FUNC_T pf_open;
+
+} VC_CONTAINER_IO_MODULE_ENTRY_T;
+
+static struct
+{
+   VCOS_ONCE_T once;
+   VCOS_MUTEX_T lock;
+   bool init;
+
+   VC_CONTAINER_IO_MODULE_ENTRY_T *schemes[IO_MODULES_HASH_SIZE];
+   VC_CONTAINER_IO_MODULE_ENTRY_T *any; /**< Modules tried for any URI */
+
+} io_modules = { VCOS_ONCE_INIT };
+
+static const char * const io_null_schemes[] = { "null", 0 };
+static const char * const io_mem_schemes[] = { "mem", 0 };
+static const char * const io_net_schemes[] = { "rtp", "rtsp", 0 };
+static const char * const io_pktfile_schemes[] = { "rtp", "rtppkt", "rtsp", "rtsppkt", "pktfile", 0 };
+static const char * const io_http_schemes[] = { "http", 0 };
+static const char * const io_mmap_schemes[] = { "mmap", 0 };
+static const char * const io_uring_schemes[] = { "", "file", "uring", 0 };
+
+static const struct
+{
+   const char *name;
+   const char * const *schemes;
+   int priority;
+   VC_CONTAINER_IO_MODULE_OPEN_FUNC_T pf_open;
+} io_builtin_modules[] =
+{
+   {"null", io_null_schemes, 60, vc_container_io_null_open},
+   {"mem", io_mem_schemes, 60, vc_container_io_mem_open},
+   {"net", io_net_schemes, 50, vc_container_io_net_open},
+   {"pktfile", io_pktfile_schemes, 40, vc_container_io_pktfile_open},
+#ifdef ENABLE_CONTAINER_IO_HTTP
+   {"http", io_http_schemes, 30, vc_container_io_http_open},
+#endif
+#ifdef ENABLE_CONTAINER_IO_MMAP
+   {"mmap", io_mmap_schemes, 20, vc_container_io_mmap_open},
+#endif
+#ifdef ENABLE_CONTAINER_IO_URING
+   {"uring", io_uring_schemes, 10, vc_container_io_uring_open},
+#endif
+   {"file", 0, 0, vc_container_io_file_open},
+   {0, 0, 0, 0}
+};
+
+/*****************************************************************************/
+static unsigned int io_modules_hash( const char *scheme )
+{
+   unsigned int hash = 5381;
+
+   /* Schemes are case insensitive */
+   while(*scheme)
+      hash = hash * 33 + tolower((unsigned char)*scheme++);
+   return hash & (IO_MODULES_HASH_SIZE - 1);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_modules_add( const char *name, const char * const *schemes,
+   int priority, VC_CONTAINER_IO_MODULE_OPEN_FUNC_T pf_open )
+{
+   VC_CONTAINER_IO_MODULE_ENTRY_T *entry, **list;
+   const char *scheme;
+   unsigned int i = 0;
+   char *strings;
+
+   /* One entry gets added for each scheme, or a single one if the module handles any URI */
+   do
+   {
+      scheme = schemes ? schemes[i++] : 0;
+      if(schemes && !scheme) break;
+
+      /* The entry and its strings are allocated in one go */
+      entry = malloc(sizeof(*entry) + strlen(name) + 1 + (scheme ? strlen(scheme) + 1 : 0));
+      if(!entry) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      memset(entry, 0, sizeof(*entry));
+      strings = (char *)&entry[1];
+      entry->name = strcpy(strings, name);
+      if(scheme) entry->scheme = strcpy(strings + strlen(name) + 1, scheme);
+      entry->priority = priority;
+      entry->pf_open = pf_open;
+
+      /* Most recent registrations come first when priorities are equal */
+      list = scheme ? &io_modules.schemes[io_modules_hash(scheme)] : &io_modules.any;
+      while(*list && (*list)->priority > priority)
+         list = &(*list)->next;
+      entry->next = *list;
+      *list = entry;
+   } while(schemes);
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static bool io_modules_remove( VC_CONTAINER_IO_MODULE_ENTRY_T **list, const char *name )
+{
+   VC_CONTAINER_IO_MODULE_ENTRY_T *entry;
+   bool found = false;
+
+   while(*list)
+   {
+      entry = *list;
+      if(strcmp(entry->name, name)) { list = &entry->next; continue; }
+      *list = entry->next;
+      free(entry);
+      found = true;
+   }
+
+   return found;
+}
+
+/*****************************************************************************/
+static void io_modules_init( void )
+{
+   unsigned int i;
+
+   if(vcos_mutex_create(&io_modules.lock, "io_modules_lock") != VCOS_SUCCESS)
+      return;
+
+   for(i = 0; io_builtin_modules[i].name; i++)
+      io_modules_add(io_builtin_modules[i].name, io_builtin_modules[i].schemes,
+                     io_builtin_modules[i].priority, io_builtin_modules[i].pf_open);
+   io_modules.init = true;
+}
+
+/*****************************************************************************/
+static unsigned int io_modules_find( const char *scheme,
+   VC_CONTAINER_IO_MODULE_OPEN_FUNC_T *modules, unsigned int max )
+{
+   VC_CONTAINER_IO_MODULE_ENTRY_T *entry, *any;
+   unsigned int num = 0;
+
+   vcos_once(&io_modules.once, io_modules_init);
+   if(!io_modules.init) return 0;
+   if(!scheme) scheme = "";
+
+   vcos_mutex_lock(&io_modules.lock);
+
+   /* Merge the modules for this scheme with the ones for any URI, by priority */
+   entry = io_modules.schemes[io_modules_hash(scheme)];
+   any = io_modules.any;
+   while(num < max && (entry || any))
+   {
+      if(entry && strcasecmp(entry->scheme, scheme))
+         entry = entry->next; /* Hash collision */
+      else if(entry && (!any || entry->priority >= any->priority))
+         modules[num++] = entry->pf_open, entry = entry->next;
+      else
+         modules[num++] = any->pf_open, any = any->next;
+   }
+
+   vcos_mutex_unlock(&io_modules.lock);
+   return num;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_module_register( const char *name, const char * const *schemes,
+   int priority, VC_CONTAINER_IO_MODULE_OPEN_FUNC_T pf_open )
+{
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   if(!name || !pf_open)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   vcos_once(&io_modules.once, io_modules_init);
+   if(!io_modules.init) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   vcos_mutex_lock(&io_modules.lock);
+   status = io_modules_add(name, schemes, priority, pf_open);
+   if(status != VC_CONTAINER_SUCCESS)
+   {
+      /* Don't leave a partially registered module behind */
+      for(i = 0; i < IO_MODULES_HASH_SIZE; i++)
+         io_modules_remove(&io_modules.schemes[i], name);
+   }
+   vcos_mutex_unlock(&io_modules.lock);
+   return status;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_module_unregister( const char *name )
+{
+   bool found;
+   unsigned int i;
+
+   if(!name) return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   vcos_once(&io_modules.once, io_modules_init);
+   if(!io_modules.init) return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   vcos_mutex_lock(&io_modules.lock);
+   found = io_modules_remove(&io_modules.any, name);
+   for(i = 0; i < IO_MODULES_HASH_SIZE; i++)
+      found |= io_modules_remove(&io_modules.schemes[i], name);
+   vcos_mutex_unlock(&io_modules.lock);
+
+   return found ? VC_CONTAINER_SUCCESS : VC_CONTAINER_ERROR_NOT_FOUND;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAINER_IO_MODE_T mode,
                                                      VC_CONTAINER_IO_CAPABILITIES_T capabilities,
@@ -137,19 +391,24 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    p_ctx->uri_parts = vc_uri_create();
    if(!p_ctx->uri_parts) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
    vc_uri_parse(p_ctx->uri_parts, uri);
+   private->mode = mode;
 
    if (b_open)
    {
-      /* Open the actual i/o module */
-      status = vc_container_io_null_open(p_ctx, uri, mode);
-      if(status) status = vc_container_io_net_open(p_ctx, uri, mode);
-      if(status) status = vc_container_io_pktfile_open(p_ctx, uri, mode);
-#ifdef ENABLE_CONTAINER_IO_HTTP
-      if(status) status = vc_container_io_http_open(p_ctx, uri, mode);
-#endif
-      if(status) status = vc_container_io_file_open(p_ctx, uri, mode);
+      VC_CONTAINER_IO_MODULE_OPEN_FUNC_T modules[IO_MODULES_PROBE_MAX];
+      unsigned int i, num_modules;
+
+      /* Open the actual i/o module, trying only the ones which can handle this URI */
+      num_modules = io_modules_find(vc_uri_scheme(p_ctx->uri_parts), modules, IO_MODULES_PROBE_MAX);
+      status = VC_CONTAINER_ERROR_URI_NOT_FOUND;
+      for(i = 0; i < num_modules && status != VC_CONTAINER_SUCCESS; i++)
+         status = modules[i](p_ctx, uri, mode);
       if(status != VC_CONTAINER_SUCCESS) goto error;
 
+      private->mem_alignment = MAX(p_ctx->alignment, MEM_CACHE_ALIGNMENT);
+      if(private->mem_alignment & (private->mem_alignment - 1))
+         private->mem_alignment = MEM_CACHE_ALIGNMENT; /* Not a power of 2, ignore it */
+
       if(!p_ctx->pf_seek || (p_ctx->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK))
       {
          p_ctx->capabilities |= VC_CONTAINER_IO_CAPS_CANT_SEEK;
@@ -160,6 +419,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    {
       /* We're only creating an empty container i/o */
       p_ctx->capabilities = capabilities;
+      private->mem_alignment = MEM_CACHE_ALIGNMENT;
    }
 
    if(p_ctx->capabilities & VC_CONTAINER_IO_CAPS_NO_CACHING)
@@ -184,7 +444,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
       cache->mem_max_size = cache_max_size;
       cache->mem_size = cache->mem_max_size;
       cache->io = p_ctx;
-      cache->mem = malloc(p_ctx->priv->caches.mem_size);
+      cache->mem = vc_container_io_mem_alloc(cache->mem_size, private->mem_alignment);
       if(cache->mem)
       {      
          cache->buffer = cache->mem;
@@ -230,6 +490,7 @@ VC_CONTAINER_IO_T *vc_container_io_create( const char *uri, VC_CONTAINER_IO_MODE
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
 {
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS, close_status;
    unsigned int i;
 
    if(p_ctx)
@@ -241,22 +502,30 @@ VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
             if(p_ctx->priv->caches.dirty)
                vc_container_io_cache_flush( p_ctx, &p_ctx->priv->caches, 1 );
          }
+         status = p_ctx->priv->write_status;
          
+         if(p_ctx->priv->read_ahead)
+            read_ahead_stop( p_ctx->priv->read_ahead );
+
          if(p_ctx->priv->async_io)
             async_io_stop( p_ctx->priv->async_io );
          else if(p_ctx->priv->caches_num)
-            free(p_ctx->priv->caches.mem);
+            vc_container_io_mem_free(p_ctx->priv->caches.mem);
 
          for(i = 0; i < p_ctx->priv->cached_areas_num; i++)
             free(p_ctx->priv->cached_areas[i].mem);
          
+         /* Modules which write in the background report their errors when closing */
          if(p_ctx->pf_close)
-            p_ctx->pf_close(p_ctx);
+         {
+            close_status = p_ctx->pf_close(p_ctx);
+            if(status == VC_CONTAINER_SUCCESS) status = close_status;
+         }
       }
       vc_uri_release(p_ctx->uri_parts);
       free(p_ctx);
    }
-   return VC_CONTAINER_SUCCESS;
+   return status;
 }
 
 /*****************************************************************************/
@@ -315,6 +584,45 @@ size_t vc_container_io_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_
    return ret < 0 ? 0 : ret;
 }
 
+/*****************************************************************************/
+size_t vc_container_io_writev(VC_CONTAINER_IO_T *p_ctx, const VC_CONTAINER_IO_VEC_T *vec,
+   unsigned int count)
+{
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache = p_ctx->priv->cache;
+   size_t written = 0, size, ret;
+   unsigned int i, num;
+
+   for(i = 0; i < count; i += num)
+   {
+      /* Small buffers are cheaper to copy into the cache */
+      if(cache && vec[i].size < WRITEV_DIRECT_MIN_SIZE)
+      {
+         num = 1;
+         ret = vc_container_io_write(p_ctx, vec[i].buffer, vec[i].size);
+         written += ret;
+         if(ret != vec[i].size) break;
+         continue;
+      }
+
+      /* Group as many of the following large buffers as we can */
+      size = vec[i].size;
+      for(num = 1; i + num < count && num < WRITEV_MAX_VECS &&
+          (!cache || vec[i + num].size >= WRITEV_DIRECT_MIN_SIZE); num++)
+         size += vec[i + num].size;
+
+      if(cache)
+         ret = vc_container_io_cache_writev( p_ctx, cache, vec + i, num );
+      else
+         ret = vc_container_io_writev_stream( p_ctx, vec + i, num );
+
+      p_ctx->offset += ret;
+      written += ret;
+      if(ret != size) break;
+   }
+
+   return written;
+}
+
 /*****************************************************************************/
 size_t vc_container_io_skip(VC_CONTAINER_IO_T *p_ctx, size_t size)
 {
@@ -402,18 +710,47 @@ static VC_CONTAINER_STATUS_T io_seek_not_seekable(VC_CONTAINER_IO_T *p_ctx, int6
 VC_CONTAINER_STATUS_T vc_container_io_control_list(VC_CONTAINER_IO_T *context, VC_CONTAINER_CONTROL_T operation, va_list args)
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   uint32_t value = 0;
+
+   /* The module might consume the argument */
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_READ_BUFFER_SIZE ||
+      operation == VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD)
+   {
+      va_list copy;
+      va_copy(copy, args);
+      value = va_arg(copy, uint32_t);
+      va_end(copy);
+   }
+
+   /* Our cache needs to be written out before the module flushes its own buffers */
+   if(operation == VC_CONTAINER_CONTROL_IO_FLUSH && context->priv->cache)
+      (void)vc_container_io_cache_flush( context, context->priv->cache, 1 );
 
    if (context->pf_control)
       status = context->pf_control(context, operation, args);
 
    /* Option to add generic I/O control here */
 
-   if(operation == VC_CONTAINER_CONTROL_IO_FLUSH && context->priv->cache)
+   if(operation == VC_CONTAINER_CONTROL_IO_FLUSH && context->priv->cache &&
+      status == VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION)
+      status = VC_CONTAINER_SUCCESS;
+
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_READ_BUFFER_SIZE && context->priv->caches_num &&
+      context->priv->mode == VC_CONTAINER_IO_MODE_READ)
    {
+      /* This will be applied on the next refill */
+      context->priv->cache_size_override = 0;
+      if(value)
+         context->priv->cache_size_override =
+            vc_container_io_cache_round_size(value);
       status = VC_CONTAINER_SUCCESS;
-      (void)vc_container_io_cache_flush( context, context->priv->cache, 1 );
    }
 
+   /* Modules without our cache (e.g. memory mapped files) can do their own read-ahead */
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD &&
+      status == VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION)
+      status = read_ahead_start(context, value);
+
    if(operation == VC_CONTAINER_CONTROL_SET_IO_PERF_STATS && context->priv->async_io)
    {
       status = VC_CONTAINER_SUCCESS;
@@ -449,6 +786,14 @@ size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, *main_cache;
    VC_CONTAINER_STATUS_T status;
 
+   /* The whole stream is already in memory so there is nothing to cache */
+   if(p_ctx->pf_map && !private->cache)
+   {
+      if(vc_container_io_seek(p_ctx, p_ctx->offset + size) != VC_CONTAINER_SUCCESS)
+         return 0;
+      return size;
+   }
+
    /* Sanity checking */
    if(private->cached_areas_num >= MAX_NUM_CACHED_AREAS) return 0;
 
@@ -492,10 +837,10 @@ size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
    /* Read the rest of the cache directly from the stream */
    if(cache->mem_size > cache->size)
    {
-      size_t ret = cache->io->pf_read(cache->io, cache->buffer + cache->size,
-                                      cache->mem_size - cache->size);
+      size_t ret = vc_container_io_read_stream(cache->io, cache->offset + cache->size,
+                                               cache->buffer + cache->size,
+                                               cache->mem_size - cache->size);
       cache->size += ret;
-      cache->io->priv->actual_offset = cache->offset + cache->size;
    }
 
    status = vc_container_io_seek(p_ctx, cache->end);
@@ -508,6 +853,123 @@ size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
       return size;
 }
 
+/*****************************************************************************/
+size_t vc_container_io_map(VC_CONTAINER_IO_T *p_ctx, const void **data, size_t size)
+{
+   const uint8_t *ptr;
+
+   *data = NULL;
+   if(!p_ctx->pf_map || p_ctx->priv->cache)
+      return 0;
+
+   /* Like a peek, this doesn't change the status of the stream */
+   ptr = p_ctx->pf_map(p_ctx, p_ctx->offset, &size);
+   if(!ptr)
+      return 0;
+
+   *data = ptr;
+   return size;
+}
+
+/*****************************************************************************/
+static size_t vc_container_io_read_stream( VC_CONTAINER_IO_T *p_ctx, int64_t offset,
+   uint8_t *buffer, size_t size )
+{
+   size_t ret;
+
+   /* The data might already have been fetched in the background */
+   if(p_ctx->priv->read_ahead)
+      return read_ahead_read(p_ctx->priv->read_ahead, offset, buffer, size);
+
+   if(p_ctx->priv->actual_offset != offset)
+   {
+      if(p_ctx->pf_seek(p_ctx, offset) != VC_CONTAINER_SUCCESS)
+         return 0;
+   }
+
+   ret = p_ctx->pf_read(p_ctx, buffer, size);
+   p_ctx->priv->actual_offset = offset + ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static unsigned int vc_container_io_cache_round_size( uint32_t size )
+{
+   unsigned int rounded = MEM_CACHE_READ_MIN_SIZE;
+
+   /* Cache sizes need to be a power of 2 */
+   while(rounded < size && rounded < MEM_CACHE_READ_GROW_MAX_SIZE)
+      rounded <<= 1;
+   return rounded;
+}
+
+/*****************************************************************************/
+static uint8_t *vc_container_io_mem_alloc( size_t size, unsigned int alignment )
+{
+   uint8_t *mem, *aligned;
+
+   /* The pointer to release is stored just before the aligned memory */
+   mem = malloc(size + alignment + sizeof(void *));
+   if(!mem) return 0;
+   aligned = (uint8_t *)(((uintptr_t)mem + sizeof(void *) + alignment - 1) &
+                         ~(uintptr_t)(alignment - 1));
+   ((void **)aligned)[-1] = mem;
+   return aligned;
+}
+
+/*****************************************************************************/
+static void vc_container_io_mem_free( uint8_t *mem )
+{
+   if(mem) free(((void **)mem)[-1]);
+}
+
+/*****************************************************************************/
+static void vc_container_io_cache_adapt(VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = p_ctx->priv;
+   unsigned int size = cache->mem_max_size;
+   uint8_t *mem;
+
+   /* Keep track of the access pattern. Long sequential scans get a bigger
+    * window while seek-heavy accesses (e.g. index walks) get a smaller one. */
+   if(cache->offset == private->refill_end)
+   {
+      private->random_refills = 0;
+      if(++private->sequential_refills >= MEM_CACHE_SEQUENTIAL_REFILLS)
+      {
+         private->sequential_refills = 0;
+         if(size < MEM_CACHE_READ_GROW_MAX_SIZE) size <<= 1;
+      }
+   }
+   else
+   {
+      private->sequential_refills = 0;
+      if(++private->random_refills >= MEM_CACHE_RANDOM_REFILLS)
+      {
+         private->random_refills = 0;
+         if(size > MEM_CACHE_READ_MIN_SIZE) size >>= 1;
+      }
+   }
+
+   if(private->cache_size_override)
+      size = private->cache_size_override;
+   /* Keep room for at least one aligned block after the alignment shift */
+   if(size < 2 * private->mem_alignment)
+      size = 2 * private->mem_alignment;
+   if(size == cache->mem_max_size)
+      return;
+
+   /* The cache is empty at this point so there is nothing to preserve */
+   mem = vc_container_io_mem_alloc(size, private->mem_alignment);
+   if(!mem) return;
+   vc_container_io_mem_free(cache->mem);
+   cache->mem = mem;
+   cache->mem_max_size = cache->mem_size = size;
+   cache->buffer = cache->mem + (cache->offset & (private->mem_alignment - 1));
+   cache->buffer_end = cache->mem + cache->mem_size;
+}
+
 /*****************************************************************************/
 static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
@@ -516,16 +978,14 @@ static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
 
    if(ret) return 0; /* TODO what should we do there ? */
 
-   if(p_ctx->priv->actual_offset != cache->offset)
-   {
-      if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
-         return 0;
-   }
+   if(cache == &p_ctx->priv->caches && p_ctx->priv->mode == VC_CONTAINER_IO_MODE_READ)
+      vc_container_io_cache_adapt( p_ctx, cache );
 
-   ret = cache->io->pf_read(cache->io, cache->buffer, cache->buffer_end - cache->buffer);
+   ret = vc_container_io_read_stream(cache->io, cache->offset, cache->buffer,
+                                     cache->buffer_end - cache->buffer);
    cache->size = ret;
    cache->position = 0;
-   cache->io->priv->actual_offset = cache->offset + ret;
+   p_ctx->priv->refill_end = cache->offset + ret;
    return ret;
 }
 
@@ -537,16 +997,10 @@ static size_t vc_container_io_cache_refill_bypass( VC_CONTAINER_IO_T *p_ctx,
 
    if(ret) return 0; /* TODO what should we do there ? */
 
-   if(p_ctx->priv->actual_offset != cache->offset)
-   {
-      if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
-         return 0;
-   }
-
-   ret = cache->io->pf_read(cache->io, buffer, size);
+   ret = vc_container_io_read_stream(cache->io, cache->offset, buffer, size);
    cache->size = cache->position = 0;
    cache->offset += ret;
-   cache->io->priv->actual_offset = cache->offset;
+   p_ctx->priv->refill_end = cache->offset;
    return ret;
 }
 
@@ -657,6 +1111,81 @@ static int32_t vc_container_io_cache_write( VC_CONTAINER_IO_T *p_ctx,
    return written;
 }
 
+/*****************************************************************************/
+static size_t vc_container_io_writev_stream( VC_CONTAINER_IO_T *p_ctx,
+   const VC_CONTAINER_IO_VEC_T *vec, unsigned int count )
+{
+   size_t ret = 0, bytes;
+   unsigned int i;
+
+   if(p_ctx->pf_writev)
+      ret = p_ctx->pf_writev(p_ctx, vec, count);
+   else for(i = 0; i < count; i++)
+   {
+      bytes = p_ctx->pf_write(p_ctx, vec[i].buffer, vec[i].size);
+      ret += bytes;
+      if(bytes != vec[i].size) break;
+   }
+
+   p_ctx->priv->actual_offset += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t vc_container_io_cache_writev( VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, const VC_CONTAINER_IO_VEC_T *vec, unsigned int count )
+{
+   VC_CONTAINER_IO_VEC_T iov[WRITEV_MAX_VECS + 1];
+   size_t size = 0, cached = 0, written = 0, ret;
+   unsigned int i;
+   int32_t bytes;
+
+   /* Overwriting data which is already in the cache has to go through the cache */
+   if(cache->position != cache->size)
+   {
+      for(i = 0; i < count; i++)
+      {
+         bytes = vc_container_io_cache_write( p_ctx, cache, vec[i].buffer, vec[i].size );
+         if(bytes > 0) written += bytes;
+         if(bytes < 0 || (size_t)bytes != vec[i].size) break;
+      }
+      return written;
+   }
+
+   for(i = 0; i < count; i++) size += vec[i].size;
+
+   if(cache->dirty && !p_ctx->priv->async_io && cache->io->pf_writev)
+   {
+      /* Send the content of the cache along with the payload */
+      iov[0].buffer = cache->buffer;
+      iov[0].size = cached = cache->size;
+   }
+   else
+   {
+      /* Write back the cache. The async writer only deals with its own memory
+       * so we also need to wait for it to be done before using the stream. */
+      if(vc_container_io_cache_flush( p_ctx, cache, 1 )) return 0;
+      if(p_ctx->priv->async_io) async_io_wait_complete( p_ctx->priv->async_io, cache, 1 );
+   }
+   memcpy(iov + !!cached, vec, count * sizeof(*vec));
+
+   if(cache->io->priv->actual_offset != cache->offset + (int64_t)cache->size - (int64_t)cached)
+   {
+      if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
+         return 0;
+      cache->io->priv->actual_offset = cache->offset;
+   }
+
+   ret = vc_container_io_writev_stream( cache->io, iov, count + !!cached );
+   written = ret > cached ? ret - cached : 0;
+
+   /* The cache is now empty and starts right after the data we've just written */
+   cache->dirty = 0;
+   cache->offset += written;
+   vc_container_io_cache_flush( p_ctx, cache, 1 );
+   return written;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache, int64_t offset)
@@ -676,31 +1205,32 @@ static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx
       offset >= cache->offset - (int64_t)shift && offset < cache->offset)
    {
       /* We need to refill the partial bit of the cache that we didn't take care of last time */
-      status = cache->io->pf_seek(cache->io, cache->offset - shift);
-      if(status != VC_CONTAINER_SUCCESS) return status;
+      ret = vc_container_io_read_stream(cache->io, cache->offset - shift, cache->buffer - shift, shift);
+      if(ret != shift) return cache->io->status ? cache->io->status : VC_CONTAINER_ERROR_FAILED;
       cache->offset -= shift;
       cache->buffer -= shift;
-
-      ret = cache->io->pf_read(cache->io, cache->buffer, shift);
-      vc_container_assert(ret == shift); /* FIXME: ret must = shift */
       cache->size += shift;
       cache->position = offset - cache->offset;
-      cache->io->priv->actual_offset = cache->offset + ret;
       return VC_CONTAINER_SUCCESS;
    }
 
+   /* A failed flush is remembered in write_status and reported on close */
    if(cache->dirty) vc_container_io_cache_flush( p_ctx, cache, 1 );
-   // FIXME: what if all the data couldn't be flushed ?
 
    if(p_ctx->priv->async_io) async_io_wait_complete( p_ctx->priv->async_io, cache, 1 );
 
-   status = cache->io->pf_seek(cache->io, offset);
-   if(status != VC_CONTAINER_SUCCESS) return status;
+   /* With read-ahead the stream position belongs to the background thread and
+    * the next refill will take care of going to the right place */
+   if(!p_ctx->priv->read_ahead)
+   {
+      status = cache->io->pf_seek(cache->io, offset);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      cache->io->priv->actual_offset = offset;
+   }
 
    vc_container_io_cache_flush( p_ctx, cache, 1 );
 
    cache->offset = offset;
-   cache->io->priv->actual_offset = offset;
    return VC_CONTAINER_SUCCESS;
 }
 
@@ -719,7 +1249,10 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
          if(p_ctx->priv->async_io) async_io_wait_complete( p_ctx->priv->async_io, cache, complete );
 
          if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
+         {
+            p_ctx->priv->write_status = VC_CONTAINER_ERROR_FAILED;
             return 0;
+         }
       }
 
       if(p_ctx->priv->async_io)
@@ -731,15 +1264,20 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
       else
          ret = cache->io->pf_write(cache->io, cache->buffer, cache->size);
 
+      /* Remember the failure so it can still be reported when the stream is closed */
+      if(ret != cache->size && p_ctx->priv->write_status == VC_CONTAINER_SUCCESS)
+         p_ctx->priv->write_status = VC_CONTAINER_ERROR_FAILED;
+
       cache->io->priv->actual_offset = cache->offset + ret;
-      ret = cache->position - ret;
+      /* The position can be behind the end of the data after a seek back */
+      ret = cache->position > ret ? cache->position - ret : 0;
    }
    cache->dirty = 0;
 
    cache->offset += cache->size;
    if(cache->mem_size == cache->mem_max_size)
    {
-      shift = cache->offset &(MEM_CACHE_ALIGNMENT-1);
+      shift = cache->offset & (p_ctx->priv->mem_alignment - 1);
       cache->buffer = cache->mem + shift;
    }
 
@@ -980,7 +1518,8 @@ static VC_CONTAINER_IO_ASYNC_T *async_io_start( VC_CONTAINER_IO_T *io, int num_a
 
    for(ctx->num_area = 1; ctx->num_area < num_areas; ctx->num_area++)
    {
-      ctx->mem[ctx->num_area] = malloc(io->priv->cache->mem_size);
+      ctx->mem[ctx->num_area] = vc_container_io_mem_alloc(io->priv->cache->mem_size,
+         io->priv->mem_alignment);
       if(!ctx->mem[ctx->num_area])
          break;
    }
@@ -1035,7 +1574,7 @@ static VC_CONTAINER_STATUS_T async_io_stop( VC_CONTAINER_IO_ASYNC_T *ctx )
    vcos_semaphore_delete(&ctx->spare_sema);
 
    while(ctx->num_area > 0)
-      free(ctx->mem[--ctx->num_area]);
+      vc_container_io_mem_free(ctx->mem[--ctx->num_area]);
 
    free(ctx);
    return VC_CONTAINER_SUCCESS;
@@ -1085,4 +1624,330 @@ static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINE
 }
 
 
+#endif
+
+/*****************************************************************************
+ * Asynchronous read-ahead.
+ * This is here to hide the latency of the I/O from the reader by fetching the
+ * data following the current read position on a background thread while the
+ * reader is busy processing the data it already has.
+ *****************************************************************************/
+
+#ifdef ENABLE_CONTAINERS_READ_AHEAD
+#include "vcos.h"
+
+typedef enum
+{
+   READ_AHEAD_AREA_FREE = 0,
+   READ_AHEAD_AREA_BUSY,        /**< Being filled by the background thread */
+   READ_AHEAD_AREA_FILLED
+
+} READ_AHEAD_AREA_STATE_T;
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_AREA_T
+{
+   uint8_t *mem;
+   int64_t offset;              /**< Offset in the stream of the data held by the area */
+   size_t size;                 /**< Amount of valid data in the area */
+   unsigned int generation;     /**< Generation of the prefetching the area belongs to */
+   READ_AHEAD_AREA_STATE_T state;
+
+} VC_CONTAINER_IO_READ_AHEAD_AREA_T;
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_T
+{
+   VC_CONTAINER_IO_T *io;
+   VC_CONTAINER_IO_T shadow;    /**< Copy of the i/o used by the thread so it doesn't
+                                     clobber the status seen by the reader */
+   VCOS_THREAD_T thread;
+   VCOS_MUTEX_T lock;           /**< Protects the state of the areas */
+   VCOS_MUTEX_T io_lock;        /**< Serialises the calls into the i/o module */
+   VCOS_EVENT_T wake_event;     /**< Signalled when there might be an area to fill */
+   VCOS_EVENT_T done_event;     /**< Signalled when an area has been filled */
+   int quit;
+
+   unsigned int depth;
+   size_t area_size;
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T area[MAX_NUM_READ_AHEAD_AREAS];
+
+   int64_t next_offset;         /**< Offset of the next area to fetch */
+   unsigned int generation;     /**< Incremented every time the prefetched data is discarded */
+
+   bool eos;                    /**< Whether the thread has reached the end of the stream */
+   int64_t eos_offset;
+   VC_CONTAINER_STATUS_T eos_status;
+
+} VC_CONTAINER_IO_READ_AHEAD_T;
+
+/*****************************************************************************/
+static void *read_ahead_thread(void *argv)
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx = argv;
+   VC_CONTAINER_IO_PRIVATE_T *private = ctx->io->priv;
+
+   vcos_mutex_lock(&ctx->lock);
+   while(!ctx->quit)
+   {
+      VC_CONTAINER_IO_READ_AHEAD_AREA_T *area = 0;
+      unsigned int i, generation;
+      int64_t offset;
+      size_t ret = 0;
+
+      for(i = 0; !ctx->eos && !area && i < ctx->depth; i++)
+         if(ctx->area[i].state == READ_AHEAD_AREA_FREE) area = &ctx->area[i];
+
+      if(!area)
+      {
+         /* Nothing to do until the reader consumes some data */
+         vcos_mutex_unlock(&ctx->lock);
+         vcos_event_wait(&ctx->wake_event);
+         vcos_mutex_lock(&ctx->lock);
+         continue;
+      }
+
+      area->state = READ_AHEAD_AREA_BUSY;
+      area->offset = offset = ctx->next_offset;
+      area->generation = generation = ctx->generation;
+      ctx->next_offset += ctx->area_size;
+      vcos_mutex_unlock(&ctx->lock);
+
+      vcos_mutex_lock(&ctx->io_lock);
+      ctx->shadow.status = VC_CONTAINER_SUCCESS;
+      if(private->actual_offset == offset ||
+         ctx->shadow.pf_seek(&ctx->shadow, offset) == VC_CONTAINER_SUCCESS)
+      {
+         ret = ctx->shadow.pf_read(&ctx->shadow, area->mem, ctx->area_size);
+         private->actual_offset = offset + ret;
+      }
+      vcos_mutex_unlock(&ctx->io_lock);
+
+      vcos_mutex_lock(&ctx->lock);
+      area->size = ret;
+      area->state = (ret && generation == ctx->generation) ?
+         READ_AHEAD_AREA_FILLED : READ_AHEAD_AREA_FREE;
+
+      if(ret < ctx->area_size && generation == ctx->generation)
+      {
+         /* Stop prefetching until the reader tells us otherwise */
+         ctx->eos = true;
+         ctx->eos_offset = ctx->next_offset = offset + ret;
+         ctx->eos_status = ctx->shadow.status ? ctx->shadow.status : VC_CONTAINER_ERROR_EOS;
+      }
+      vcos_event_signal(&ctx->done_event);
+   }
+   vcos_mutex_unlock(&ctx->lock);
+
+   return NULL;
+}
+
+/*****************************************************************************/
+static size_t read_ahead_read( VC_CONTAINER_IO_READ_AHEAD_T *ctx, int64_t offset,
+                               uint8_t *buffer, size_t size )
+{
+   VC_CONTAINER_IO_T *io = ctx->io;
+   size_t read = 0, bytes, ret = 0;
+   unsigned int i;
+
+   vcos_mutex_lock(&ctx->lock);
+   while(size)
+   {
+      VC_CONTAINER_IO_READ_AHEAD_AREA_T *area = 0;
+
+      /* Find the area holding the data we're after */
+      for(i = 0; i < ctx->depth; i++)
+      {
+         VC_CONTAINER_IO_READ_AHEAD_AREA_T *current = &ctx->area[i];
+         int64_t end = current->offset + (int64_t)(current->state == READ_AHEAD_AREA_FILLED ?
+            current->size : ctx->area_size);
+
+         if(current->state == READ_AHEAD_AREA_FREE || current->generation != ctx->generation)
+            continue;
+
+         /* The reader has skipped past this one */
+         if(current->state == READ_AHEAD_AREA_FILLED && end <= offset)
+         {
+            current->state = READ_AHEAD_AREA_FREE;
+            vcos_event_signal(&ctx->wake_event);
+            continue;
+         }
+
+         if(offset >= current->offset && offset < end)
+            area = current;
+      }
+
+      if(area && area->state == READ_AHEAD_AREA_BUSY)
+      {
+         /* The data is on its way */
+         vcos_mutex_unlock(&ctx->lock);
+         vcos_event_wait(&ctx->done_event);
+         vcos_mutex_lock(&ctx->lock);
+         continue;
+      }
+
+      if(area)
+      {
+         bytes = MIN(size, (size_t)(area->offset + area->size - offset));
+         memcpy(buffer + read, area->mem + (offset - area->offset), bytes);
+         offset += bytes;
+         read += bytes;
+         size -= bytes;
+
+         /* Hand the area back to the thread once it has been consumed */
+         if(offset == area->offset + (int64_t)area->size)
+         {
+            area->state = READ_AHEAD_AREA_FREE;
+            vcos_event_signal(&ctx->wake_event);
+         }
+         continue;
+      }
+
+      if(ctx->eos && offset >= ctx->eos_offset)
+      {
+         /* The thread has already found the end of the stream. Don't make
+          * this sticky so we will try again if the reader insists. */
+         io->status = ctx->eos_status;
+         ctx->eos = false;
+         break;
+      }
+
+      /* This isn't data we have prefetched (e.g. after a seek) so discard
+       * everything, read it synchronously and restart prefetching after it */
+      ctx->generation++;
+      for(i = 0; i < ctx->depth; i++)
+         if(ctx->area[i].state == READ_AHEAD_AREA_FILLED)
+            ctx->area[i].state = READ_AHEAD_AREA_FREE;
+      ctx->eos = false;
+      ctx->next_offset = offset + size;
+      vcos_mutex_unlock(&ctx->lock);
+
+      vcos_mutex_lock(&ctx->io_lock);
+      if(io->priv->actual_offset == offset ||
+         io->pf_seek(io, offset) == VC_CONTAINER_SUCCESS)
+      {
+         ret = io->pf_read(io, buffer + read, size);
+         io->priv->actual_offset = offset + ret;
+      }
+      vcos_mutex_unlock(&ctx->io_lock);
+
+      vcos_mutex_lock(&ctx->lock);
+      if(ret < size) ctx->next_offset = offset + ret;
+      vcos_event_signal(&ctx->wake_event);
+      read += ret;
+      break;
+   }
+   vcos_mutex_unlock(&ctx->lock);
+
+   return read;
+}
+
+/*****************************************************************************/
+static void read_ahead_stop( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   unsigned int i;
+
+   vcos_mutex_lock(&ctx->lock);
+   ctx->quit = 1;
+   vcos_mutex_unlock(&ctx->lock);
+   vcos_event_signal(&ctx->wake_event);
+   vcos_thread_join(&ctx->thread, NULL);
+
+   vcos_event_delete(&ctx->done_event);
+   vcos_event_delete(&ctx->wake_event);
+   vcos_mutex_delete(&ctx->io_lock);
+   vcos_mutex_delete(&ctx->lock);
+
+   for(i = 0; i < ctx->depth; i++)
+      free(ctx->area[i].mem);
+
+   ctx->io->priv->read_ahead = 0;
+   free(ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int depth )
+{
+   VC_CONTAINER_IO_PRIVATE_T *private = io->priv;
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx;
+
+   /* Read-ahead only makes sense for seekable streams going through our cache */
+   if(private->mode != VC_CONTAINER_IO_MODE_READ || !private->caches_num ||
+      (io->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK))
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   if(depth > MAX_NUM_READ_AHEAD_AREAS) depth = MAX_NUM_READ_AHEAD_AREAS;
+   if(private->read_ahead && private->read_ahead->depth == depth)
+      return VC_CONTAINER_SUCCESS;
+
+   if(private->read_ahead) read_ahead_stop(private->read_ahead);
+   if(!depth) return VC_CONTAINER_SUCCESS;
+
+   /* Allocate our context */
+   ctx = malloc(sizeof(*ctx));
+   if(!ctx) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->io = io;
+   ctx->shadow = *io;
+   ctx->area_size = private->caches.mem_max_size;
+   ctx->next_offset = private->caches.offset + private->caches.size;
+
+   for(ctx->depth = 0; ctx->depth < depth; ctx->depth++)
+   {
+      ctx->area[ctx->depth].mem = malloc(ctx->area_size);
+      if(!ctx->area[ctx->depth].mem) goto error_mem;
+   }
+
+   if(vcos_mutex_create(&ctx->lock, "read_ahead_lock") != VCOS_SUCCESS)
+      goto error_mem;
+   if(vcos_mutex_create(&ctx->io_lock, "read_ahead_io_lock") != VCOS_SUCCESS)
+      goto error_io_lock;
+   if(vcos_event_create(&ctx->wake_event, "read_ahead_wake_event") != VCOS_SUCCESS)
+      goto error_wake_event;
+   if(vcos_event_create(&ctx->done_event, "read_ahead_done_event") != VCOS_SUCCESS)
+      goto error_done_event;
+
+   if(vcos_thread_create(&ctx->thread, "io_read_ahead", NULL, read_ahead_thread, ctx) != VCOS_SUCCESS)
+      goto error_thread;
+
+   private->read_ahead = ctx;
+   return VC_CONTAINER_SUCCESS;
+
+ error_thread:
+   vcos_event_delete(&ctx->done_event);
+ error_done_event:
+   vcos_event_delete(&ctx->wake_event);
+ error_wake_event:
+   vcos_mutex_delete(&ctx->io_lock);
+ error_io_lock:
+   vcos_mutex_delete(&ctx->lock);
+ error_mem:
+   while(ctx->depth > 0)
+      free(ctx->area[--ctx->depth].mem);
+   free(ctx);
+   return VC_CONTAINER_ERROR_FAILED;
+}
+
+#else
+
+static VC_CONTAINER_STATUS_T read_ahead_start( VC_CONTAINER_IO_T *io, unsigned int depth )
+{
+   VC_CONTAINER_PARAM_UNUSED(io);
+   VC_CONTAINER_PARAM_UNUSED(depth);
+   return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+}
+
+static void read_ahead_stop( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+}
+
+static size_t read_ahead_read( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int64_t offset,
+                               uint8_t *buffer, size_t size )
+{
+   VC_CONTAINER_PARAM_UNUSED(ctx);
+   VC_CONTAINER_PARAM_UNUSED(offset);
+   VC_CONTAINER_PARAM_UNUSED(buffer);
+   VC_CONTAINER_PARAM_UNUSED(size);
+   return 0;
+}
+
 #endif
@@ -60,6 +60,14 @@ typedef uint32_t VC_CONTAINER_IO_CAPABILITIES_T;
 #define VC_CONTAINER_IO_CAPS_NO_CACHING   0x4
 /* @} */
 
+/** Description of one of the buffers passed to \ref vc_container_io_writev */
+typedef struct VC_CONTAINER_IO_VEC_T
+{
+   const void *buffer; /**< Pointer to the data to write */
+   size_t size;        /**< Size of the data to write */
+
+} VC_CONTAINER_IO_VEC_T;
+
 /** Container Input / Output Context.
  * This structure defines the context for a container io instance */
 struct VC_CONTAINER_IO_T
@@ -95,6 +103,11 @@ struct VC_CONTAINER_IO_T
     * to limit the size of the stream to below this value. */
    int64_t max_size;
 
+   /** Alignment in bytes that the memory and stream offsets of the data written to the
+    * i/o module should ideally have (0 if the module doesn't care). This is set by modules
+    * bypassing the system's page cache so the core can lay out its write cache accordingly. */
+   uint32_t alignment;
+
    /** \note the following list of function pointers should not be used directly.
     * They defines the interface for implementing container io modules and are filled in
     * by the container modules themselves. */
@@ -121,10 +134,29 @@ struct VC_CONTAINER_IO_T
    VC_CONTAINER_STATUS_T (*pf_control)(struct VC_CONTAINER_IO_T *io, 
                                        VC_CONTAINER_CONTROL_T operation, va_list args);
 
+   /** \private
+    * Function pointer to get direct access to the data of a container io module which
+    * keeps the whole stream in memory (optional). On return, size is updated with the
+    * number of bytes which are contiguously available at the returned address. */
+   const uint8_t *(*pf_map)(struct VC_CONTAINER_IO_T *io, int64_t offset, size_t *size);
+
+   /** \private
+    * Function pointer to write a list of buffers in a single operation (optional).
+    * Returns the total number of bytes written. */
+   size_t (*pf_writev)(struct VC_CONTAINER_IO_T *io, const VC_CONTAINER_IO_VEC_T *vec,
+                       unsigned int count);
+
 };
 
 /** Opens an i/o stream pointed to by a URI.
  * This will create an instance of the container i/o module.
+ * Local files are read through io_uring when the kernel supports it. Writing through
+ * io_uring is opt-in and has to be asked for with the uring: scheme, other local files
+ * are written by the plain file module.
+ * Local files can be read through a memory mapping by using the mmap: scheme. This
+ * installs a process-wide SIGBUS handler the first time it is used, which passes the
+ * signals it doesn't handle on to the handler that was installed before it. A handler
+ * installed later by the application must do the same.
  *
  * \param  uri         Uniform Resource Identifier pointing to the multimedia container
  * \param  mode        Mode in which the i/o stream will be opened
@@ -150,9 +182,71 @@ VC_CONTAINER_IO_T *vc_container_io_create( const char *uri, VC_CONTAINER_IO_MODE
                                            VC_CONTAINER_IO_CAPABILITIES_T capabilities,
                                            VC_CONTAINER_STATUS_T *p_status );
 
+/** Creates an i/o stream reading from memory, using the "mem:" i/o module.
+ * The stream is made of a chain of buffers which can keep growing while the stream is
+ * being read (see \ref vc_container_io_mem_append). The buffers are used in place and
+ * must stay valid until the i/o is closed.
+ *
+ * \param  data        Pointer to the first buffer of the stream (can be NULL)
+ * \param  size        Size of the first buffer (can be 0)
+ * \param  status      Returns the status of the operation
+ * \return             If successful, this returns a pointer to the new instance
+ *                     of the i/o module. Returns NULL on failure.
+ */
+VC_CONTAINER_IO_T *vc_container_io_mem_create( const void *data, size_t size,
+                                               VC_CONTAINER_STATUS_T *status );
+
+/** Appends a buffer to the end of an i/o stream created with \ref vc_container_io_mem_create.
+ * This can be called from another thread than the one reading the stream. Reading past the
+ * data appended so far signals VC_CONTAINER_ERROR_EOS, so data needs to be appended ahead
+ * of what the reader needs. The size of the i/o only includes the new data once the stream
+ * has been accessed again by the reading thread.
+ *
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  data        Pointer to the buffer to append, which must stay valid until the i/o
+ *                     is closed
+ * \param  size        Size of the buffer
+ * \return             Status of the operation
+ */
+VC_CONTAINER_STATUS_T vc_container_io_mem_append( VC_CONTAINER_IO_T *context,
+                                                  const void *data, size_t size );
+
+/** Type definition for the function used to open an instance of an i/o module.
+ * The function returns VC_CONTAINER_SUCCESS if the module can handle the URI, in which
+ * case it will have filled in the function pointers of the i/o instance. */
+typedef VC_CONTAINER_STATUS_T (*VC_CONTAINER_IO_MODULE_OPEN_FUNC_T)( VC_CONTAINER_IO_T *io,
+   const char *uri, VC_CONTAINER_IO_MODE_T mode );
+
+/** Registers an i/o module.
+ * When an i/o stream is opened, only the modules which have registered the scheme of
+ * its URI, as well as the modules which have registered to be tried for any URI, are
+ * probed. They are probed in decreasing order of priority and the most recently
+ * registered module comes first when priorities are equal. The built-in modules use
+ * priorities between 0 (plain file access, tried for any URI) and 100.
+ *
+ * \param  name        Name of the module, used to unregister it
+ * \param  schemes     NULL terminated list of URI schemes handled by the module. An empty
+ *                     string stands for URIs without a scheme. A NULL list means the
+ *                     module will be tried for any URI.
+ * \param  priority    Priority of the module
+ * \param  pf_open     Function used to open an instance of the module
+ * \return             VC_CONTAINER_SUCCESS on success.
+ */
+VC_CONTAINER_STATUS_T vc_container_io_module_register( const char *name, const char * const *schemes,
+   int priority, VC_CONTAINER_IO_MODULE_OPEN_FUNC_T pf_open );
+
+/** Unregisters an i/o module. Built-in modules can also be unregistered.
+ * \param  name        Name the module was registered with
+ * \return             VC_CONTAINER_SUCCESS on success, VC_CONTAINER_ERROR_NOT_FOUND if
+ *                     there is no module with this name.
+ */
+VC_CONTAINER_STATUS_T vc_container_io_module_unregister( const char *name );
+
 /** Closes an instance of a container i/o module.
+ * Any data still pending is written out first.
  * \param  context     Pointer to the VC_CONTAINER_IO_T context of the instance to close
- * \return             VC_CONTAINER_SUCCESS on success.
+ * \return             VC_CONTAINER_SUCCESS on success, otherwise the error of the pending
+ *                     data which couldn't be written.
  */
 VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *context );
 
@@ -187,6 +281,19 @@ size_t vc_container_io_skip(VC_CONTAINER_IO_T *context, size_t size);
  */
 size_t vc_container_io_write(VC_CONTAINER_IO_T *context, const void *buffer, size_t size);
 
+/** Write a list of buffers to an i/o stream.
+ * Small buffers are copied into the write cache as with \ref vc_container_io_write
+ * but large ones are written straight from the caller's memory, together with
+ * whatever is pending in the cache. The buffers can be reused as soon as the
+ * function returns.
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  vec         Array of buffers to write
+ * \param  count       Number of entries in the array
+ * \return             The size of the data actually written.
+ */
+size_t vc_container_io_writev(VC_CONTAINER_IO_T *context, const VC_CONTAINER_IO_VEC_T *vec,
+                              unsigned int count);
+
 /** Seek into an i/o stream.
  * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
  * \param  offset      Absolute file offset to seek to
@@ -220,6 +327,20 @@ VC_CONTAINER_STATUS_T vc_container_io_control(VC_CONTAINER_IO_T *context,
  */
 size_t vc_container_io_cache(VC_CONTAINER_IO_T *context, size_t size);
 
+/** Get direct access to the data of an i/o stream without copying it and without
+ * advancing the read position within the stream.
+ * This is only supported by i/o modules which keep the stream in memory (e.g. memory
+ * mapped files). The returned pointer stays valid until the i/o is closed.
+ * Unlike reads, accesses to the returned data aren't protected against the file
+ * being truncated underneath (this raises SIGBUS with memory mapped files).
+ * \param  context     Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  data        Returns a pointer to the data at the current position
+ * \param  size        Number of bytes requested
+ * \return             The number of bytes available at the returned address. Returns 0
+ *                     if the i/o doesn't support direct access.
+ */
+size_t vc_container_io_map(VC_CONTAINER_IO_T *context, const void **data, size_t size);
+
 /* @} */
 
 #ifdef __cplusplus
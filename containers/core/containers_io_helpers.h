@@ -534,6 +534,38 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
    return ret == 8 ? VC_CONTAINER_SUCCESS : VC_CONTAINER_ERROR_FAILED;
 }
 
+/*****************************************************************************
+ * Helper inline function to read the data of a packet from an i/o stream
+ *****************************************************************************/
+
+/** Reads the data of a packet from an i/o stream.
+ * When VC_CONTAINER_READ_FLAG_NO_COPY is given and the i/o gives direct access to
+ * all the requested data, the packet is pointed at that data and flagged as a
+ * reference instead of getting a copy of it. The caller's buffer is kept in the
+ * packet so it can be given back when the reference is released.
+ * \param  io          Pointer to the VC_CONTAINER_IO_T instance to use
+ * \param  packet      Packet to read the data into
+ * \param  size        Number of bytes to read
+ * \param  flags       Flags of the read operation
+ * \return             The number of bytes read
+ */
+STATIC_INLINE size_t vc_container_io_read_packet_data(VC_CONTAINER_IO_T *io,
+   VC_CONTAINER_PACKET_T *packet, size_t size, VC_CONTAINER_READ_FLAGS_T flags)
+{
+   const void *data;
+
+   if((flags & VC_CONTAINER_READ_FLAG_NO_COPY) && size &&
+      vc_container_io_map(io, &data, size) == size)
+   {
+      packet->buffer = packet->data;
+      packet->data = (uint8_t *)(uintptr_t)data; /* Packet data is read-only in this case */
+      packet->flags |= VC_CONTAINER_PACKET_FLAG_REFERENCE;
+      return vc_container_io_skip(io, size);
+   }
+
+   return vc_container_io_read(io, packet->data, size);
+}
+
 /*****************************************************************************
  * Helper macros for accessing the i/o stream. These will also call the right
  * functions depending on the endianness defined.
@@ -552,6 +584,7 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
 
 #define PEEK_BYTES(ctx, buffer, size) vc_container_io_peek((ctx)->priv->io, buffer, (size_t)(size))
 #define READ_BYTES(ctx, buffer, size) vc_container_io_read((ctx)->priv->io, buffer, (size_t)(size))
+#define READ_PACKET_BYTES(ctx, packet, size, flags) vc_container_io_read_packet_data((ctx)->priv->io, packet, (size_t)(size), flags)
 #define SKIP_BYTES(ctx, size) vc_container_io_skip((ctx)->priv->io, (size_t)(size))
 #define SEEK(ctx, off) vc_container_io_seek((ctx)->priv->io, (int64_t)(off))
 #define CACHE_BYTES(ctx, size) vc_container_io_cache((ctx)->priv->io, (size_t)(size))
@@ -596,6 +629,7 @@ STATIC_INLINE VC_CONTAINER_STATUS_T vc_container_io_write_le_uint64(VC_CONTAINER
 #endif
 
 #define WRITE_BYTES(ctx, buffer, size) vc_container_io_write((ctx)->priv->io, buffer, (size_t)(size))
+#define WRITEV_BYTES(ctx, vec, count) vc_container_io_writev((ctx)->priv->io, vec, count)
 #define _WRITE_GUID(ctx, buffer) vc_container_io_write((ctx)->priv->io, buffer, 16)
 #define _WRITE_U8(ctx, v)  vc_container_io_write_uint8((ctx)->priv->io, v)
 #define _WRITE_FOURCC(ctx, v) vc_container_io_write_fourcc((ctx)->priv->io, v)
@@ -100,6 +100,21 @@ typedef struct VC_CONTAINER_PRIVATE_T
    VC_CONTAINER_STATUS_T (*pf_read)( VC_CONTAINER_T *context,
       VC_CONTAINER_PACKET_T *packet, VC_CONTAINER_READ_FLAGS_T flags );
 
+   /** Reads several data packets from a container reader (optional).
+    * Only needs implementing if the reader can do this faster than successive calls to
+    * pf_read. It is only used when no flags are given and when no track is packetized or
+    * encrypted. Only packets from enabled tracks must be returned and
+    * VC_CONTAINER_ERROR_CONTINUE must not be returned.
+    *
+    * \param  context       Pointer to the context of the reader to use
+    * \param  packets       Array of VC_CONTAINER_PACKET_T structures describing the data packets
+    * \param  packets_num   Number of packets in the array
+    * \param  packets_read  Number of packets actually read will be filled here
+    * \return               the status of the operation
+    */
+   VC_CONTAINER_STATUS_T (*pf_read_batch)( VC_CONTAINER_T *context,
+      VC_CONTAINER_PACKET_T *packets, unsigned int packets_num, unsigned int *packets_read );
+
    /** Writes a data packet to a container writer.
     *
     * \param  context   Pointer to the context of the writer to use
@@ -168,6 +183,9 @@ typedef struct VC_CONTAINER_PRIVATE_T
    /** Temporary buffer used by the packetizer */
    uint8_t *packetizer_buffer;
 
+   /** Number of packets read with VC_CONTAINER_READ_FLAG_NO_COPY which haven't been released yet */
+   unsigned int references;
+
 } VC_CONTAINER_PRIVATE_T;
 
 /* Internal functions */
@@ -0,0 +1,262 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "containers/containers.h"
+#include "containers/containers_remux.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+#include "containers/core/containers_utils.h"
+#include "containers/core/containers_uri.h"
+#include "vcos.h"
+
+/******************************************************************************
+Type definitions
+******************************************************************************/
+typedef struct VC_CONTAINER_REMUX_BATCH_T
+{
+   VC_CONTAINER_REMUX_JOB_T *jobs;
+   unsigned int jobs_num;
+   const VC_CONTAINER_REMUX_PARAMS_T *params;
+
+   VCOS_MUTEX_T lock;      /**< Protects next_job */
+   unsigned int next_job;  /**< Index of the next job to hand out */
+
+} VC_CONTAINER_REMUX_BATCH_T;
+
+/******************************************************************************
+Local Functions
+******************************************************************************/
+static VC_CONTAINER_STATUS_T remux_add_tracks( VC_CONTAINER_T *reader, VC_CONTAINER_T *writer,
+   uint32_t *mapping, bool packetize )
+{
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   for(i = 0; i < reader->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_T *track = reader->tracks[i];
+      if(!track->is_enabled) continue;
+
+      if(packetize && !(track->format->flags & VC_CONTAINER_ES_FORMAT_FLAG_FRAMED))
+      {
+         status = vc_container_control(reader, VC_CONTAINER_CONTROL_TRACK_PACKETIZE,
+                                       i, track->format->codec_variant);
+         if(status != VC_CONTAINER_SUCCESS)
+            LOG_DEBUG(reader, "packetization not supported on track %u (%i)", i, status);
+      }
+
+      mapping[i] = writer->tracks_num;
+      status = vc_container_control(writer, VC_CONTAINER_CONTROL_TRACK_ADD, track->format);
+      if(status != VC_CONTAINER_SUCCESS)
+      {
+         LOG_DEBUG(writer, "unsupported track type %4.4s (%i)", (char *)&track->format->codec, status);
+         track->is_enabled = false; /* The reader will now skip its data */
+      }
+   }
+
+   if(!writer->tracks_num)
+      return VC_CONTAINER_ERROR_NO_TRACK_AVAILABLE;
+
+   return vc_container_control(writer, VC_CONTAINER_CONTROL_TRACK_ADD_DONE);
+}
+
+/*****************************************************************************/
+/* Removes what a failed job left of its output so it can't be mistaken for a good
+   stream. Only local files can be removed. */
+static void remux_delete_output( const char *output )
+{
+   static const char * const local_schemes[] = { "file", "direct", "mmap", "uring", 0 };
+   VC_URI_PARTS_T *uri = vc_uri_create();
+   const char *scheme, *path;
+   unsigned int i = 0;
+
+   if(!uri) return;
+   if(vc_uri_parse(uri, output))
+   {
+      scheme = vc_uri_scheme(uri);
+      path = vc_uri_path(uri);
+      while(scheme && local_schemes[i] && strcasecmp(scheme, local_schemes[i])) i++;
+      if((!scheme || local_schemes[i]) && path && remove(path))
+         LOG_DEBUG(0, "failed to remove %s", path);
+   }
+   vc_uri_release(uri);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T remux_job_run( VC_CONTAINER_REMUX_JOB_T *job,
+   const VC_CONTAINER_REMUX_PARAMS_T *params )
+{
+   VC_CONTAINER_STATUS_T status, close_status;
+   VC_CONTAINER_T *reader = NULL, *writer = NULL;
+   VC_CONTAINER_PACKET_T packet;
+   uint32_t buffer_size = params->buffer_size ? params->buffer_size : VC_CONTAINER_REMUX_BUFFER_SIZE;
+   uint32_t *mapping = NULL;
+   uint8_t *buffer;
+
+   buffer = malloc(buffer_size);
+   if(!buffer)
+      return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+
+   reader = vc_container_open_reader(job->input, &status, 0, 0);
+   if(!reader) goto end;
+
+   writer = vc_container_open_writer(job->output, &status, 0, 0);
+   if(!writer)
+   {
+      /* The output was already created if only finding a writer for it failed */
+      if(status != VC_CONTAINER_ERROR_URI_NOT_FOUND && status != VC_CONTAINER_ERROR_URI_OPEN_FAILED)
+         remux_delete_output(job->output);
+      goto end;
+   }
+
+   mapping = malloc(MAX(reader->tracks_num, 1) * sizeof(*mapping));
+   if(!mapping) {status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto end;}
+
+   status = remux_add_tracks(reader, writer, mapping, params->packetize);
+   if(status != VC_CONTAINER_SUCCESS) goto end;
+   job->tracks_num = writer->tracks_num;
+
+   memset(&packet, 0, sizeof(packet));
+   while(1)
+   {
+      packet.data = buffer;
+      packet.buffer_size = buffer_size;
+      packet.size = 0;
+      status = vc_container_read(reader, &packet, 0);
+      if(status == VC_CONTAINER_ERROR_CONTINUE) continue;
+      if(status != VC_CONTAINER_SUCCESS) break;
+
+      packet.track = mapping[packet.track];
+      status = vc_container_write(writer, &packet);
+      if(status != VC_CONTAINER_SUCCESS) break;
+
+      job->packets++;
+      job->bytes += packet.size;
+   }
+
+   /* Reaching the end of the input is the normal way out */
+   if(status == VC_CONTAINER_ERROR_EOS)
+      status = VC_CONTAINER_SUCCESS;
+
+ end:
+   if(reader) vc_container_close(reader);
+   if(writer)
+   {
+      /* This is where the writer flushes its data and writes its index */
+      close_status = vc_container_close(writer);
+      if(status == VC_CONTAINER_SUCCESS)
+         status = close_status;
+      if(status != VC_CONTAINER_SUCCESS)
+         remux_delete_output(job->output);
+   }
+   free(mapping);
+   free(buffer);
+   return status;
+}
+
+/*****************************************************************************/
+static void *remux_worker( void *arg )
+{
+   VC_CONTAINER_REMUX_BATCH_T *batch = arg;
+   VC_CONTAINER_REMUX_JOB_T *job;
+
+   while(1)
+   {
+      vcos_mutex_lock(&batch->lock);
+      job = batch->next_job < batch->jobs_num ? &batch->jobs[batch->next_job++] : NULL;
+      vcos_mutex_unlock(&batch->lock);
+      if(!job) break;
+
+      job->status = remux_job_run(job, batch->params);
+      if(job->status != VC_CONTAINER_SUCCESS)
+         LOG_ERROR(0, "failed to remux %s into %s (%i)", job->input, job->output, job->status);
+
+      if(batch->params->pf_done)
+         batch->params->pf_done(job, batch->params->done_userdata);
+   }
+
+   return NULL;
+}
+
+/*****************************************************************************
+Functions exported as part of the Remux API
+ *****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_remux( VC_CONTAINER_REMUX_JOB_T *jobs, unsigned int jobs_num,
+   const VC_CONTAINER_REMUX_PARAMS_T *params )
+{
+   static const VC_CONTAINER_REMUX_PARAMS_T default_params;
+   VC_CONTAINER_REMUX_BATCH_T batch;
+   VCOS_THREAD_T *threads = NULL;
+   unsigned int i, threads_num;
+
+   if(!jobs && jobs_num)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   memset(&batch, 0, sizeof(batch));
+   batch.jobs = jobs;
+   batch.jobs_num = jobs_num;
+   batch.params = params ? params : &default_params;
+
+   for(i = 0; i < jobs_num; i++)
+   {
+      jobs[i].status = VC_CONTAINER_ERROR_NOT_READY;
+      jobs[i].tracks_num = 0;
+      jobs[i].packets = jobs[i].bytes = 0;
+   }
+
+   if(vcos_mutex_create(&batch.lock, "vc_container_remux") != VCOS_SUCCESS)
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   /* No point in having more workers than jobs */
+   threads_num = MIN(MAX(batch.params->threads, 1), VC_CONTAINER_REMUX_THREADS_MAX);
+   threads_num = MIN(threads_num, jobs_num);
+
+   /* The calling thread is one of the workers */
+   if(threads_num > 1)
+      threads = malloc((threads_num - 1) * sizeof(*threads));
+   for(i = 0; threads && i < threads_num - 1; i++)
+      if(vcos_thread_create(&threads[i], "vc_container_remux", NULL, remux_worker, &batch) != VCOS_SUCCESS)
+         break;
+   threads_num = threads ? i : 0;
+
+   /* This also makes sure the batch still gets processed if no worker thread could be created */
+   remux_worker(&batch);
+
+   for(i = 0; i < threads_num; i++)
+      vcos_thread_join(&threads[i], NULL);
+   free(threads);
+   vcos_mutex_delete(&batch.lock);
+
+   for(i = 0; i < jobs_num; i++)
+      if(jobs[i].status != VC_CONTAINER_SUCCESS)
+         return jobs[i].status;
+
+   return VC_CONTAINER_SUCCESS;
+}
@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "containers/core/containers_startcode.h"
+
+/* Define STARTCODE_NO_SIMD to only build the scalar search */
+#if defined(STARTCODE_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define STARTCODE_SSE2
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define STARTCODE_NEON
+# include <arm_neon.h>
+#endif
+
+#define STARTCODE_BLOCK 16
+
+/*****************************************************************************/
+size_t vc_container_find_startcodes( const uint8_t *data, size_t size,
+   size_t *offsets, size_t offsets_max )
+{
+   size_t i = 0, found = 0;
+
+   if(!offsets_max)
+      return 0;
+
+   /* Look at 16 possible positions at once. A start code begins at every
+    * position where the byte and the next one are zero and the one after
+    * that is one. */
+#if defined(STARTCODE_SSE2)
+   {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i one = _mm_set1_epi8(1);
+      unsigned int mask, bit;
+
+      for(; i + STARTCODE_BLOCK + 2 <= size; i += STARTCODE_BLOCK)
+      {
+         __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+         __m128i b = _mm_loadu_si128((const __m128i *)(data + i + 1));
+         __m128i c = _mm_loadu_si128((const __m128i *)(data + i + 2));
+         mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)),
+            _mm_cmpeq_epi8(c, one)));
+
+         for(bit = 0; mask; bit++, mask >>= 1)
+         {
+            if(!(mask & 1)) continue;
+            offsets[found++] = i + bit;
+            if(found == offsets_max) return found;
+         }
+      }
+   }
+#elif defined(STARTCODE_NEON)
+   {
+      const uint8x16_t zero = vdupq_n_u8(0);
+      const uint8x16_t one = vdupq_n_u8(1);
+      unsigned int bit;
+
+      for(; i + STARTCODE_BLOCK + 2 <= size; i += STARTCODE_BLOCK)
+      {
+         uint8x16_t m = vandq_u8(vandq_u8(vceqq_u8(vld1q_u8(data + i), zero),
+            vceqq_u8(vld1q_u8(data + i + 1), zero)), vceqq_u8(vld1q_u8(data + i + 2), one));
+         uint64x2_t m64 = vreinterpretq_u64_u8(m);
+
+         if(!(vgetq_lane_u64(m64, 0) | vgetq_lane_u64(m64, 1)))
+            continue;
+
+         /* There's no cheap movemask on NEON, hits are rare anyway */
+         for(bit = 0; bit < STARTCODE_BLOCK; bit++)
+         {
+            if(data[i + bit] || data[i + bit + 1] || data[i + bit + 2] != 1) continue;
+            offsets[found++] = i + bit;
+            if(found == offsets_max) return found;
+         }
+      }
+   }
+#endif
+
+   /* Scalar search for what's left. The third byte tells us how far we can
+    * skip: anything above one rules out a start code at the three positions
+    * it could be part of. */
+   while(i + 3 <= size)
+   {
+      if(data[i + 2] > 1)
+         i += 3;
+      else if(data[i + 2] == 0)
+         i++;
+      else
+      {
+         if(!data[i] && !data[i + 1])
+         {
+            offsets[found++] = i;
+            if(found == offsets_max) return found;
+         }
+         i += 3;
+      }
+   }
+
+   return found;
+}
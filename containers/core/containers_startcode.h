@@ -0,0 +1,49 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef VC_CONTAINERS_STARTCODE_H
+#define VC_CONTAINERS_STARTCODE_H
+
+/** \file containers_startcode.h
+ * Search for the 00 00 01 start code prefix used by MPEG elementary streams,
+ * program streams and H.264 byte streams. Uses SSE2 or NEON when available.
+ */
+
+#include "containers/containers.h"
+
+/**
+ * Finds the start code prefixes (00 00 01) contained in a buffer.
+ * @param data         Buffer to search.
+ * @param size         Size of the buffer.
+ * @param offsets      Filled with the offsets of the start codes found, in increasing order.
+ * @param offsets_max  Maximum number of offsets to return. The search stops
+ *                     once that many start codes have been found.
+ * @return             Number of start codes found.
+ */
+size_t vc_container_find_startcodes( const uint8_t *data, size_t size,
+   size_t *offsets, size_t offsets_max );
+
+#endif /* VC_CONTAINERS_STARTCODE_H */
@@ -56,9 +56,14 @@ Defines.
 #define FLV_SCRIPT_DATA_TYPE_NUMBER      0
 #define FLV_SCRIPT_DATA_TYPE_BOOL        1
 #define FLV_SCRIPT_DATA_TYPE_STRING      2
+#define FLV_SCRIPT_DATA_TYPE_OBJECT      3
 #define FLV_SCRIPT_DATA_TYPE_ECMA        8
+#define FLV_SCRIPT_DATA_TYPE_OBJECT_END  9
+#define FLV_SCRIPT_DATA_TYPE_STRICT     10
 #define FLV_SCRIPT_DATA_TYPE_LONGSTRING 12
 
+#define MAX_METADATA_STRING_SIZE 25
+
 #define FLV_FLAG_DISCARD    1
 #define FLV_FLAG_KEYFRAME   2
 #define FLV_FLAG_INTERFRAME 4
@@ -106,6 +111,14 @@ typedef struct VC_CONTAINER_MODULE_T
    uint32_t meta_width;
    uint32_t meta_height;
 
+   /* Keyframe index from the metadata, only kept until the index is created */
+   int64_t *meta_keyframes_times;
+   int64_t *meta_keyframes_positions;
+   uint32_t meta_keyframes_times_num;
+   uint32_t meta_keyframes_positions_num;
+
+   bool save_index; /*< save the index to a sidecar file on close */
+
 } VC_CONTAINER_MODULE_T;
 
 /******************************************************************************
@@ -327,6 +340,120 @@ static VC_CONTAINER_STATUS_T flv_read_audiodata_properties(VC_CONTAINER_T *p_ctx
    return STREAM_STATUS(p_ctx);
 }
 
+/** Reads an AMF number.
+  * This is stored as a big endian double which we convert without relying
+  * on the platform's floating point representation.
+  *
+  * @param p_ctx              pointer to our context
+  * @return                   value of the number
+  */
+static double flv_read_number(VC_CONTAINER_T *p_ctx)
+{
+   uint64_t u_value = _READ_U64(p_ctx);
+   int64_t value = ((u_value & ((UINT64_C(1)<<52)-1)) + (UINT64_C(1)<<52)) * ((((int64_t)u_value)>>63)|1);
+   int exp = ((u_value>>52)&0x7FF)-1075 + 16;
+
+   if(exp < -63) return 0; /* zero or too small to matter */
+   if(exp >= 0) value <<= exp;
+   else value >>= -exp;
+   return ((double)value) / (1 << 16);
+}
+
+/** Reads the keyframes object of an FLV metadata tag.
+  * This is the index of keyframes some muxers add to the metadata. It is made
+  * of arrays with the time and file position of each keyframe.
+  *
+  * @param p_ctx              pointer to our context
+  * @param size               size of the data left in the tag
+  * @return                   size of the data left in the tag after the object
+  *                            or -1 if the object couldn't be parsed
+  */
+static int flv_read_metadata_keyframes(VC_CONTAINER_T *p_ctx, int size)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   char psz_string[MAX_METADATA_STRING_SIZE+1];
+   uint32_t i, num_values;
+   uint16_t length;
+   uint8_t type;
+
+   while(size >= 3)
+   {
+      length = _READ_U16(p_ctx); size -= 2;
+      if(length >= size || length > MAX_METADATA_STRING_SIZE) return -1;
+      if(READ_BYTES(p_ctx, psz_string, length) != length) return -1;
+      psz_string[length] = 0; size -= length;
+      type = _READ_U8(p_ctx); size--;
+
+      if(!length && type == FLV_SCRIPT_DATA_TYPE_OBJECT_END)
+         return size;
+
+      if(type == FLV_SCRIPT_DATA_TYPE_STRICT)
+      {
+         int64_t **pp_values = 0;
+         uint32_t *p_num = 0;
+         double scale = 1.0;
+
+         if(size < 4) return -1;
+         num_values = _READ_U32(p_ctx); size -= 4;
+         if(num_values > (uint32_t)size / 9) return -1;
+
+         if(!strcmp(psz_string, "times"))
+         {
+            pp_values = &module->meta_keyframes_times;
+            p_num = &module->meta_keyframes_times_num;
+            scale = 1000000.0; /* seconds to microseconds */
+         }
+         else if(!strcmp(psz_string, "filepositions"))
+         {
+            pp_values = &module->meta_keyframes_positions;
+            p_num = &module->meta_keyframes_positions_num;
+         }
+
+         if(pp_values && !*pp_values && num_values)
+         {
+            *pp_values = malloc(num_values * sizeof(**pp_values));
+            if(!*pp_values) return -1;
+            *p_num = num_values;
+         }
+         else pp_values = 0;
+
+         for(i = 0; i < num_values; i++)
+         {
+            type = _READ_U8(p_ctx); size--;
+            if(type != FLV_SCRIPT_DATA_TYPE_NUMBER) return -1;
+            if(pp_values) (*pp_values)[i] = (int64_t)(flv_read_number(p_ctx) * scale);
+            else _SKIP_U64(p_ctx);
+            size -= 8;
+         }
+         LOG_DEBUG(p_ctx, "metadata keyframes (%s, %i entries)", psz_string, (int)num_values);
+         continue;
+      }
+
+      /* We don't care about anything else in there */
+      switch(type)
+      {
+      case FLV_SCRIPT_DATA_TYPE_NUMBER:
+         if(size < 8) return -1;
+         _SKIP_U64(p_ctx); size -= 8;
+         continue;
+      case FLV_SCRIPT_DATA_TYPE_BOOL:
+         if(size < 1) return -1;
+         _SKIP_U8(p_ctx); size -= 1;
+         continue;
+      case FLV_SCRIPT_DATA_TYPE_STRING:
+         if(size < 2) return -1;
+         length = _READ_U16(p_ctx); size -= 2;
+         if(length > size) return -1;
+         SKIP_BYTES(p_ctx, length); size -= length;
+         continue;
+      default:
+         return -1;
+      }
+   }
+
+   return -1;
+}
+
 /** Reads an FLV metadata tag.
   * This contains metadata information about the stream.
   * All the data we extract from this will be placed directly in the context.
@@ -338,7 +465,6 @@ static VC_CONTAINER_STATUS_T flv_read_audiodata_properties(VC_CONTAINER_T *p_ctx
 static int flv_read_metadata(VC_CONTAINER_T *p_ctx, int size)
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
-#define MAX_METADATA_STRING_SIZE 25
    char psz_string[MAX_METADATA_STRING_SIZE+1];
    uint16_t length, num_values;
    double f_value;
@@ -373,15 +499,7 @@ static int flv_read_metadata(VC_CONTAINER_T *p_ctx, int size)
          /* We only cope with DOUBLE types*/
          if(size < 8) return VC_CONTAINER_SUCCESS;
 
-         u_value = _READ_U64(p_ctx); size -= 8;
-         /* Convert value into a double */
-         {
-            int64_t value = ((u_value & ((UINT64_C(1)<<52)-1)) + (UINT64_C(1)<<52)) * ((((int64_t)u_value)>>63)|1);
-            int exp = ((u_value>>52)&0x7FF)-1075 + 16;
-            if(exp >= 0) value <<= exp;
-            else value >>= -exp;
-            f_value = ((double)value) / (1 << 16);
-         }
+         f_value = flv_read_number(p_ctx); size -= 8;
 
          LOG_DEBUG(p_ctx, "metadata (%s=%i.%i)", psz_string,
                    ((int)(f_value*100))/100, ((int)(f_value*100))%100);
@@ -415,11 +533,19 @@ static int flv_read_metadata(VC_CONTAINER_T *p_ctx, int size)
          LOG_DEBUG(p_ctx, "metadata skipping (%s)", psz_string);
          continue;
 
+      case FLV_SCRIPT_DATA_TYPE_OBJECT:
+         if(strcmp(psz_string, "keyframes")) break;
+         size = flv_read_metadata_keyframes(p_ctx, size);
+         if(size < 0) return VC_CONTAINER_SUCCESS;
+         continue;
+
       /* We can't cope with anything else */
       default:
-         LOG_DEBUG(p_ctx, "unknown amf type (%s,%i)", psz_string, type);
-         return VC_CONTAINER_SUCCESS;
+         break;
       }
+
+      LOG_DEBUG(p_ctx, "unknown amf type (%s,%i)", psz_string, type);
+      return VC_CONTAINER_SUCCESS;
    }
 
    return STREAM_STATUS(p_ctx);
@@ -715,6 +841,60 @@ static VC_CONTAINER_STATUS_T flv_find_previous_frame(VC_CONTAINER_T *p_ctx, int
    return status;
 }
 
+/** Adds the keyframes listed in the metadata to the index.
+  * The file positions point at the tags whereas the index points at the
+  * PreviousTagSize field preceding them. The list is only used if it is
+  * ordered, fits in the stream and its first entry is a video tag.
+  *
+  * @param p_ctx              pointer to our context
+  */
+static void flv_index_metadata_keyframes(VC_CONTAINER_T *p_ctx)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t i, num = MIN(module->meta_keyframes_times_num, module->meta_keyframes_positions_num);
+   int64_t *times = module->meta_keyframes_times, *positions = module->meta_keyframes_positions;
+   int64_t size = p_ctx->priv->io->size;
+
+   if(!num || !module->state.index || module->video_track < 0) return;
+
+   for(i = 0; i < num; i++)
+   {
+      if(positions[i] < module->data_offset + 4 || (size > 0 && positions[i] >= size)) break;
+      if(i && (positions[i] <= positions[i-1] || times[i] < times[i-1])) break;
+   }
+   if(i != num)
+   {
+      LOG_DEBUG(p_ctx, "invalid metadata keyframe %i", i);
+      return;
+   }
+
+   if(SEEK(p_ctx, positions[0]) != VC_CONTAINER_SUCCESS ||
+      READ_U8(p_ctx, "TagType") != FLV_TAG_TYPE_VIDEO)
+   {
+      LOG_DEBUG(p_ctx, "metadata keyframes don't point at video tags");
+      return;
+   }
+
+   for(i = 0; i < num; i++)
+      vc_container_index_add(module->state.index, times[i], positions[i] - 4);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T flv_reader_control( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_SAVE_SEEK_INDEX:
+      module->save_index = va_arg(args, uint32_t) != 0;
+      return VC_CONTAINER_SUCCESS;
+   default:
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T flv_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -725,8 +905,14 @@ static VC_CONTAINER_STATUS_T flv_reader_close( VC_CONTAINER_T *p_ctx )
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
 
    if(module->state.index)
+   {
+      if(module->save_index)
+         vc_container_index_save(module->state.index, p_ctx->priv->io);
       vc_container_index_free(module->state.index);
+   }
 
+   free(module->meta_keyframes_times);
+   free(module->meta_keyframes_positions);
    free(module);
    return VC_CONTAINER_SUCCESS;
 }
@@ -1111,9 +1297,20 @@ VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T *p_ctx )
 
    /* Try and create an index.  All times are signed, so adding a base timestamp
     * of zero means that we will always seek back to the start of the file, even if
-    * the actual frame timestamps start at some higher number. */
-   if(vc_container_index_create(&module->state.index, 512) == VC_CONTAINER_SUCCESS)
+    * the actual frame timestamps start at some higher number. An index saved
+    * by a previous session already starts with that entry. Otherwise we start
+    * with the keyframes listed in the metadata, if any, and the index keeps
+    * growing as frames are read. */
+   if(vc_container_index_load(&module->state.index, p_ctx->priv->io, 512) != VC_CONTAINER_SUCCESS &&
+      vc_container_index_create(&module->state.index,
+         MAX(512, (int)module->meta_keyframes_times_num)) == VC_CONTAINER_SUCCESS)
+   {
       vc_container_index_add(module->state.index, 0LL, (int64_t) data_offset);
+      flv_index_metadata_keyframes(p_ctx);
+   }
+   free(module->meta_keyframes_times);
+   free(module->meta_keyframes_positions);
+   module->meta_keyframes_times = module->meta_keyframes_positions = 0;
 
    /* Use the metadata we read */
    if(module->audio_track >= 0)
@@ -1155,6 +1352,7 @@ VC_CONTAINER_STATUS_T flv_reader_open( VC_CONTAINER_T *p_ctx )
    p_ctx->priv->pf_close = flv_reader_close;
    p_ctx->priv->pf_read = flv_reader_read;
    p_ctx->priv->pf_seek = flv_reader_seek;
+   p_ctx->priv->pf_control = flv_reader_control;
 
    return VC_CONTAINER_SUCCESS;
 
@@ -24,26 +24,345 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
 
+#if !defined(_MSC_VER) && !defined(_VIDEOCORE)
+# define IO_FILE_POSIX
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/uio.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <errno.h>
+#endif
+
 #include "containers/containers.h"
 #include "containers/core/containers_common.h"
 #include "containers/core/containers_io.h"
 #include "containers/core/containers_uri.h"
 
+#define IO_FILE_MAX_IOVECS 16
+#define IO_FILE_DIRECT_BOUNCE_SIZE (64*1024)
+#define IO_FILE_DIRECT_BLOCK_SIZE_MIN 512
+#define IO_FILE_DIRECT_BLOCK_SIZE_DEFAULT 4096
+
+#if defined(IO_FILE_POSIX) && defined(O_DIRECT)
+# define IO_FILE_DIRECT
+#endif
+
+/* Plain file i/o module.
+ * On POSIX platforms the file is accessed with pread/pwrite using 64 bits
+ * offsets so there is no limit on the size of the files we can read or write.
+ * Other platforms fall back to stdio.
+ *
+ * Using the "direct" URI scheme (e.g. direct:/mnt/sd/video.mp4) opens the file
+ * with O_DIRECT so the data bypasses the page cache. Transfers then need to be
+ * aligned on the device block size. Whatever isn't (the start and end of the
+ * data or badly aligned buffers) goes through a small aligned bounce buffer,
+ * and the block padding is truncated away when the file is closed. */
+
 typedef struct VC_CONTAINER_IO_MODULE_T
 {
+#ifdef IO_FILE_POSIX
+   int fd;
+   int64_t position;   /**< Current position into the file */
+   bool sequential;    /**< Pipe or character device, no positioned i/o */
+
+   uint32_t block_size;   /**< Alignment required by O_DIRECT (0 if not in direct mode) */
+   uint8_t *bounce;       /**< Aligned bounce buffer for partial blocks */
+   uint8_t *bounce_mem;   /**< Allocated memory for the bounce buffer */
+   int64_t bounce_offset; /**< Offset of the block held at the start of the bounce buffer (-1 if none) */
+   int64_t size;          /**< Size of the data in the file, without the block padding */
+#else
    FILE *stream;
+#endif
 
 } VC_CONTAINER_IO_MODULE_T;
 
 VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *, const char *,
    VC_CONTAINER_IO_MODE_T );
 
+#ifdef IO_FILE_POSIX
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   struct stat st;
+
+   /* Get rid of the padding added to write the last block of the file */
+   if(module->block_size && !fstat(module->fd, &st) && st.st_size != module->size)
+   {
+      while(ftruncate(module->fd, (off_t)module->size) < 0 && errno == EINTR);
+   }
+
+   close(module->fd);
+   free(module->bounce_mem);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static size_t io_file_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = 0;
+
+   while(ret < size)
+   {
+      ssize_t bytes = module->sequential ?
+         read(module->fd, (uint8_t *)buffer + ret, size - ret) :
+         pread(module->fd, (uint8_t *)buffer + ret, size - ret,
+               (off_t)(module->position + ret));
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes <= 0)
+      {
+         p_ctx->status = bytes ? VC_CONTAINER_ERROR_FAILED : VC_CONTAINER_ERROR_EOS;
+         break;
+      }
+      ret += bytes;
+   }
+
+   module->position += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_file_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = 0;
+
+   while(ret < size)
+   {
+      ssize_t bytes = module->sequential ?
+         write(module->fd, (const uint8_t *)buffer + ret, size - ret) :
+         pwrite(module->fd, (const uint8_t *)buffer + ret, size - ret,
+                (off_t)(module->position + ret));
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes <= 0) break;
+      ret += bytes;
+   }
+
+   module->position += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_file_writev(VC_CONTAINER_IO_T *p_ctx, const VC_CONTAINER_IO_VEC_T *vec,
+   unsigned int count)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   struct iovec iov[IO_FILE_MAX_IOVECS];
+   size_t ret = 0, left;
+   unsigned int num;
+   ssize_t bytes;
+
+   while(count)
+   {
+      for(num = 0; num < count && num < IO_FILE_MAX_IOVECS; num++)
+      {
+         iov[num].iov_base = (void *)(uintptr_t)vec[num].buffer;
+         iov[num].iov_len = vec[num].size;
+      }
+
+      bytes = module->sequential ? writev(module->fd, iov, num) :
+         pwritev(module->fd, iov, num, (off_t)module->position);
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes <= 0) break;
+      module->position += bytes;
+      ret += bytes;
+
+      /* Skip the buffers which have been written entirely */
+      for(; count && (size_t)bytes >= vec->size; vec++, count--)
+         bytes -= vec->size;
+
+      /* And finish off the one which was only partially written */
+      if(count && bytes)
+      {
+         left = vec->size - bytes;
+         bytes = io_file_write(p_ctx, (const uint8_t *)vec->buffer + bytes, left);
+         ret += bytes;
+         if((size_t)bytes != left) break;
+         vec++, count--;
+      }
+   }
+
+   return ret;
+}
+
+#ifdef IO_FILE_DIRECT
+/*****************************************************************************/
+static bool io_file_direct_load(VC_CONTAINER_IO_MODULE_T *module, uint8_t *block, int64_t offset)
+{
+   ssize_t bytes = 0;
+
+   /* Check if we already have this block */
+   if(block == module->bounce && offset == module->bounce_offset)
+      return true;
+
+   while(offset < module->size)
+   {
+      bytes = pread(module->fd, block, module->block_size, (off_t)offset);
+      if(bytes >= 0 || errno != EINTR) break;
+   }
+   if(bytes < 0) return false;
+
+   /* Anything past the end of the data reads as zeros */
+   memset(block + bytes, 0, module->block_size - bytes);
+   return true;
+}
+
+/*****************************************************************************/
+static size_t io_file_direct_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   uint32_t mask = module->block_size - 1;
+   size_t ret = 0, head, length;
+   int64_t start;
+   ssize_t bytes;
+
+   /* Everything goes through the bounce buffer since neither the position
+    * nor the caller's buffer are likely to be aligned */
+   module->bounce_offset = -1;
+   while(ret < size)
+   {
+      head = (module->position + ret) & mask;
+      start = module->position + ret - head;
+      length = MIN((head + size - ret + mask) & ~(size_t)mask, IO_FILE_DIRECT_BOUNCE_SIZE);
+
+      bytes = pread(module->fd, module->bounce, length, (off_t)start);
+      if(bytes < 0 && errno == EINTR) continue;
+      if(bytes < 0) { p_ctx->status = VC_CONTAINER_ERROR_FAILED; break; }
+
+      /* Don't return the block padding */
+      if(start + bytes > module->size) bytes = MAX(module->size - start, 0);
+      if((size_t)bytes <= head) { p_ctx->status = VC_CONTAINER_ERROR_EOS; break; }
+
+      bytes = MIN((size_t)bytes - head, size - ret);
+      memcpy((uint8_t *)buffer + ret, module->bounce + head, bytes);
+      ret += bytes;
+   }
+
+   module->position += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_file_direct_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   uint32_t mask = module->block_size - 1;
+   size_t ret = 0, head, left, length, done;
+   const uint8_t *data;
+   int64_t start;
+   ssize_t bytes;
+
+   while(ret < size)
+   {
+      data = (const uint8_t *)buffer + ret;
+      start = module->position + ret;
+      head = start & mask;
+      left = size - ret;
+
+      if(!head && left > mask && !((uintptr_t)data & mask))
+      {
+         /* Everything is nicely aligned so write straight from the caller's memory */
+         bytes = pwrite(module->fd, data, left & ~(size_t)mask, (off_t)start);
+         if(bytes < 0 && errno == EINTR) continue;
+         if(bytes <= 0) break;
+         if(module->bounce_offset >= start && module->bounce_offset < start + bytes)
+            module->bounce_offset = -1;
+         ret += bytes;
+         continue;
+      }
+
+      /* Otherwise go through the bounce buffer. If the data becomes aligned after the
+       * first block, only that block is bounced and the rest is written directly. */
+      left = MIN(left, IO_FILE_DIRECT_BOUNCE_SIZE - head);
+      if(head && !((uintptr_t)(data + module->block_size - head) & mask))
+         left = MIN(left, module->block_size - head);
+      start -= head;
+      length = (head + left + mask) & ~(size_t)mask;
+
+      /* Partial blocks need to be merged with what's already in the file */
+      if(head && !io_file_direct_load(module, module->bounce, start))
+         break;
+      if(((head + left) & mask) && (!head || length > module->block_size) &&
+         !io_file_direct_load(module, module->bounce + length - module->block_size,
+                              start + length - module->block_size))
+         break;
+
+      module->bounce_offset = -1;
+      memcpy(module->bounce + head, data, left);
+
+      for(done = 0; done < length; done += bytes)
+      {
+         bytes = pwrite(module->fd, module->bounce + done, length - done, (off_t)(start + done));
+         if(bytes < 0 && errno == EINTR) { bytes = 0; continue; }
+         if(bytes <= 0) break;
+      }
+      if(done < length) break;
+
+      /* Keep the last block around as the next write is likely to start there */
+      if(length > module->block_size)
+         memmove(module->bounce, module->bounce + length - module->block_size, module->block_size);
+      module->bounce_offset = start + length - module->block_size;
+      ret += left;
+   }
+
+   module->position += ret;
+   if(module->position > module->size) module->size = module->position;
+   return ret;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file_direct_open(VC_CONTAINER_IO_T *p_ctx, const struct stat *st)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   uint32_t block_size = st->st_blksize;
+
+   /* The preferred i/o size is a safe bet for the alignment the device needs */
+   if(block_size < IO_FILE_DIRECT_BLOCK_SIZE_MIN || block_size > IO_FILE_DIRECT_BOUNCE_SIZE / 2 ||
+      (block_size & (block_size - 1)))
+      block_size = IO_FILE_DIRECT_BLOCK_SIZE_DEFAULT;
+
+   module->bounce_mem = malloc(IO_FILE_DIRECT_BOUNCE_SIZE + block_size);
+   if(!module->bounce_mem) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   module->bounce = (uint8_t *)(((uintptr_t)module->bounce_mem + block_size - 1) &
+                                ~(uintptr_t)(block_size - 1));
+   module->bounce_offset = -1;
+   module->block_size = block_size;
+   module->size = st->st_size;
+
+   p_ctx->pf_read = io_file_direct_read;
+   p_ctx->pf_write = io_file_direct_write;
+   p_ctx->pf_writev = 0; /* iovecs would all need to be aligned */
+   p_ctx->alignment = block_size;
+   return VC_CONTAINER_SUCCESS;
+}
+#endif /* IO_FILE_DIRECT */
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   if(offset < 0 || (module->sequential && offset != module->position))
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+      return p_ctx->status;
+   }
+
+   /* Reads beyond the end of the file will signal EOS */
+   module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+#else /* !IO_FILE_POSIX */
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T io_file_close( VC_CONTAINER_IO_T *p_ctx )
 {
@@ -80,18 +399,12 @@ static VC_CONTAINER_STATUS_T io_file_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offs
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    int ret;
 
-   //FIXME: large file support
-#ifdef _VIDEOCORE
+#if defined(_VIDEOCORE)
    extern int fseek64(FILE *fp, int64_t offset, int whence);
    ret = fseek64(p_ctx->module->stream, offset, SEEK_SET);
-#else
-   if (offset > (int64_t)UINT_MAX)
-   {
-      p_ctx->status = VC_CONTAINER_ERROR_EOS;
-      return VC_CONTAINER_ERROR_EOS;
-   }
-   ret = fseek(p_ctx->module->stream, (long)offset, SEEK_SET);
-#endif   
+#elif defined(_MSC_VER)
+   ret = _fseeki64(p_ctx->module->stream, offset, SEEK_SET);
+#endif
    if(ret)
    {
       if( feof(p_ctx->module->stream) ) status = VC_CONTAINER_ERROR_EOS;
@@ -101,6 +414,7 @@ static VC_CONTAINER_STATUS_T io_file_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offs
    p_ctx->status = status;
    return status;
 }
+#endif /* IO_FILE_POSIX */
 
 /*****************************************************************************/
 VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *p_ctx,
@@ -108,47 +422,84 @@ VC_CONTAINER_STATUS_T vc_container_io_file_open( VC_CONTAINER_IO_T *p_ctx,
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = 0;
-   const char *psz_mode = mode == VC_CONTAINER_IO_MODE_WRITE ? "wb+" : "rb";
    const char *uri = p_ctx->uri;
+#ifdef IO_FILE_POSIX
+   int flags = mode == VC_CONTAINER_IO_MODE_WRITE ? O_RDWR|O_CREAT|O_TRUNC : O_RDONLY;
+   const char *scheme = vc_uri_scheme(p_ctx->uri_parts);
+   bool direct = scheme && !strcasecmp(scheme, "direct");
+   struct stat st;
+   int fd = -1;
+#else
+   const char *psz_mode = mode == VC_CONTAINER_IO_MODE_WRITE ? "wb+" : "rb";
    FILE *stream = 0;
+#endif
    VC_CONTAINER_PARAM_UNUSED(unused);
 
    if(vc_uri_path(p_ctx->uri_parts))
       uri = vc_uri_path(p_ctx->uri_parts);
 
+#ifdef IO_FILE_POSIX
+#ifdef IO_FILE_DIRECT
+   /* Not all file systems support direct i/o, we'll just use the page cache on those */
+   fd = direct ? open(uri, flags|O_DIRECT, 0666) : -1;
+   if(fd < 0 && direct && errno != EINVAL) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+   direct = fd >= 0;
+#else
+   direct = false;
+#endif
+   if(fd < 0) fd = open(uri, flags, 0666);
+   if(fd < 0) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+   if(fstat(fd, &st)) { status = VC_CONTAINER_ERROR_FAILED; goto error; }
+#else
    stream = fopen(uri, psz_mode);
    if(!stream) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
 
    /* Turn off buffering. The container layer will provide its own cache */
    setvbuf(stream, NULL, _IONBF, 0);
+#endif
 
    module = malloc( sizeof(*module) );
    if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
    memset(module, 0, sizeof(*module));
 
    p_ctx->module = module;
-   module->stream = stream;
    p_ctx->pf_close = io_file_close;
    p_ctx->pf_read = io_file_read;
    p_ctx->pf_write = io_file_write;
    p_ctx->pf_seek = io_file_seek;
 
-   if(mode == VC_CONTAINER_IO_MODE_WRITE)
+#ifdef IO_FILE_POSIX
+   p_ctx->pf_writev = io_file_writev;
+   module->fd = fd;
+   module->sequential = !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode);
+   if(mode != VC_CONTAINER_IO_MODE_WRITE && !module->sequential)
+      p_ctx->size = st.st_size;
+#ifdef IO_FILE_DIRECT
+   if(direct && !module->sequential)
    {
-      p_ctx->max_size = (1UL<<31)-1; /* For now limit to 2GB */
+      status = io_file_direct_open(p_ctx, &st);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
    }
-   else
+#endif
+#else
+   module->stream = stream;
+   if(mode != VC_CONTAINER_IO_MODE_WRITE)
    {
-      //FIXME: large file support, platform-specific file size
-      fseek(p_ctx->module->stream, 0, SEEK_END);
-      p_ctx->size = ftell(p_ctx->module->stream);
-      fseek(p_ctx->module->stream, 0, SEEK_SET);
+      fseek(stream, 0, SEEK_END);
+      p_ctx->size = ftell(stream);
+      fseek(stream, 0, SEEK_SET);
    }
+#endif
 
    p_ctx->capabilities = VC_CONTAINER_IO_CAPS_NO_CACHING;
    return VC_CONTAINER_SUCCESS;
 
  error:
+#ifdef IO_FILE_POSIX
+   if(fd >= 0) close(fd);
+   free(module);
+#else
    if(stream) fclose(stream);
+#endif
    return status;
 }
@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "containers/core/containers_list.h"
 #include "containers/core/containers_utils.h"
 #include "containers/net/net_sockets.h"
+#include "vcos.h"
 
 /* Set to 1 if you want to log all HTTP requests */
 #define ENABLE_HTTP_EXTRA_LOGGING 0
@@ -81,6 +82,8 @@ Defines and constants.
 #define CONTENT_LOCATION_NAME          "Content-Location"
 #define ACCEPT_RANGES_NAME             "Accept-Ranges"
 #define CONNECTION_NAME                "Connection"
+#define ETAG_NAME                      "ETag"
+#define LAST_MODIFIED_NAME             "Last-Modified"
 /* @} */
 
 /** Supported HTTP major version number */
@@ -88,6 +91,22 @@ Defines and constants.
 /** Supported HTTP minor version number */
 #define HTTP_MINOR_VERSION             1
 
+/** Size of the byte ranges requested from the server */
+#define HTTP_SEGMENT_SIZE              (64*1024)
+
+/** Number of segments kept in the cache */
+#define HTTP_CACHE_SEGMENTS            64
+
+/** Maximum number of connections used to fetch segments in parallel */
+#define HTTP_CONNECTIONS_MAX           4
+
+/** Number of segments requested ahead of the read position */
+#define HTTP_PREFETCH_SEGMENTS         (HTTP_CONNECTIONS_MAX - 1)
+
+/** Number of closed resources whose segments are kept in case they get opened again.
+ * All of them together hold at most HTTP_CACHE_SEGMENTS segments. */
+#define HTTP_SHARED_CACHE_ENTRIES      4
+
 /** Lowest successful status code value */
 #define HTTP_STATUS_OK                 200
 #define HTTP_STATUS_PARTIAL_CONTENT    206
@@ -101,14 +120,47 @@ typedef struct http_header_tag {
 /******************************************************************************
 Type definitions
 ******************************************************************************/
+
+/** Byte range of the resource held in memory */
+typedef struct http_segment_tag {
+   int64_t offset;                              /**< Offset of the range, -1 if unused */
+   size_t size;                                 /**< Size of the range */
+   uint32_t last_used;                          /**< For least recently used replacement */
+   uint8_t *data;
+} HTTP_SEGMENT_T;
+
+/** Connection to the server used to fetch segments */
+typedef struct http_connection_tag {
+   VC_CONTAINER_NET_T *sock;
+   int64_t pending;                             /**< Offset of the segment requested, -1 if idle */
+} HTTP_CONNECTION_T;
+
+/** Segments of a resource which was closed, kept for the next time its URI is opened */
+typedef struct http_cache_entry_tag {
+   char *uri;                                   /**< URI of the resource, NULL if unused */
+   char *validator;                             /**< ETag or Last-Modified value of the resource */
+   int64_t size;                                /**< Size of the resource */
+   uint32_t last_used;                          /**< For least recently used replacement */
+   uint32_t segment_clock;
+   unsigned int segments_num;                   /**< Number of segments holding data */
+   HTTP_SEGMENT_T segment[HTTP_CACHE_SEGMENTS];
+} HTTP_CACHE_ENTRY_T;
+
 typedef struct VC_CONTAINER_IO_MODULE_T
 {
-   VC_CONTAINER_NET_T *sock;
+   VC_CONTAINER_NET_T *sock;                    /**< Socket used for the current request */
    VC_CONTAINERS_LIST_T *header_list;           /**< Parsed response headers, pointing into comms buffer */
 
    bool persistent;
    int64_t cur_offset;
-   bool reconnecting;
+   char *validator;                             /**< ETag or Last-Modified value, NULL if none */
+
+   HTTP_CONNECTION_T connection[HTTP_CONNECTIONS_MAX];
+   HTTP_SEGMENT_T segment[HTTP_CACHE_SEGMENTS];
+   uint32_t segment_clock;
+
+   uint32_t read_buffer_size;                   /**< Settings applied to new connections, 0 if unset */
+   uint32_t read_timeout_ms;
 
    /* Buffer used for sending and receiving HTTP messages */
    char comms_buffer[COMMS_BUFFER_SIZE];
@@ -124,6 +176,18 @@ static VC_CONTAINER_STATUS_T io_http_send(VC_CONTAINER_IO_T *p_ctx);
 VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *, const char *,
    VC_CONTAINER_IO_MODE_T);
 
+/******************************************************************************
+Local variables
+******************************************************************************/
+
+/** Segments of closed resources, shared by all the instances of the module */
+static HTTP_CACHE_ENTRY_T io_http_cache[HTTP_SHARED_CACHE_ENTRIES];
+static unsigned int io_http_cache_segments;     /**< Number of segments held by all the entries */
+static uint32_t io_http_cache_clock;
+static VCOS_MUTEX_T io_http_cache_lock;
+static bool io_http_cache_lock_created;
+static VCOS_ONCE_T io_http_cache_once = VCOS_ONCE_INIT;
+
 /******************************************************************************
 Local Functions
 ******************************************************************************/
@@ -491,12 +555,14 @@ static VC_CONTAINER_STATUS_T io_http_read_response(VC_CONTAINER_IO_T *p_ctx)
 }
 
 /**************************************************************************//**
- * Send a GET request to the HTTP server.
+ * Send a GET request for a byte range to the HTTP server.
  *
  * @param p_ctx      The reader context.
+ * @param offset     Start of the byte range.
+ * @param size       Size of the byte range.
  * @return  The resulting status of the function.
  */
-static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx, size_t size)
+static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx, int64_t offset, size_t size)
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
    char *ptr = module->comms_buffer, *end = ptr + sizeof(module->comms_buffer);
@@ -505,12 +571,12 @@ static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx,
    ptr += snprintf(ptr, end - ptr, HTTP_REQUEST_LINE_FORMAT, GET_METHOD,
                    vc_uri_path(p_ctx->uri_parts), vc_uri_host(p_ctx->uri_parts));
 
-   end_offset = module->cur_offset + size - 1;
+   end_offset = offset + size - 1;
    if (end_offset >= p_ctx->size)
       end_offset = p_ctx->size - 1;
 
    if (ptr < end)
-      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST, module->cur_offset, end_offset);
+      ptr += snprintf(ptr, end - ptr, HTTP_RANGE_REQUEST, offset, end_offset);
 
    if (ptr < end)
       ptr += snprintf(ptr, end - ptr, TRAILING_HEADERS_FORMAT);
@@ -528,95 +594,136 @@ static VC_CONTAINER_STATUS_T io_http_send_get_request(VC_CONTAINER_IO_T *p_ctx,
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T io_http_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+static vc_container_net_status_t io_http_net_control(VC_CONTAINER_NET_T *sock,
+      vc_container_net_control_t operation, ...)
+{
+   vc_container_net_status_t net_status;
+   va_list args;
+
+   va_start(args, operation);
+   net_status = vc_container_net_control(sock, operation, args);
+   va_end(args);
+
+   return net_status;
+}
+
+/**************************************************************************//**
+ * Make sure a connection is open, applying any settings requested so far.
+ *
+ * @param p_ctx      The reader context.
+ * @param connection The connection.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_connect(VC_CONTAINER_IO_T *p_ctx, HTTP_CONNECTION_T *connection)
 {
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status;
 
-   /*
-    * No seeking past the end of the file.
-    */
+   module->sock = connection->sock;
+   if (module->sock)
+      return VC_CONTAINER_SUCCESS;
 
-   if (offset < 0 || offset > p_ctx->size)
-   {
-      p_ctx->status = VC_CONTAINER_ERROR_EOS;
-      return VC_CONTAINER_ERROR_EOS;
-   }
+   status = io_http_open_socket(p_ctx);
+   if (status != VC_CONTAINER_SUCCESS)
+      return status;
 
-   module->cur_offset = offset;
-   p_ctx->status = VC_CONTAINER_SUCCESS;
+   if (module->read_buffer_size)
+      io_http_net_control(module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_BUFFER_SIZE, module->read_buffer_size);
+   if (module->read_timeout_ms)
+      io_http_net_control(module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS, module->read_timeout_ms);
 
+   connection->sock = module->sock;
    return VC_CONTAINER_SUCCESS;
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T io_http_close(VC_CONTAINER_IO_T *p_ctx)
+static void io_http_disconnect(VC_CONTAINER_IO_MODULE_T *module, HTTP_CONNECTION_T *connection)
 {
-   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   module->sock = connection->sock;
+   io_http_close_socket(module);
+   connection->sock = NULL;
+   connection->pending = -1;
+}
 
-   if (!module)
-      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+/**************************************************************************//**
+ * Request a segment on a connection.
+ *
+ * @param p_ctx      The reader context.
+ * @param connection The idle connection to use.
+ * @param offset     Offset of the segment.
+ * @return  The resulting status of the function.
+ */
+static VC_CONTAINER_STATUS_T io_http_request_segment(VC_CONTAINER_IO_T *p_ctx,
+      HTTP_CONNECTION_T *connection, int64_t offset)
+{
+   VC_CONTAINER_STATUS_T status;
 
-   io_http_close_socket(module);
-   if (module->header_list)
-      vc_containers_list_destroy(module->header_list);
+   status = io_http_connect(p_ctx, connection);
+   if (status == VC_CONTAINER_SUCCESS)
+      status = io_http_send_get_request(p_ctx, offset, HTTP_SEGMENT_SIZE);
 
-   free(module);
-   p_ctx->module = NULL;
+   if (status != VC_CONTAINER_SUCCESS)
+   {
+      io_http_disconnect(p_ctx->module, connection);
+      return status;
+   }
 
+   connection->pending = offset;
    return VC_CONTAINER_SUCCESS;
 }
 
 /*****************************************************************************/
-static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+static HTTP_SEGMENT_T *io_http_find_segment(VC_CONTAINER_IO_MODULE_T *module, int64_t offset)
 {
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
-   size_t content_length;
-   size_t bytes_read;
-   size_t ret = 0;
-   char *ptr = buffer;
+   unsigned int i;
 
-   /*
-    * Are we at the end of the file?
-    */
+   for (i = 0; i < HTTP_CACHE_SEGMENTS; i++)
+      if (module->segment[i].data && module->segment[i].offset == offset)
+         return &module->segment[i];
 
-   if (module->cur_offset >= p_ctx->size)
-   {
-      p_ctx->status = VC_CONTAINER_ERROR_EOS;
-      return 0;
-   }
+   return NULL;
+}
 
-   if (!module->persistent)
-   {
-      status = io_http_open_socket(p_ctx);
-      if (status != VC_CONTAINER_SUCCESS)
-      {
-         LOG_ERROR(NULL, "Error opening socket for GET request");
-         return status;
-      }
-   }
+/*****************************************************************************/
+static HTTP_CONNECTION_T *io_http_find_connection(VC_CONTAINER_IO_MODULE_T *module, int64_t pending)
+{
+   unsigned int i;
 
-   /* Send GET request and get response */
-   status = io_http_send_get_request(p_ctx, size);
-   if (status != VC_CONTAINER_SUCCESS)
-   {
-      LOG_ERROR(NULL, "Error sending GET request");
-      goto error;
-   }
+   for (i = 0; i < HTTP_CONNECTIONS_MAX; i++)
+      if (module->connection[i].pending == pending)
+         return &module->connection[i];
+
+   return NULL;
+}
 
+/**************************************************************************//**
+ * Read the response to a segment request into the cache, replacing the least
+ * recently used segment.
+ *
+ * @param p_ctx      The reader context.
+ * @param connection The connection the segment was requested on.
+ * @return  The segment, or NULL on failure.
+ */
+static HTTP_SEGMENT_T *io_http_receive_segment(VC_CONTAINER_IO_T *p_ctx, HTTP_CONNECTION_T *connection)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status;
+   HTTP_SEGMENT_T *segment = &module->segment[0];
+   int64_t offset = connection->pending;
+   size_t size = (size_t)MIN(HTTP_SEGMENT_SIZE, p_ctx->size - offset);
+   size_t content_length, bytes_read = 0;
+   unsigned int i;
+
+   module->sock = connection->sock;
    status = io_http_read_response(p_ctx);
-   if (status == VC_CONTAINER_ERROR_EOS && !module->reconnecting)
+   if (status == VC_CONTAINER_ERROR_EOS)
    {
+      /* The server might have dropped an idle persistent connection */
       LOG_DEBUG(NULL, "reconnecting");
-      io_http_close_socket(module);
-      status = io_http_open_socket(p_ctx);
+      io_http_disconnect(module, connection);
+      status = io_http_request_segment(p_ctx, connection, offset);
       if (status == VC_CONTAINER_SUCCESS)
-      {
-         module->reconnecting = true;
-         status = io_http_read(p_ctx, buffer, size);
-         module->reconnecting = false;
-         return status;
-      }
+         status = io_http_read_response(p_ctx);
    }
    if (status != VC_CONTAINER_SUCCESS)
    {
@@ -625,45 +732,365 @@ static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
    }
 
    /*
-    * How much data is the server offering us?
+    * Make sure the server is giving us the range we asked for.
     */
 
    content_length = (size_t)io_http_get_content_length(module->header_list);
-   if (content_length > size)
+   if (content_length != size)
    {
-      LOG_ERROR(NULL, "received too much data (%i/%i)",
+      LOG_ERROR(NULL, "received unexpected amount of data (%i/%i)",
                 (int)content_length, (int)size);
       status = VC_CONTAINER_ERROR_CORRUPTED;
       goto error;
    }
 
-   bytes_read = 0;
+   for (i = 1; i < HTTP_CACHE_SEGMENTS && segment->data; i++)
+      if (!module->segment[i].data || module->segment[i].last_used < segment->last_used)
+         segment = &module->segment[i];
+
+   if (!segment->data)
+      segment->data = malloc(HTTP_SEGMENT_SIZE);
+   if (!segment->data)
+   {
+      status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      goto error;
+   }
+   segment->offset = -1;
+
    while (bytes_read < content_length && p_ctx->status == VC_CONTAINER_SUCCESS)
    {
-      ret = io_http_read_from_net(p_ctx, ptr, content_length - bytes_read);
+      size_t ret = io_http_read_from_net(p_ctx, segment->data + bytes_read, content_length - bytes_read);
       if (p_ctx->status == VC_CONTAINER_SUCCESS)
-      {
          bytes_read += ret;
-         ptr += ret;
-      }
    }
-
-   if (p_ctx->status == VC_CONTAINER_SUCCESS)
+   if (bytes_read != content_length)
    {
-      module->cur_offset += bytes_read;
-      ret = bytes_read;
+      status = p_ctx->status;
+      goto error;
    }
 
+   segment->offset = offset;
+   segment->size = size;
+   connection->pending = -1;
+
    if (!module->persistent)
-      io_http_close_socket(module);
+      io_http_disconnect(module, connection);
 
-   return ret;
+   return segment;
 
 error:
-   if (!module->persistent)
+   io_http_disconnect(module, connection);
+   p_ctx->status = status;
+   return NULL;
+}
+
+/**************************************************************************//**
+ * Request the segments following the read position on idle connections so
+ * the server can send them while we're busy with the current one.
+ *
+ * @param p_ctx      The reader context.
+ * @param offset     Offset of the first segment to prefetch.
+ */
+static void io_http_prefetch(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   HTTP_CONNECTION_T *connection;
+   unsigned int i;
+
+   for (i = 0; i < HTTP_PREFETCH_SEGMENTS && offset < p_ctx->size; i++, offset += HTTP_SEGMENT_SIZE)
+   {
+      if (io_http_find_segment(module, offset) || io_http_find_connection(module, offset))
+         continue;
+
+      connection = io_http_find_connection(module, -1);
+      if (!connection || io_http_request_segment(p_ctx, connection, offset) != VC_CONTAINER_SUCCESS)
+         break;
+   }
+}
+
+/**************************************************************************//**
+ * Get a segment from the cache, fetching it from the server if needed.
+ *
+ * @param p_ctx      The reader context.
+ * @param offset     Offset of the segment.
+ * @return  The segment, or NULL on failure.
+ */
+static HTTP_SEGMENT_T *io_http_get_segment(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   HTTP_CONNECTION_T *connection;
+   HTTP_SEGMENT_T *segment;
+
+   segment = io_http_find_segment(module, offset);
+   if (!segment)
+   {
+      connection = io_http_find_connection(module, offset);
+      if (!connection)
+      {
+         /* All the connections might be busy with segments we don't need yet */
+         connection = io_http_find_connection(module, -1);
+         if (!connection)
+         {
+            /* A prefetch which failed is simply dropped, the connection is free either way */
+            connection = &module->connection[0];
+            if (!io_http_receive_segment(p_ctx, connection))
+               LOG_DEBUG(NULL, "dropped failed prefetch");
+         }
+
+         p_ctx->status = io_http_request_segment(p_ctx, connection, offset);
+         if (p_ctx->status != VC_CONTAINER_SUCCESS)
+         {
+            LOG_ERROR(NULL, "Error sending GET request");
+            return NULL;
+         }
+      }
+
+      io_http_prefetch(p_ctx, offset + HTTP_SEGMENT_SIZE);
+      segment = io_http_receive_segment(p_ctx, connection);
+      if (!segment)
+         return NULL;
+   }
+
+   io_http_prefetch(p_ctx, offset + HTTP_SEGMENT_SIZE);
+   segment->last_used = ++module->segment_clock;
+   return segment;
+}
+
+/*****************************************************************************/
+static void io_http_cache_init(void)
+{
+   io_http_cache_lock_created =
+      vcos_mutex_create(&io_http_cache_lock, "io_http_cache") == VCOS_SUCCESS;
+}
+
+/*****************************************************************************/
+static void io_http_cache_clear(HTTP_CACHE_ENTRY_T *entry)
+{
+   unsigned int i;
+
+   for (i = 0; i < HTTP_CACHE_SEGMENTS; i++)
+      free(entry->segment[i].data);
+   io_http_cache_segments -= entry->segments_num;
+   free(entry->uri);
+   free(entry->validator);
+   memset(entry, 0, sizeof(*entry));
+}
+
+/*****************************************************************************/
+static HTTP_CACHE_ENTRY_T *io_http_cache_find(const char *uri)
+{
+   unsigned int i;
+
+   /* A NULL URI finds an unused entry */
+   for (i = 0; i < HTTP_SHARED_CACHE_ENTRIES; i++)
+      if (uri ? io_http_cache[i].uri && !strcmp(io_http_cache[i].uri, uri) : !io_http_cache[i].uri)
+         return &io_http_cache[i];
+
+   return NULL;
+}
+
+/*****************************************************************************/
+static HTTP_CACHE_ENTRY_T *io_http_cache_oldest(const HTTP_CACHE_ENTRY_T *exclude)
+{
+   HTTP_CACHE_ENTRY_T *entry = NULL;
+   unsigned int i;
+
+   for (i = 0; i < HTTP_SHARED_CACHE_ENTRIES; i++)
+   {
+      if (&io_http_cache[i] == exclude || !io_http_cache[i].uri)
+         continue;
+      if (!entry || io_http_cache[i].last_used < entry->last_used)
+         entry = &io_http_cache[i];
+   }
+
+   return entry;
+}
+
+/**************************************************************************//**
+ * Hand the segments of a resource being closed over to the shared cache, so
+ * they don't need fetching again if the same URI gets opened later on.
+ * Resources without a validator aren't kept since we couldn't tell whether
+ * they changed in the meantime.
+ *
+ * @param p_ctx      The reader context.
+ */
+static void io_http_cache_store(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   HTTP_CACHE_ENTRY_T *entry, *oldest;
+   unsigned int i, segments_num = 0;
+
+   for (i = 0; i < HTTP_CACHE_SEGMENTS; i++)
+      if (module->segment[i].data && module->segment[i].offset >= 0)
+         segments_num++;
+   if (!segments_num || !module->validator)
+      return;
+
+   vcos_once(&io_http_cache_once, io_http_cache_init);
+   if (!io_http_cache_lock_created)
+      return;
+   vcos_mutex_lock(&io_http_cache_lock);
+
+   /* An older copy of the same resource gets replaced */
+   entry = io_http_cache_find(p_ctx->uri);
+   if (!entry)
+      entry = io_http_cache_find(NULL);
+   if (!entry)
+      entry = io_http_cache_oldest(NULL);
+   io_http_cache_clear(entry);
+
+   /* Make room by dropping the least recently used resources */
+   while (io_http_cache_segments + segments_num > HTTP_CACHE_SEGMENTS &&
+          (oldest = io_http_cache_oldest(entry)) != NULL)
+      io_http_cache_clear(oldest);
+
+   entry->uri = strdup(p_ctx->uri);
+   entry->validator = strdup(module->validator);
+   if (!entry->uri || !entry->validator)
+   {
+      io_http_cache_clear(entry);
+      goto end;
+   }
+
+   for (i = 0; i < HTTP_CACHE_SEGMENTS; i++)
+   {
+      if (!module->segment[i].data || module->segment[i].offset < 0)
+         continue;
+      entry->segment[entry->segments_num++] = module->segment[i];
+      module->segment[i].data = NULL;
+   }
+   for (i = entry->segments_num; i < HTTP_CACHE_SEGMENTS; i++)
+      entry->segment[i].offset = -1;
+   io_http_cache_segments += entry->segments_num;
+   entry->size = p_ctx->size;
+   entry->segment_clock = module->segment_clock;
+   entry->last_used = ++io_http_cache_clock;
+
+end:
+   vcos_mutex_unlock(&io_http_cache_lock);
+}
+
+/**************************************************************************//**
+ * Take back the segments kept by the shared cache for the resource being
+ * opened. They are dropped if the resource changed since they were fetched.
+ *
+ * @param p_ctx      The reader context.
+ */
+static void io_http_cache_take(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   HTTP_CACHE_ENTRY_T *entry;
+
+   vcos_once(&io_http_cache_once, io_http_cache_init);
+   if (!io_http_cache_lock_created)
+      return;
+   vcos_mutex_lock(&io_http_cache_lock);
+
+   entry = io_http_cache_find(p_ctx->uri);
+   if (entry && entry->size == p_ctx->size &&
+       module->validator && !strcmp(entry->validator, module->validator))
+   {
+      LOG_DEBUG(NULL, "reusing %u cached segments", entry->segments_num);
+      memcpy(module->segment, entry->segment, sizeof(module->segment));
+      module->segment_clock = entry->segment_clock;
+      io_http_cache_segments -= entry->segments_num;
+      memset(entry->segment, 0, sizeof(entry->segment));
+      entry->segments_num = 0;
+   }
+   if (entry)
+      io_http_cache_clear(entry);
+
+   vcos_mutex_unlock(&io_http_cache_lock);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_http_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   /*
+    * No seeking past the end of the file.
+    */
+
+   if (offset < 0 || offset > p_ctx->size)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return VC_CONTAINER_ERROR_EOS;
+   }
+
+   module->cur_offset = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_http_close(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int i;
+
+   if (!module)
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+
+   /* The socket used for the HEAD request might not belong to a connection */
+   for (i = 0; i < HTTP_CONNECTIONS_MAX; i++)
+      if (module->connection[i].sock == module->sock)
+         break;
+   if (i == HTTP_CONNECTIONS_MAX)
       io_http_close_socket(module);
 
-   return status;
+   for (i = 0; i < HTTP_CONNECTIONS_MAX; i++)
+      io_http_disconnect(module, &module->connection[i]);
+   if (module->header_list)
+      vc_containers_list_destroy(module->header_list);
+
+   io_http_cache_store(p_ctx);
+   for (i = 0; i < HTTP_CACHE_SEGMENTS; i++)
+      free(module->segment[i].data);
+   free(module->validator);
+
+   free(module);
+   p_ctx->module = NULL;
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static size_t io_http_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   HTTP_SEGMENT_T *segment;
+   size_t bytes, read = 0;
+
+   /*
+    * Are we at the end of the file?
+    */
+
+   if (module->cur_offset >= p_ctx->size)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return 0;
+   }
+
+   while (read < size && module->cur_offset < p_ctx->size)
+   {
+      int64_t offset = module->cur_offset - module->cur_offset % HTTP_SEGMENT_SIZE;
+
+      segment = io_http_get_segment(p_ctx, offset);
+      if (!segment)
+         break;
+
+      bytes = (size_t)MIN((int64_t)(size - read), segment->offset + (int64_t)segment->size - module->cur_offset);
+      memcpy((uint8_t *)buffer + read, segment->data + (module->cur_offset - segment->offset), bytes);
+      module->cur_offset += bytes;
+      read += bytes;
+   }
+
+   if (read < size && p_ctx->status == VC_CONTAINER_SUCCESS)
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+
+   return read;
 }
 
 /*****************************************************************************/
@@ -683,21 +1110,32 @@ static VC_CONTAINER_STATUS_T io_http_control(struct VC_CONTAINER_IO_T *p_ctx,
       VC_CONTAINER_CONTROL_T operation,
       va_list args)
 {
-   vc_container_net_status_t net_status;
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   vc_container_net_status_t net_status = VC_CONTAINER_NET_SUCCESS;
+   vc_container_net_control_t net_operation;
    VC_CONTAINER_STATUS_T status;
+   uint32_t value;
+   unsigned int i;
 
    switch (operation)
    {
    case VC_CONTAINER_CONTROL_IO_SET_READ_BUFFER_SIZE:
-      net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_BUFFER_SIZE, args);
+      net_operation = VC_CONTAINER_NET_CONTROL_SET_READ_BUFFER_SIZE;
+      value = module->read_buffer_size = va_arg(args, uint32_t);
       break;
    case VC_CONTAINER_CONTROL_IO_SET_READ_TIMEOUT_MS:
-      net_status = vc_container_net_control(p_ctx->module->sock, VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS, args);
+      net_operation = VC_CONTAINER_NET_CONTROL_SET_READ_TIMEOUT_MS;
+      value = module->read_timeout_ms = va_arg(args, uint32_t);
       break;
    default:
-      net_status = VC_CONTAINER_NET_ERROR_NOT_ALLOWED;
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
    }
 
+   /* Connections opened later will pick the setting up when they are opened */
+   for (i = 0; i < HTTP_CONNECTIONS_MAX && net_status == VC_CONTAINER_NET_SUCCESS; i++)
+      if (module->connection[i].sock)
+         net_status = io_http_net_control(module->connection[i].sock, net_operation, value);
+
    status = translate_net_status_to_container_status(net_status);
    p_ctx->status = status;
 
@@ -763,6 +1201,7 @@ static VC_CONTAINER_STATUS_T io_http_head(VC_CONTAINER_IO_T *p_ctx)
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
    uint64_t content_length;
+   HTTP_HEADER_T header;
 
    /* Send HEAD request and get response */
    status = io_http_send_head_request(p_ctx);
@@ -797,9 +1236,25 @@ static VC_CONTAINER_STATUS_T io_http_head(VC_CONTAINER_IO_T *p_ctx)
     * Does it support persistent connections?
     */
 
+   /*
+    * Remember what identifies this version of the resource so cached
+    * segments can be reused if it gets opened again.
+    */
+
+   header.name = ETAG_NAME;
+   if (!vc_containers_list_find_entry(module->header_list, &header))
+   {
+      header.name = LAST_MODIFIED_NAME;
+      if (!vc_containers_list_find_entry(module->header_list, &header))
+         header.value = NULL;
+   }
+   if (header.value && *header.value)
+      module->validator = strdup(header.value);
+
    if (io_http_check_persistent_connection(module->header_list))
    {
       module->persistent = true;
+      module->connection[0].sock = module->sock;
    }
    else
    {
@@ -822,6 +1277,7 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_IO_MODULE_T *module = 0;
+   unsigned int i;
    VC_CONTAINER_PARAM_UNUSED(unused);
 
    /* Check the URI to see if we're dealing with an http stream */
@@ -853,6 +1309,11 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
    }
    p_ctx->module = module;
 
+   for (i = 0; i < HTTP_CONNECTIONS_MAX; i++)
+      module->connection[i].pending = -1;
+   for (i = 0; i < HTTP_CACHE_SEGMENTS; i++)
+      module->segment[i].offset = -1;
+
    /* header_list will contain pointers into the response_buffer, so take care in re-use */
    module->header_list = vc_containers_list_create(HEADER_LIST_INITIAL_CAPACITY, sizeof(HTTP_HEADER_T),
                                            (VC_CONTAINERS_LIST_COMPARATOR_T)io_http_header_comparator);
@@ -881,6 +1342,8 @@ VC_CONTAINER_STATUS_T vc_container_io_http_open(VC_CONTAINER_IO_T *p_ctx,
    if (status != VC_CONTAINER_SUCCESS)
       goto error;
 
+   io_http_cache_take(p_ctx);
+
    p_ctx->pf_close   = io_http_close;
    p_ctx->pf_read    = io_http_read;
    p_ctx->pf_write   = NULL;
@@ -0,0 +1,262 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "vcos.h"
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_io.h"
+#include "containers/core/containers_uri.h"
+
+/* In-memory i/o module.
+ * The stream is made of a chain of buffers supplied by the caller, which can
+ * keep growing while the stream is being read. The buffers are used in place
+ * so the data never gets copied before it is read.
+ * Appends can happen on another thread so they only update the size kept by
+ * the module. The size of the i/o is refreshed from it by the reading thread. */
+
+#define IO_MEM_SEGMENTS_MIN 16
+
+typedef struct IO_MEM_SEGMENT_T
+{
+   const uint8_t *data;
+   size_t size;
+   int64_t offset;     /**< Offset of the segment in the stream */
+
+} IO_MEM_SEGMENT_T;
+
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   VCOS_MUTEX_T lock;  /**< Protects the list of segments and the size against appends */
+
+   IO_MEM_SEGMENT_T *segments;
+   unsigned int segments_num;
+   unsigned int segments_max;
+
+   int64_t size;       /**< Total size of the data in the chain */
+   int64_t position;   /**< Current read position into the stream */
+   unsigned int current; /**< Segment containing the current position */
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_mem_open( VC_CONTAINER_IO_T *, const char *,
+   VC_CONTAINER_IO_MODE_T );
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mem_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   vcos_mutex_delete(&module->lock);
+   free(module->segments);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static unsigned int io_mem_find_segment( VC_CONTAINER_IO_MODULE_T *module, int64_t offset )
+{
+   unsigned int start = 0, end = module->segments_num;
+
+   /* Most of the time we're just moving on to the next segment */
+   if(module->current < end && offset >= module->segments[module->current].offset)
+   {
+      start = module->current;
+      if(offset < module->segments[start].offset + (int64_t)module->segments[start].size)
+         return start;
+   }
+
+   /* Otherwise find the last segment starting at or before this offset */
+   while(end - start > 1)
+   {
+      unsigned int middle = start + (end - start) / 2;
+      if(module->segments[middle].offset <= offset) start = middle;
+      else end = middle;
+   }
+   return start;
+}
+
+/*****************************************************************************/
+static size_t io_mem_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_MEM_SEGMENT_T *segment;
+   size_t ret = 0, bytes, offset;
+
+   vcos_mutex_lock(&module->lock);
+   p_ctx->size = module->size;
+   while(ret < size && module->position < module->size)
+   {
+      module->current = io_mem_find_segment(module, module->position);
+      segment = &module->segments[module->current];
+      offset = (size_t)(module->position - segment->offset);
+      bytes = MIN(segment->size - offset, size - ret);
+      memcpy((uint8_t *)buffer + ret, segment->data + offset, bytes);
+      module->position += bytes;
+      ret += bytes;
+   }
+   vcos_mutex_unlock(&module->lock);
+
+   if(ret < size) p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   return ret;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mem_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+      return p_ctx->status;
+   }
+
+   /* Reads beyond the end of the data will signal EOS */
+   vcos_mutex_lock(&module->lock);
+   p_ctx->size = module->size;
+   module->position = offset;
+   vcos_mutex_unlock(&module->lock);
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static const uint8_t *io_mem_map(VC_CONTAINER_IO_T *p_ctx, int64_t offset, size_t *size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   const uint8_t *data = NULL;
+   IO_MEM_SEGMENT_T *segment;
+   size_t available = 0;
+
+   vcos_mutex_lock(&module->lock);
+   p_ctx->size = module->size;
+   if(offset >= 0 && offset < module->size)
+   {
+      segment = &module->segments[io_mem_find_segment(module, offset)];
+      data = segment->data + (size_t)(offset - segment->offset);
+      available = segment->size - (size_t)(offset - segment->offset);
+   }
+   vcos_mutex_unlock(&module->lock);
+
+   /* Only the data contiguous in memory can be accessed directly */
+   *size = MIN(*size, available);
+   return data;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_mem_append( VC_CONTAINER_IO_T *p_ctx,
+   const void *data, size_t size )
+{
+   VC_CONTAINER_IO_MODULE_T *module;
+   IO_MEM_SEGMENT_T *segments, *segment;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int max;
+
+   if(!p_ctx || p_ctx->pf_close != io_mem_close || (!data && size))
+      return VC_CONTAINER_ERROR_INVALID_ARGUMENT;
+   if(!size) return VC_CONTAINER_SUCCESS;
+
+   module = p_ctx->module;
+   vcos_mutex_lock(&module->lock);
+
+   if(module->segments_num == module->segments_max)
+   {
+      max = MAX(module->segments_max * 2, IO_MEM_SEGMENTS_MIN);
+      segments = realloc(module->segments, max * sizeof(*segments));
+      if(!segments) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto end; }
+      module->segments = segments;
+      module->segments_max = max;
+   }
+
+   segment = &module->segments[module->segments_num++];
+   segment->data = data;
+   segment->size = size;
+   segment->offset = module->size;
+   module->size += size;
+
+ end:
+   vcos_mutex_unlock(&module->lock);
+   return status;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_IO_T *vc_container_io_mem_create( const void *data, size_t size,
+   VC_CONTAINER_STATUS_T *p_status )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_T *p_ctx;
+
+   p_ctx = vc_container_io_open("mem:", VC_CONTAINER_IO_MODE_READ, &status);
+   if(p_ctx && size)
+   {
+      status = vc_container_io_mem_append(p_ctx, data, size);
+      if(status != VC_CONTAINER_SUCCESS)
+      {
+         vc_container_io_close(p_ctx);
+         p_ctx = 0;
+      }
+      else p_ctx->size = size; /* Nobody else has access to the i/o yet */
+   }
+
+   if(p_status) *p_status = status;
+   return p_ctx;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_mem_open( VC_CONTAINER_IO_T *p_ctx,
+   const char *unused, VC_CONTAINER_IO_MODE_T mode )
+{
+   VC_CONTAINER_IO_MODULE_T *module;
+   const char *scheme = vc_uri_scheme(p_ctx->uri_parts);
+   VC_CONTAINER_PARAM_UNUSED(unused);
+
+   /* We only provide read access to the data appended by the caller */
+   if(!scheme || strcasecmp(scheme, "mem"))
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+   if(mode != VC_CONTAINER_IO_MODE_READ)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   module = malloc( sizeof(*module) );
+   if(!module) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(module, 0, sizeof(*module));
+   if(vcos_mutex_create(&module->lock, "io_mem_lock") != VCOS_SUCCESS)
+   {
+      free(module);
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   }
+
+   p_ctx->module = module;
+   p_ctx->pf_close = io_mem_close;
+   p_ctx->pf_read = io_mem_read;
+   p_ctx->pf_seek = io_mem_seek;
+   p_ctx->pf_map = io_mem_map;
+
+   /* The data is already in memory so we do not want any caching from the core */
+   p_ctx->capabilities = 0;
+   return VC_CONTAINER_SUCCESS;
+}
@@ -0,0 +1,436 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_io.h"
+#include "containers/core/containers_uri.h"
+#include "vcos.h"
+
+#define IO_MMAP_READ_AHEAD_AREA_SIZE (1024*1024) /* Amount of data prefetched per read-ahead area */
+#define IO_MMAP_TAIL_MIN_SIZE (4*1024*1024) /* Data appended to the file before it gets mapped */
+
+/* Memory mapped file i/o module.
+ * The whole file is mapped read-only when the i/o is opened. Reads are served
+ * straight from the mapping so the core doesn't need to provide any caching.
+ * Data appended to files which are still being written to is read with pread()
+ * until there is enough of it to be worth mapping, and only that new tail of the
+ * file then gets mapped. Earlier mappings are never replaced, so pointers returned
+ * by pf_map stay valid and the address space used stays close to the file size.
+ * Touching a page of the mapping which is past the end of a truncated file, or which
+ * can't be read from the storage, raises SIGBUS. Copies out of the mapping are guarded
+ * so this turns into a read error as it would with the plain file module.
+ * This module is only used for URIs with the mmap: scheme because guarding the copies
+ * means installing a process-wide SIGBUS handler, which is done the first time such a
+ * URI is opened. Signals raised outside of our copies are passed on to the handler which
+ * was installed before ours, so applications installing their own handler afterwards
+ * need to chain to the previous one as well. */
+
+typedef struct IO_MMAP_AREA_T
+{
+   uint8_t *base;     /**< Start of the mapping */
+   size_t offset;     /**< Offset of the mapping in the file (multiple of the page size) */
+   size_t length;     /**< Length of the mapping */
+
+} IO_MMAP_AREA_T;
+
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   int fd;
+   size_t size;       /**< Size of the file the last time we checked */
+   size_t mapped;     /**< Offset of the end of the last mapping */
+   size_t position;   /**< Current read position into the file */
+   size_t page_size;
+
+   IO_MMAP_AREA_T *areas;   /**< Mappings of the file, by increasing offset */
+   unsigned int areas_num;
+   unsigned int areas_max;
+   unsigned int area;       /**< Index of the mapping used last */
+
+   unsigned int read_ahead; /**< Number of areas to prefetch ahead of the read position */
+   size_t prefetch_start;   /**< Start of the range we last asked the kernel to prefetch */
+   size_t prefetch_end;     /**< End of the range we last asked the kernel to prefetch */
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *, const char *,
+   VC_CONTAINER_IO_MODE_T );
+
+static VCOS_ONCE_T io_mmap_sigbus_once = VCOS_ONCE_INIT;
+static struct sigaction io_mmap_sigbus_previous;
+static bool io_mmap_sigbus_installed;
+
+/** Set while the current thread is copying out of a mapping. This is volatile so the
+ * compiler can't drop the stores around the copy. */
+static __thread sigjmp_buf * volatile io_mmap_guard;
+
+/*****************************************************************************/
+static void io_mmap_sigbus_handler(int sig, siginfo_t *info, void *context)
+{
+   struct sigaction *previous = &io_mmap_sigbus_previous;
+
+   if(io_mmap_guard)
+      siglongjmp(*io_mmap_guard, 1);
+
+   /* Not one of ours so hand it over to whoever was there before us */
+   if(previous->sa_flags & SA_SIGINFO)
+      previous->sa_sigaction(sig, info, context);
+   else if(previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN)
+      previous->sa_handler(sig);
+   else
+      sigaction(SIGBUS, previous, NULL); /* The faulting access will trigger it again */
+}
+
+/*****************************************************************************/
+static void io_mmap_sigbus_install(void)
+{
+   struct sigaction action;
+
+   memset(&action, 0, sizeof(action));
+   action.sa_sigaction = io_mmap_sigbus_handler;
+   action.sa_flags = SA_SIGINFO | SA_NODEFER; /* No signal mask to restore when jumping out */
+   sigemptyset(&action.sa_mask);
+   io_mmap_sigbus_installed = !sigaction(SIGBUS, &action, &io_mmap_sigbus_previous);
+}
+
+/*****************************************************************************/
+static bool io_mmap_copy(void *buffer, const uint8_t *data, size_t size)
+{
+   sigjmp_buf guard;
+
+   if(sigsetjmp(guard, 0))
+   {
+      io_mmap_guard = NULL;
+      return false;
+   }
+
+   io_mmap_guard = &guard;
+   memcpy(buffer, data, size);
+   io_mmap_guard = NULL;
+   return true;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   unsigned int i;
+
+   for(i = 0; i < module->areas_num; i++)
+      munmap(module->areas[i].base, module->areas[i].length);
+   free(module->areas);
+   close(module->fd);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static bool io_mmap_add_area(VC_CONTAINER_IO_MODULE_T *module, size_t offset, size_t length)
+{
+   IO_MMAP_AREA_T *area;
+   void *base;
+
+   if(module->areas_num == module->areas_max)
+   {
+      unsigned int max = module->areas_max ? module->areas_max * 2 : 4;
+      area = realloc(module->areas, max * sizeof(*area));
+      if(!area) return false;
+      module->areas = area;
+      module->areas_max = max;
+   }
+
+   base = mmap(NULL, length, PROT_READ, MAP_SHARED, module->fd, (off_t)offset);
+   if(base == MAP_FAILED) return false;
+   posix_madvise(base, length, POSIX_MADV_SEQUENTIAL);
+
+   area = &module->areas[module->areas_num++];
+   area->base = base;
+   area->offset = offset;
+   area->length = length;
+   module->mapped = offset + length;
+   return true;
+}
+
+/*****************************************************************************/
+static IO_MMAP_AREA_T *io_mmap_find_area(VC_CONTAINER_IO_MODULE_T *module, size_t offset)
+{
+   IO_MMAP_AREA_T *area = &module->areas[module->area];
+   unsigned int start = 0, end = module->areas_num;
+
+   /* Accesses are mostly sequential so check the mapping we used last first */
+   if(offset >= area->offset && offset - area->offset < area->length)
+      return area;
+   if(offset >= module->mapped)
+      return NULL;
+
+   /* Find the last mapping starting at or before the offset. The start of each
+    * mapping is rounded down to a page so it can overlap the previous one. */
+   while(end - start > 1)
+   {
+      unsigned int middle = start + (end - start) / 2;
+      if(module->areas[middle].offset <= offset) start = middle;
+      else end = middle;
+   }
+
+   module->area = start;
+   return &module->areas[start];
+}
+
+/*****************************************************************************/
+static void io_mmap_grow(VC_CONTAINER_IO_T *p_ctx)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t offset;
+   struct stat st;
+
+   /* Check whether the file has grown since we last looked at it */
+   if(fstat(module->fd, &st) || (uint64_t)st.st_size <= (uint64_t)module->size ||
+      (uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+      return;
+
+   module->size = (size_t)st.st_size;
+   p_ctx->size = st.st_size;
+
+   /* Only map the new data once there is enough of it, it gets read with pread()
+    * in the meantime. This keeps the number of mappings down when following a
+    * file which grows in small steps. */
+   if(module->size - module->mapped < IO_MMAP_TAIL_MIN_SIZE)
+      return;
+
+   offset = module->mapped & ~(module->page_size - 1);
+   io_mmap_add_area(module, offset, module->size - offset);
+}
+
+/*****************************************************************************/
+static void io_mmap_prefetch(VC_CONTAINER_IO_MODULE_T *module, size_t position)
+{
+   IO_MMAP_AREA_T *area;
+   size_t start, end;
+
+   /* Only go back to the kernel when we get close to the end of the prefetched range */
+   if(!module->read_ahead || position >= module->mapped ||
+      (position >= module->prefetch_start &&
+       position + IO_MMAP_READ_AHEAD_AREA_SIZE <= module->prefetch_end))
+      return;
+
+   area = io_mmap_find_area(module, position);
+   if(!area) return;
+
+   /* The range is limited to the current mapping which is the whole file in most cases */
+   start = position & ~(module->page_size - 1);
+   end = MIN(area->offset + area->length - position,
+             (size_t)module->read_ahead * IO_MMAP_READ_AHEAD_AREA_SIZE);
+   end += position;
+   posix_madvise(area->base + (start - area->offset), end - start, POSIX_MADV_WILLNEED);
+   module->prefetch_start = start;
+   module->prefetch_end = end;
+}
+
+/*****************************************************************************/
+static size_t io_mmap_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   uint8_t *data = buffer;
+   size_t read = 0, bytes;
+   IO_MMAP_AREA_T *area;
+   ssize_t ret;
+
+   if(module->position + size > module->size)
+      io_mmap_grow(p_ctx);
+
+   io_mmap_prefetch(module, module->position);
+   while(read < size && module->position < module->size)
+   {
+      bytes = MIN(size - read, module->size - module->position);
+      area = io_mmap_find_area(module, module->position);
+      if(area)
+      {
+         bytes = MIN(bytes, area->offset + area->length - module->position);
+         if(!io_mmap_copy(data + read, area->base + (module->position - area->offset), bytes))
+         {
+            /* The file got truncated or the storage failed underneath us */
+            p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+            return read;
+         }
+      }
+      else
+      {
+         /* This is data which got appended since we last mapped the file */
+         ret = pread(module->fd, data + read, bytes, (off_t)module->position);
+         if(ret <= 0)
+         {
+            p_ctx->status = ret < 0 ? VC_CONTAINER_ERROR_FAILED : VC_CONTAINER_ERROR_EOS;
+            return read;
+         }
+         bytes = (size_t)ret;
+      }
+
+      module->position += bytes;
+      read += bytes;
+   }
+
+   if(read < size)
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   return read;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   /* Like fseek(), seeking past the end is allowed. Reads will hit the end of stream. */
+   if(offset < 0 || (uint64_t)offset > (uint64_t)SIZE_MAX)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+      return p_ctx->status;
+   }
+
+   module->position = (size_t)offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static const uint8_t *io_mmap_map(VC_CONTAINER_IO_T *p_ctx, int64_t offset, size_t *size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_MMAP_AREA_T *area;
+
+   if(offset < 0 || (uint64_t)offset > (uint64_t)SIZE_MAX)
+   {
+      *size = 0;
+      return NULL;
+   }
+
+   if((size_t)offset + *size > module->mapped)
+      io_mmap_grow(p_ctx);
+
+   /* Data which isn't mapped yet has to be read */
+   area = io_mmap_find_area(module, (size_t)offset);
+   if(!area)
+   {
+      *size = 0;
+      return NULL;
+   }
+
+   /* Only the data within a single mapping can be accessed directly */
+   *size = MIN(*size, area->offset + area->length - (size_t)offset);
+   io_mmap_prefetch(module, (size_t)offset);
+   return area->base + ((size_t)offset - area->offset);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_mmap_control(VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD:
+      /* The page cache does the actual work so we only need to tell the kernel what we want */
+      module->read_ahead = va_arg(args, uint32_t);
+      module->prefetch_start = module->prefetch_end = 0;
+      return VC_CONTAINER_SUCCESS;
+   default:
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_mmap_open( VC_CONTAINER_IO_T *p_ctx,
+   const char *unused, VC_CONTAINER_IO_MODE_T mode )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_IO_MODULE_T *module = 0;
+   const char *scheme = vc_uri_scheme(p_ctx->uri_parts);
+   const char *uri = p_ctx->uri;
+   struct stat st;
+   int fd = -1;
+   VC_CONTAINER_PARAM_UNUSED(unused);
+
+   /* Mapping has to be asked for with the mmap: scheme and we only provide read access */
+   if(mode != VC_CONTAINER_IO_MODE_READ || !scheme || strcasecmp(scheme, "mmap"))
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   /* Without a SIGBUS guard an i/o error would kill the process so leave it to io_file */
+   vcos_once(&io_mmap_sigbus_once, io_mmap_sigbus_install);
+   if(!io_mmap_sigbus_installed)
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   if(vc_uri_path(p_ctx->uri_parts))
+      uri = vc_uri_path(p_ctx->uri_parts);
+
+   fd = open(uri, O_RDONLY);
+   if(fd < 0) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+
+   /* Let the plain file module deal with anything we can't map in one go */
+   if(fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size ||
+      (uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+   { status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED; goto error; }
+
+   module = malloc( sizeof(*module) );
+   if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+   module->fd = fd;
+   module->size = (size_t)st.st_size;
+   module->page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+   if(!io_mmap_add_area(module, 0, module->size))
+   { status = VC_CONTAINER_ERROR_OUT_OF_RESOURCES; goto error; }
+
+   p_ctx->module = module;
+   p_ctx->pf_close = io_mmap_close;
+   p_ctx->pf_read = io_mmap_read;
+   p_ctx->pf_seek = io_mmap_seek;
+   p_ctx->pf_map = io_mmap_map;
+   p_ctx->pf_control = io_mmap_control;
+
+   p_ctx->size = st.st_size;
+
+   /* The data is already in memory so we do not want any caching from the core */
+   p_ctx->capabilities = 0;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   if(module) free(module->areas);
+   free(module);
+   if(fd >= 0) close(fd);
+   return status;
+}
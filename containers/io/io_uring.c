@@ -0,0 +1,582 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_io.h"
+#include "containers/core/containers_uri.h"
+
+/* Linux io_uring file i/o module.
+ * All the transfers are done in blocks which are queued on a submission ring
+ * and handed to the kernel in batches, so a single system call covers
+ * several cache refills or flushes. In read mode the blocks following the
+ * read position are prefetched. In write mode the data is copied into a block
+ * and written in the background, and errors are reported by the next call.
+ * If io_uring isn't available the open fails and the plain file module is
+ * used instead. Local files are read through this module by default, but it
+ * is opt-in for writing: only URIs with the uring: scheme are written through
+ * here, everything else is written by the plain file module. */
+
+#define IO_URING_QUEUE_DEPTH 8
+#define IO_URING_BLOCK_SIZE (64*1024)
+#define IO_URING_SUBMIT_BATCH 4 /* Number of queued requests which triggers a submission */
+
+typedef enum
+{
+   IO_URING_BLOCK_FREE = 0,
+   IO_URING_BLOCK_IN_FLIGHT,  /**< Queued on the ring or being processed by the kernel */
+   IO_URING_BLOCK_DONE        /**< Read data available */
+
+} IO_URING_BLOCK_STATE_T;
+
+typedef struct IO_URING_BLOCK_T
+{
+   uint8_t *mem;
+   struct iovec iov;
+   int64_t offset;            /**< Offset in the file of the transfer */
+   size_t size;               /**< Size of the transfer */
+   int result;                /**< Result of the transfer once completed */
+   bool stale;                /**< Data isn't wanted anymore */
+   IO_URING_BLOCK_STATE_T state;
+
+} IO_URING_BLOCK_T;
+
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   int fd;
+   int ring_fd;
+   bool write;
+   int64_t position;
+
+   int64_t read_offset;       /**< Offset of the next block to prefetch */
+   bool eos;                  /**< Prefetching has reached the end of the file */
+   VC_CONTAINER_STATUS_T error; /**< Deferred write error */
+
+   unsigned int queued;       /**< Requests on the ring not yet submitted */
+   unsigned int in_flight;    /**< Requests not yet completed */
+
+   uint8_t *sq_ring;
+   size_t sq_ring_size;
+   unsigned *sq_tail, *sq_mask, *sq_array;
+   struct io_uring_sqe *sqes;
+   size_t sqes_size;
+
+   uint8_t *cq_ring;
+   size_t cq_ring_size;
+   unsigned *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_cqe *cqes;
+
+   IO_URING_BLOCK_T block[IO_URING_QUEUE_DEPTH];
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_uring_open( VC_CONTAINER_IO_T *, const char *,
+   VC_CONTAINER_IO_MODE_T );
+
+/*****************************************************************************/
+static void io_uring_queue(VC_CONTAINER_IO_MODULE_T *module, IO_URING_BLOCK_T *block, int opcode)
+{
+   unsigned tail = *module->sq_tail, index = tail & *module->sq_mask;
+   struct io_uring_sqe *sqe = &module->sqes[index];
+
+   block->iov.iov_base = block->mem;
+   block->iov.iov_len = block->size;
+   block->stale = false;
+   block->state = IO_URING_BLOCK_IN_FLIGHT;
+
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode = opcode;
+   sqe->fd = module->fd;
+   sqe->off = block->offset;
+   sqe->addr = (uintptr_t)&block->iov;
+   sqe->len = 1;
+   sqe->user_data = block - module->block;
+
+   module->sq_array[index] = index;
+   __atomic_store_n(module->sq_tail, tail + 1, __ATOMIC_RELEASE);
+   module->queued++;
+   module->in_flight++;
+}
+
+/*****************************************************************************/
+static int io_uring_submit(VC_CONTAINER_IO_MODULE_T *module, unsigned int wait)
+{
+   int ret;
+
+   if(!module->queued && !wait)
+      return 0;
+
+   do {
+      ret = (int)syscall(__NR_io_uring_enter, module->ring_fd, module->queued, wait,
+                         wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+   } while(ret < 0 && errno == EINTR);
+
+   if(ret > 0) module->queued -= MIN((unsigned int)ret, module->queued);
+   return ret;
+}
+
+/*****************************************************************************/
+static void io_uring_reap(VC_CONTAINER_IO_MODULE_T *module)
+{
+   unsigned head = *module->cq_head;
+
+   while(head != __atomic_load_n(module->cq_tail, __ATOMIC_ACQUIRE))
+   {
+      struct io_uring_cqe *cqe = &module->cqes[head & *module->cq_mask];
+      IO_URING_BLOCK_T *block = &module->block[cqe->user_data];
+
+      block->result = cqe->res;
+      block->state = block->stale ? IO_URING_BLOCK_FREE : IO_URING_BLOCK_DONE;
+      module->in_flight--;
+
+      if(module->write)
+      {
+         if(block->result != (int)block->size)
+            module->error = VC_CONTAINER_ERROR_FAILED;
+         block->state = IO_URING_BLOCK_FREE;
+      }
+      else if(!block->stale && block->result != (int)block->size)
+         module->eos = true;
+
+      head++;
+   }
+   __atomic_store_n(module->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+static bool io_uring_wait(VC_CONTAINER_IO_MODULE_T *module, IO_URING_BLOCK_T *block)
+{
+   /* Wait for the given block or for all the requests to complete */
+   while(1)
+   {
+      io_uring_reap(module);
+      if(block ? block->state != IO_URING_BLOCK_IN_FLIGHT : !module->in_flight)
+         return true;
+      if(io_uring_submit(module, 1) < 0)
+         return false;
+   }
+}
+
+/*****************************************************************************/
+static IO_URING_BLOCK_T *io_uring_find_block(VC_CONTAINER_IO_MODULE_T *module, int64_t offset)
+{
+   unsigned int i;
+
+   for(i = 0; i < IO_URING_QUEUE_DEPTH; i++)
+   {
+      IO_URING_BLOCK_T *block = &module->block[i];
+      int64_t size = block->size;
+
+      if(block->state == IO_URING_BLOCK_FREE || block->stale)
+         continue;
+      if(block->state == IO_URING_BLOCK_DONE)
+         size = block->result > 0 ? block->result : 0;
+      if(offset >= block->offset && offset < block->offset + size)
+         return block;
+   }
+   return NULL;
+}
+
+/*****************************************************************************/
+static void io_uring_prefetch(VC_CONTAINER_IO_MODULE_T *module)
+{
+   unsigned int i;
+
+   for(i = 0; i < IO_URING_QUEUE_DEPTH && !module->eos; i++)
+   {
+      IO_URING_BLOCK_T *block = &module->block[i];
+      if(block->state != IO_URING_BLOCK_FREE) continue;
+
+      block->offset = module->read_offset;
+      block->size = IO_URING_BLOCK_SIZE;
+      module->read_offset += IO_URING_BLOCK_SIZE;
+      io_uring_queue(module, block, IORING_OP_READV);
+   }
+}
+
+/*****************************************************************************/
+static IO_URING_BLOCK_T *io_uring_restart(VC_CONTAINER_IO_MODULE_T *module)
+{
+   unsigned int i;
+
+   /* Forget about everything we've prefetched so far */
+   for(i = 0; i < IO_URING_QUEUE_DEPTH; i++)
+   {
+      if(module->block[i].state == IO_URING_BLOCK_DONE)
+         module->block[i].state = IO_URING_BLOCK_FREE;
+      module->block[i].stale = true;
+   }
+
+   module->read_offset = module->position;
+   module->eos = false;
+   io_uring_prefetch(module);
+   return io_uring_find_block(module, module->position);
+}
+
+/*****************************************************************************/
+static size_t io_uring_read_sync(VC_CONTAINER_IO_T *p_ctx, uint8_t *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t read = 0;
+   ssize_t ret;
+
+   /* Make sure we read back what has been written */
+   if(!io_uring_wait(module, NULL))
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+      return 0;
+   }
+
+   while(read < size)
+   {
+      ret = pread(module->fd, buffer + read, size - read, (off_t)(module->position + read));
+      if(ret < 0 && errno == EINTR) continue;
+      if(ret <= 0) break;
+      read += ret;
+   }
+
+   if(read != size)
+      p_ctx->status = ret < 0 ? VC_CONTAINER_ERROR_FAILED : VC_CONTAINER_ERROR_EOS;
+   module->position += read;
+   return read;
+}
+
+/*****************************************************************************/
+static size_t io_uring_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   IO_URING_BLOCK_T *block;
+   size_t read = 0, bytes;
+
+   if(module->write)
+      return io_uring_read_sync(p_ctx, buffer, size);
+
+   while(read < size)
+   {
+      block = io_uring_find_block(module, module->position);
+      if(!block)
+      {
+         /* This isn't data we've asked for (e.g. first read or after a seek)
+          * so start prefetching from the current position */
+         block = io_uring_restart(module);
+         if(!block)
+         {
+            /* All the blocks are busy with data we don't want anymore */
+            if(io_uring_submit(module, 1) < 0) break;
+            continue;
+         }
+
+         if(!io_uring_wait(module, block)) break;
+         if(block->result <= 0)
+         {
+            p_ctx->status = block->result < 0 ? VC_CONTAINER_ERROR_FAILED : VC_CONTAINER_ERROR_EOS;
+            block->state = IO_URING_BLOCK_FREE;
+            return read;
+         }
+         continue;
+      }
+
+      if(block->state == IO_URING_BLOCK_IN_FLIGHT)
+      {
+         if(!io_uring_wait(module, block)) break;
+         continue;
+      }
+
+      bytes = MIN(size - read, (size_t)(block->offset + block->result - module->position));
+      memcpy((uint8_t *)buffer + read, block->mem + (module->position - block->offset), bytes);
+      module->position += bytes;
+      read += bytes;
+
+      /* Recycle the block once it's been consumed */
+      if(module->position == block->offset + block->result)
+      {
+         block->state = IO_URING_BLOCK_FREE;
+         io_uring_prefetch(module);
+      }
+   }
+
+   if(read < size && !p_ctx->status)
+      p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+
+   if(module->queued >= IO_URING_SUBMIT_BATCH)
+      io_uring_submit(module, 0);
+   return read;
+}
+
+/*****************************************************************************/
+static size_t io_uring_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t written = 0, bytes;
+   unsigned int i;
+
+   /* Pick up the result of the writes which completed since the last call */
+   io_uring_reap(module);
+
+   while(written < size && !module->error)
+   {
+      IO_URING_BLOCK_T *block = 0, *overlap = 0;
+      bytes = MIN(size - written, IO_URING_BLOCK_SIZE);
+
+      for(i = 0; i < IO_URING_QUEUE_DEPTH; i++)
+      {
+         IO_URING_BLOCK_T *current = &module->block[i];
+         if(current->state == IO_URING_BLOCK_FREE)
+         {
+            if(!block) block = current;
+         }
+         else if(current->offset < module->position + (int64_t)bytes &&
+                 module->position < current->offset + (int64_t)current->size)
+            overlap = current;
+      }
+
+      /* The kernel doesn't order requests so we can't have overlapping writes in flight */
+      if(!block || overlap)
+      {
+         if(!io_uring_wait(module, overlap)) module->error = VC_CONTAINER_ERROR_FAILED;
+         continue;
+      }
+
+      memcpy(block->mem, (const uint8_t *)buffer + written, bytes);
+      block->offset = module->position;
+      block->size = bytes;
+      io_uring_queue(module, block, IORING_OP_WRITEV);
+      module->position += bytes;
+      written += bytes;
+   }
+
+   if(module->queued >= IO_URING_SUBMIT_BATCH)
+      io_uring_submit(module, 0);
+
+   if(module->error)
+      p_ctx->status = module->error;
+   return written;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_uring_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+      return p_ctx->status;
+   }
+
+   module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_uring_control(VC_CONTAINER_IO_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_PARAM_UNUSED(args);
+
+   if(operation != VC_CONTAINER_CONTROL_IO_FLUSH)
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   if(!io_uring_wait(module, NULL))
+      module->error = VC_CONTAINER_ERROR_FAILED;
+   return module->error;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_uring_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   /* This is the last chance to report a failure of the writes still in flight */
+   if(!io_uring_wait(module, NULL))
+      module->error = VC_CONTAINER_ERROR_FAILED;
+   status = module->error;
+
+   munmap(module->sqes, module->sqes_size);
+   if(module->cq_ring != module->sq_ring)
+      munmap(module->cq_ring, module->cq_ring_size);
+   munmap(module->sq_ring, module->sq_ring_size);
+   close(module->ring_fd);
+   close(module->fd);
+
+   for(i = 0; i < IO_URING_QUEUE_DEPTH; i++)
+      free(module->block[i].mem);
+   free(module);
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_uring_setup_ring( VC_CONTAINER_IO_MODULE_T *module )
+{
+   struct io_uring_params params;
+
+   memset(&params, 0, sizeof(params));
+   module->ring_fd = (int)syscall(__NR_io_uring_setup, IO_URING_QUEUE_DEPTH, &params);
+   if(module->ring_fd < 0)
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   module->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   module->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   if(params.features & IORING_FEAT_SINGLE_MMAP)
+      module->sq_ring_size = module->cq_ring_size = MAX(module->sq_ring_size, module->cq_ring_size);
+
+   module->sq_ring = mmap(NULL, module->sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                          module->ring_fd, IORING_OFF_SQ_RING);
+   if(module->sq_ring == MAP_FAILED) goto error_sq_ring;
+
+   module->cq_ring = module->sq_ring;
+   if(!(params.features & IORING_FEAT_SINGLE_MMAP))
+   {
+      module->cq_ring = mmap(NULL, module->cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                             module->ring_fd, IORING_OFF_CQ_RING);
+      if(module->cq_ring == MAP_FAILED) goto error_cq_ring;
+   }
+
+   module->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+   module->sqes = mmap(NULL, module->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                       module->ring_fd, IORING_OFF_SQES);
+   if(module->sqes == MAP_FAILED) goto error_sqes;
+
+   module->sq_tail = (unsigned *)(module->sq_ring + params.sq_off.tail);
+   module->sq_mask = (unsigned *)(module->sq_ring + params.sq_off.ring_mask);
+   module->sq_array = (unsigned *)(module->sq_ring + params.sq_off.array);
+   module->cq_head = (unsigned *)(module->cq_ring + params.cq_off.head);
+   module->cq_tail = (unsigned *)(module->cq_ring + params.cq_off.tail);
+   module->cq_mask = (unsigned *)(module->cq_ring + params.cq_off.ring_mask);
+   module->cqes = (struct io_uring_cqe *)(module->cq_ring + params.cq_off.cqes);
+   return VC_CONTAINER_SUCCESS;
+
+ error_sqes:
+   if(module->cq_ring != module->sq_ring)
+      munmap(module->cq_ring, module->cq_ring_size);
+ error_cq_ring:
+   munmap(module->sq_ring, module->sq_ring_size);
+ error_sq_ring:
+   close(module->ring_fd);
+   return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_uring_open( VC_CONTAINER_IO_T *p_ctx,
+   const char *unused, VC_CONTAINER_IO_MODE_T mode )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_IO_MODULE_T *module = 0;
+   const char *scheme = vc_uri_scheme(p_ctx->uri_parts);
+   const char *uri = p_ctx->uri;
+   bool ring = false;
+   struct stat st;
+   unsigned int i;
+   int fd = -1;
+   VC_CONTAINER_PARAM_UNUSED(unused);
+
+   /* Only local files are handled here */
+   if(scheme && strcasecmp(scheme, "file") && strcasecmp(scheme, "uring"))
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   /* Writers get the file module by default since it has scatter-gather and O_DIRECT
+    * support. The uring: scheme can be used to write through here. */
+   if(mode == VC_CONTAINER_IO_MODE_WRITE && (!scheme || strcasecmp(scheme, "uring")))
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   if(vc_uri_path(p_ctx->uri_parts))
+      uri = vc_uri_path(p_ctx->uri_parts);
+
+   if(mode == VC_CONTAINER_IO_MODE_WRITE)
+      fd = open(uri, O_RDWR|O_CREAT|O_TRUNC, 0666);
+   else
+      fd = open(uri, O_RDONLY);
+   if(fd < 0) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+
+   /* Positioned transfers only work on regular files, leave the rest to the file module */
+   if(fstat(fd, &st) || !S_ISREG(st.st_mode))
+   { status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED; goto error; }
+
+   module = malloc( sizeof(*module) );
+   if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+
+   status = io_uring_setup_ring(module);
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+   ring = true;
+
+   for(i = 0; i < IO_URING_QUEUE_DEPTH; i++)
+   {
+      module->block[i].mem = malloc(IO_URING_BLOCK_SIZE);
+      if(!module->block[i].mem) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   }
+
+   p_ctx->module = module;
+   module->fd = fd;
+   module->write = mode == VC_CONTAINER_IO_MODE_WRITE;
+   p_ctx->pf_close = io_uring_close;
+   p_ctx->pf_read = io_uring_read;
+   p_ctx->pf_write = io_uring_write;
+   p_ctx->pf_seek = io_uring_seek;
+   p_ctx->pf_control = io_uring_control;
+
+   if(!module->write)
+      p_ctx->size = st.st_size;
+
+   p_ctx->capabilities = VC_CONTAINER_IO_CAPS_NO_CACHING;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   if(module)
+   {
+      for(i = 0; i < IO_URING_QUEUE_DEPTH; i++)
+         free(module->block[i].mem);
+      if(ring)
+      {
+         munmap(module->sqes, module->sqes_size);
+         if(module->cq_ring != module->sq_ring)
+            munmap(module->cq_ring, module->cq_ring_size);
+         munmap(module->sq_ring, module->sq_ring_size);
+         close(module->ring_fd);
+      }
+      free(module);
+   }
+   if(fd >= 0) close(fd);
+   return status;
+}
@@ -53,6 +53,8 @@ Defines.
 
 #define MKV_MAX_READER_STATE_LEVEL 4
 
+#define MKV_CUES_INCREMENT 256
+
 #define MKV_SKIP_U8(ctx,n)   (size -= 1, SKIP_U8(ctx,n))
 #define MKV_SKIP_U16(ctx,n)  (size -= 2, SKIP_U16(ctx,n))
 #define MKV_SKIP_U24(ctx,n)  (size -= 3, SKIP_U24(ctx,n))
@@ -307,6 +309,8 @@ typedef struct
    int64_t cluster_timecode;
    int64_t prev_cluster_size; /* Size of the previous cluster if available */
    int64_t frame_duration;
+   int64_t cluster_offset; /* Offset to the header of the current cluster */
+   bool cluster_indexed; /* Keyframes of the current cluster go in the index */
 
    int level;
    struct {
@@ -341,6 +345,13 @@ typedef struct
 
 } MKV_ELEMENT_T;
 
+/** Entry of the in-memory seek index */
+typedef struct
+{
+   int64_t time; /* Time in microseconds */
+   uint64_t offset; /* Offset of the cluster relative to the segment */
+} MKV_CUE_T;
+
 typedef struct VC_CONTAINER_TRACK_MODULE_T
 {
    MKV_READER_STATE_T *state;
@@ -394,6 +405,11 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
       uint8_t *data;
    } encodings[MKV_MAX_ENCODINGS];
 
+   /* Seek index, sorted by time */
+   MKV_CUE_T *cues;
+   unsigned int cues_num;
+   unsigned int cues_max;
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -415,15 +431,23 @@ typedef struct VC_CONTAINER_MODULE_T
    float duration;
 
    uint64_t cluster_offset; /**< Offset to the first cluster */
+   uint64_t info_offset; /**< Offset to the start of the segment info */
+   uint64_t tracks_offset; /**< Offset to the start of the tracks */
    uint64_t cues_offset; /**< Offset to the start of the seeking cues */
    uint64_t tags_offset; /**< Offset to the start of the tags */
 
+   bool cues_loaded; /**< Cues have been loaded into the seek index */
+   bool index_complete; /**< The index built during playback covers the whole segment */
+   uint64_t index_next_cluster; /**< Offset of the first cluster not covered by the index yet */
+
    /*
     * Variables only used during parsing of the header
     */
 
    VC_CONTAINER_TRACK_T *parsing; /**< Current track being parsed */
    bool is_doctype_valid;
+   bool has_info; /**< Segment info has been read */
+   bool has_tracks; /**< Tracks have been read */
 
    MKV_ELEMENT_ID_T seekhead_elem_id;
    int64_t seekhead_elem_offset;
@@ -462,8 +486,11 @@ static VC_CONTAINER_STATUS_T mkv_read_subelements_compression( VC_CONTAINER_T *p
 static VC_CONTAINER_STATUS_T mkv_read_subelements_seek_head( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size );
 static VC_CONTAINER_STATUS_T mkv_read_element_cues( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size );
 static VC_CONTAINER_STATUS_T mkv_read_subelements_cue_point( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size );
+static VC_CONTAINER_STATUS_T mkv_read_subelements_cue_track_positions( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size );
 
 static VC_CONTAINER_STATUS_T mkv_read_subelements_cluster( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size );
+static void mkv_index_cluster( VC_CONTAINER_T *p_ctx, MKV_READER_STATE_T *state, int64_t search_offset,
+   int64_t offset, int64_t data_offset, int64_t size );
 
 /******************************************************************************
 List of element IDs and their associated processing functions
@@ -676,7 +703,7 @@ MKV_ELEMENT_T mkv_cue_elements_list[] =
    {MKV_ELEMENT_ID_CUES, MKV_ELEMENT_ID_SEGMENT, "Cues", 0},
    {MKV_ELEMENT_ID_CUE_POINT, MKV_ELEMENT_ID_CUES, "Cue Point", mkv_read_elements},
    {MKV_ELEMENT_ID_CUE_TIME, MKV_ELEMENT_ID_CUE_POINT, "Cue Time", mkv_read_subelements_cue_point},
-   {MKV_ELEMENT_ID_CUE_TRACK_POSITIONS, MKV_ELEMENT_ID_CUE_POINT, "Cue Track Positions", mkv_read_elements},
+   {MKV_ELEMENT_ID_CUE_TRACK_POSITIONS, MKV_ELEMENT_ID_CUE_POINT, "Cue Track Positions", mkv_read_subelements_cue_track_positions},
    {MKV_ELEMENT_ID_CUE_TRACK, MKV_ELEMENT_ID_CUE_TRACK_POSITIONS, "Cue Track", mkv_read_subelements_cue_point},
    {MKV_ELEMENT_ID_CUE_CLUSTER_POSITION, MKV_ELEMENT_ID_CUE_TRACK_POSITIONS, "Cue Cluster Position", mkv_read_subelements_cue_point},
    {MKV_ELEMENT_ID_CUE_BLOCK_NUMBER, MKV_ELEMENT_ID_CUE_TRACK_POSITIONS, "Cue Block Number", mkv_read_subelements_cue_point},
@@ -1040,6 +1067,72 @@ static VC_CONTAINER_STATUS_T mkv_read_elements( VC_CONTAINER_T *p_ctx, MKV_ELEME
    return status;
 }
 
+/** Reads a top-level element of the segment, keeping track of the ones
+ * we need before we can start playing the stream */
+static VC_CONTAINER_STATUS_T mkv_read_segment_child( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_T *child,
+   int64_t child_size, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+
+   status = mkv_read_element_data(p_ctx, child, child_size, size);
+   if(child->id == MKV_ELEMENT_ID_INFO) module->has_info = true;
+   if(child->id == MKV_ELEMENT_ID_TRACKS) module->has_tracks = true;
+   return status;
+}
+
+/** Reads the segment info and tracks directly from where the SeekHead says they are */
+static VC_CONTAINER_STATUS_T mkv_read_seek_head_targets( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   struct { MKV_ELEMENT_ID_T id; uint64_t offset; bool done; } targets[] = {
+      {MKV_ELEMENT_ID_INFO, module->info_offset, module->has_info},
+      {MKV_ELEMENT_ID_TRACKS, module->tracks_offset, module->has_tracks} };
+   unsigned int i, j, tracks_num = p_ctx->tracks_num;
+
+   if(!STREAM_SEEKABLE(p_ctx) || !module->info_offset || !module->tracks_offset)
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   for(i = 0; i < sizeof(targets)/sizeof(targets[0]) && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      MKV_ELEMENT_T *child = mkv_elements_list;
+      MKV_ELEMENT_ID_T child_id;
+      int64_t child_size;
+
+      if(targets[i].done) continue;
+      status = SEEK(p_ctx, targets[i].offset);
+      if(status != VC_CONTAINER_SUCCESS) break;
+      status = mkv_read_element_header(p_ctx, INT64_C(-1), &child_id, &child_size,
+                                       MKV_ELEMENT_ID_SEGMENT, &child);
+      if(status == VC_CONTAINER_SUCCESS && (child_id != targets[i].id || child_size < 0))
+         status = VC_CONTAINER_ERROR_CORRUPTED;
+      if(status != VC_CONTAINER_SUCCESS) break;
+
+      /* Call the parsing function directly so we know whether the element was valid */
+      status = child->pf_func(p_ctx, child_id, child_size);
+      if(status == VC_CONTAINER_SUCCESS && child_id == MKV_ELEMENT_ID_INFO) module->has_info = true;
+      if(status == VC_CONTAINER_SUCCESS && child_id == MKV_ELEMENT_ID_TRACKS) module->has_tracks = true;
+   }
+
+   /* Drop whatever tracks we got so they can be read again in the normal way */
+   if(status != VC_CONTAINER_SUCCESS && !targets[1].done)
+   {
+      for(i = tracks_num; i < p_ctx->tracks_num; i++)
+      {
+         for(j = 0; j < MKV_MAX_ENCODINGS; j++)
+            free(p_ctx->tracks[i]->priv->module->encodings[j].data);
+         vc_container_free_track(p_ctx, p_ctx->tracks[i]);
+         p_ctx->tracks[i] = NULL;
+      }
+      p_ctx->tracks_num = tracks_num;
+      module->parsing = NULL;
+      module->has_tracks = false;
+   }
+
+   return status;
+}
+
 static VC_CONTAINER_STATUS_T mkv_read_element_segment( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
@@ -1060,8 +1153,9 @@ static VC_CONTAINER_STATUS_T mkv_read_element_segment( VC_CONTAINER_T *p_ctx, MK
    module->segment_offset = STREAM_POSITION(p_ctx);
    module->segment_size = size;
 
-   /* Read contained elements until we have all the information we need to start
-    * playing the stream */
+   /* Read contained elements until we find the first cluster. Only the headers of
+    * elements we don't need to start playing the stream get read (e.g. cues are
+    * only located here, tags and attachments are skipped). */
    module->element_level++;
    while(status == VC_CONTAINER_SUCCESS &&
          (unknown_size || size >= MKV_ELEMENT_MIN_HEADER_SIZE))
@@ -1085,11 +1179,28 @@ static VC_CONTAINER_STATUS_T mkv_read_element_segment( VC_CONTAINER_T *p_ctx, MK
          module->state.levels[1].id = MKV_ELEMENT_ID_CLUSTER;
          module->state.levels[1].data_start = 0;
          module->state.levels[1].data_offset = 0;
+         module->index_next_cluster = module->cluster_offset;
+         mkv_index_cluster(p_ctx, &module->state, module->cluster_offset, module->cluster_offset,
+            module->state.levels[1].offset, child_size);
          break;
       }
 
-      status = mkv_read_element_data(p_ctx, child, child_size, size);
+      /* Don't read again what the SeekHead already led us to */
+      if((child_id == MKV_ELEMENT_ID_INFO && module->has_info) ||
+         (child_id == MKV_ELEMENT_ID_TRACKS && module->has_tracks))
+         status = SEEK(p_ctx, STREAM_POSITION(p_ctx) + child_size);
+      else
+         status = mkv_read_segment_child(p_ctx, child, child_size, size);
       if(!unknown_size) size -= (STREAM_POSITION(p_ctx) - offset);
+
+      /* Use the SeekHead to go straight to the elements we need, in case
+       * they are stored after the clusters */
+      if(status == VC_CONTAINER_SUCCESS && child_id == MKV_ELEMENT_ID_SEEK_HEAD && !unknown_size)
+      {
+         offset = STREAM_POSITION(p_ctx);
+         mkv_read_seek_head_targets(p_ctx);
+         status = SEEK(p_ctx, offset);
+      }
    }
 
    module->element_level--;
@@ -1557,6 +1668,12 @@ static VC_CONTAINER_STATUS_T mkv_read_subelements_seek_head( VC_CONTAINER_T *p_c
       if(status == VC_CONTAINER_SUCCESS && !module->tags_offset &&
          module->seekhead_elem_id == MKV_ELEMENT_ID_TAGS && module->seekhead_elem_offset)
          module->tags_offset = module->seekhead_elem_offset;
+      if(status == VC_CONTAINER_SUCCESS && !module->info_offset &&
+         module->seekhead_elem_id == MKV_ELEMENT_ID_INFO && module->seekhead_elem_offset)
+         module->info_offset = module->seekhead_elem_offset;
+      if(status == VC_CONTAINER_SUCCESS && !module->tracks_offset &&
+         module->seekhead_elem_id == MKV_ELEMENT_ID_TRACKS && module->seekhead_elem_offset)
+         module->tracks_offset = module->seekhead_elem_offset;
       return status;
    }
 
@@ -1581,15 +1698,98 @@ static VC_CONTAINER_STATUS_T mkv_read_subelements_seek_head( VC_CONTAINER_T *p_c
    return status;
 }
 
+/** Inserts an entry in the seek index of a track, keeping it sorted by time.
+ * Only the first entry is kept for a given cluster. */
+static VC_CONTAINER_STATUS_T mkv_add_cue( VC_CONTAINER_TRACK_MODULE_T *track_module,
+   int64_t time, uint64_t offset )
+{
+   unsigned int low = 0, high = track_module->cues_num;
+
+   /* Find the insertion point. Cues are usually in order so check the end first */
+   if(high && track_module->cues[high-1].time > time)
+   {
+      while(low < high)
+      {
+         unsigned int mid = low + (high - low) / 2;
+         if(track_module->cues[mid].time <= time) low = mid + 1;
+         else high = mid;
+      }
+   }
+   else low = high;
+
+   if((low && track_module->cues[low-1].offset == offset) ||
+      (low < track_module->cues_num && track_module->cues[low].offset == offset &&
+       track_module->cues[low].time == time))
+      return VC_CONTAINER_SUCCESS; /* Already indexed */
+
+   if(track_module->cues_num == track_module->cues_max)
+   {
+      MKV_CUE_T *cues = realloc(track_module->cues,
+         (track_module->cues_max + MKV_CUES_INCREMENT) * sizeof(*cues));
+      if(!cues) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      track_module->cues = cues;
+      track_module->cues_max += MKV_CUES_INCREMENT;
+   }
+
+   memmove(track_module->cues + low + 1, track_module->cues + low,
+      (track_module->cues_num - low) * sizeof(*track_module->cues));
+   track_module->cues[low].time = time;
+   track_module->cues[low].offset = offset;
+   track_module->cues_num++;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/** Binary search for the entry of the seek index to use to seek to the given time.
+ * Returns -1 if no suitable entry exists. */
+static int mkv_find_cue( VC_CONTAINER_TRACK_MODULE_T *track_module, int64_t time, bool forward )
+{
+   unsigned int low = 0, high = track_module->cues_num;
+
+   /* Find the first entry past the requested time */
+   while(low < high)
+   {
+      unsigned int mid = low + (high - low) / 2;
+      if(track_module->cues[mid].time <= time) low = mid + 1;
+      else high = mid;
+   }
+
+   if(!forward) return (int)low - 1;
+   if(low && track_module->cues[low-1].time == time) return low - 1;
+   return low < track_module->cues_num ? (int)low : -1;
+}
+
 static VC_CONTAINER_STATUS_T mkv_read_element_cues( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_PARAM_UNUSED(id);
    VC_CONTAINER_PARAM_UNUSED(size);
+
+   /* Cues are only loaded when we first need to seek */
    module->cues_offset = module->element_offset;
    return VC_CONTAINER_SUCCESS;
 }
 
+static VC_CONTAINER_STATUS_T mkv_read_subelements_cue_track_positions( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   module->cue_track = 0;
+   module->cue_cluster_offset = 0;
+   module->cue_block = 0;
+   status = mkv_read_elements(p_ctx, id, size);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->number == module->cue_track) break;
+   if(i == p_ctx->tracks_num) return VC_CONTAINER_SUCCESS; /* Unknown track */
+
+   LOG_DEBUG(p_ctx, "INDEX: track %u, %"PRIi64, i, module->cue_timecode);
+   return mkv_add_cue(p_ctx->tracks[i]->priv->module,
+      module->cue_timecode * module->timecode_scale / 1000, module->cue_cluster_offset);
+}
+
 static VC_CONTAINER_STATUS_T mkv_read_subelements_cue_point( VC_CONTAINER_T *p_ctx, MKV_ELEMENT_ID_T id, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
@@ -1639,6 +1839,26 @@ static VC_CONTAINER_STATUS_T mkv_read_subelements_cluster( VC_CONTAINER_T *p_ctx
 
 /*******************************/
 
+/** Keeps track of the cluster being read so its keyframes can be added to the seek index.
+ * The index is only built when the stream has no cues and only ever grows contiguously
+ * from the first cluster so we always know which part of the stream it covers.
+ * search_offset is where we started looking for the cluster. */
+static void mkv_index_cluster(VC_CONTAINER_T *p_ctx, MKV_READER_STATE_T *state,
+   int64_t search_offset, int64_t offset, int64_t data_offset, int64_t size)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   state->cluster_offset = offset;
+   state->cluster_indexed = false;
+   if(module->cues_offset || module->index_complete || size < 0 ||
+      (uint64_t)search_offset > module->index_next_cluster ||
+      (uint64_t)offset < module->index_next_cluster)
+      return;
+
+   state->cluster_indexed = true;
+   module->index_next_cluster = data_offset + size;
+}
+
 static VC_CONTAINER_STATUS_T mkv_skip_element(VC_CONTAINER_T *p_ctx,
       MKV_READER_STATE_T *state)
 {
@@ -1671,7 +1891,7 @@ static VC_CONTAINER_STATUS_T mkv_find_next_element(VC_CONTAINER_T *p_ctx,
       MKV_READER_STATE_T *state, MKV_ELEMENT_ID_T element_id)
 {
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
-   int64_t element_size, element_offset;
+   int64_t element_size, element_offset, search_offset = STREAM_POSITION(p_ctx);
    MKV_ELEMENT_ID_T id;
 
    /* Skip all elements until we find the next requested element */
@@ -1709,6 +1929,10 @@ static VC_CONTAINER_STATUS_T mkv_find_next_element(VC_CONTAINER_T *p_ctx,
    if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS)
       return STREAM_STATUS(p_ctx);
 
+   if(id == MKV_ELEMENT_ID_CLUSTER)
+      mkv_index_cluster(p_ctx, state, search_offset, p_ctx->priv->module->element_offset,
+         element_offset, element_size);
+
    state->level++;
    state->levels[state->level].offset = element_offset;
    state->levels[state->level].size = element_size;
@@ -1927,6 +2151,11 @@ static VC_CONTAINER_STATUS_T mkv_read_next_frame_header(VC_CONTAINER_T *p_ctx,
    state->pts /= 1000;
    state->flags = flags;
 
+   /* Build up the seek index as we go when the stream doesn't have any cues */
+   if(state->cluster_indexed && track_module &&
+      ((flags & 0x80) || p_ctx->tracks[i]->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO))
+      mkv_add_cue(track_module, state->pts, state->cluster_offset - module->segment_offset);
+
    state->frame_duration = state->frame_duration * module->timecode_scale / 1000;
    if(state->lacing_num_frames) state->frame_duration /= state->lacing_num_frames;
    if(!state->frame_duration && track_module)
@@ -2093,108 +2322,152 @@ static VC_CONTAINER_STATUS_T mkv_reader_read(VC_CONTAINER_T *p_ctx,
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T mkv_reader_seek(VC_CONTAINER_T *p_ctx,
-   int64_t *p_offset, VC_CONTAINER_SEEK_MODE_T mode, VC_CONTAINER_SEEK_FLAGS_T flags)
+static VC_CONTAINER_STATUS_T mkv_reader_reset_state(VC_CONTAINER_T *p_ctx, uint64_t offset)
 {
-   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    MKV_READER_STATE_T *state = &module->state;
-   uint64_t offset = 0, prev_offset = 0, position = STREAM_POSITION(p_ctx);
-   int64_t time_offset = 0, prev_time_offset = 0;
-   unsigned int i, video_track;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   status = SEEK(p_ctx, offset);
+   if(status != VC_CONTAINER_SUCCESS && status != VC_CONTAINER_ERROR_EOS) return status;
+
+   memset(state, 0, sizeof(*state));
+   state->levels[0].offset = module->segment_offset;
+   state->levels[0].size = module->segment_size;
+   state->levels[0].id = MKV_ELEMENT_ID_SEGMENT;
+   if(status == VC_CONTAINER_ERROR_EOS) state->eos = true;
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_T *p_track = p_ctx->tracks[i];
+      p_track->priv->module->state = state;
+   }
+   return VC_CONTAINER_SUCCESS;
+}
+
+/** Loads the cues pointed to by the seek head into the seek index */
+static void mkv_reader_load_cues(VC_CONTAINER_T *p_ctx)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
    MKV_ELEMENT_T *element = mkv_cue_elements_list;
-   int64_t size, element_size;
    MKV_ELEMENT_ID_T id;
-   VC_CONTAINER_PARAM_UNUSED(mode);
-   VC_CONTAINER_PARAM_UNUSED(flags);
+   int64_t size;
 
-   /* Find out if we have a video track */
-   for(video_track = 0; video_track < p_ctx->tracks_num; video_track++)
-      if(p_ctx->tracks[video_track]->is_enabled &&
-         p_ctx->tracks[video_track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+   status = SEEK(p_ctx, module->cues_offset);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = mkv_read_element_header(p_ctx, INT64_C(-1) /* TODO */, &id, &size,
+                                       MKV_ELEMENT_ID_SEGMENT, &element);
+   if(status == VC_CONTAINER_SUCCESS && id == MKV_ELEMENT_ID_CUES)
+   {
+      module->elements_list = mkv_cue_elements_list;
+      status = mkv_read_elements(p_ctx, id, size);
+      module->elements_list = mkv_elements_list;
+   }
+   module->cues_loaded = true;
 
-   if(!*p_offset) goto end; /* Nothing much to do */
-   if(!module->cues_offset) {status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION; goto error;}
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->cues_num) return;
 
-   /* We need to do a search in the cue list */
-   status = SEEK(p_ctx, module->cues_offset);
-   if(status != VC_CONTAINER_SUCCESS) goto error;
+   /* The cues are unusable, fall back to building the index ourselves */
+   LOG_DEBUG(p_ctx, "no usable cues found (%i)", status);
+   module->cues_offset = 0;
+}
+
+/** Extends the seek index built during playback until it goes past the given time.
+ * For forward seeks we also need an index entry past that time. */
+static VC_CONTAINER_STATUS_T mkv_reader_extend_index(VC_CONTAINER_T *p_ctx,
+   unsigned int track, int64_t time, bool forward)
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   MKV_READER_STATE_T *state = &module->state;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   VC_CONTAINER_STATUS_T status;
 
-   /* First read the header of the cues element */
-   status = mkv_read_element_header(p_ctx, INT64_C(-1) /* TODO */, &id, &element_size,
-                                    MKV_ELEMENT_ID_SEGMENT, &element);
-   if(status != VC_CONTAINER_SUCCESS || id != MKV_ELEMENT_ID_CUES) goto error;
-   size = element_size;
+   status = mkv_reader_reset_state(p_ctx, module->index_next_cluster);
+   if(status != VC_CONTAINER_SUCCESS) return status;
 
-   module->elements_list = mkv_cue_elements_list;
-   do
+   /* Go through all the frame headers, the index gets filled up as we go */
+   while(!state->eos)
    {
-      MKV_ELEMENT_T *element = mkv_cue_elements_list;
-      int64_t element_offset = STREAM_POSITION(p_ctx);
+      uint32_t frame_track, data_size;
+      status = mkv_read_next_frame_header(p_ctx, state, &frame_track, &data_size);
+      if(status != VC_CONTAINER_SUCCESS) break;
+      if(frame_track == track && state->pts > time && (!forward ||
+         (track_module->cues_num && track_module->cues[track_module->cues_num-1].time >= time)))
+         break;
+      status = mkv_read_frame_data(p_ctx, state, 0, &data_size);
+      if(status != VC_CONTAINER_SUCCESS) break;
+   }
 
-      /* Exit condition for when we've scanned the whole cues list */
-      if(size <= 0)
-      {
-         if(!(flags & VC_CONTAINER_SEEK_FLAG_FORWARD))
-            break; /* Just use the last valid entry in that case */
-         status = VC_CONTAINER_ERROR_EOS;
-         goto error;
-      }
+   if(status == VC_CONTAINER_ERROR_EOS || state->eos)
+   {
+      module->index_complete = true;
+      status = VC_CONTAINER_SUCCESS;
+   }
+   return status;
+}
 
-      status = mkv_read_element_header(p_ctx, size, &id, &element_size,
-                                       MKV_ELEMENT_ID_CUES, &element);
-      size -= STREAM_POSITION(p_ctx) - element_offset;
-      if(status == VC_CONTAINER_SUCCESS && element->id != MKV_ELEMENT_ID_UNKNOWN)
-         status = mkv_read_element_data(p_ctx, element, element_size, size);
+static VC_CONTAINER_STATUS_T mkv_reader_seek(VC_CONTAINER_T *p_ctx,
+   int64_t *p_offset, VC_CONTAINER_SEEK_MODE_T mode, VC_CONTAINER_SEEK_FLAGS_T flags)
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   MKV_READER_STATE_T *state = &module->state, state_backup = module->state;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   uint64_t offset = 0, position = STREAM_POSITION(p_ctx);
+   int64_t time_offset = 0;
+   unsigned int i, video_track, track;
+   bool forward = !!(flags & VC_CONTAINER_SEEK_FLAG_FORWARD);
+   int cue;
+   VC_CONTAINER_PARAM_UNUSED(mode);
 
-      if(status != VC_CONTAINER_SUCCESS || element->id == MKV_ELEMENT_ID_UNKNOWN)
-      {
-         if(!(flags & VC_CONTAINER_SEEK_FLAG_FORWARD))
-            break; /* Just use the last valid entry in that case */
-         goto error;
-      }
+   /* Find out if we have a video track */
+   for(video_track = 0; video_track < p_ctx->tracks_num; video_track++)
+      if(p_ctx->tracks[video_track]->is_enabled &&
+         p_ctx->tracks[video_track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
 
-      size -= element_size;
-      if(id != MKV_ELEMENT_ID_CUE_POINT) continue;
+   if(!*p_offset) goto end; /* Nothing much to do */
 
-      /* Ignore cue points which don't belong to the track we want */
-      if(video_track != p_ctx->tracks_num &&
-         p_ctx->tracks[video_track]->priv->module->number != module->cue_track) continue;
+   if(module->cues_offset && !module->cues_loaded)
+      mkv_reader_load_cues(p_ctx);
+
+   /* Pick the track whose index we'll be using */
+   track = video_track;
+   for(i = 0; track == p_ctx->tracks_num && i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->is_enabled &&
+         (p_ctx->tracks[i]->priv->module->cues_num || !module->cues_offset)) track = i;
+   for(i = 0; track == p_ctx->tracks_num && i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->cues_num) track = i;
+   if(track == p_ctx->tracks_num) {status = VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION; goto error;}
+   track_module = p_ctx->tracks[track]->priv->module;
+
+   /* Without cues, make sure the index we've built so far covers the requested position */
+   if(!module->cues_offset && !module->index_complete &&
+      (!track_module->cues_num || track_module->cues[track_module->cues_num-1].time <= *p_offset))
+   {
+      status = mkv_reader_extend_index(p_ctx, track, *p_offset, forward);
+      if(status != VC_CONTAINER_SUCCESS) /* Just use what we've got */
+         LOG_DEBUG(p_ctx, "failed to extend the index (%i)", status);
+   }
 
-      time_offset = module->cue_timecode * module->timecode_scale / 1000;
-      offset = module->cue_cluster_offset;
-      LOG_DEBUG(p_ctx, "INDEX: %"PRIi64, time_offset);
-      if( time_offset > *p_offset )
-      {
-         if(!(flags & VC_CONTAINER_SEEK_FLAG_FORWARD))
-         {
-            time_offset = prev_time_offset;
-            offset = prev_offset;
-         }
-         break;
-      }
-      prev_time_offset = time_offset;
-      prev_offset = offset;
-   } while( 1 );
-   module->elements_list = mkv_elements_list;
+   /* Binary search in the index */
+   cue = mkv_find_cue(track_module, *p_offset, forward);
+   if(cue < 0 && forward) {status = VC_CONTAINER_ERROR_EOS; goto error;}
+   if(cue >= 0)
+   {
+      time_offset = track_module->cues[cue].time;
+      offset = track_module->cues[cue].offset;
+   }
+   LOG_DEBUG(p_ctx, "INDEX: %"PRIi64" -> %"PRIi64" (%"PRIu64")", *p_offset, time_offset, offset);
    *p_offset = time_offset;
 
  end:
-   /* Try seeking to the requested position */
-   status = SEEK(p_ctx, module->segment_offset + offset);
-   if(status != VC_CONTAINER_SUCCESS && status != VC_CONTAINER_ERROR_EOS) goto error;
-
-   /* Reinitialise the state */
-   memset(state, 0, sizeof(*state));
-   state->levels[0].offset = module->segment_offset;
-   state->levels[0].size = module->segment_size;
-   state->levels[0].id = MKV_ELEMENT_ID_SEGMENT;
-   if(status == VC_CONTAINER_ERROR_EOS) state->eos = true;
-   for(i = 0; i < p_ctx->tracks_num; i++)
-   {
-      VC_CONTAINER_TRACK_T *p_track = p_ctx->tracks[i];
-      p_track->priv->module->state = state;
-   }
+   /* Try seeking to the requested position and reinitialise the state */
+   status = mkv_reader_reset_state(p_ctx, module->segment_offset + offset);
+   if(status != VC_CONTAINER_SUCCESS) goto error;
 
    /* If we have a video track, we skip frames until the next keyframe */
    for(i = 0; video_track != p_ctx->tracks_num && i < 200 /* limit search */; )
@@ -2215,6 +2488,7 @@ static VC_CONTAINER_STATUS_T mkv_reader_seek(VC_CONTAINER_T *p_ctx,
  error:
      /* Reset everything as it was before the seek */
      SEEK(p_ctx, position);
+     *state = state_backup;
      if(status == VC_CONTAINER_SUCCESS) status = VC_CONTAINER_ERROR_FAILED;
      return status;
 }
@@ -2229,6 +2503,7 @@ static VC_CONTAINER_STATUS_T mkv_reader_close(VC_CONTAINER_T *p_ctx)
    {
       for(j = 0; j < MKV_MAX_ENCODINGS; j++)
          free(p_ctx->tracks[i]->priv->module->encodings[j].data);
+      free(p_ctx->tracks[i]->priv->module->cues);
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
    }
    free(module);
@@ -2295,15 +2570,8 @@ VC_CONTAINER_STATUS_T mkv_reader_open(VC_CONTAINER_T *p_ctx)
    if(!STREAM_SEEKABLE(p_ctx))
       return VC_CONTAINER_SUCCESS;
 
-   if(module->cues_offset && (int64_t)module->cues_offset < p_ctx->size)
-      p_ctx->capabilities |= VC_CONTAINER_CAPS_CAN_SEEK;
-
-   if(module->tags_offset)
-   {
-      status = SEEK(p_ctx, module->tags_offset);
-      if(status == VC_CONTAINER_SUCCESS)
-         status = mkv_read_element(p_ctx, INT64_C(-1) /*FIXME*/, MKV_ELEMENT_ID_SEGMENT);
-   }
+   /* We can always build a seek index if the stream doesn't have cues */
+   p_ctx->capabilities |= VC_CONTAINER_CAPS_CAN_SEEK;
 
    /* Seek back to the start of the data */
    return SEEK(p_ctx, module->state.levels[1].offset);
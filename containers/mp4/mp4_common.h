@@ -73,6 +73,19 @@ typedef enum {
    MP4_BOX_TYPE_DAWP              = VC_FOURCC('d','a','w','p'),
    MP4_BOX_TYPE_DEVC              = VC_FOURCC('d','e','v','c'),
    MP4_BOX_TYPE_WAVE              = VC_FOURCC('w','a','v','e'),
+   MP4_BOX_TYPE_MVEX              = VC_FOURCC('m','v','e','x'),
+   MP4_BOX_TYPE_MEHD              = VC_FOURCC('m','e','h','d'),
+   MP4_BOX_TYPE_TREX              = VC_FOURCC('t','r','e','x'),
+   MP4_BOX_TYPE_MOOF              = VC_FOURCC('m','o','o','f'),
+   MP4_BOX_TYPE_MFHD              = VC_FOURCC('m','f','h','d'),
+   MP4_BOX_TYPE_TRAF              = VC_FOURCC('t','r','a','f'),
+   MP4_BOX_TYPE_TFHD              = VC_FOURCC('t','f','h','d'),
+   MP4_BOX_TYPE_TFDT              = VC_FOURCC('t','f','d','t'),
+   MP4_BOX_TYPE_TRUN              = VC_FOURCC('t','r','u','n'),
+   MP4_BOX_TYPE_SIDX              = VC_FOURCC('s','i','d','x'),
+   MP4_BOX_TYPE_MFRA              = VC_FOURCC('m','f','r','a'),
+   MP4_BOX_TYPE_TFRA              = VC_FOURCC('t','f','r','a'),
+   MP4_BOX_TYPE_MFRO              = VC_FOURCC('m','f','r','o'),
    MP4_BOX_TYPE_ZERO              = 0
 } MP4_BOX_TYPE_T;
 
@@ -100,6 +113,28 @@ typedef enum
    MP4_SAMPLE_TABLE_NUM
 } MP4_SAMPLE_TABLE_T;
 
+/* Flags of the track fragment header (tfhd) */
+#define MP4_TFHD_BASE_DATA_OFFSET_PRESENT         0x000001
+#define MP4_TFHD_SAMPLE_DESCRIPTION_INDEX_PRESENT 0x000002
+#define MP4_TFHD_DEFAULT_SAMPLE_DURATION_PRESENT  0x000008
+#define MP4_TFHD_DEFAULT_SAMPLE_SIZE_PRESENT      0x000010
+#define MP4_TFHD_DEFAULT_SAMPLE_FLAGS_PRESENT     0x000020
+#define MP4_TFHD_DURATION_IS_EMPTY                0x010000
+#define MP4_TFHD_DEFAULT_BASE_IS_MOOF             0x020000
+
+/* Flags of the track fragment run (trun) */
+#define MP4_TRUN_DATA_OFFSET_PRESENT              0x000001
+#define MP4_TRUN_FIRST_SAMPLE_FLAGS_PRESENT       0x000004
+#define MP4_TRUN_SAMPLE_DURATION_PRESENT          0x000100
+#define MP4_TRUN_SAMPLE_SIZE_PRESENT              0x000200
+#define MP4_TRUN_SAMPLE_FLAGS_PRESENT             0x000400
+#define MP4_TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT 0x000800
+
+/* Sample flags used in track fragments */
+#define MP4_SAMPLE_FLAG_IS_NON_SYNC               0x00010000
+#define MP4_SAMPLE_FLAG_DEPENDS_ON_OTHERS         0x01000000
+#define MP4_SAMPLE_FLAG_DEPENDS_ON_NO_OTHER       0x02000000
+
 /* Values for object_type_indication (mp4_decoder_config_descriptor)
  * see ISO/IEC 14496-1:2001(E) section 8.6.6.2 table 8 p. 30
  * see ISO/IEC 14496-15:2003 (draft) section 4.2.2 table 3 p. 11
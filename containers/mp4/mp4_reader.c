@@ -61,6 +61,13 @@ Defines.
 
 #define MP4_MAX_SAMPLES_BATCH_SIZE (16*1024)
 
+/* Maximum amount of memory used to decode the sample tables of a track at open time.
+ * Tracks which need more than this (or all tracks if this is set to 0) will have
+ * their sample tables read from the stream as the samples are being accessed. */
+#ifndef MP4_SAMPLE_INDEX_MAX_SIZE
+# define MP4_SAMPLE_INDEX_MAX_SIZE (16*1024*1024)
+#endif
+
 #define MP4_SKIP_U8(ctx,n)   (size -= 1, SKIP_U8(ctx,n))
 #define MP4_SKIP_U16(ctx,n)  (size -= 2, SKIP_U16(ctx,n))
 #define MP4_SKIP_U24(ctx,n)  (size -= 3, SKIP_U24(ctx,n))
@@ -111,6 +118,52 @@ typedef struct
 
 } MP4_READER_STATE_T;
 
+/* Run of samples sharing the same duration, from the stts table */
+typedef struct
+{
+   uint32_t sample;    /**< First sample of the run */
+   uint32_t count;     /**< Number of samples in the run */
+   uint32_t duration;  /**< Duration of each sample in the run */
+   int64_t time;       /**< Decoding time of the first sample of the run */
+
+} MP4_TIME_RUN_T;
+
+/* Run of samples sharing the same composition offset, from the ctts table */
+typedef struct
+{
+   uint32_t sample;    /**< First sample of the run */
+   uint32_t count;     /**< Number of samples in the run */
+   int32_t offset;     /**< Composition offset of each sample in the run */
+
+} MP4_COMPOSITION_RUN_T;
+
+/* Sample tables of a track, decoded in memory */
+typedef struct
+{
+   uint32_t samples;   /**< Number of samples which can be accessed */
+   uint32_t samples_max; /**< Number of samples the arrays can hold */
+   int64_t *offsets;   /**< Offset in the stream of each sample */
+   uint32_t *sizes;    /**< Size of each sample (NULL if they all have the same size) */
+   uint32_t *keyframes; /**< Bitmap of the sync samples (NULL if there isn't any stss) */
+   uint32_t *chunks;   /**< Bitmap of the samples starting a new chunk */
+
+   MP4_TIME_RUN_T *times;
+   uint32_t times_num;
+   uint32_t times_max;
+   MP4_COMPOSITION_RUN_T *compositions;
+   uint32_t compositions_num;
+   uint32_t compositions_max;
+
+} MP4_SAMPLE_INDEX_T;
+
+/* Random access point into a fragmented stream, from the sidx or mfra boxes */
+typedef struct
+{
+   int64_t time;       /**< Presentation time of the point in microseconds */
+   int64_t offset;     /**< Offset of the fragment (or segment) starting at this point */
+
+} MP4_FRAGMENT_POINT_T;
+
 typedef struct VC_CONTAINER_TRACK_MODULE_T
 {
    MP4_READER_STATE_T state;
@@ -127,6 +180,14 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
 
    uint32_t samples_batch_size;
 
+   MP4_SAMPLE_INDEX_T *index; /**< Decoded sample tables (NULL if not available) */
+
+   uint32_t track_id;
+   uint32_t default_sample_duration; /**< Defaults for the track fragments (trex) */
+   uint32_t default_sample_size;
+   uint32_t default_sample_flags;
+   int64_t fragment_time; /**< Decoding time of the next sample from the fragments */
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -145,6 +206,27 @@ typedef struct VC_CONTAINER_MODULE_T
    int64_t data_offset;
    int64_t data_size;
 
+   /* Fragmented streams */
+   bool fragmented;          /**< The moov box has an mvex box */
+   bool fragments_only;      /**< All the samples are described by the fragments */
+   int64_t fragment_offset;  /**< Offset of the next top level box to look for fragments */
+   int64_t eos_size;         /**< Size of the stream when we last looked for new fragments */
+   int64_t first_fragment_offset;
+   int64_t moof_offset;      /**< Offset of the moof box being parsed */
+   int64_t traf_end;         /**< End of the data described by the previous traf */
+   struct {
+      VC_CONTAINER_TRACK_MODULE_T *track_module; /**< NULL if the track isn't known */
+      int64_t base_offset;
+      int64_t data_offset;   /**< Offset of the data of the next sample */
+      uint32_t duration;
+      uint32_t size;
+      uint32_t flags;
+   } traf;
+
+   MP4_FRAGMENT_POINT_T *points; /**< Random access points sorted by time */
+   unsigned int points_num;
+   unsigned int points_max;
+
 } VC_CONTAINER_MODULE_T;
 
 /******************************************************************************
@@ -177,6 +259,17 @@ static VC_CONTAINER_STATUS_T mp4_read_box_stss( VC_CONTAINER_T *p_ctx, int64_t s
 static VC_CONTAINER_STATUS_T mp4_read_box_vide( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_soun( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_text( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_mehd( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_moof( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfdt( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_sidx( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_mfra( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfra( VC_CONTAINER_T *p_ctx, int64_t size );
 
 static VC_CONTAINER_STATUS_T mp4_read_box_esds( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_vide_avcC( VC_CONTAINER_T *p_ctx, int64_t size );
@@ -219,6 +312,21 @@ static struct {
    {MP4_BOX_TYPE_SOUN, mp4_read_box_soun, MP4_BOX_TYPE_STSD},
    {MP4_BOX_TYPE_TEXT, mp4_read_box_text, MP4_BOX_TYPE_STSD},
 
+   /* Fragmented streams */
+   {MP4_BOX_TYPE_MVEX, mp4_read_box_mvex, MP4_BOX_TYPE_MOOV},
+   {MP4_BOX_TYPE_MEHD, mp4_read_box_mehd, MP4_BOX_TYPE_MVEX},
+   {MP4_BOX_TYPE_TREX, mp4_read_box_trex, MP4_BOX_TYPE_MVEX},
+   {MP4_BOX_TYPE_MOOF, mp4_read_box_moof, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_MFHD, 0,                 MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TRAF, mp4_read_box_traf, MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TFHD, mp4_read_box_tfhd, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_TFDT, mp4_read_box_tfdt, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_TRUN, mp4_read_box_trun, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_SIDX, mp4_read_box_sidx, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_MFRA, mp4_read_box_mfra, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_TFRA, mp4_read_box_tfra, MP4_BOX_TYPE_MFRA},
+   {MP4_BOX_TYPE_MFRO, 0,                 MP4_BOX_TYPE_MFRA},
+
    /* Codec specific boxes */
    {MP4_BOX_TYPE_AVCC, mp4_read_box_vide_avcC, MP4_BOX_TYPE_VIDE},
    {MP4_BOX_TYPE_D263, mp4_read_box_vide_d263, MP4_BOX_TYPE_VIDE},
@@ -528,6 +636,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_trak( VC_CONTAINER_T *p_ctx, int64_t s
 static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
    uint32_t i, version;
    int64_t duration;
 
@@ -538,7 +647,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t s
    {
       MP4_SKIP_U64(p_ctx, "creation_time");
       MP4_SKIP_U64(p_ctx, "modification_time");
-      MP4_SKIP_U32(p_ctx, "track_ID");
+      track_module->track_id = MP4_READ_U32(p_ctx, "track_ID");
       MP4_SKIP_U32(p_ctx, "reserved");
       duration = MP4_READ_U64(p_ctx, "duration");
    }
@@ -546,7 +655,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t s
    {
       MP4_SKIP_U32(p_ctx, "creation_time");
       MP4_SKIP_U32(p_ctx, "modification_time");
-      MP4_SKIP_U32(p_ctx, "track_ID");
+      track_module->track_id = MP4_READ_U32(p_ctx, "track_ID");
       MP4_SKIP_U32(p_ctx, "reserved");
       duration = MP4_READ_U32(p_ctx, "duration");
    }
@@ -1197,6 +1306,957 @@ static VC_CONTAINER_STATUS_T mp4_read_box_text( VC_CONTAINER_T *p_ctx, int64_t s
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static void mp4_free_sample_index( MP4_SAMPLE_INDEX_T *index )
+{
+   if(!index) return;
+   free(index->offsets);
+   free(index->sizes);
+   free(index->keyframes);
+   free(index->chunks);
+   free(index->times);
+   free(index->compositions);
+   free(index);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_build_sample_index( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_TRACK_MODULE_T *track_module, uint64_t max_size )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   MP4_SAMPLE_TABLE_T table = MP4_SAMPLE_TABLE_STCO;
+   MP4_SAMPLE_INDEX_T *index;
+   uint32_t i, j, count, value, samples = 0, stsc_entries, *stsc = 0;
+   uint32_t entry, chunks_left, samples_per_chunk;
+   int64_t time = 0, offset;
+   uint64_t index_size;
+
+   /* CO64 support */
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries)
+      table = MP4_SAMPLE_TABLE_CO64;
+
+   if(!track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries ||
+      !track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries ||
+      !track_module->sample_table[table].entries)
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+
+   index = malloc(sizeof(*index));
+   if(!index) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+   memset(index, 0, sizeof(*index));
+
+   /* Decode the time to sample table, merging the runs which have the same duration */
+   index->times = malloc(track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries *
+      sizeof(*index->times));
+   if(!index->times) goto error;
+   status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
+   for(i = 0; status == VC_CONTAINER_SUCCESS &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries; i++)
+   {
+      count = _READ_U32(p_ctx);
+      value = _READ_U32(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+      if(!count) break; /* Samples after this point can't be accessed */
+      count = MIN(count, UINT32_MAX - samples);
+
+      if(index->times_num && index->times[index->times_num-1].duration == value)
+         index->times[index->times_num-1].count += count;
+      else
+      {
+         index->times[index->times_num].sample = samples;
+         index->times[index->times_num].count = count;
+         index->times[index->times_num].duration = value;
+         index->times[index->times_num].time = time;
+         index->times_num++;
+      }
+      samples += count;
+      time += (int64_t)count * value;
+   }
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+
+   /* Decode the composition time to sample table */
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries)
+   {
+      index->compositions = malloc(track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries *
+         sizeof(*index->compositions));
+      if(!index->compositions) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+      status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].offset);
+      for(i = 0, j = 0; status == VC_CONTAINER_SUCCESS &&
+          i < track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries && j < samples; i++)
+      {
+         count = _READ_U32(p_ctx);
+         value = _READ_U32(p_ctx); /* Converted to signed */
+         status = STREAM_STATUS(p_ctx);
+         if(status != VC_CONTAINER_SUCCESS) goto error;
+         if(!count) break;
+         count = MIN(count, samples - j);
+
+         if(index->compositions_num &&
+            index->compositions[index->compositions_num-1].offset == (int32_t)value)
+            index->compositions[index->compositions_num-1].count += count;
+         else
+         {
+            index->compositions[index->compositions_num].sample = j;
+            index->compositions[index->compositions_num].count = count;
+            index->compositions[index->compositions_num].offset = (int32_t)value;
+            index->compositions_num++;
+         }
+         j += count;
+      }
+      samples = j; /* Samples without a composition time can't be accessed */
+   }
+
+   if(!track_module->sample_size)
+      samples = MIN(samples, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries);
+
+   /* Make sure we stay within our memory budget */
+   index_size = (uint64_t)samples * sizeof(*index->offsets) + samples / 4 +
+      track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries * 2 * sizeof(*stsc);
+   if(!track_module->sample_size) index_size += (uint64_t)samples * sizeof(*index->sizes);
+   if(!samples || index_size > max_size)
+   { status = VC_CONTAINER_ERROR_OUT_OF_RESOURCES; goto error; }
+
+   index->offsets = malloc(samples * sizeof(*index->offsets));
+   index->chunks = calloc((samples + 31) / 32, sizeof(*index->chunks));
+   if(!index->offsets || !index->chunks) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+
+   /* Decode the sample size table */
+   if(!track_module->sample_size)
+   {
+      index->sizes = malloc(samples * sizeof(*index->sizes));
+      if(!index->sizes) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+      status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].offset);
+      for(i = 0; status == VC_CONTAINER_SUCCESS && i < samples; i++)
+         index->sizes[i] = _READ_U32(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
+
+   /* Keep the first chunk and number of samples per chunk of each sample to chunk entry */
+   stsc_entries = track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries;
+   stsc = malloc(stsc_entries * 2 * sizeof(*stsc));
+   if(!stsc) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].offset);
+   for(i = 0; status == VC_CONTAINER_SUCCESS && i < stsc_entries; i++)
+   {
+      stsc[2*i] = _READ_U32(p_ctx);
+      stsc[2*i+1] = _READ_U32(p_ctx);
+      _SKIP_U32(p_ctx);
+   }
+   status = STREAM_STATUS(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+
+   /* Work out the offset of each sample from the chunk offsets. This follows the same
+    * rules as the sample by sample parsing, including where it stops on corrupted entries. */
+   status = SEEK(p_ctx, track_module->sample_table[table].offset);
+   for(i = 0, j = 0, entry = 0, chunks_left = 0, samples_per_chunk = 0;
+       status == VC_CONTAINER_SUCCESS && j < samples &&
+       i < track_module->sample_table[table].entries; i++)
+   {
+      if(!chunks_left)
+      {
+         /* Switch to the next entry in the sample to chunk table */
+         if(entry >= stsc_entries) break;
+         value = entry + 1 < stsc_entries ? stsc[2*(entry+1)] : UINT32_MAX;
+         samples_per_chunk = stsc[2*entry+1];
+         if(!stsc[2*entry] || !samples_per_chunk || stsc[2*entry] >= value) break;
+         chunks_left = value - stsc[2*entry];
+         entry++;
+      }
+
+      offset = table == MP4_SAMPLE_TABLE_STCO ? _READ_U32(p_ctx) : (int64_t)_READ_U64(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS || !offset) break;
+
+      index->chunks[j >> 5] |= 1u << (j & 31);
+      for(count = 0; count < samples_per_chunk && j < samples; count++, j++)
+      {
+         index->offsets[j] = offset;
+         offset += index->sizes ? index->sizes[j] : track_module->sample_size;
+      }
+      chunks_left--;
+   }
+   samples = j;
+   if(!samples) { status = VC_CONTAINER_ERROR_CORRUPTED; goto error; }
+
+   /* Build the bitmap of the sync samples */
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries)
+   {
+      index->keyframes = calloc((samples + 31) / 32, sizeof(*index->keyframes));
+      if(!index->keyframes) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+      status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].offset);
+      for(i = 0; status == VC_CONTAINER_SUCCESS &&
+          i < track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries; i++)
+      {
+         value = _READ_U32(p_ctx) - 1;
+         status = STREAM_STATUS(p_ctx);
+         if(status == VC_CONTAINER_SUCCESS && value < samples)
+            index->keyframes[value >> 5] |= 1u << (value & 31);
+      }
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
+
+   free(stsc);
+   index->samples = index->samples_max = samples;
+   index->times_max = track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries;
+   index->compositions_max = track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries;
+   track_module->index = index;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   free(stsc);
+   mp4_free_sample_index(index);
+   return status;
+}
+
+/*****************************************************************************/
+static bool mp4_index_test_bit( const uint32_t *bitmap, uint32_t bit )
+{
+   return bitmap && (bitmap[bit >> 5] & (1u << (bit & 31)));
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_time_run( const MP4_SAMPLE_INDEX_T *index, uint32_t sample )
+{
+   uint32_t start = 0, end = index->times_num;
+
+   /* Find the last run starting at or before this sample */
+   while(end - start > 1)
+   {
+      uint32_t middle = start + (end - start) / 2;
+      if(index->times[middle].sample <= sample) start = middle;
+      else end = middle;
+   }
+   return start;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_composition_run( const MP4_SAMPLE_INDEX_T *index, uint32_t sample )
+{
+   uint32_t start = 0, end = index->compositions_num;
+
+   /* Find the last run starting at or before this sample */
+   while(end - start > 1)
+   {
+      uint32_t middle = start + (end - start) / 2;
+      if(index->compositions[middle].sample <= sample) start = middle;
+      else end = middle;
+   }
+   return start;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_sample( const MP4_SAMPLE_INDEX_T *index,
+   int64_t seek_time, int64_t seek_time_up )
+{
+   const MP4_TIME_RUN_T *run;
+   uint32_t start = 0, end = index->times_num;
+
+   if(!index->times_num) return 0;
+
+   /* Find the first run which ends after the requested time */
+   while(start < end)
+   {
+      uint32_t middle = start + (end - start) / 2;
+      run = &index->times[middle];
+      if(run->time + (int64_t)run->count * run->duration <= seek_time) start = middle + 1;
+      else end = middle;
+   }
+   if(start == index->times_num)
+      return index->times[start-1].sample + index->times[start-1].count;
+
+   run = &index->times[start];
+   if(!run->duration || seek_time < run->time) return run->sample;
+   return run->sample + MAX((seek_time - run->time) / run->duration,
+      (seek_time_up - run->time) / run->duration);
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_sync_sample( const MP4_SAMPLE_INDEX_T *index,
+   uint32_t sample, bool forward )
+{
+   uint32_t next, prev, word;
+
+   /* Find the first sync sample after the requested one */
+   for(next = sample + 1; next < index->samples; next = (next | 31) + 1)
+   {
+      word = index->keyframes[next >> 5] >> (next & 31);
+      if(!word) continue;
+      while(!(word & 1)) { word >>= 1; next++; }
+      break;
+   }
+   if(next >= index->samples) return sample;
+   if(forward) return next;
+
+   /* Find the last sync sample at or before the requested one */
+   for(prev = sample; ; prev = (prev & ~31) - 1)
+   {
+      word = index->keyframes[prev >> 5] << (31 - (prev & 31));
+      if(word)
+      {
+         while(!(word & 0x80000000)) { word <<= 1; prev--; }
+         return prev;
+      }
+      if(prev < 32) return 0;
+   }
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_read_sample_header( VC_CONTAINER_TRACK_MODULE_T *track_module,
+   MP4_READER_STATE_T *state )
+{
+   const MP4_SAMPLE_INDEX_T *index = track_module->index;
+   const MP4_TIME_RUN_T *run;
+   uint32_t sample = state->sample, *entry;
+
+   /* Switch to the next sample */
+   state->sample_offset = 0;
+   state->sample_size = 0;
+   if(sample >= index->samples)
+      return state->status = VC_CONTAINER_ERROR_EOS;
+
+   state->offset = index->offsets[sample];
+   state->sample_size = index->sizes ? index->sizes[sample] : track_module->sample_size;
+
+   /* Get the timestamp */
+   entry = &state->sample_table[MP4_SAMPLE_TABLE_STTS].entry;
+   while(sample >= index->times[*entry].sample + index->times[*entry].count) (*entry)++;
+   run = &index->times[*entry];
+   state->sample_duration = run->duration;
+   state->duration = run->time + (int64_t)(sample - run->sample) * run->duration;
+   if(track_module->timescale)
+      state->pts = state->dts = state->duration * 1000000 / track_module->timescale;
+
+   /* Get the composition time */
+   if(index->compositions_num)
+   {
+      entry = &state->sample_table[MP4_SAMPLE_TABLE_CTTS].entry;
+      while(sample >= index->compositions[*entry].sample + index->compositions[*entry].count)
+         (*entry)++;
+      state->sample_composition_offset = index->compositions[*entry].offset;
+      if(track_module->timescale)
+         state->pts = (state->duration + state->sample_composition_offset) * 1000000 /
+            track_module->timescale;
+   }
+   state->duration += state->sample_duration;
+
+   state->keyframe = mp4_index_test_bit(index->keyframes, sample);
+   state->sample = ++sample;
+
+   /* Try to batch several samples together if requested. We'll always stop at the chunk boundary */
+   if(track_module->samples_batch_size)
+   {
+      uint32_t size = state->sample_size;
+      entry = &state->sample_table[MP4_SAMPLE_TABLE_STTS].entry;
+      while(sample < index->samples && size < track_module->samples_batch_size &&
+            !mp4_index_test_bit(index->chunks, sample))
+      {
+         while(sample >= index->times[*entry].sample + index->times[*entry].count) (*entry)++;
+         state->duration += index->times[*entry].duration;
+         size += index->sizes ? index->sizes[sample] : track_module->sample_size;
+         sample++;
+      }
+      state->sample = sample;
+      state->sample_size = size;
+   }
+
+   return state->status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_reserve( VC_CONTAINER_TRACK_MODULE_T *track_module,
+   uint32_t count )
+{
+   MP4_SAMPLE_INDEX_T *index = track_module->index;
+   uint32_t i, max, words, old_words;
+   void *buffer;
+
+   if(count > UINT32_MAX - index->samples) return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   /* Fragments can carry composition offsets even if previous samples didn't */
+   if(!index->compositions_num && index->samples)
+   {
+      if(!index->compositions_max)
+      {
+         index->compositions = malloc(sizeof(*index->compositions));
+         if(!index->compositions) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         index->compositions_max = 1;
+      }
+      index->compositions[0].sample = 0;
+      index->compositions[0].count = index->samples;
+      index->compositions[0].offset = 0;
+      index->compositions_num = 1;
+   }
+
+   if(index->samples + count > index->samples_max || !index->sizes)
+   {
+      max = MAX(index->samples + count, index->samples_max + index->samples_max / 2);
+      max = MAX(max, 256);
+      old_words = (index->samples_max + 31) / 32;
+      words = (max + 31) / 32;
+
+      buffer = realloc(index->offsets, max * sizeof(*index->offsets));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      index->offsets = buffer;
+
+      /* Samples in fragments don't necessarily all have the same size */
+      buffer = realloc(index->sizes, max * sizeof(*index->sizes));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      if(!index->sizes)
+         for(i = 0; i < index->samples; i++)
+            ((uint32_t *)buffer)[i] = track_module->sample_size;
+      index->sizes = buffer;
+
+      buffer = realloc(index->keyframes, words * sizeof(*index->keyframes));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      if(!index->keyframes) old_words = 0;
+      index->keyframes = buffer;
+      memset(index->keyframes + old_words, 0, (words - old_words) * sizeof(*index->keyframes));
+
+      old_words = (index->samples_max + 31) / 32;
+      buffer = realloc(index->chunks, words * sizeof(*index->chunks));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      index->chunks = buffer;
+      memset(index->chunks + old_words, 0, (words - old_words) * sizeof(*index->chunks));
+
+      index->samples_max = max;
+   }
+
+   /* Each new sample could start a new run */
+   if(count > index->times_max - index->times_num)
+   {
+      max = MAX(index->times_num + count, index->times_max + index->times_max / 2);
+      buffer = realloc(index->times, max * sizeof(*index->times));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      index->times = buffer;
+      index->times_max = max;
+   }
+   if(count > index->compositions_max - index->compositions_num)
+   {
+      max = MAX(index->compositions_num + count, index->compositions_max + index->compositions_max / 2);
+      buffer = realloc(index->compositions, max * sizeof(*index->compositions));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      index->compositions = buffer;
+      index->compositions_max = max;
+   }
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static void mp4_index_add_sample( MP4_SAMPLE_INDEX_T *index, int64_t offset, uint32_t size,
+   int64_t time, uint32_t duration, int32_t composition_offset, bool keyframe, bool chunk )
+{
+   MP4_TIME_RUN_T *run = index->times_num ? &index->times[index->times_num-1] : 0;
+   MP4_COMPOSITION_RUN_T *composition =
+      index->compositions_num ? &index->compositions[index->compositions_num-1] : 0;
+   uint32_t sample = index->samples++;
+
+   index->offsets[sample] = offset;
+   index->sizes[sample] = size;
+   if(keyframe) index->keyframes[sample >> 5] |= 1u << (sample & 31);
+   if(chunk) index->chunks[sample >> 5] |= 1u << (sample & 31);
+
+   if(run && run->duration == duration && run->time + (int64_t)run->count * duration == time)
+      run->count++;
+   else
+   {
+      run = &index->times[index->times_num++];
+      run->sample = sample;
+      run->count = 1;
+      run->duration = duration;
+      run->time = time;
+   }
+
+   if(composition && composition->offset == composition_offset)
+      composition->count++;
+   else
+   {
+      composition = &index->compositions[index->compositions_num++];
+      composition->sample = sample;
+      composition->count = 1;
+      composition->offset = composition_offset;
+   }
+}
+
+/*****************************************************************************/
+static void mp4_index_reset( MP4_SAMPLE_INDEX_T *index )
+{
+   if(index->keyframes)
+      memset(index->keyframes, 0, (index->samples_max + 31) / 32 * sizeof(*index->keyframes));
+   if(index->chunks)
+      memset(index->chunks, 0, (index->samples_max + 31) / 32 * sizeof(*index->chunks));
+   index->samples = 0;
+   index->times_num = 0;
+   index->compositions_num = 0;
+}
+
+/*****************************************************************************/
+static int64_t mp4_index_end_time( const MP4_SAMPLE_INDEX_T *index )
+{
+   const MP4_TIME_RUN_T *run;
+   if(!index->times_num) return 0;
+   run = &index->times[index->times_num-1];
+   return run->time + (int64_t)run->count * run->duration;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_reference_track( VC_CONTAINER_T *p_ctx )
+{
+   uint32_t track;
+
+   /* This is the track used to find the seek points */
+   for(track = 0; track < p_ctx->tracks_num; track++)
+      if(p_ctx->tracks[track]->is_enabled &&
+         p_ctx->tracks[track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) return track;
+   return 0;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_add_fragment_point( VC_CONTAINER_T *p_ctx,
+   int64_t time, int64_t offset )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   MP4_FRAGMENT_POINT_T *points;
+   unsigned int max;
+
+   /* Points are kept sorted and we don't want duplicates */
+   if(module->points_num && time <= module->points[module->points_num-1].time)
+      return VC_CONTAINER_SUCCESS;
+
+   if(module->points_num == module->points_max)
+   {
+      max = MAX(module->points_max * 2, 64);
+      points = realloc(module->points, max * sizeof(*points));
+      if(!points) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->points = points;
+      module->points_max = max;
+   }
+
+   module->points[module->points_num].time = time;
+   module->points[module->points_num].offset = offset;
+   module->points_num++;
+   if(time > p_ctx->duration) p_ctx->duration = time;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   module->fragmented = true;
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MVEX);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mehd( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t version;
+   int64_t duration;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   duration = version ? MP4_READ_U64(p_ctx, "fragment_duration") :
+      MP4_READ_U32(p_ctx, "fragment_duration");
+
+   if(module->timescale)
+      duration = duration * 1000000 / module->timescale;
+   if(duration > p_ctx->duration) p_ctx->duration = duration;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module = 0;
+   uint32_t i, track_id;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->track_id == track_id)
+         track_module = p_ctx->tracks[i]->priv->module;
+   if(!track_module) return STREAM_STATUS(p_ctx);
+
+   MP4_SKIP_U32(p_ctx, "default_sample_description_index");
+   track_module->default_sample_duration = MP4_READ_U32(p_ctx, "default_sample_duration");
+   track_module->default_sample_size = MP4_READ_U32(p_ctx, "default_sample_size");
+   track_module->default_sample_flags = MP4_READ_U32(p_ctx, "default_sample_flags");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_moof( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* Without an explicit base offset, the first traf is relative to the moof box */
+   module->traf_end = module->moof_offset;
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MOOF);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+
+   module->traf.track_module = 0;
+   status = mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_TRAF);
+
+   /* The next traf without an explicit base offset carries on from our data */
+   if(module->traf.track_module)
+      module->traf_end = module->traf.data_offset;
+   module->traf.track_module = 0;
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = 0;
+   uint32_t i, flags, track_id;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   flags = MP4_READ_U24(p_ctx, "flags");
+
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->track_id == track_id)
+         track_module = p_ctx->tracks[i]->priv->module;
+   if(!track_module || !track_module->index)
+   {
+      LOG_DEBUG(p_ctx, "ignoring fragment for unknown track %u", track_id);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   if(flags & MP4_TFHD_BASE_DATA_OFFSET_PRESENT)
+      module->traf.base_offset = MP4_READ_U64(p_ctx, "base_data_offset");
+   else if(flags & MP4_TFHD_DEFAULT_BASE_IS_MOOF)
+      module->traf.base_offset = module->moof_offset;
+   else
+      module->traf.base_offset = module->traf_end;
+   if(flags & MP4_TFHD_SAMPLE_DESCRIPTION_INDEX_PRESENT)
+      MP4_SKIP_U32(p_ctx, "sample_description_index");
+
+   module->traf.duration = (flags & MP4_TFHD_DEFAULT_SAMPLE_DURATION_PRESENT) ?
+      MP4_READ_U32(p_ctx, "default_sample_duration") : track_module->default_sample_duration;
+   module->traf.size = (flags & MP4_TFHD_DEFAULT_SAMPLE_SIZE_PRESENT) ?
+      MP4_READ_U32(p_ctx, "default_sample_size") : track_module->default_sample_size;
+   module->traf.flags = (flags & MP4_TFHD_DEFAULT_SAMPLE_FLAGS_PRESENT) ?
+      MP4_READ_U32(p_ctx, "default_sample_flags") : track_module->default_sample_flags;
+
+   module->traf.data_offset = module->traf.base_offset;
+   module->traf.track_module = track_module;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfdt( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t version;
+   int64_t time;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   time = version ? MP4_READ_U64(p_ctx, "base_media_decode_time") :
+      MP4_READ_U32(p_ctx, "base_media_decode_time");
+
+   if(module->traf.track_module && STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS)
+      module->traf.track_module->fragment_time = time;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = module->traf.track_module;
+   VC_CONTAINER_STATUS_T status;
+   uint32_t i, flags, count, entry_size, first_flags = 0;
+   uint32_t duration, sample_size, sample_flags;
+   int32_t composition_offset;
+   int64_t end;
+
+   if(!track_module) return STREAM_STATUS(p_ctx);
+
+   MP4_SKIP_U8(p_ctx, "version");
+   flags = MP4_READ_U24(p_ctx, "flags");
+   count = MP4_READ_U32(p_ctx, "sample_count");
+   if(flags & MP4_TRUN_DATA_OFFSET_PRESENT)
+      module->traf.data_offset = module->traf.base_offset +
+         (int32_t)MP4_READ_U32(p_ctx, "data_offset");
+   if(flags & MP4_TRUN_FIRST_SAMPLE_FLAGS_PRESENT)
+      first_flags = MP4_READ_U32(p_ctx, "first_sample_flags");
+
+   status = STREAM_STATUS(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Sanity check the number of samples against the size of the box */
+   entry_size = 4 * (!!(flags & MP4_TRUN_SAMPLE_DURATION_PRESENT) +
+      !!(flags & MP4_TRUN_SAMPLE_SIZE_PRESENT) + !!(flags & MP4_TRUN_SAMPLE_FLAGS_PRESENT) +
+      !!(flags & MP4_TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT));
+   if(size < 0 || (entry_size && count > size / entry_size))
+      return VC_CONTAINER_ERROR_CORRUPTED;
+
+   status = mp4_index_reserve(track_module, count);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0; i < count; i++)
+   {
+      duration = (flags & MP4_TRUN_SAMPLE_DURATION_PRESENT) ?
+         _READ_U32(p_ctx) : module->traf.duration;
+      sample_size = (flags & MP4_TRUN_SAMPLE_SIZE_PRESENT) ?
+         _READ_U32(p_ctx) : module->traf.size;
+      sample_flags = (flags & MP4_TRUN_SAMPLE_FLAGS_PRESENT) ? _READ_U32(p_ctx) :
+         (!i && (flags & MP4_TRUN_FIRST_SAMPLE_FLAGS_PRESENT)) ? first_flags : module->traf.flags;
+      composition_offset = (flags & MP4_TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT) ?
+         (int32_t)_READ_U32(p_ctx) : 0; /* Converted to signed */
+      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) break;
+
+      mp4_index_add_sample(track_module->index, module->traf.data_offset, sample_size,
+         track_module->fragment_time, duration, composition_offset,
+         !(sample_flags & MP4_SAMPLE_FLAG_IS_NON_SYNC), !i);
+      module->traf.data_offset += sample_size;
+      track_module->fragment_time += duration;
+   }
+
+   /* Keep track of the duration of streams which are still being written */
+   if(track_module->timescale)
+   {
+      end = track_module->fragment_time * 1000000 / track_module->timescale;
+      if(end > p_ctx->duration) p_ctx->duration = end;
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_sidx( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   int64_t offset = STREAM_POSITION(p_ctx) + size, time;
+   uint32_t i, version, timescale, count, reference, duration;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   MP4_SKIP_U32(p_ctx, "reference_ID");
+   timescale = MP4_READ_U32(p_ctx, "timescale");
+   if(version)
+   {
+      time = MP4_READ_U64(p_ctx, "earliest_presentation_time");
+      offset += MP4_READ_U64(p_ctx, "first_offset");
+   }
+   else
+   {
+      time = MP4_READ_U32(p_ctx, "earliest_presentation_time");
+      offset += MP4_READ_U32(p_ctx, "first_offset");
+   }
+   MP4_SKIP_U16(p_ctx, "reserved");
+   count = MP4_READ_U16(p_ctx, "reference_count");
+   if(!timescale) return STREAM_STATUS(p_ctx);
+
+   /* Each reference gives us the start of a segment (or of another sidx) */
+   for(i = 0; i < count && size >= 12; i++)
+   {
+      reference = MP4_READ_U32(p_ctx, "referenced_size");
+      duration = MP4_READ_U32(p_ctx, "subsegment_duration");
+      MP4_SKIP_U32(p_ctx, "SAP");
+      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) break;
+
+      if(mp4_add_fragment_point(p_ctx, time * 1000000 / timescale, offset) != VC_CONTAINER_SUCCESS)
+         break;
+      offset += reference & 0x7fffffff;
+      time += duration;
+   }
+
+   time = time * 1000000 / timescale;
+   if(time > p_ctx->duration) p_ctx->duration = time;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mfra( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MFRA);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfra( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module =
+      p_ctx->tracks[mp4_reference_track(p_ctx)]->priv->module;
+   uint32_t i, version, lengths, count, skip;
+   int64_t time, offset;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+
+   /* We're only interested in the random access points of our reference track */
+   if(MP4_READ_U32(p_ctx, "track_ID") != track_module->track_id || !track_module->timescale)
+      return STREAM_STATUS(p_ctx);
+
+   lengths = MP4_READ_U32(p_ctx, "length_sizes");
+   skip = (lengths & 3) + ((lengths >> 2) & 3) + ((lengths >> 4) & 3) + 3;
+   count = MP4_READ_U32(p_ctx, "number_of_entry");
+
+   for(i = 0; i < count && size > 0; i++)
+   {
+      time = version ? MP4_READ_U64(p_ctx, "time") : MP4_READ_U32(p_ctx, "time");
+      offset = version ? MP4_READ_U64(p_ctx, "moof_offset") : MP4_READ_U32(p_ctx, "moof_offset");
+      MP4_SKIP_BYTES(p_ctx, skip);
+      if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) break;
+
+      if(mp4_add_fragment_point(p_ctx, time * 1000000 / track_module->timescale, offset) !=
+         VC_CONTAINER_SUCCESS) break;
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_mfra( VC_CONTAINER_T *p_ctx )
+{
+   int64_t size = p_ctx->priv->io->size;
+   uint32_t mfra_size;
+
+   /* The mfro box at the very end of the stream tells us where the mfra box starts */
+   if(!STREAM_SEEKABLE(p_ctx) || size < 16) return VC_CONTAINER_ERROR_NOT_FOUND;
+   if(SEEK(p_ctx, size - 16) != VC_CONTAINER_SUCCESS) return STREAM_STATUS(p_ctx);
+   if(_READ_U32(p_ctx) != 16 || _READ_FOURCC(p_ctx) != MP4_BOX_TYPE_MFRO)
+      return VC_CONTAINER_ERROR_NOT_FOUND;
+   _SKIP_U32(p_ctx); /* version and flags */
+   mfra_size = _READ_U32(p_ctx);
+   if(STREAM_STATUS(p_ctx) != VC_CONTAINER_SUCCESS) return STREAM_STATUS(p_ctx);
+   if(mfra_size < 16 || mfra_size > size) return VC_CONTAINER_ERROR_CORRUPTED;
+
+   if(SEEK(p_ctx, size - mfra_size) != VC_CONTAINER_SUCCESS) return STREAM_STATUS(p_ctx);
+   return mp4_read_box( p_ctx, mfra_size, MP4_BOX_TYPE_ROOT );
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_check_box_written( VC_CONTAINER_T *p_ctx, int64_t end )
+{
+   /* Check the last byte of the box is there */
+   if(SEEK(p_ctx, end - 1) != VC_CONTAINER_SUCCESS) return STREAM_STATUS(p_ctx);
+   _SKIP_U8(p_ctx);
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_fragment( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   MP4_BOX_TYPE_T box_type, data_type;
+   int64_t box_size, data_size, offset;
+
+   if(!module->fragment_offset) return VC_CONTAINER_ERROR_EOS;
+
+   /* Go through the top level boxes until we find the next moof */
+   while(1)
+   {
+      status = SEEK(p_ctx, module->fragment_offset);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      status = mp4_read_box_header( p_ctx, INT64_C(-1), &box_type, &box_size );
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      offset = STREAM_POSITION(p_ctx);
+
+      if(box_type == MP4_BOX_TYPE_MOOF)
+         break;
+
+      if(box_type == MP4_BOX_TYPE_SIDX)
+         mp4_read_box_data( p_ctx, box_type, box_size, MP4_BOX_TYPE_ROOT );
+      module->fragment_offset = offset + box_size;
+   }
+
+   /* Only use fragments which have been completely written, including their data.
+    * Streams which are still being recorded will be picked up on the next try. */
+   status = mp4_check_box_written(p_ctx, offset + box_size);
+   if(status == VC_CONTAINER_SUCCESS)
+      status = mp4_read_box_header( p_ctx, INT64_C(-1), &data_type, &data_size );
+   if(status == VC_CONTAINER_SUCCESS && data_type == MP4_BOX_TYPE_MDAT)
+      status = mp4_check_box_written(p_ctx, STREAM_POSITION(p_ctx) + data_size);
+   if(status != VC_CONTAINER_SUCCESS) return VC_CONTAINER_ERROR_EOS;
+
+   status = SEEK(p_ctx, offset);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   module->moof_offset = module->fragment_offset;
+   module->fragment_offset = offset + box_size;
+   return mp4_read_box_data( p_ctx, box_type, box_size, MP4_BOX_TYPE_ROOT );
+}
+
+/*****************************************************************************/
+static void mp4_reset_fragments( VC_CONTAINER_T *p_ctx, int64_t offset, int64_t time )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   unsigned int i;
+
+   /* Start indexing again from the given fragment. Tracks without a tfdt box will
+    * have to rely on the time of the random access point. */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      track_module = p_ctx->tracks[i]->priv->module;
+      mp4_index_reset(track_module->index);
+      track_module->fragment_time = time * track_module->timescale / 1000000;
+   }
+   module->fragment_offset = offset;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_seek_fragments( VC_CONTAINER_T *p_ctx, int64_t seek_time )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module =
+      p_ctx->tracks[mp4_reference_track(p_ctx)]->priv->module;
+   MP4_SAMPLE_INDEX_T *index = track_module->index;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   const MP4_FRAGMENT_POINT_T *point = 0;
+   unsigned int start = 0, end = module->points_num;
+   int64_t time = seek_time * track_module->timescale / 1000000;
+
+   /* Find the last random access point before the requested time */
+   while(start < end)
+   {
+      unsigned int middle = start + (end - start) / 2;
+      if(module->points[middle].time <= seek_time) start = middle + 1;
+      else end = middle;
+   }
+   if(start) point = &module->points[start - 1];
+
+   /* We can only drop what we have already indexed if it all comes from the fragments */
+   if(module->fragments_only)
+   {
+      if(index->samples && time < index->times[0].time)
+      {
+         /* The requested time is before what we've got indexed */
+         if(point) mp4_reset_fragments(p_ctx, point->offset, point->time);
+         else mp4_reset_fragments(p_ctx, module->first_fragment_offset, 0);
+      }
+      else if(point && point->offset >= module->fragment_offset &&
+              time >= mp4_index_end_time(index))
+      {
+         /* Jump straight to the fragment instead of going through all the ones before it */
+         mp4_reset_fragments(p_ctx, point->offset, point->time);
+      }
+   }
+
+   /* Index the fragments until we cover the requested time */
+   while(status == VC_CONTAINER_SUCCESS &&
+         (!index->samples || time >= mp4_index_end_time(index)))
+      status = mp4_read_fragment(p_ctx);
+
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -1204,7 +2264,11 @@ static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
    unsigned int i;
 
    for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      mp4_free_sample_index(p_ctx->tracks[i]->priv->module->index);
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
+   }
+   free(module->points);
    free(module);
    return VC_CONTAINER_SUCCESS;
 }
@@ -1352,6 +2416,15 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
    if(state->sample_offset < state->sample_size)
       return state->status; /* We still have data left from the current sample */
 
+   if(track_module->index)
+   {
+      /* Fragmented streams get indexed as we go along */
+      if(p_ctx->priv->module->fragmented && state->sample >= track_module->index->samples)
+         while(state->sample >= track_module->index->samples &&
+               mp4_read_fragment(p_ctx) == VC_CONTAINER_SUCCESS);
+      return mp4_index_read_sample_header(track_module, state);
+   }
+
    /* Switch to the next sample */
    state->offset += state->sample_size;
    state->sample_offset = 0;
@@ -1450,7 +2523,7 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
 
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32_t track,
-   MP4_READER_STATE_T *state, uint8_t *data, unsigned int *data_size )
+   MP4_READER_STATE_T *state, VC_CONTAINER_PACKET_T *packet, unsigned int *data_size, uint32_t flags )
 {
    VC_CONTAINER_STATUS_T status;
    unsigned int size = state->sample_size - state->sample_offset;
@@ -1459,12 +2532,12 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32
 
    if(data_size && *data_size < size) size = *data_size;
 
-   if(data)
+   if(packet)
    {
       state->status = SEEK(p_ctx, state->offset + state->sample_offset);
       if(state->status != VC_CONTAINER_SUCCESS) return state->status;
 
-      size = READ_BYTES(p_ctx, data, size);
+      size = READ_PACKET_BYTES(p_ctx, packet, size, flags);
    }
    state->sample_offset += size;
 
@@ -1485,14 +2558,36 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_data( VC_CONTAINER_T *p_ctx, uint32
 static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
                                               VC_CONTAINER_PACKET_T *packet, uint32_t flags )
 {
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module;
    VC_CONTAINER_STATUS_T status;
    MP4_READER_STATE_T *state;
-   uint32_t i, track;
+   uint32_t i, track, eos_tracks = 0;
    unsigned int data_size;
-   uint8_t *data = 0;
    int64_t offset;
 
+   /* New fragments might have been appended to the stream since we reached its end.
+    * Only look for them if the stream has grown or if there is nothing else left to
+    * read, otherwise tracks ending unevenly would re-read the end of the stream on
+    * every call. */
+   if(module->fragmented)
+   {
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         if(p_ctx->tracks[i]->priv->module->state.status == VC_CONTAINER_ERROR_EOS)
+            eos_tracks++;
+   }
+   if(eos_tracks && (eos_tracks == p_ctx->tracks_num || p_ctx->priv->io->size > module->eos_size))
+   {
+      for(i = 0; i < p_ctx->tracks_num; i++)
+      {
+         state = &p_ctx->tracks[i]->priv->module->state;
+         if(state->status != VC_CONTAINER_ERROR_EOS) continue;
+         state->status = VC_CONTAINER_SUCCESS;
+         mp4_read_sample_header(p_ctx, i, state);
+      }
+      module->eos_size = p_ctx->priv->io->size;
+   }
+
    /* Select the track to read from. If no specific track is requested by the caller, this
     * will be the track to which the next bit of data in the mdat belongs to */
    if(!(flags & VC_CONTAINER_READ_FLAG_FORCE_TRACK))
@@ -1520,7 +2615,7 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    if(status != VC_CONTAINER_SUCCESS) return status;
 
    if(!packet) /* Skip packet */
-      return mp4_read_sample_data(p_ctx, track, state, 0, 0);
+      return mp4_read_sample_data(p_ctx, track, state, 0, 0, 0);
 
    packet->dts = state->dts;
    packet->pts = state->pts;
@@ -1532,14 +2627,13 @@ static VC_CONTAINER_STATUS_T mp4_reader_read( VC_CONTAINER_T *p_ctx,
    packet->size = state->sample_size - state->sample_offset;
 
    if(flags & VC_CONTAINER_READ_FLAG_SKIP)
-      return mp4_read_sample_data(p_ctx, track, state, 0, 0);
+      return mp4_read_sample_data(p_ctx, track, state, 0, 0, 0);
    else if((flags & VC_CONTAINER_READ_FLAG_INFO) || !packet->data)
       return VC_CONTAINER_SUCCESS;
 
-   data = packet->data;
    data_size = packet->buffer_size;
 
-   status = mp4_read_sample_data(p_ctx, track, state, data, &data_size);
+   status = mp4_read_sample_data(p_ctx, track, state, packet, &data_size, flags);
    if(status != VC_CONTAINER_SUCCESS)
    {
       /* FIXME */
@@ -1569,6 +2663,12 @@ static uint32_t mp4_find_sample( VC_CONTAINER_T *p_ctx, uint32_t track,
     * rounding errors in the timestamp (because of the timescale conversion) */
    seek_time_up = seek_time_up * track_module->timescale / 1000000;
 
+   if(track_module->index)
+   {
+      sample = mp4_index_find_sample(track_module->index, seek_time, seek_time_up);
+      goto end;
+   }
+
    status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
    if(status != VC_CONTAINER_SUCCESS) goto end;
 
@@ -1610,6 +2710,17 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
 
    memset(state, 0, sizeof(*state));
 
+   if(track_module->index)
+   {
+      /* Position ourselves on the right entries in the decoded tables */
+      state->sample_table[MP4_SAMPLE_TABLE_STTS].entry =
+         mp4_index_find_time_run(track_module->index, sample);
+      state->sample_table[MP4_SAMPLE_TABLE_CTTS].entry =
+         mp4_index_find_composition_run(track_module->index, sample);
+      state->sample = sample;
+      return mp4_index_read_sample_header(track_module, state);
+   }
+
    /* Find the right chunk */
    for(i = 0, samples = sample; i < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries; i++)
    {
@@ -1710,13 +2821,16 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_STATUS_T status;
    uint32_t i, track, sample, prev_sample, next_sample;
    int64_t seek_time = *offset;
-   VC_CONTAINER_PARAM_UNUSED(module);
    VC_CONTAINER_PARAM_UNUSED(mode);
 
    /* Reset the states */
    for(i = 0; i < p_ctx->tracks_num; i++)
       memset(&p_ctx->tracks[i]->priv->module->state, 0, sizeof(p_ctx->tracks[i]->priv->module->state));
 
+   /* Make sure the fragments covering the requested time are indexed */
+   if(module->fragmented)
+      mp4_seek_fragments(p_ctx, seek_time);
+
    /* Deal with the easy case first */
    if(!*offset)
    {
@@ -1741,6 +2855,13 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
 
    /* Find the closest sync sample */
+   if(track_module->index)
+   {
+      if(!track_module->index->keyframes) goto seek_time_found;
+      sample = mp4_index_find_sync_sample(track_module->index, sample,
+         !!(flags & VC_CONTAINER_SEEK_FLAG_FORWARD));
+      goto sample_found;
+   }
    status = mp4_seek_sample_table( p_ctx, track_module, &track_module->state, MP4_SAMPLE_TABLE_STSS );
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
    for(i = 0, prev_sample = 0, next_sample = 0;
@@ -1755,6 +2876,7 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
       prev_sample = next_sample;
    }
 
+ sample_found:
    /* Do the seek on this track and use its timestamp as the new seek point */
    status = mp4_seek_track(p_ctx, track, &track_module->state, sample);
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
@@ -1824,12 +2946,26 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
 
    while(STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS)
    {
+      int64_t offset = STREAM_POSITION(p_ctx);
       MP4_BOX_TYPE_T box_type;
       int64_t box_size;
 
       status = mp4_read_box_header( p_ctx, INT64_C(-1), &box_type, &box_size );
+      if(status != VC_CONTAINER_SUCCESS && module->fragmented)
+      {
+         /* The fragments might not have been written yet */
+         module->fragment_offset = offset;
+         break;
+      }
       if(status != VC_CONTAINER_SUCCESS) goto error;
 
+      if(box_type == MP4_BOX_TYPE_MOOF && module->fragmented)
+      {
+         /* The fragments will be indexed as we go along */
+         module->fragment_offset = offset;
+         break;
+      }
+
       if(box_type == MP4_BOX_TYPE_MDAT)
       {
          module->data_offset = STREAM_POSITION(p_ctx);
@@ -1845,6 +2981,34 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
       if(module->found_moov && module->data_offset) break; /* We've got everything we want */
    }
 
+   /* Decode the sample tables in memory when they are small enough. Tracks for
+    * which this fails will keep reading their sample tables from the stream. */
+   if(MP4_SAMPLE_INDEX_MAX_SIZE && !module->fragmented)
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         mp4_build_sample_index(p_ctx, p_ctx->tracks[i]->priv->module, MP4_SAMPLE_INDEX_MAX_SIZE);
+
+   /* Fragmented streams always need the index as this is where the samples from
+    * the fragments are added */
+   if(module->fragmented)
+   {
+      if(!p_ctx->tracks_num) { status = VC_CONTAINER_ERROR_FORMAT_INVALID; goto error; }
+      module->fragments_only = true;
+      module->first_fragment_offset = module->fragment_offset;
+      for(i = 0; i < p_ctx->tracks_num; i++)
+      {
+         VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+         mp4_build_sample_index(p_ctx, track_module, UINT64_MAX);
+         if(!track_module->index)
+            track_module->index = calloc(1, sizeof(*track_module->index));
+         if(!track_module->index) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+         if(track_module->index->samples) module->fragments_only = false;
+         track_module->fragment_time = mp4_index_end_time(track_module->index);
+      }
+
+      /* Use the random access points from the mfra box if there is one */
+      mp4_read_mfra(p_ctx);
+   }
+
    /* Initialise tracks */
    for(i = 0; i < p_ctx->tracks_num; i++)
    {
@@ -47,9 +47,45 @@ Defines.
 
 #define MP4_64BITS_TIME 0 /* 0 to disable / 1 to enable */
 
+/* Amount of sample data a fragment can buffer before it gets written out
+ * regardless of its duration */
+#ifndef MP4_FRAGMENT_MAX_SIZE
+# define MP4_FRAGMENT_MAX_SIZE (16*1024*1024)
+#endif
+
+/* Streams with video only get cut at video keyframes so each fragment can be
+ * decoded on its own. This is the amount of sample data after which a fragment
+ * gets written out anyway because no keyframe is coming. */
+#ifndef MP4_FRAGMENT_HARD_MAX_SIZE
+# define MP4_FRAGMENT_HARD_MAX_SIZE (2*MP4_FRAGMENT_MAX_SIZE)
+#endif
+
 /******************************************************************************
 Type definitions.
 ******************************************************************************/
+/* Sample buffered in the current fragment */
+typedef struct
+{
+   size_t offset;     /**< Offset of the data in the fragment buffer */
+   uint32_t size;
+   uint32_t duration; /**< Duration in timescale units, set when the fragment is written */
+   int64_t dts;
+   int64_t pts;
+   unsigned int track;
+   bool keyframe;
+
+} MP4_FRAGMENT_SAMPLE_T;
+
+/* Random access point written in the tfra box */
+typedef struct
+{
+   int64_t time;
+   int64_t moof_offset;
+   uint32_t traf_number;
+   uint32_t sample_number;
+
+} MP4_FRAGMENT_ENTRY_T;
+
 typedef struct VC_CONTAINER_TRACK_MODULE_T
 {
    uint32_t fourcc;
@@ -69,6 +105,16 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
    int64_t first_pts;
    int64_t last_pts;
 
+   /* Fragmented output */
+   int64_t fragment_time;   /**< Decoding time of the track fragment being written */
+   uint32_t fragment_samples; /**< Number of samples in the track fragment */
+   bool fragment_composition; /**< Samples in the track fragment have composition offsets */
+   int64_t fragment_data_offset; /**< Offset of the samples data from the start of the moof */
+   uint32_t last_duration;
+   MP4_FRAGMENT_ENTRY_T *entries;
+   unsigned int entries_num;
+   unsigned int entries_max;
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -84,8 +130,11 @@ typedef struct VC_CONTAINER_MODULE_T
    unsigned int current_track;
 
    unsigned moov_size;
+   uint32_t moov_reserve;        /**< Space reserved for the moov box in front of the mdat */
+   int64_t moov_reserve_offset;
    int64_t mdat_offset;
    int64_t data_offset;
+   bool large_offsets; /**< chunk offsets don't fit in 32 bits, use co64 */
 
    uint32_t samples;
    VC_CONTAINER_WRITER_EXTRAIO_T temp;
@@ -96,6 +145,27 @@ typedef struct VC_CONTAINER_MODULE_T
    int64_t duration;
    /**/
 
+   /* Fragmented output */
+   uint32_t fragment_duration; /**< Maximum duration of a fragment in ms (0 if not fragmented) */
+   uint32_t fragment_flags;
+   int64_t moov_offset;
+   int64_t moof_offset;
+   int64_t moof_size;
+   uint32_t sequence_number;
+   unsigned int reference_track;
+   unsigned int mfra_size;
+   struct {
+      MP4_FRAGMENT_SAMPLE_T *samples;
+      unsigned int samples_num;
+      unsigned int samples_max;
+      VC_CONTAINER_IO_VEC_T *vecs;
+      uint8_t *data;
+      size_t data_size;
+      size_t data_max;
+      int64_t start_dts;
+      int64_t end_dts;
+   } fragment;
+
 } VC_CONTAINER_MODULE_T;
 
 /******************************************************************************
@@ -128,6 +198,19 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_vide( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_soun( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mehd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_sidx( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfra( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfra( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfro( VC_CONTAINER_T *p_ctx );
 
 static struct {
   const MP4_BOX_TYPE_T type;
@@ -159,6 +242,19 @@ static struct {
    {MP4_BOX_TYPE_VIDE, mp4_write_box_vide},
    {MP4_BOX_TYPE_SOUN, mp4_write_box_soun},
    {MP4_BOX_TYPE_ESDS, mp4_write_box_esds},
+   {MP4_BOX_TYPE_MVEX, mp4_write_box_mvex},
+   {MP4_BOX_TYPE_MEHD, mp4_write_box_mehd},
+   {MP4_BOX_TYPE_TREX, mp4_write_box_trex},
+   {MP4_BOX_TYPE_SIDX, mp4_write_box_sidx},
+   {MP4_BOX_TYPE_MOOF, mp4_write_box_moof},
+   {MP4_BOX_TYPE_MFHD, mp4_write_box_mfhd},
+   {MP4_BOX_TYPE_TRAF, mp4_write_box_traf},
+   {MP4_BOX_TYPE_TFHD, mp4_write_box_tfhd},
+   {MP4_BOX_TYPE_TFDT, mp4_write_box_tfdt},
+   {MP4_BOX_TYPE_TRUN, mp4_write_box_trun},
+   {MP4_BOX_TYPE_MFRA, mp4_write_box_mfra},
+   {MP4_BOX_TYPE_TFRA, mp4_write_box_tfra},
+   {MP4_BOX_TYPE_MFRO, mp4_write_box_mfro},
    {MP4_BOX_TYPE_UNKNOWN, 0}
 };
 
@@ -252,6 +348,10 @@ static VC_CONTAINER_STATUS_T mp4_write_box_moov( VC_CONTAINER_T *p_ctx )
       if(status != VC_CONTAINER_SUCCESS) return status;
    }
 
+   /* The samples of fragmented streams are described by the movie fragments */
+   if(module->fragment_duration)
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MVEX);
+
    return status;
 }
 
@@ -567,10 +667,11 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stbl( VC_CONTAINER_T *p_ctx )
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_STSZ);
    if(status != VC_CONTAINER_SUCCESS) return status;
 
-   if(1)
+   if(!module->large_offsets)
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_STCO);
    else
       status = mp4_write_box(p_ctx, MP4_BOX_TYPE_CO64);
+   if(status != VC_CONTAINER_SUCCESS) return status;
 
    if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
    {
@@ -804,7 +905,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsz( VC_CONTAINER_T *p_ctx )
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
+static VC_CONTAINER_STATUS_T mp4_write_chunk_offsets( VC_CONTAINER_T *p_ctx, bool large )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
@@ -815,6 +916,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
 
    memset(&sample, 0, sizeof(VC_CONTAINER_PACKET_T));
 
+   /* Both boxes share the same chunk count, only the size of the entries differ */
    WRITE_U8(p_ctx,  0, "version");
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries, "entry_count");
@@ -822,7 +924,8 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
    if(module->null.refcount)
    {
       /* We're not actually writing the data, we just want the size */
-      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries * 4);
+      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries *
+         (large ? 8 : 4));
       return STREAM_STATUS(p_ctx);
    }
 
@@ -837,7 +940,8 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
       /* Is it a new chunk ? */
       if(track_offset != offset)
       {
-         WRITE_U32(p_ctx, offset, "chunk_offset");
+         if(large) WRITE_U64(p_ctx, offset, "chunk_offset");
+         else WRITE_U32(p_ctx, offset, "chunk_offset");
          entries++;
       }
       track_offset = offset + sample.size;
@@ -852,23 +956,15 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
 }
 
 /*****************************************************************************/
-static VC_CONTAINER_STATUS_T mp4_write_box_co64( VC_CONTAINER_T *p_ctx )
+static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
 {
-   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
-   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
-
-   WRITE_U8(p_ctx,  0, "version");
-   WRITE_U24(p_ctx, 0, "flags");
-   WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries, "entry_count");
-
-   if(module->null.refcount)
-   {
-      /* We're not actually writing the data, we just want the size */
-      WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries * 8);
-      return STREAM_STATUS(p_ctx);
-   }
+   return mp4_write_chunk_offsets(p_ctx, false);
+}
 
-   return STREAM_STATUS(p_ctx);
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_co64( VC_CONTAINER_T *p_ctx )
+{
+   return mp4_write_chunk_offsets(p_ctx, true);
 }
 
 /*****************************************************************************/
@@ -1138,6 +1234,535 @@ static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx )
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static int64_t mp4_fragment_time( int64_t dts )
+{
+   return dts > 0 ? dts * MP4_TIMESCALE / 1000000 : 0;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MEHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TREX);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mehd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   unsigned int version = MP4_64BITS_TIME;
+
+   WRITE_U8(p_ctx,  version, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+
+   /* The duration is only known once the stream gets closed */
+   if(version)
+      WRITE_U64(p_ctx, module->duration * MP4_TIMESCALE / 1000000, "fragment_duration");
+   else
+      WRITE_U32(p_ctx, module->duration * MP4_TIMESCALE / 1000000, "fragment_duration");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+   WRITE_U32(p_ctx, 1, "default_sample_description_index");
+   WRITE_U32(p_ctx, 0, "default_sample_duration");
+   WRITE_U32(p_ctx, 0, "default_sample_size");
+   WRITE_U32(p_ctx, 0, "default_sample_flags");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_sidx( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->reference_track]->priv->module;
+   MP4_FRAGMENT_SAMPLE_T *sample;
+   uint32_t duration = 0, sap = 0;
+   bool first = true;
+   unsigned int i;
+
+   /* The segment is described in terms of the reference track */
+   for(i = 0; i < module->fragment.samples_num; i++)
+   {
+      sample = &module->fragment.samples[i];
+      if(sample->track != module->reference_track) continue;
+      if(first && sample->keyframe) sap = 0x90000000; /* starts_with_SAP, SAP_type 1 */
+      first = false;
+      duration += sample->duration;
+   }
+
+   WRITE_U8(p_ctx,  1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+
+   WRITE_U32(p_ctx, module->reference_track + 1, "reference_ID");
+   WRITE_U32(p_ctx, MP4_TIMESCALE, "timescale");
+   WRITE_U64(p_ctx, track_module->fragment_time, "earliest_presentation_time");
+   WRITE_U64(p_ctx, 0, "first_offset");
+   WRITE_U16(p_ctx, 0, "reserved");
+   WRITE_U16(p_ctx, 1, "reference_count");
+
+   /* The segment is the moof box and its mdat box */
+   WRITE_U32(p_ctx, (uint32_t)(module->moof_size + 8 + module->fragment.data_size), "referenced_size");
+   WRITE_U32(p_ctx, duration, "subsegment_duration");
+   WRITE_U32(p_ctx, sap, "SAP");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!p_ctx->tracks[i]->priv->module->fragment_samples) continue;
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TRAF);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->sequence_number, "sequence_number");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFDT);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return mp4_write_box(p_ctx, MP4_BOX_TYPE_TRUN);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* Data offsets are relative to the start of the moof box */
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, MP4_TFHD_BASE_DATA_OFFSET_PRESENT, "flags");
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+   WRITE_U64(p_ctx, module->moof_offset, "base_data_offset");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
+
+   WRITE_U8(p_ctx,  1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U64(p_ctx, track_module->fragment_time, "base_media_decode_time");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
+   MP4_FRAGMENT_SAMPLE_T *sample;
+   unsigned int i;
+
+   uint32_t flags = MP4_TRUN_DATA_OFFSET_PRESENT | MP4_TRUN_SAMPLE_DURATION_PRESENT |
+      MP4_TRUN_SAMPLE_SIZE_PRESENT | MP4_TRUN_SAMPLE_FLAGS_PRESENT;
+   int64_t offset;
+
+   if(track_module->fragment_composition)
+      flags |= MP4_TRUN_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, flags, "flags");
+   WRITE_U32(p_ctx, track_module->fragment_samples, "sample_count");
+   WRITE_U32(p_ctx, (uint32_t)track_module->fragment_data_offset, "data_offset");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->fragment_samples *
+         (track_module->fragment_composition ? 16 : 12));
+      return STREAM_STATUS(p_ctx);
+   }
+
+   for(i = 0; i < module->fragment.samples_num; i++)
+   {
+      sample = &module->fragment.samples[i];
+      if(sample->track != module->current_track) continue;
+
+      WRITE_U32(p_ctx, sample->duration, "sample_duration");
+      WRITE_U32(p_ctx, sample->size, "sample_size");
+      WRITE_U32(p_ctx, sample->keyframe ? MP4_SAMPLE_FLAG_DEPENDS_ON_NO_OTHER :
+         MP4_SAMPLE_FLAG_DEPENDS_ON_OTHERS | MP4_SAMPLE_FLAG_IS_NON_SYNC, "sample_flags");
+      if(!track_module->fragment_composition) continue;
+
+      offset = mp4_fragment_time(sample->pts) - mp4_fragment_time(sample->dts);
+      WRITE_U32(p_ctx, offset > 0 ? (uint32_t)offset : 0, "sample_composition_time_offset");
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfra( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!p_ctx->tracks[i]->priv->module->entries_num) continue;
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFRA);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   return mp4_write_box(p_ctx, MP4_BOX_TYPE_MFRO);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfra( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
+   unsigned int i;
+
+   WRITE_U8(p_ctx,  1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+   WRITE_U32(p_ctx, 0x3F, "length_size"); /* 4 bytes for the traf, trun and sample numbers */
+   WRITE_U32(p_ctx, track_module->entries_num, "number_of_entry");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->entries_num * 28);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   for(i = 0; i < track_module->entries_num; i++)
+   {
+      WRITE_U64(p_ctx, track_module->entries[i].time, "time");
+      WRITE_U64(p_ctx, track_module->entries[i].moof_offset, "moof_offset");
+      WRITE_U32(p_ctx, track_module->entries[i].traf_number, "traf_number");
+      WRITE_U32(p_ctx, 1, "trun_number");
+      WRITE_U32(p_ctx, track_module->entries[i].sample_number, "sample_number");
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfro( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->mfra_size, "size");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_add_fragment_entry( VC_CONTAINER_TRACK_MODULE_T *track_module,
+   int64_t time, int64_t moof_offset, uint32_t traf_number, uint32_t sample_number )
+{
+   MP4_FRAGMENT_ENTRY_T *entries;
+   unsigned int max;
+
+   if(track_module->entries_num == track_module->entries_max)
+   {
+      max = MAX(track_module->entries_max * 2, 64);
+      entries = realloc(track_module->entries, max * sizeof(*entries));
+      if(!entries) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      track_module->entries = entries;
+      track_module->entries_max = max;
+   }
+
+   entries = &track_module->entries[track_module->entries_num++];
+   entries->time = time;
+   entries->moof_offset = moof_offset;
+   entries->traf_number = traf_number;
+   entries->sample_number = sample_number;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_write_fragment( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   MP4_FRAGMENT_SAMPLE_T *sample, *last[MP4_TRACKS_MAX];
+   unsigned int i, j, count, traf_number = 0, sample_number;
+   int64_t offset, time;
+
+   if(!module->fragment.samples_num) return VC_CONTAINER_SUCCESS;
+
+   /* Work out the duration of the samples from the timestamp of the next one */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      p_ctx->tracks[i]->priv->module->fragment_samples = 0;
+      p_ctx->tracks[i]->priv->module->fragment_composition = false;
+      last[i] = 0;
+   }
+   for(i = 0; i < module->fragment.samples_num; i++)
+   {
+      sample = &module->fragment.samples[i];
+      track_module = p_ctx->tracks[sample->track]->priv->module;
+      if(last[sample->track])
+      {
+         time = mp4_fragment_time(sample->dts) - mp4_fragment_time(last[sample->track]->dts);
+         track_module->last_duration = time > 0 ? (uint32_t)time : 0;
+         last[sample->track]->duration = track_module->last_duration;
+      }
+      else track_module->fragment_time = mp4_fragment_time(sample->dts);
+      last[sample->track] = sample;
+      track_module->fragment_samples++;
+      if(sample->pts != sample->dts) track_module->fragment_composition = true;
+   }
+
+   /* We don't know yet when the last sample of each track ends so we assume it
+    * lasts as long as the previous one */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!last[i]) continue;
+      track_module = p_ctx->tracks[i]->priv->module;
+      time = mp4_fragment_time(module->fragment.end_dts) - mp4_fragment_time(last[i]->dts);
+      if(!track_module->last_duration && time > 0) track_module->last_duration = (uint32_t)time;
+      last[i]->duration = track_module->last_duration;
+   }
+
+   /* We need the size of the moof box to know where the data of each track will be */
+   if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+      module->moof_size = STREAM_POSITION(p_ctx);
+   }
+   vc_container_writer_extraio_disable(p_ctx, &module->null);
+   if(status != VC_CONTAINER_SUCCESS) goto end;
+
+   /* The data of each track is written in a single run, after the mdat header */
+   for(i = 0, count = 0, offset = module->moof_size + 8; i < p_ctx->tracks_num; i++)
+   {
+      p_ctx->tracks[i]->priv->module->fragment_data_offset = offset;
+      for(j = 0; j < module->fragment.samples_num; j++)
+      {
+         sample = &module->fragment.samples[j];
+         if(sample->track != i) continue;
+         module->fragment.vecs[count].buffer = module->fragment.data + sample->offset;
+         module->fragment.vecs[count++].size = sample->size;
+         offset += sample->size;
+      }
+   }
+
+   if(module->fragment_flags & VC_CONTAINER_FRAGMENT_FLAG_INDEX)
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_SIDX);
+      if(status != VC_CONTAINER_SUCCESS) goto end;
+   }
+
+   module->moof_offset = STREAM_POSITION(p_ctx);
+   module->sequence_number++;
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+   if(status != VC_CONTAINER_SUCCESS) goto end;
+
+   WRITE_U32(p_ctx, (uint32_t)(8 + module->fragment.data_size), "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+   if(WRITEV_BYTES(p_ctx, module->fragment.vecs, count) != module->fragment.data_size)
+   {
+      status = STREAM_STATUS(p_ctx);
+      if(status == VC_CONTAINER_SUCCESS) status = VC_CONTAINER_ERROR_FAILED;
+      goto end;
+   }
+
+   /* Keep track of the first sync sample of each track fragment for the mfra box */
+   for(i = 0; i < p_ctx->tracks_num && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      track_module = p_ctx->tracks[i]->priv->module;
+      if(!track_module->fragment_samples) continue;
+      traf_number++;
+
+      for(j = 0, sample_number = 0; j < module->fragment.samples_num; j++)
+      {
+         sample = &module->fragment.samples[j];
+         if(sample->track != i) continue;
+         sample_number++;
+         if(!sample->keyframe) continue;
+
+         status = mp4_writer_add_fragment_entry(track_module, mp4_fragment_time(sample->dts),
+            module->moof_offset, traf_number, sample_number);
+         break;
+      }
+   }
+
+   /* The next fragment of each track starts where this one ends */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!last[i]) continue;
+      track_module = p_ctx->tracks[i]->priv->module;
+      track_module->fragment_time = mp4_fragment_time(last[i]->dts) + last[i]->duration;
+      time = track_module->fragment_time * 1000000 / MP4_TIMESCALE;
+      if(time > module->duration) module->duration = time;
+   }
+
+   p_ctx->size = STREAM_POSITION(p_ctx);
+
+ end:
+   module->fragment.samples_num = 0;
+   module->fragment.data_size = 0;
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_close_fragments( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+
+   /* Write out what's left */
+   module->fragment.end_dts = module->prev_sample_dts;
+   status = mp4_writer_write_fragment(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Add the index of the random access points at the end of the stream */
+   if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFRA);
+      module->mfra_size = STREAM_POSITION(p_ctx);
+   }
+   vc_container_writer_extraio_disable(p_ctx, &module->null);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFRA);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Now that we know the duration of the stream we can update the moov box.
+    * Its size doesn't change since it doesn't describe any sample. */
+   status = SEEK(p_ctx, module->moov_offset);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   return mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_reserve_moov( VC_CONTAINER_T *p_ctx )
+{
+   static const uint8_t zero[512];
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   uint32_t size, bytes;
+
+   /* The reserved space is a free box which replaces the mdat header we prepared */
+   module->moov_reserve_offset = module->mdat_offset - 8;
+   status = SEEK(p_ctx, module->moov_reserve_offset);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   WRITE_U32(p_ctx, module->moov_reserve, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+   for(size = module->moov_reserve - 8; size; size -= bytes)
+   {
+      bytes = MIN(size, sizeof(zero));
+      if(WRITE_BYTES(p_ctx, zero, bytes) != bytes) break;
+   }
+
+   /* Followed by the same headers as before */
+   WRITE_U32(p_ctx, 8, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+   module->mdat_offset = STREAM_POSITION(p_ctx);
+   WRITE_U32(p_ctx, 0, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+   module->data_offset = STREAM_POSITION(p_ctx);
+
+   p_ctx->size += module->moov_reserve;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_write_reserved_moov( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t moov_size = 0, left;
+
+   if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+      moov_size = STREAM_POSITION(p_ctx);
+   }
+   vc_container_writer_extraio_disable(p_ctx, &module->null);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Whatever space is left needs to be big enough for a free box */
+   left = module->moov_reserve - moov_size;
+   if(left < 0 || (left && left < 8))
+   {
+      LOG_DEBUG(p_ctx, "moov box (%"PRIi64" bytes) doesn't fit in the reserved space (%u bytes)",
+         moov_size, module->moov_reserve);
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   }
+
+   status = SEEK(p_ctx, module->moov_reserve_offset);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+   if(status != VC_CONTAINER_SUCCESS || !left) return status;
+
+   WRITE_U32(p_ctx, (uint32_t)left, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+   return STREAM_STATUS(p_ctx);
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
 {
@@ -1145,20 +1770,51 @@ static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
    VC_CONTAINER_STATUS_T status;
    int64_t mdat_size;
 
+   if(module->fragment_duration && module->tracks_add_done)
+   {
+      status = mp4_writer_close_fragments(p_ctx);
+      goto end;
+   }
+
    mdat_size = STREAM_POSITION(p_ctx) - module->mdat_offset;
 
-   /* Write the moov box */
-   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+   /* Chunk offsets past the 4GB mark need the 64 bits variant of the table */
+   module->large_offsets = STREAM_POSITION(p_ctx) > (int64_t)UINT32_MAX;
+
+   /* Write the moov box, in front of the mdat box if we reserved space for it */
+   status = VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   if(module->moov_reserve)
+      status = mp4_writer_write_reserved_moov(p_ctx);
+   if(status == VC_CONTAINER_ERROR_OUT_OF_RESOURCES)
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
 
-   /* Finalise the mdat box */
-   SEEK(p_ctx, module->mdat_offset);
-   WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+   /* Finalise the mdat box. If its size doesn't fit in 32 bits, we turn the
+    * free box we reserved in front of it into the header of a large mdat box */
+   if(mdat_size > (int64_t)UINT32_MAX)
+   {
+      SEEK(p_ctx, module->mdat_offset - 8);
+      WRITE_U32(p_ctx, 1, "size");
+      WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+      WRITE_U64(p_ctx, mdat_size + 8, "largesize");
+   }
+   else
+   {
+      SEEK(p_ctx, module->mdat_offset);
+      WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+   }
 
+ end:
    for(; p_ctx->tracks_num > 0; p_ctx->tracks_num--)
+   {
+      free(p_ctx->tracks[p_ctx->tracks_num-1]->priv->module->entries);
       vc_container_free_track(p_ctx, p_ctx->tracks[p_ctx->tracks_num-1]);
+   }
 
    vc_container_writer_extraio_delete(p_ctx, &module->temp);
    vc_container_writer_extraio_delete(p_ctx, &module->null);
+   free(module->fragment.samples);
+   free(module->fragment.vecs);
+   free(module->fragment.data);
    free(module);
 
    return status;
@@ -1236,8 +1892,28 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_track_done( VC_CONTAINER_T *p_ctx )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i;
    if(module->tracks_add_done) return status;
 
+   if(module->fragment_duration)
+   {
+      /* Segment indexes refer to the first video track if there is one */
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         if(p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+      module->reference_track = i < p_ctx->tracks_num ? i : 0;
+
+      /* Fragmented streams have their moov box written straight away, in place of
+       * the mdat header we prepared */
+      module->moov_offset = module->mdat_offset - 8;
+      status = SEEK(p_ctx, module->moov_offset);
+      if(status == VC_CONTAINER_SUCCESS)
+         status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+      p_ctx->size = STREAM_POSITION(p_ctx);
+
+      if(status == VC_CONTAINER_SUCCESS) module->tracks_add_done = true;
+      return status;
+   }
+
    /* We need to find out the size of the object we're going to write it. */
    if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
    {
@@ -1247,6 +1923,9 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_track_done( VC_CONTAINER_T *p_ctx )
    }
    vc_container_writer_extraio_disable(p_ctx, &module->null);
 
+   if(status == VC_CONTAINER_SUCCESS && module->moov_reserve)
+      status = mp4_writer_reserve_moov(p_ctx);
+
    if(status == VC_CONTAINER_SUCCESS) module->tracks_add_done = true;
    return status;
 }
@@ -1269,6 +1948,18 @@ static VC_CONTAINER_STATUS_T mp4_writer_control( VC_CONTAINER_T *p_ctx, VC_CONTA
    case VC_CONTAINER_CONTROL_TRACK_ADD_DONE:
       return mp4_writer_add_track_done(p_ctx);
 
+   case VC_CONTAINER_CONTROL_SET_FRAGMENTED:
+      if(module->tracks_add_done) return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+      module->fragment_duration = (uint32_t)va_arg(args, uint32_t);
+      module->fragment_flags = (uint32_t)va_arg(args, uint32_t);
+      return VC_CONTAINER_SUCCESS;
+
+   case VC_CONTAINER_CONTROL_RESERVE_INDEX_SPACE:
+      if(module->tracks_add_done) return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+      module->moov_reserve = (uint32_t)va_arg(args, uint32_t);
+      if(module->moov_reserve && module->moov_reserve < 8) module->moov_reserve = 8;
+      return VC_CONTAINER_SUCCESS;
+
    default: return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
    }
 }
@@ -1318,12 +2009,96 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_sample( VC_CONTAINER_T *p_ctx,
    return VC_CONTAINER_SUCCESS;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_write_fragmented( VC_CONTAINER_T *p_ctx,
+                                                          VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = p_ctx->tracks[packet->track];
+   VC_CONTAINER_STATUS_T status;
+   MP4_FRAGMENT_SAMPLE_T *sample;
+   bool video = track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO;
+   bool keyframe = !video || (packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME);
+   bool cut_allowed = video ? keyframe : true;
+   void *buffer;
+   size_t max;
+   unsigned int i;
+
+   /* Other samples can't start a fragment of a stream with video */
+   for(i = 0; !video && i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO)
+         cut_allowed = false;
+
+   if((packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START) || !module->fragment.samples_num)
+   {
+      /* Samples are stored in decoding order */
+      if(packet->dts != VC_CONTAINER_TIME_UNKNOWN)
+         module->prev_sample_dts = packet->dts;
+      else if(packet->pts != VC_CONTAINER_TIME_UNKNOWN)
+         module->prev_sample_dts = packet->pts;
+
+      /* Check whether this sample needs to go in a new fragment. Fragments which are
+       * due only get cut at a keyframe, unless they are getting much too big. */
+      if(module->fragment.samples_num &&
+         ((video && keyframe && (module->fragment_flags & VC_CONTAINER_FRAGMENT_FLAG_KEYFRAME)) ||
+          (cut_allowed && (module->fragment.data_size >= MP4_FRAGMENT_MAX_SIZE ||
+             module->prev_sample_dts - module->fragment.start_dts >=
+                (int64_t)module->fragment_duration * 1000)) ||
+          module->fragment.data_size >= MP4_FRAGMENT_HARD_MAX_SIZE))
+      {
+         module->fragment.end_dts = module->prev_sample_dts;
+         status = mp4_writer_write_fragment(p_ctx);
+         if(status != VC_CONTAINER_SUCCESS) return status;
+      }
+
+      if(module->fragment.samples_num == module->fragment.samples_max)
+      {
+         max = MAX(module->fragment.samples_max * 2, 64);
+         buffer = realloc(module->fragment.samples, max * sizeof(*module->fragment.samples));
+         if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         module->fragment.samples = buffer;
+         buffer = realloc(module->fragment.vecs, max * sizeof(*module->fragment.vecs));
+         if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+         module->fragment.vecs = buffer;
+         module->fragment.samples_max = max;
+      }
+
+      sample = &module->fragment.samples[module->fragment.samples_num++];
+      sample->offset = module->fragment.data_size;
+      sample->size = 0;
+      sample->duration = 0;
+      sample->dts = module->prev_sample_dts;
+      sample->pts = packet->pts != VC_CONTAINER_TIME_UNKNOWN ? packet->pts : sample->dts;
+      sample->track = packet->track;
+      sample->keyframe = keyframe;
+      if(module->fragment.samples_num == 1) module->fragment.start_dts = sample->dts;
+   }
+   sample = &module->fragment.samples[module->fragment.samples_num - 1];
+
+   /* The data is kept in memory until the whole fragment can be written */
+   if(packet->size > module->fragment.data_max - module->fragment.data_size)
+   {
+      max = MAX(module->fragment.data_size + packet->size, module->fragment.data_max * 2);
+      buffer = realloc(module->fragment.data, max);
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->fragment.data = buffer;
+      module->fragment.data_max = max;
+   }
+   memcpy(module->fragment.data + module->fragment.data_size, packet->data, packet->size);
+   module->fragment.data_size += packet->size;
+   sample->size += packet->size;
+   p_ctx->size += packet->size;
+
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
                                                VC_CONTAINER_PACKET_T *packet )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_PACKET_T *sample = &module->sample;
+   VC_CONTAINER_IO_VEC_T payload = { packet->data, packet->size };
    VC_CONTAINER_STATUS_T status;
 
    if(!module->tracks_add_done)
@@ -1332,6 +2107,9 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
       if(status != VC_CONTAINER_SUCCESS) return status;
    }
 
+   if(module->fragment_duration)
+      return mp4_writer_write_fragmented(p_ctx, packet);
+
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
       ++module->samples; /* Switching to a new sample */
 
@@ -1350,7 +2128,8 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
       sample->flags |= packet->flags;
    }
 
-   if(WRITE_BYTES(p_ctx, packet->data, packet->size) != packet->size)
+   /* The payload is written straight from the packet without going through the cache */
+   if(WRITEV_BYTES(p_ctx, &payload, 1) != packet->size)
       return STREAM_STATUS(p_ctx); // TODO do something
    p_ctx->size += packet->size;
 
@@ -1411,6 +2190,11 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_FTYP);
    if(status != VC_CONTAINER_SUCCESS) goto error;
 
+   /* Reserve space in front of the mdat box in case it ends up needing a
+    * 64 bits size field */
+   WRITE_U32(p_ctx, 8, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('f','r','e','e'), "type");
+
    /* Start the mdat box */
    module->mdat_offset = STREAM_POSITION(p_ctx);
    WRITE_U32(p_ctx, 0, "size");
@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "containers/core/containers_io_helpers.h"
 #include "containers/core/containers_utils.h"
 #include "containers/core/containers_logging.h"
+#include "containers/core/containers_startcode.h"
 #undef CONTAINER_HELPER_LOG_INDENT
 #define CONTAINER_HELPER_LOG_INDENT(a) (2*(a)->priv->module->level)
 
@@ -47,6 +48,8 @@ Defines.
 #define PS_SYNC_FAIL_MAX 65536 /** Maximum number of byte-wise sync attempts,
                                    should be enough to stride at least one
                                    PES packet (length encoded using 16 bits). */
+#define PS_SYNC_SCAN_SIZE 2048 /** Amount of data searched at once when resyncing */
+#define PS_SYNC_OFFSETS_MAX 16 /** Start codes returned by each search */
 
 /** Maximum number of pack/packet start codes scanned when searching for tracks
     at open time or when resyncing. */
@@ -170,24 +173,44 @@ static VC_CONTAINER_TRACK_T *ps_find_track( VC_CONTAINER_T *ctx, uint32_t stream
 /*****************************************************************************/
 STATIC_INLINE VC_CONTAINER_STATUS_T ps_find_start_code( VC_CONTAINER_T *ctx, uint8_t *buffer )
 {
-   unsigned int i;
+   uint8_t data[PS_SYNC_SCAN_SIZE];
+   size_t offsets[PS_SYNC_OFFSETS_MAX];
+   size_t size, found, skip, i;
+   unsigned int skipped = 0;
+
+   if(PEEK_BYTES(ctx, buffer, 4) < 4)
+      return VC_CONTAINER_ERROR_EOS;
 
-   /* Scan for a pack or PES packet start code prefix */
-   for (i = 0; i < PS_SYNC_FAIL_MAX; ++i)
+   /* Scan for a pack or PES packet start code prefix. We are usually right on
+      one, otherwise search for candidates a block at a time. */
+   while(!(buffer[0] == 0x0 && buffer[1] == 0x0 && buffer[2] == 0x1 && buffer[3] >= 0xB9))
    {
-      if(PEEK_BYTES(ctx, buffer, 4) < 4)
+      size = PEEK_BYTES(ctx, data, sizeof(data));
+      if(size < 4)
          return VC_CONTAINER_ERROR_EOS;
 
-      if(buffer[0] == 0x0 && buffer[1] == 0x0 && buffer[2] == 0x1 && buffer[3] >= 0xB9) 
-         break;
+      /* Only look for start codes which are followed by their id */
+      found = vc_container_find_startcodes(data, size - 1, offsets, PS_SYNC_OFFSETS_MAX);
+      for(i = 0; i < found; i++)
+         if(data[offsets[i] + 3] >= 0xB9) break;
+
+      if(i < found)
+         skip = offsets[i];
+      else if(found == PS_SYNC_OFFSETS_MAX)
+         skip = offsets[found - 1] + 1;
+      else
+         skip = size - 3;
+
+      if(skipped + skip >= PS_SYNC_FAIL_MAX) /* We didn't find a valid pack or PES packet */
+         return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+      if(SKIP_BYTES(ctx, skip) != skip)
+         return VC_CONTAINER_ERROR_EOS;
+      skipped += skip;
 
-      if (SKIP_BYTES(ctx, 1) != 1)
+      if(PEEK_BYTES(ctx, buffer, 4) < 4)
          return VC_CONTAINER_ERROR_EOS;
    }
 
-   if(i == PS_SYNC_FAIL_MAX) /* We didn't find a valid pack or PES packet */
-      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
-
    if (buffer[3] == 0xB9) /* MPEG_program_end_code */
       return VC_CONTAINER_ERROR_EOS;
       
@@ -1081,7 +1104,9 @@ static VC_CONTAINER_STATUS_T ps_reader_seek( VC_CONTAINER_T *ctx,
       seekpos = module->data_offset + (*p_offset * module->data_size) / ctx->duration;
    }
 
-   SEEK(ctx, seekpos);
+   /* Don't go looking for a packet from wherever a failed seek left us */
+   if ((status = SEEK(ctx, seekpos)) != VC_CONTAINER_SUCCESS)
+      goto error;
    module->scr = module->scr_offset;
    status = ps_find_pes_packet(ctx);
    if (status && status != VC_CONTAINER_ERROR_EOS)
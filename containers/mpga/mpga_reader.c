@@ -45,6 +45,11 @@ Defines and constants.
 #define MPGA_XING_HAS_TOC      0x00000004
 #define MPGA_XING_HAS_QUALITY  0x00000008
 
+#define MPGA_SEEK_TABLE_STEP   16   /*< Number of frames between entries of a scanned seek table */
+#define MPGA_SEEK_TABLE_CHUNK  1024 /*< Number of entries allocated at once as a seek table grows */
+
+#define MPGA_BATCH_MAP_SIZE    (64*1024) /*< Amount of stream mapped at once when reading a batch */
+
 #define MPGA_MAX_BAD_FRAMES    4096 /*< Maximum number of failed byte-wise syncs,
                                         should be at least 2881+4 to cover the largest 
                                         frame size (MPEG2.5 Layer 2, 160kbit/s 8kHz) 
@@ -77,6 +82,13 @@ typedef struct VC_CONTAINER_MODULE_T
    /* VBR header information */
    uint8_t xing_toc[100];
    int xing_toc_valid;
+
+   /* Exact seek table (from a VBRI header or a scan of the frame headers) */
+   int64_t *seek_table;             /**< File position of frame seek_table_base + n * seek_table_step */
+   unsigned int seek_table_num;
+   unsigned int seek_table_max;
+   unsigned int seek_table_step;    /**< Number of frames between entries */
+   unsigned int seek_table_base;    /**< Index of the frame of the first entry */
          
    /* Per-frame state (updated upon a read or a seek) */
    unsigned int frame_size;
@@ -204,6 +216,94 @@ static int64_t mpga_calculate_frame_time( VC_CONTAINER_T *p_ctx )
    return time;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mpga_seek_table_add( VC_CONTAINER_MODULE_T *module, int64_t position )
+{
+   if (module->seek_table_num == module->seek_table_max)
+   {
+      unsigned int seek_table_max = module->seek_table_max + MPGA_SEEK_TABLE_CHUNK;
+      int64_t *seek_table = realloc(module->seek_table, seek_table_max * sizeof(*seek_table));
+      if (!seek_table) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->seek_table = seek_table;
+      module->seek_table_max = seek_table_max;
+   }
+
+   module->seek_table[module->seek_table_num++] = position;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static void mpga_seek_table_clear( VC_CONTAINER_MODULE_T *module )
+{
+   free(module->seek_table);
+   module->seek_table = NULL;
+   module->seek_table_num = module->seek_table_max = 0;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mpga_read_vbri_header( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   unsigned int toc_entries, toc_scale, entry_size, frames_per_entry, i, j;
+   uint8_t entry[4];
+   int64_t position, start = STREAM_POSITION(p_ctx);
+
+   /* The VBRI header is always 32 bytes after the frame header */
+   SKIP_BYTES(p_ctx, 36);
+
+   SKIP_FOURCC(p_ctx, "VBRI");
+   SKIP_U16(p_ctx, "VBRI version");
+   SKIP_U16(p_ctx, "VBRI delay");
+   SKIP_U16(p_ctx, "VBRI quality");
+   module->data_size = READ_U32(p_ctx, "VBRI bytes");
+   module->num_frames = READ_U32(p_ctx, "VBRI frames");
+   toc_entries = READ_U16(p_ctx, "VBRI TOC entries");
+   toc_scale = READ_U16(p_ctx, "VBRI TOC scale");
+   entry_size = READ_U16(p_ctx, "VBRI TOC entry size");
+   frames_per_entry = READ_U16(p_ctx, "VBRI TOC frames per entry");
+
+   if (module->num_frames && module->data_size)
+   {
+      /* We can calculate average bitrate */
+      module->bitrate =
+         module->data_size * module->sample_rate * 8 / (module->num_frames * module->frame_size_samples);
+   }
+
+   p_ctx->duration = (module->num_frames * module->frame_size_samples * 1000000LL) / module->sample_rate;
+
+   /* Each TOC entry gives the size of the next run of frames following the VBRI
+      frame, which translates directly into our seek table */
+   if (toc_entries && toc_scale && frames_per_entry && entry_size && entry_size <= sizeof(entry))
+   {
+      position = start + module->frame_size;
+      module->seek_table_step = frames_per_entry;
+      module->seek_table_base = 1;
+
+      for (i = 0; i < toc_entries; i++)
+      {
+         uint32_t size = 0;
+
+         if (READ_BYTES(p_ctx, entry, entry_size) != entry_size ||
+             mpga_seek_table_add(module, position) != VC_CONTAINER_SUCCESS)
+            break;
+
+         for (j = 0; j < entry_size; j++)
+            size = (size << 8) | entry[j];
+         position += (int64_t)size * toc_scale;
+      }
+
+      /* Only keep a table which is complete and consistent with the stream */
+      if (i < toc_entries || (p_ctx->priv->io->size > 0 && position > p_ctx->priv->io->size))
+      {
+         LOG_DEBUG(p_ctx, "discarding invalid VBRI TOC");
+         mpga_seek_table_clear(module);
+      }
+   }
+
+   SEEK(p_ctx, start);
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mpga_read_vbr_headers( VC_CONTAINER_T *p_ctx )
 {
@@ -293,8 +393,132 @@ static VC_CONTAINER_STATUS_T mpga_read_vbr_headers( VC_CONTAINER_T *p_ctx )
       status = VC_CONTAINER_SUCCESS;
    }
    
-   /* FIXME: if not success, try to read 'VBRI' header */
-   
+   /* Look for VBRI header (layer 3 only) */
+   if (status == VC_CONTAINER_ERROR_NOT_FOUND && module->layer == 3 &&
+       PEEK_BYTES_AT(p_ctx, INT64_C(36), (uint8_t*)peek_buf, 4) == 4 &&
+       peek_buf[0] == VC_FOURCC('V','B','R','I'))
+      status = mpga_read_vbri_header(p_ctx);
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mpga_build_seek_table( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t frame_position, data_end = module->data_offset, position = STREAM_POSITION(p_ctx);
+   unsigned int frame_size = module->frame_size, frame_data_left = module->frame_data_left;
+   unsigned int frame_bitrate = module->frame_bitrate;
+   uint64_t num_frames = 0;
+
+   if (module->seek_table_num)
+      return VC_CONTAINER_SUCCESS; /* We already have an exact table */
+   if (!STREAM_SEEKABLE(p_ctx))
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+   module->seek_table_step = MPGA_SEEK_TABLE_STEP;
+   module->seek_table_base = 0;
+
+   /* Hop from frame to frame using the frame headers only */
+   SEEK(p_ctx, module->data_offset);
+   while (1)
+   {
+      if (mpga_sync(p_ctx) != VC_CONTAINER_SUCCESS)
+         break;
+      frame_position = STREAM_POSITION(p_ctx); /* Syncing can skip garbage before the frame */
+
+      if (!(num_frames % MPGA_SEEK_TABLE_STEP))
+      {
+         status = mpga_seek_table_add(module, frame_position);
+         if (status != VC_CONTAINER_SUCCESS) goto end;
+      }
+
+      SKIP_BYTES(p_ctx, module->frame_size);
+      data_end = STREAM_POSITION(p_ctx);
+      num_frames++;
+   }
+
+   if (!num_frames)
+   {
+      status = VC_CONTAINER_ERROR_FORMAT_INVALID;
+      goto end;
+   }
+
+   LOG_DEBUG(p_ctx, "scanned %"PRIu64" frames", num_frames);
+
+   /* Replace the estimates we had with the real thing */
+   module->num_frames = num_frames;
+   module->data_size = data_end - module->data_offset;
+   module->bitrate =
+      module->data_size * module->sample_rate * 8 / (module->num_frames * module->frame_size_samples);
+   p_ctx->duration = (module->num_frames * module->frame_size_samples * 1000000LL) / module->sample_rate;
+
+ end:
+   if (status != VC_CONTAINER_SUCCESS)
+      mpga_seek_table_clear(module);
+
+   SEEK(p_ctx, position);
+   module->frame_size = frame_size;
+   module->frame_data_left = frame_data_left;
+   module->frame_bitrate = frame_bitrate;
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mpga_seek_by_table( VC_CONTAINER_T *p_ctx, int64_t *p_offset,
+   VC_CONTAINER_SEEK_FLAGS_T flags )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   int64_t scale = INT64_C(1000000) * module->frame_size_samples;
+   int64_t frame_position, seekpos, position = STREAM_POSITION(p_ctx);
+   uint64_t frame = 0, target = 0;
+   unsigned int entry;
+
+   /* Find the frame containing the requested time (or the first one
+      starting at or after it when seeking forward) */
+   if (*p_offset > 0)
+      target = (*p_offset * module->sample_rate + ((flags & VC_CONTAINER_SEEK_FLAG_FORWARD) ? scale - 1 : 0)) / scale;
+   if (module->num_frames && target >= module->num_frames)
+      target = module->num_frames - 1;
+
+   seekpos = module->data_offset;
+   if (target >= module->seek_table_base)
+   {
+      entry = MIN((target - module->seek_table_base) / module->seek_table_step, module->seek_table_num - 1);
+      frame = module->seek_table_base + (uint64_t)entry * module->seek_table_step;
+      seekpos = module->seek_table[entry];
+   }
+
+   if ((status = SEEK(p_ctx, seekpos)) != VC_CONTAINER_SUCCESS)
+      goto error;
+
+   /* Hop over the frames between the table entry and the target */
+   for (; frame < target; frame++)
+   {
+      frame_position = STREAM_POSITION(p_ctx);
+      if (mpga_sync(p_ctx) != VC_CONTAINER_SUCCESS)
+      {
+         SEEK(p_ctx, frame_position);
+         break;
+      }
+      SKIP_BYTES(p_ctx, module->frame_size);
+   }
+
+   status = mpga_sync(p_ctx);
+   if (status && status != VC_CONTAINER_ERROR_EOS)
+      goto error;
+
+   module->frame_index = frame;
+   module->frame_offset = STREAM_POSITION(p_ctx) - module->data_offset;
+
+   *p_offset = module->frame_time_pos = mpga_calculate_frame_time(p_ctx);
+
+   return STREAM_STATUS(p_ctx);
+
+error:
+   SEEK(p_ctx, position);
    return status;
 }
 
@@ -359,7 +583,7 @@ static VC_CONTAINER_STATUS_T mpga_reader_read( VC_CONTAINER_T *p_ctx,
       return VC_CONTAINER_SUCCESS;
 
    p_packet->size = MIN(p_packet->buffer_size, module->frame_data_left);
-   p_packet->size = READ_BYTES(p_ctx, p_packet->data, p_packet->size);
+   p_packet->size = READ_PACKET_BYTES(p_ctx, p_packet, p_packet->size, flags);
    module->frame_data_left -= p_packet->size;
 
  end:
@@ -382,6 +606,94 @@ error:
    return status;
 }
 
+/*****************************************************************************/
+/* Reads as many whole frames as possible straight out of the mapped stream, with a
+   single map and skip for the lot. Like mpga_sync(), a frame is only taken if the
+   header of the next one is valid too. Anything else is left to mpga_reader_read(). */
+static unsigned int mpga_read_mapped_frames( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *p_packets, unsigned int packets_num )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint8_t frame_header[MPGA_HEADER_SIZE];
+   const void *map;
+   const uint8_t *data;
+   size_t size, position = 0;
+   unsigned int i;
+
+   if (module->frame_data_left || !p_ctx->tracks[0]->is_enabled)
+      return 0;
+   size = vc_container_io_map(p_ctx->priv->io, &map, MPGA_BATCH_MAP_SIZE);
+   data = map;
+
+   for (i = 0; i < packets_num; i++)
+   {
+      VC_CONTAINER_PACKET_T *p_packet = &p_packets[i];
+      unsigned int frame_bitrate, version, layer, offset;
+      uint32_t frame_size;
+
+      if (position + MPGA_HEADER_SIZE > size) break;
+      memcpy(frame_header, data + position, MPGA_HEADER_SIZE);
+      if (module->pf_parse_header(frame_header, &frame_size, &frame_bitrate, &version,
+             &layer, NULL, NULL, NULL, &offset) != VC_CONTAINER_SUCCESS ||
+          frame_size <= offset || version != module->version || layer != module->layer ||
+          frame_size - offset > p_packet->buffer_size ||
+          position + frame_size + MPGA_HEADER_SIZE > size)
+         break;
+      memcpy(frame_header, data + position + frame_size, MPGA_HEADER_SIZE);
+      if (mpga_check_frame_header(p_ctx, module, frame_header) != VC_CONTAINER_SUCCESS)
+         break;
+
+      module->frame_size = frame_size - offset;
+      module->frame_bitrate = frame_bitrate;
+      module->bitrate = module->bitrate ? (module->bitrate * 31 + frame_bitrate) >> 5 : frame_bitrate;
+
+      memcpy(p_packet->data, data + position + offset, module->frame_size);
+      p_packet->size = module->frame_size;
+      p_packet->flags = VC_CONTAINER_PACKET_FLAG_FRAME;
+      p_packet->track = 0;
+      p_packet->pts = module->frame_time_pos;
+      p_packet->dts = VC_CONTAINER_TIME_UNKNOWN;
+
+      module->frame_index++;
+      module->frame_offset += module->frame_size;
+      module->frame_time_pos = mpga_calculate_frame_time(p_ctx);
+      position += frame_size;
+   }
+
+   if (position) SKIP_BYTES(p_ctx, position);
+   return i;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mpga_reader_read_batch( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *p_packets, unsigned int packets_num, unsigned int *p_packets_read )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i = 0;
+
+   /* Frames are contiguous so we take whole runs of them from the mapped stream
+      when we can, and go through the normal read for the ones we can't */
+   while (i < packets_num)
+   {
+      unsigned int mapped = mpga_read_mapped_frames(p_ctx, p_packets + i, packets_num - i);
+      if (mapped)
+      {
+         i += mapped;
+         continue;
+      }
+
+      status = mpga_reader_read(p_ctx, &p_packets[i], 0);
+      if (status == VC_CONTAINER_ERROR_CONTINUE)
+         continue; /* Track is disabled */
+      if (status != VC_CONTAINER_SUCCESS)
+         break;
+      i++;
+   }
+
+   *p_packets_read = i;
+   return status;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mpga_reader_seek( VC_CONTAINER_T *p_ctx, 
                                                int64_t *p_offset,
@@ -391,11 +703,14 @@ static VC_CONTAINER_STATUS_T mpga_reader_seek( VC_CONTAINER_T *p_ctx,
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
    uint64_t seekpos, position = STREAM_POSITION(p_ctx);
-   VC_CONTAINER_PARAM_UNUSED(flags);
 
    if (mode != VC_CONTAINER_SEEK_MODE_TIME || !STREAM_SEEKABLE(p_ctx))
       return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
 
+   /* Use the exact seek table when we have one */
+   if (module->seek_table_num)
+      return mpga_seek_by_table(p_ctx, p_offset, flags);
+
    if (*p_offset != INT64_C(0))
    {
       if (!p_ctx->duration)
@@ -446,6 +761,21 @@ error:
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mpga_reader_control( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_PARAM_UNUSED(args);
+
+   switch (operation)
+   {
+   case VC_CONTAINER_CONTROL_BUILD_SEEK_INDEX:
+      return mpga_build_seek_table(p_ctx);
+   default:
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mpga_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -455,6 +785,7 @@ static VC_CONTAINER_STATUS_T mpga_reader_close( VC_CONTAINER_T *p_ctx )
       vc_container_free_track(p_ctx, p_ctx->tracks[0]);
    p_ctx->tracks = NULL;
    p_ctx->tracks_num = 0;
+   mpga_seek_table_clear(module);
    free(module);
    p_ctx->priv->module = 0;  
    return VC_CONTAINER_SUCCESS;
@@ -589,7 +920,9 @@ VC_CONTAINER_STATUS_T mpga_reader_open( VC_CONTAINER_T *p_ctx )
 
    p_ctx->priv->pf_close = mpga_reader_close;
    p_ctx->priv->pf_read = mpga_reader_read;
+   p_ctx->priv->pf_read_batch = mpga_reader_read_batch;
    p_ctx->priv->pf_seek = mpga_reader_seek;
+   p_ctx->priv->pf_control = mpga_reader_control;
 
    if(STREAM_SEEKABLE(p_ctx)) p_ctx->capabilities |= VC_CONTAINER_CAPS_CAN_SEEK;
 
@@ -604,7 +937,11 @@ error:
       vc_container_free_track(p_ctx, p_ctx->tracks[0]);
    p_ctx->tracks = NULL;
    p_ctx->tracks_num = 0;
-   if (module) free(module);
+   if (module)
+   {
+      mpga_seek_table_clear(module);
+      free(module);
+   }
    p_ctx->priv->module = NULL;
    return status;
 }
@@ -304,7 +304,7 @@ static VC_CONTAINER_STATUS_T rawvideo_reader_read( VC_CONTAINER_T *ctx,
       return VC_CONTAINER_SUCCESS;
 
    size = MIN(module->block_size - module->block_offset, packet->buffer_size);
-   size = READ_BYTES(ctx, packet->data, size);
+   size = READ_PACKET_BYTES(ctx, packet, size, flags);
    module->block_offset += size;
    packet->size = size;
 
@@ -70,6 +70,7 @@ typedef struct VC_CONTAINER_MODULE_T
    uint32_t frame_read;
    RCV_FRAME_HEADER_T frame;
    VC_CONTAINER_INDEX_T *index; /* index of key frames */
+   bool save_index; /* save the index to a sidecar file on close */
 
 } VC_CONTAINER_MODULE_T;
 
@@ -289,6 +290,22 @@ static VC_CONTAINER_STATUS_T rcv_reader_seek( VC_CONTAINER_T *p_ctx, int64_t *of
    return status;
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T rcv_reader_control( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_CONTROL_T operation, va_list args )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   switch(operation)
+   {
+   case VC_CONTAINER_CONTROL_SAVE_SEEK_INDEX:
+      module->save_index = va_arg(args, uint32_t) != 0;
+      return VC_CONTAINER_SUCCESS;
+   default:
+      return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+   }
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T rcv_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -297,7 +314,11 @@ static VC_CONTAINER_STATUS_T rcv_reader_close( VC_CONTAINER_T *p_ctx )
       vc_container_free_track(p_ctx, p_ctx->tracks[p_ctx->tracks_num-1]);
 
    if(module->index)
+   {
+      if(module->save_index)
+         vc_container_index_save(module->index, p_ctx->priv->io);
       vc_container_index_free(module->index);
+   }
 
    free(module);
 
@@ -333,7 +354,9 @@ VC_CONTAINER_STATUS_T rcv_reader_open( VC_CONTAINER_T *p_ctx )
 
    LOG_DEBUG(p_ctx, "using rcv reader");
 
-   if(vc_container_index_create(&module->index, 512) == VC_CONTAINER_SUCCESS)
+   /* Reuse the index from a previous session if there is one */
+   if(vc_container_index_load(&module->index, p_ctx->priv->io, 512) != VC_CONTAINER_SUCCESS &&
+      vc_container_index_create(&module->index, 512) == VC_CONTAINER_SUCCESS)
       vc_container_index_add(module->index, 0LL, STREAM_POSITION(p_ctx));
 
    if(STREAM_SEEKABLE(p_ctx))
@@ -342,6 +365,7 @@ VC_CONTAINER_STATUS_T rcv_reader_open( VC_CONTAINER_T *p_ctx )
    p_ctx->priv->pf_close = rcv_reader_close;
    p_ctx->priv->pf_read = rcv_reader_read;
    p_ctx->priv->pf_seek = rcv_reader_seek;
+   p_ctx->priv->pf_control = rcv_reader_control;
    return VC_CONTAINER_SUCCESS;
 
  error:
@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#ifdef __unix__
+#include <unistd.h>
+#endif
+#include "containers/containers.h"
+#include "containers/containers_remux.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+
+#define MAX_LINE_SIZE 4096
+
+static int remux_parse_cmdline(int argc, char **argv);
+static int remux_add_job(const char *input, const char *output);
+static int remux_read_list(const char *list);
+
+static VC_CONTAINER_REMUX_JOB_T *jobs = 0;
+static unsigned int jobs_num = 0, jobs_max = 0;
+static long threads_num = 0;
+static long buffer_size = 0;
+static bool b_packetize = 0;
+static bool b_errorcode = 1;
+static int32_t verbosity = VC_CONTAINER_LOG_ERROR|VC_CONTAINER_LOG_INFO;
+
+/*****************************************************************************/
+static void remux_job_done(VC_CONTAINER_REMUX_JOB_T *job, void *userdata)
+{
+   VC_CONTAINER_PARAM_UNUSED(userdata);
+   if(job->status == VC_CONTAINER_SUCCESS)
+      LOG_INFO(0, "%s -> %s: %u tracks, %"PRIu64" packets, %"PRIu64" bytes",
+               job->input, job->output, job->tracks_num, job->packets, job->bytes);
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   VC_CONTAINER_REMUX_PARAMS_T params;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i, failed = 0;
+   int retval = 0;
+
+   if(remux_parse_cmdline(argc, argv))
+   {
+      retval = 1;
+      goto end;
+   }
+
+   vc_container_log_set_verbosity(0, verbosity);
+   vc_container_log_set_default_verbosity(verbosity);
+
+   /* Default to one job per processor */
+#if defined(__unix__) && defined(_SC_NPROCESSORS_ONLN)
+   if(!threads_num) threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   if(threads_num <= 0) threads_num = 1;
+
+   memset(&params, 0, sizeof(params));
+   params.threads = threads_num;
+   params.buffer_size = buffer_size * 1024;
+   params.packetize = b_packetize;
+   params.pf_done = remux_job_done;
+
+   LOG_INFO(0, "remuxing %u streams, %li at a time", jobs_num, threads_num);
+   status = vc_container_remux(jobs, jobs_num, &params);
+
+   for(i = 0; i < jobs_num; i++)
+      if(jobs[i].status != VC_CONTAINER_SUCCESS) failed++;
+   LOG_INFO(0, "%u streams remuxed, %u failed", jobs_num - failed, failed);
+   if(status != VC_CONTAINER_SUCCESS) retval = (int)status;
+
+ end:
+   for(i = 0; i < jobs_num; i++)
+   {
+      free((char *)(uintptr_t)jobs[i].input);
+      free((char *)(uintptr_t)jobs[i].output);
+   }
+   free(jobs);
+   return b_errorcode ? retval : 0;
+}
+
+/*****************************************************************************/
+static int remux_add_job(const char *input, const char *output)
+{
+   if(jobs_num == jobs_max)
+   {
+      unsigned int max = jobs_max ? jobs_max * 2 : 64;
+      VC_CONTAINER_REMUX_JOB_T *new_jobs = realloc(jobs, max * sizeof(*jobs));
+      if(!new_jobs) return 1;
+      jobs = new_jobs;
+      jobs_max = max;
+   }
+
+   memset(&jobs[jobs_num], 0, sizeof(jobs[jobs_num]));
+   jobs[jobs_num].input = vcos_strdup(input);
+   jobs[jobs_num].output = vcos_strdup(output);
+   jobs_num++;
+   return !jobs[jobs_num-1].input || !jobs[jobs_num-1].output;
+}
+
+/*****************************************************************************/
+static int remux_read_list(const char *list)
+{
+   char line[MAX_LINE_SIZE], *input, *output;
+   unsigned int line_num = 0;
+   FILE *file = fopen(list, "r");
+
+   if(!file)
+   {
+      LOG_ERROR(0, "error opening list %s", list);
+      return 1;
+   }
+
+   /* Each line holds an input uri and an output uri separated by white spaces */
+   while(fgets(line, sizeof(line), file))
+   {
+      line_num++;
+      input = strtok(line, " \t\r\n");
+      if(!input || input[0] == '#') continue;
+      output = strtok(NULL, " \t\r\n");
+      if(!output)
+      {
+         LOG_ERROR(0, "missing output uri in %s line %u", list, line_num);
+         break;
+      }
+      if(remux_add_job(input, output)) break;
+   }
+
+   if(!feof(file))
+   {
+      fclose(file);
+      return 1;
+   }
+
+   fclose(file);
+   return 0;
+}
+
+/*****************************************************************************/
+static int remux_parse_cmdline(int argc, char **argv)
+{
+   const char *name;
+   int i, k;
+
+   /* Parse the command line arguments */
+   for(i = 1; i < argc; i++)
+   {
+      if(!argv[i]) continue;
+
+      if(argv[i][0] != '-')
+      {
+         /* Not an option argument so will be an input / output uri pair */
+         if(i+1 == argc || !argv[i+1] || argv[i+1][0] == '-') goto invalid_option;
+         if(remux_add_job(argv[i], argv[i+1])) return 1;
+         i++;
+         continue;
+      }
+
+      /* We are now dealing with command line options */
+      switch(argv[i][1])
+      {
+      case 'v':
+         verbosity = VC_CONTAINER_LOG_ERROR|VC_CONTAINER_LOG_INFO;
+         for(k = 0; k < 2 && argv[i][2+k] == 'v'; k++)
+            verbosity = (verbosity << 1) | 1 ;
+         break;
+      case 'j':
+         if(i+1 == argc || !argv[i+1]) goto invalid_option;
+         threads_num = strtol(argv[++i], 0, 0);
+         if(threads_num <= 0 || threads_num > VC_CONTAINER_REMUX_THREADS_MAX) goto invalid_option;
+         break;
+      case 'b':
+         if(i+1 == argc || !argv[i+1]) goto invalid_option;
+         buffer_size = strtol(argv[++i], 0, 0);
+         if(buffer_size <= 0 || buffer_size > 64*1024) goto invalid_option;
+         break;
+      case 'l':
+         if(i+1 == argc || !argv[i+1]) goto invalid_option;
+         if(remux_read_list(argv[++i])) return 1;
+         break;
+      case 'e':
+         if(argv[i][2] == 'p') b_packetize = 1;
+         else goto invalid_option;
+         break;
+      case 'n':
+         if(argv[i][2] == 'r') b_errorcode = 0;
+         else goto invalid_option;
+         break;
+      case 'h': goto usage;
+      default: goto invalid_option;
+      }
+      continue;
+   }
+
+   /* Sanity check that we have something to do */
+   if(!jobs_num)
+   {
+     LOG_ERROR(0, "missing uri arguments");
+     goto usage;
+   }
+
+   return 0;
+
+ invalid_option:
+   LOG_ERROR(0, "invalid command line option (%s)", argv[i]);
+
+ usage:
+   name = strrchr(argv[0], '\\'); if(name) name++;
+   if(!name) {name = strrchr(argv[0], '/'); if(name) name++;}
+   if(!name) name = argv[0];
+   LOG_INFO(0, "");
+   LOG_INFO(0, "usage: %s [options] [input_uri output_uri]...", name);
+   LOG_INFO(0, "options list:");
+   LOG_INFO(0, " -l file : read input / output uri pairs from a file (one pair per line)");
+   LOG_INFO(0, " -j X    : remux X streams at a time (defaults to the number of processors)");
+   LOG_INFO(0, " -b X    : size in kB of the packet buffer of each stream");
+   LOG_INFO(0, " -ep     : enable packetization if data is not already packetized");
+   LOG_INFO(0, " -nr     : always return an error code of 0 (even in case of failure)");
+   LOG_INFO(0, " -vxx    : verbosity level (replace xx with a number of \'v\')");
+   LOG_INFO(0, " -h      : help");
+   return 1;
+}
@@ -0,0 +1,576 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#include "vcos.h"
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_io.h"
+#include "containers/core/containers_logging.h"
+#include "containers/net/net_sockets.h"
+
+/* These need to match the values used by io_http.c */
+#define SEGMENT_SIZE      (64*1024)
+#define CACHE_SEGMENTS    64
+#define CONNECTIONS_MAX   4
+
+/* The resource doesn't fit in the cache and ends with a partial segment */
+#define RESOURCE_SEGMENTS (CACHE_SEGMENTS + 16 + 1)
+#define RESOURCE_SIZE     ((CACHE_SEGMENTS + 16) * SEGMENT_SIZE + 1234)
+
+#define SERVER_PORT_FIRST 18080
+#define SERVER_PORT_TRIES 100
+#define SERVER_SLOTS      64
+
+/** Loopback HTTP server serving the same resource for any path */
+typedef struct SERVER_T SERVER_T;
+
+typedef struct SERVER_SLOT_T
+{
+   SERVER_T *server;
+   VC_CONTAINER_NET_T *sock;
+   VCOS_THREAD_T thread;
+   int used;
+   int finished;
+
+} SERVER_SLOT_T;
+
+struct SERVER_T
+{
+   VC_CONTAINER_NET_T *sock;
+   char port[8];
+   VCOS_THREAD_T thread;
+   VCOS_MUTEX_T lock;
+   int stop;
+
+   /* Behaviour of the server, changed by the tests */
+   unsigned int close_after;     /**< Responses sent before dropping a connection, 0 for never */
+   int64_t fail_offset;          /**< Start of the range which gets an error response, -1 for none */
+   unsigned int etag;
+
+   /* What the server saw */
+   unsigned int connections;
+   unsigned int requests[RESOURCE_SEGMENTS]; /**< GET requests for each segment */
+   unsigned int bad_requests;
+
+   SERVER_SLOT_T slots[SERVER_SLOTS];
+};
+
+static uint8_t resource[RESOURCE_SIZE];
+static uint8_t buffer[3 * SEGMENT_SIZE];
+
+/*****************************************************************************/
+static int server_write( VC_CONTAINER_NET_T *sock, const void *data, size_t size )
+{
+   const uint8_t *ptr = data;
+   size_t written;
+
+   while (size)
+   {
+      written = vc_container_net_write(sock, ptr, size);
+      if (!written)
+         return 0;
+      ptr += written;
+      size -= written;
+   }
+   return 1;
+}
+
+/*****************************************************************************/
+static int server_read_request( VC_CONTAINER_NET_T *sock, char *request, size_t size )
+{
+   size_t len = 0;
+
+   /* The client doesn't pipeline requests so reading up to the blank line is enough */
+   while (len + 1 < size)
+   {
+      if (vc_container_net_read(sock, request + len, 1) != 1)
+         return 0;
+      request[++len] = 0;
+      if (len >= 4 && !strcmp(request + len - 4, "\r\n\r\n"))
+         return 1;
+   }
+   return 0;
+}
+
+/*****************************************************************************/
+static int server_respond( SERVER_T *server, VC_CONTAINER_NET_T *sock, const char *request )
+{
+   int64_t start = 0, end = -1, fail_offset;
+   const char *range;
+   char header[256];
+   unsigned int etag;
+
+   vcos_mutex_lock(&server->lock);
+   fail_offset = server->fail_offset;
+   etag = server->etag;
+   vcos_mutex_unlock(&server->lock);
+
+   if (!strncmp(request, "HEAD ", 5))
+   {
+      snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n"
+               "Accept-Ranges: bytes\r\nETag: \"%u\"\r\n\r\n", RESOURCE_SIZE, etag);
+      return server_write(sock, header, strlen(header));
+   }
+
+   range = strstr(request, "Range: bytes=");
+   if (strncmp(request, "GET ", 4) || !range ||
+       sscanf(range, "Range: bytes=%" SCNi64 "-%" SCNi64, &start, &end) != 2 ||
+       start < 0 || start > end || end >= RESOURCE_SIZE)
+   {
+      vcos_mutex_lock(&server->lock);
+      server->bad_requests++;
+      vcos_mutex_unlock(&server->lock);
+      snprintf(header, sizeof(header), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n");
+      return server_write(sock, header, strlen(header));
+   }
+
+   vcos_mutex_lock(&server->lock);
+   if (start % SEGMENT_SIZE == 0)
+      server->requests[start / SEGMENT_SIZE]++;
+   vcos_mutex_unlock(&server->lock);
+
+   if (start == fail_offset)
+   {
+      snprintf(header, sizeof(header), "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n");
+      return server_write(sock, header, strlen(header));
+   }
+
+   snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\nContent-Length: %u\r\n"
+            "Accept-Ranges: bytes\r\n\r\n", (unsigned)(end - start + 1));
+   return server_write(sock, header, strlen(header)) &&
+          server_write(sock, resource + start, (size_t)(end - start + 1));
+}
+
+/*****************************************************************************/
+static void *server_connection( void *arg )
+{
+   SERVER_SLOT_T *slot = arg;
+   SERVER_T *server = slot->server;
+   unsigned int responses = 0, close_after;
+   char request[1024];
+
+   while (server_read_request(slot->sock, request, sizeof(request)))
+   {
+      if (!server_respond(server, slot->sock, request))
+         break;
+
+      /* Drop the connection without telling the client, as servers do with idle ones */
+      vcos_mutex_lock(&server->lock);
+      close_after = server->close_after;
+      vcos_mutex_unlock(&server->lock);
+      if (close_after && ++responses >= close_after)
+         break;
+   }
+
+   vc_container_net_close(slot->sock);
+   vcos_mutex_lock(&server->lock);
+   slot->finished = 1;
+   vcos_mutex_unlock(&server->lock);
+   return NULL;
+}
+
+/*****************************************************************************/
+static void *server_accept( void *arg )
+{
+   SERVER_T *server = arg;
+   VC_CONTAINER_NET_T *sock;
+   SERVER_SLOT_T *slot;
+   unsigned int ii;
+   int stop;
+
+   while (vc_container_net_accept(server->sock, &sock) == VC_CONTAINER_NET_SUCCESS)
+   {
+      vcos_mutex_lock(&server->lock);
+      stop = server->stop;
+      server->connections++;
+      vcos_mutex_unlock(&server->lock);
+      if (stop)
+      {
+         vc_container_net_close(sock);
+         break;
+      }
+
+      /* Reuse the slot of a connection which is gone */
+      slot = NULL;
+      vcos_mutex_lock(&server->lock);
+      for (ii = 0; ii < SERVER_SLOTS && !slot; ii++)
+         if (!server->slots[ii].used || server->slots[ii].finished)
+            slot = &server->slots[ii];
+      vcos_mutex_unlock(&server->lock);
+      if (slot && slot->used)
+         vcos_thread_join(&slot->thread, NULL);
+
+      if (slot)
+      {
+         slot->server = server;
+         slot->sock = sock;
+         slot->finished = 0;
+         slot->used = vcos_thread_create(&slot->thread, "test_http_connection", NULL,
+                                         server_connection, slot) == VCOS_SUCCESS;
+      }
+      if (!slot || !slot->used)
+      {
+         LOG_ERROR(NULL, "*** Server couldn't handle a new connection");
+         vc_container_net_close(sock);
+      }
+   }
+
+   return NULL;
+}
+
+/*****************************************************************************/
+static int server_start( SERVER_T *server )
+{
+   unsigned int ii;
+
+   memset(server, 0, sizeof(*server));
+   server->fail_offset = -1;
+
+   for (ii = 0; ii < SERVER_PORT_TRIES && !server->sock; ii++)
+   {
+      snprintf(server->port, sizeof(server->port), "%u", SERVER_PORT_FIRST + ii);
+      server->sock = vc_container_net_open(NULL, server->port,
+         VC_CONTAINER_NET_OPEN_FLAG_STREAM | VC_CONTAINER_NET_OPEN_FLAG_FORCE_IP4, NULL);
+      if (server->sock && vc_container_net_listen(server->sock, SERVER_SLOTS) != VC_CONTAINER_NET_SUCCESS)
+      {
+         vc_container_net_close(server->sock);
+         server->sock = NULL;
+      }
+   }
+   if (!server->sock)
+      return 0;
+
+   if (vcos_mutex_create(&server->lock, "test_http_server") != VCOS_SUCCESS)
+   {
+      vc_container_net_close(server->sock);
+      return 0;
+   }
+   if (vcos_thread_create(&server->thread, "test_http_server", NULL, server_accept, server) != VCOS_SUCCESS)
+   {
+      vcos_mutex_delete(&server->lock);
+      vc_container_net_close(server->sock);
+      return 0;
+   }
+   return 1;
+}
+
+/*****************************************************************************/
+static void server_stop( SERVER_T *server )
+{
+   VC_CONTAINER_NET_T *sock;
+   unsigned int ii;
+
+   /* Wake the server up with a connection of our own */
+   vcos_mutex_lock(&server->lock);
+   server->stop = 1;
+   vcos_mutex_unlock(&server->lock);
+   sock = vc_container_net_open("127.0.0.1", server->port, VC_CONTAINER_NET_OPEN_FLAG_STREAM, NULL);
+   vcos_thread_join(&server->thread, NULL);
+   if (sock)
+      vc_container_net_close(sock);
+
+   /* The clients are all closed so the connections are going away */
+   for (ii = 0; ii < SERVER_SLOTS; ii++)
+      if (server->slots[ii].used)
+         vcos_thread_join(&server->slots[ii].thread, NULL);
+
+   vcos_mutex_delete(&server->lock);
+   vc_container_net_close(server->sock);
+}
+
+/*****************************************************************************/
+static void server_reset( SERVER_T *server )
+{
+   vcos_mutex_lock(&server->lock);
+   server->connections = 0;
+   memset(server->requests, 0, sizeof(server->requests));
+   vcos_mutex_unlock(&server->lock);
+}
+
+/*****************************************************************************/
+static unsigned int server_requests( SERVER_T *server, unsigned int segment )
+{
+   unsigned int requests;
+
+   vcos_mutex_lock(&server->lock);
+   requests = server->requests[segment];
+   vcos_mutex_unlock(&server->lock);
+   return requests;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_IO_T *open_resource( SERVER_T *server, const char *name )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_T *io;
+   char uri[64];
+
+   snprintf(uri, sizeof(uri), "http://127.0.0.1:%s/%s", server->port, name);
+   io = vc_container_io_open(uri, VC_CONTAINER_IO_MODE_READ, &status);
+   if (!io)
+      LOG_ERROR(NULL, "*** Failed to open %s (%d)", uri, status);
+   else if (io->size != RESOURCE_SIZE)
+   {
+      LOG_ERROR(NULL, "*** %s has a size of %" PRIi64, uri, io->size);
+      vc_container_io_close(io);
+      io = NULL;
+   }
+   return io;
+}
+
+/*****************************************************************************/
+static int check_read( VC_CONTAINER_IO_T *io, int64_t offset, size_t size, const char *what )
+{
+   size_t read;
+
+   vc_container_io_seek(io, offset);
+   read = vc_container_io_read(io, buffer, size);
+   if (read != size || memcmp(buffer, resource + offset, size))
+   {
+      LOG_ERROR(NULL, "*** %s: reading %u bytes at %" PRIi64 " gave %u bytes%s (status %d)",
+                what, (unsigned)size, offset, (unsigned)read,
+                read == size ? " of the wrong data" : "", io->status);
+      return 1;
+   }
+   return 0;
+}
+
+/*****************************************************************************/
+static int test_ranges( SERVER_T *server )
+{
+   VC_CONTAINER_IO_T *io;
+   int64_t offset;
+   unsigned int ii;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing range requests and least recently used replacement");
+
+   server_reset(server);
+   io = open_resource(server, "ranges");
+   if (!io)
+      return 1;
+
+   /* Reads which don't line up with the segments */
+   for (offset = 0; offset < RESOURCE_SIZE && !error_count; offset += 10007)
+      error_count += check_read(io, offset, (size_t)MIN(10007, RESOURCE_SIZE - offset), "Sequential read");
+
+   for (ii = 0; ii < RESOURCE_SEGMENTS; ii++)
+   {
+      if (server_requests(server, ii) != 1)
+      {
+         LOG_ERROR(NULL, "*** Segment %u was requested %u times", ii, server_requests(server, ii));
+         error_count++;
+      }
+   }
+
+   /* The start was pushed out of the cache by the rest, but the end is still there */
+   error_count += check_read(io, 0, 16, "Read after eviction");
+   error_count += check_read(io, RESOURCE_SIZE - 16, 16, "Read from the cache");
+   if (server_requests(server, 0) != 2)
+   {
+      LOG_ERROR(NULL, "*** Evicted segment was requested %u times", server_requests(server, 0));
+      error_count++;
+   }
+   if (server_requests(server, RESOURCE_SEGMENTS - 1) != 1)
+   {
+      LOG_ERROR(NULL, "*** Cached segment was requested %u times",
+                server_requests(server, RESOURCE_SEGMENTS - 1));
+      error_count++;
+   }
+
+   vc_container_io_close(io);
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_failed_prefetch( SERVER_T *server )
+{
+   VC_CONTAINER_IO_T *io;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing failed prefetches on busy connections");
+
+   server_reset(server);
+   vcos_mutex_lock(&server->lock);
+   server->fail_offset = 21 * SEGMENT_SIZE;
+   vcos_mutex_unlock(&server->lock);
+
+   io = open_resource(server, "prefetch");
+   if (!io)
+      return 1;
+
+   /* The first read leaves segments 1 to 3 pending on all but one connection, and the
+    * second one prefetches segment 21 on that last connection. Fetching segment 40 then
+    * has to wait for that prefetch, which fails. */
+   error_count += check_read(io, 0, 16, "Read before the prefetches");
+   error_count += check_read(io, 20 * SEGMENT_SIZE, 16, "Read before the failed prefetch");
+   error_count += check_read(io, 40 * SEGMENT_SIZE, 16, "Read after the failed prefetch");
+   if (server_requests(server, 21) != 1)
+   {
+      LOG_ERROR(NULL, "*** Segment 21 was requested %u times", server_requests(server, 21));
+      error_count++;
+   }
+
+   vc_container_io_close(io);
+
+   vcos_mutex_lock(&server->lock);
+   server->fail_offset = -1;
+   vcos_mutex_unlock(&server->lock);
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_reconnect( SERVER_T *server )
+{
+   VC_CONTAINER_IO_T *io;
+   unsigned int connections;
+   int64_t offset;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing reconnection when the server drops connections");
+
+   server_reset(server);
+   vcos_mutex_lock(&server->lock);
+   server->close_after = 3;
+   vcos_mutex_unlock(&server->lock);
+
+   io = open_resource(server, "reconnect");
+   if (!io)
+      return 1;
+
+   for (offset = 0; offset < RESOURCE_SIZE && !error_count; offset += sizeof(buffer))
+      error_count += check_read(io, offset, (size_t)MIN((int64_t)sizeof(buffer), RESOURCE_SIZE - offset),
+                                "Read with dropped connections");
+   vc_container_io_close(io);
+
+   vcos_mutex_lock(&server->lock);
+   server->close_after = 0;
+   connections = server->connections;
+   vcos_mutex_unlock(&server->lock);
+
+   if (connections <= CONNECTIONS_MAX)
+   {
+      LOG_ERROR(NULL, "*** Only %u connections were made", connections);
+      error_count++;
+   }
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_reopen( SERVER_T *server )
+{
+   VC_CONTAINER_IO_T *io;
+   unsigned int ii;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing the cache kept across instances");
+
+   io = open_resource(server, "reopen");
+   if (!io)
+      return 1;
+   error_count += check_read(io, 0, 3 * SEGMENT_SIZE, "Read before reopening");
+   vc_container_io_close(io);
+
+   /* Opening the same resource again finds what was already fetched */
+   server_reset(server);
+   io = open_resource(server, "reopen");
+   if (!io)
+      return error_count + 1;
+   error_count += check_read(io, 0, 3 * SEGMENT_SIZE, "Read after reopening");
+   vc_container_io_close(io);
+   for (ii = 0; ii < 3; ii++)
+   {
+      if (server_requests(server, ii))
+      {
+         LOG_ERROR(NULL, "*** Segment %u was fetched again after reopening", ii);
+         error_count++;
+      }
+   }
+
+   /* Unless the resource changed in the meantime */
+   vcos_mutex_lock(&server->lock);
+   server->etag++;
+   vcos_mutex_unlock(&server->lock);
+   io = open_resource(server, "reopen");
+   if (!io)
+      return error_count + 1;
+   error_count += check_read(io, 0, 16, "Read after the resource changed");
+   vc_container_io_close(io);
+   if (server_requests(server, 0) != 1)
+   {
+      LOG_ERROR(NULL, "*** Segment of a changed resource was requested %u times",
+                server_requests(server, 0));
+      error_count++;
+   }
+
+   return error_count;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   SERVER_T server;
+   unsigned int ii;
+   int error_count = 0;
+   VC_CONTAINER_PARAM_UNUSED(argc);
+   VC_CONTAINER_PARAM_UNUSED(argv);
+
+#ifdef SIGPIPE
+   /* Writing to a connection the other side dropped must fail rather than kill us */
+   signal(SIGPIPE, SIG_IGN);
+#endif
+
+   for (ii = 0; ii < RESOURCE_SIZE; ii++)
+      resource[ii] = (uint8_t)(ii * 7 + (ii >> 16));
+
+   if (!server_start(&server))
+   {
+      LOG_ERROR(NULL, "*** Failed to start the loopback HTTP server");
+      return 1;
+   }
+
+   error_count += test_ranges(&server);
+   error_count += test_failed_prefetch(&server);
+   error_count += test_reconnect(&server);
+   error_count += test_reopen(&server);
+
+   if (server.bad_requests)
+   {
+      LOG_ERROR(NULL, "*** Server received %u bad requests", server.bad_requests);
+      error_count++;
+   }
+   server_stop(&server);
+
+   if (error_count)
+      LOG_ERROR(NULL, "*** %d errors reported", error_count);
+
+   return error_count;
+}
@@ -0,0 +1,234 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+#include "containers/core/containers_index.h"
+
+#define MEDIA_SIZE        8192
+#define INDEX_ENTRIES     1000
+#define SIDECAR_EXTENSION ".vcidx"
+
+static uint8_t media[MEDIA_SIZE];
+
+/*****************************************************************************/
+static int write_media( const char *path, size_t size )
+{
+   FILE *file = fopen(path, "wb");
+   size_t written;
+
+   if (!file)
+      return 0;
+   written = fwrite(media, 1, size, file);
+   fclose(file);
+   return written == size;
+}
+
+static int set_mtime( const char *path, time_t mtime )
+{
+   struct utimbuf times;
+
+   times.actime = mtime;
+   times.modtime = mtime;
+   return !utime(path, &times);
+}
+
+/** Loads the sidecar of the media and checks it gives back what was saved. */
+static int check_load( const char *path, VC_CONTAINER_STATUS_T expected )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_INDEX_T *index = NULL;
+   VC_CONTAINER_IO_T *io;
+   int64_t time, offset;
+   int past, ii, error_count = 0;
+
+   io = vc_container_io_open(path, VC_CONTAINER_IO_MODE_READ, &status);
+   if (!io)
+   {
+      LOG_ERROR(NULL, "*** Failed to open %s (%d)", path, status);
+      return 1;
+   }
+   vc_container_io_skip(io, 100);
+
+   status = vc_container_index_load(&index, io, 0);
+   if (status != expected)
+   {
+      LOG_ERROR(NULL, "*** Loading the index returned %d, expected %d", status, expected);
+      error_count++;
+   }
+   if (io->offset != 100)
+   {
+      LOG_ERROR(NULL, "*** Loading the index moved the read position to %" PRIi64, io->offset);
+      error_count++;
+   }
+
+   for (ii = 0; index && ii < INDEX_ENTRIES; ii++)
+   {
+      time = ii * 1000 + 500;
+      if (vc_container_index_get(index, 0, &time, &offset, &past) != VC_CONTAINER_SUCCESS ||
+          time != ii * 1000 || offset != ii * 8 || past != (ii == INDEX_ENTRIES - 1))
+      {
+         LOG_ERROR(NULL, "*** Entry %d wasn't loaded correctly", ii);
+         error_count++;
+         break;
+      }
+   }
+
+   if (index)
+      vc_container_index_free(index);
+   vc_container_io_close(io);
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_save_and_load( const char *path )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_INDEX_T *index;
+   VC_CONTAINER_IO_T *io;
+   struct stat st;
+   int ii, error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing vc_container_index_save and vc_container_index_load");
+
+   for (ii = 0; ii < MEDIA_SIZE; ii++)
+      media[ii] = (uint8_t)(ii * 13 + 5);
+   if (!write_media(path, MEDIA_SIZE) || stat(path, &st))
+   {
+      LOG_ERROR(NULL, "*** Failed to write %s", path);
+      return 1;
+   }
+
+   io = vc_container_io_open(path, VC_CONTAINER_IO_MODE_READ, &status);
+   if (!io)
+   {
+      LOG_ERROR(NULL, "*** Failed to open %s (%d)", path, status);
+      return 1;
+   }
+   if (vc_container_index_create(&index, 0) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to create an index");
+      vc_container_io_close(io);
+      return 1;
+   }
+
+   /* Enough entries to need several batches in the sidecar */
+   for (ii = 0; ii < INDEX_ENTRIES; ii++)
+      vc_container_index_add(index, ii * 1000, ii * 8);
+   status = vc_container_index_save(index, io);
+   if (status != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Saving the index failed (%d)", status);
+      error_count++;
+   }
+   vc_container_index_free(index);
+   vc_container_io_close(io);
+
+   /* Round trip */
+   error_count += check_load(path, VC_CONTAINER_SUCCESS);
+
+   /* A sidecar saved for other contents is ignored, even if the size and time match */
+   media[10] ^= 0xFF;
+   write_media(path, MEDIA_SIZE);
+   set_mtime(path, st.st_mtime);
+   error_count += check_load(path, VC_CONTAINER_ERROR_FORMAT_INVALID);
+
+   /* Same for a media whose size changed */
+   media[10] ^= 0xFF;
+   write_media(path, MEDIA_SIZE - 1);
+   set_mtime(path, st.st_mtime);
+   error_count += check_load(path, VC_CONTAINER_ERROR_FORMAT_INVALID);
+
+   /* Or which was modified at another time */
+   write_media(path, MEDIA_SIZE);
+   set_mtime(path, st.st_mtime + 10);
+   error_count += check_load(path, VC_CONTAINER_ERROR_FORMAT_INVALID);
+
+   /* Everything back as it was */
+   set_mtime(path, st.st_mtime);
+   error_count += check_load(path, VC_CONTAINER_SUCCESS);
+
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_save_unsupported(void)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_INDEX_T *index;
+   VC_CONTAINER_IO_T *io;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing vc_container_index_save on a stream which isn't a local file");
+
+   io = vc_container_io_mem_create(media, MEDIA_SIZE, &status);
+   if (!io || vc_container_index_create(&index, 0) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to create an in-memory i/o and an index");
+      if (io) vc_container_io_close(io);
+      return 1;
+   }
+
+   vc_container_index_add(index, 0, 0);
+   vc_container_index_add(index, 1000, 100);
+   if (vc_container_index_save(index, io) != VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION)
+   {
+      LOG_ERROR(NULL, "*** Saving the index of an in-memory stream should not be supported");
+      error_count++;
+   }
+
+   vc_container_index_free(index);
+   vc_container_io_close(io);
+   return error_count;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   const char *path = argc > 1 ? argv[1] : "containers_test_index.bin";
+   char sidecar[256];
+   int error_count = 0;
+
+   snprintf(sidecar, sizeof(sidecar), "%s%s", path, SIDECAR_EXTENSION);
+
+   error_count += test_save_and_load(path);
+   error_count += test_save_unsupported();
+
+   remove(sidecar);
+   remove(path);
+
+   if (error_count)
+      LOG_ERROR(NULL, "*** %d errors reported", error_count);
+
+   return error_count;
+}
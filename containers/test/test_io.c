@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+#include "containers/core/containers_io.h"
+
+/** Names of the test modules, in the order in which they are probed, for the last open. */
+static char probe_trace[32];
+
+/** Name of the test module which accepts the URI being opened (0 for none). */
+static char probe_accept;
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T test_module_close( VC_CONTAINER_IO_T *io )
+{
+   VC_CONTAINER_PARAM_UNUSED(io);
+   return VC_CONTAINER_SUCCESS;
+}
+
+static size_t test_module_read( VC_CONTAINER_IO_T *io, void *buffer, size_t size )
+{
+   VC_CONTAINER_PARAM_UNUSED(io);
+   VC_CONTAINER_PARAM_UNUSED(buffer);
+   VC_CONTAINER_PARAM_UNUSED(size);
+   return 0;
+}
+
+static VC_CONTAINER_STATUS_T test_module_open( VC_CONTAINER_IO_T *io, char name )
+{
+   size_t len = strlen(probe_trace);
+
+   if (len < sizeof(probe_trace) - 1)
+   {
+      probe_trace[len] = name;
+      probe_trace[len + 1] = 0;
+   }
+
+   if (name != probe_accept)
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+
+   io->pf_close = test_module_close;
+   io->pf_read = test_module_read;
+   io->capabilities = VC_CONTAINER_IO_CAPS_CANT_SEEK;
+   return VC_CONTAINER_SUCCESS;
+}
+
+#define TEST_MODULE(n) \
+   static VC_CONTAINER_STATUS_T test_module_open_##n( VC_CONTAINER_IO_T *io, \
+      const char *uri, VC_CONTAINER_IO_MODE_T mode ) \
+   { \
+      VC_CONTAINER_PARAM_UNUSED(uri); \
+      VC_CONTAINER_PARAM_UNUSED(mode); \
+      return test_module_open(io, #n[0]); \
+   }
+
+TEST_MODULE(a)
+TEST_MODULE(b)
+TEST_MODULE(c)
+TEST_MODULE(d)
+
+static const char * const test_schemes[] = { "ttest", 0 };
+static const char * const test_other_schemes[] = { "ttest", "other", 0 };
+
+/*****************************************************************************/
+static int check_probe( const char *uri, char accept, const char *expected_trace )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_T *io;
+
+   probe_trace[0] = 0;
+   probe_accept = accept;
+   io = vc_container_io_open(uri, VC_CONTAINER_IO_MODE_READ, &status);
+   if (io)
+      vc_container_io_close(io);
+
+   if (strcmp(probe_trace, expected_trace))
+   {
+      LOG_ERROR(NULL, "*** Opening \"%s\" probed \"%s\", expected \"%s\"", uri, probe_trace,
+                expected_trace);
+      return 1;
+   }
+   if (!io != !accept)
+   {
+      LOG_ERROR(NULL, "*** Opening \"%s\" returned status %d, expected %s", uri, status,
+                accept ? "success" : "failure");
+      return 1;
+   }
+   return 0;
+}
+
+/*****************************************************************************/
+static int test_module_registry(void)
+{
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing vc_container_io_module_register and vc_container_io_module_unregister");
+
+   if (vc_container_io_module_register("test_a", test_schemes, 200, test_module_open_a) != VC_CONTAINER_SUCCESS ||
+       vc_container_io_module_register("test_b", test_schemes, 300, test_module_open_b) != VC_CONTAINER_SUCCESS ||
+       vc_container_io_module_register("test_c", test_other_schemes, 200, test_module_open_c) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to register the test modules");
+      return 1;
+   }
+
+   /* Decreasing priority, most recent registration first for equal priorities */
+   error_count += check_probe("ttest://x", 0, "bca");
+   error_count += check_probe("ttest://x", 'c', "bc");
+   error_count += check_probe("ttest://x", 'a', "bca");
+
+   /* Only the modules registered for the scheme get probed, whatever its case */
+   error_count += check_probe("other://x", 'c', "c");
+   error_count += check_probe("OTHER://x", 'c', "c");
+   error_count += check_probe("unknown://x", 0, "");
+
+   /* Modules registered for any URI are merged in by priority */
+   if (vc_container_io_module_register("test_d", NULL, 250, test_module_open_d) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to register the test module for any URI");
+      error_count++;
+   }
+   error_count += check_probe("ttest://x", 0, "bdca");
+   error_count += check_probe("unknown://x", 'd', "d");
+
+   if (vc_container_io_module_unregister("test_b") != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to unregister a test module");
+      error_count++;
+   }
+   if (vc_container_io_module_unregister("test_b") != VC_CONTAINER_ERROR_NOT_FOUND)
+   {
+      LOG_ERROR(NULL, "*** Unregistering a module twice should fail");
+      error_count++;
+   }
+   error_count += check_probe("ttest://x", 0, "dca");
+
+   vc_container_io_module_unregister("test_a");
+   vc_container_io_module_unregister("test_c");
+   vc_container_io_module_unregister("test_d");
+   error_count += check_probe("ttest://x", 0, "");
+   error_count += check_probe("other://x", 0, "");
+
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_builtin_modules(void)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_T *io;
+   uint8_t buffer[16];
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing the dispatch to built-in modules");
+
+   /* The null module is registered for its own scheme */
+   io = vc_container_io_open("null://", VC_CONTAINER_IO_MODE_READ, &status);
+   if (!io)
+   {
+      LOG_ERROR(NULL, "*** Failed to open the null i/o (%d)", status);
+      return 1;
+   }
+   if (vc_container_io_read(io, buffer, sizeof(buffer)) != sizeof(buffer))
+   {
+      LOG_ERROR(NULL, "*** Reading from the null i/o failed");
+      error_count++;
+   }
+   vc_container_io_close(io);
+
+   /* Built-in modules can be removed like any other */
+   if (vc_container_io_module_unregister("null") != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to unregister the null i/o");
+      error_count++;
+   }
+   io = vc_container_io_open("null://", VC_CONTAINER_IO_MODE_READ, &status);
+   if (io)
+   {
+      LOG_ERROR(NULL, "*** The null i/o is still used after being unregistered");
+      vc_container_io_close(io);
+      error_count++;
+   }
+
+   return error_count;
+}
+
+/** Segments of the in-memory stream, with their sizes. */
+#define MEM_STREAM_SIZE 400
+static const size_t mem_segment_sizes[] = { 100, 50, 1, 149, 100 };
+
+static uint8_t mem_stream[MEM_STREAM_SIZE];
+
+static int check_mem_data( const uint8_t *data, int64_t offset, size_t size, const char *what )
+{
+   if (offset < 0 || offset + size > MEM_STREAM_SIZE || memcmp(data, mem_stream + offset, size))
+   {
+      LOG_ERROR(NULL, "*** %s returned the wrong data at offset %" PRIi64, what, offset);
+      return 1;
+   }
+   return 0;
+}
+
+/*****************************************************************************/
+static int test_mem_io(void)
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_IO_T *io;
+   uint8_t buffer[MEM_STREAM_SIZE];
+   const void *data;
+   size_t ii, size, appended;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing vc_container_io_mem_create and vc_container_io_mem_append");
+
+   for (ii = 0; ii < MEM_STREAM_SIZE; ii++)
+      mem_stream[ii] = (uint8_t)(ii * 7 + (ii >> 8));
+
+   /* Each segment is kept in place, so every one of them lives in the same array */
+   io = vc_container_io_mem_create(mem_stream, mem_segment_sizes[0], &status);
+   if (!io)
+   {
+      LOG_ERROR(NULL, "*** Failed to create an in-memory i/o (%d)", status);
+      return 1;
+   }
+   appended = mem_segment_sizes[0];
+   for (ii = 1; ii < countof(mem_segment_sizes) - 1; ii++)
+   {
+      if (vc_container_io_mem_append(io, mem_stream + appended, mem_segment_sizes[ii]) != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(NULL, "*** Failed to append segment %u", (unsigned)ii);
+         error_count++;
+      }
+      appended += mem_segment_sizes[ii];
+   }
+
+   /* Reads spanning several segments */
+   if (vc_container_io_read(io, buffer, 120) != 120)
+   {
+      LOG_ERROR(NULL, "*** Short read across segments");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, 0, 120, "Read");
+
+   /* The size is picked up by the reading thread when it accesses the stream */
+   if (io->size != (int64_t)appended)
+   {
+      LOG_ERROR(NULL, "*** Size is %" PRIi64 " after appending %u bytes", io->size, (unsigned)appended);
+      error_count++;
+   }
+   if (vc_container_io_read(io, buffer, 40) != 40)
+   {
+      LOG_ERROR(NULL, "*** Short read across the 1 byte segment");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, 120, 40, "Read");
+
+   /* Peeks don't move the read position */
+   if (vc_container_io_peek(io, buffer, 16) != 16 || io->offset != 160)
+   {
+      LOG_ERROR(NULL, "*** Peek failed or moved the read position");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, 160, 16, "Peek");
+
+   /* Mapping only gives access to what is contiguous in memory */
+   vc_container_io_seek(io, 120);
+   size = vc_container_io_map(io, &data, 100);
+   if (size != 30 || data != mem_stream + 120)
+   {
+      LOG_ERROR(NULL, "*** Mapping offset 120 gave %u bytes at %p, expected 30 bytes at %p",
+                (unsigned)size, data, mem_stream + 120);
+      error_count++;
+   }
+   vc_container_io_seek(io, 150);
+   size = vc_container_io_map(io, &data, 100);
+   if (size != 1 || data != mem_stream + 150)
+   {
+      LOG_ERROR(NULL, "*** Mapping the 1 byte segment gave %u bytes", (unsigned)size);
+      error_count++;
+   }
+
+   /* Seeking backwards */
+   vc_container_io_seek(io, 10);
+   if (vc_container_io_read(io, buffer, 5) != 5 || io->offset != 15)
+   {
+      LOG_ERROR(NULL, "*** Read after seeking backwards failed");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, 10, 5, "Read after seek");
+
+   /* Reading past the data appended so far signals the end of the stream */
+   vc_container_io_seek(io, appended - 10);
+   if (vc_container_io_read(io, buffer, 20) != 10 || io->status != VC_CONTAINER_ERROR_EOS)
+   {
+      LOG_ERROR(NULL, "*** Reading past the end should return the remaining bytes and EOS");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, appended - 10, 10, "Read up to the end");
+   size = vc_container_io_map(io, &data, 16);
+   if (size || data)
+   {
+      LOG_ERROR(NULL, "*** Mapping at the end of the data should fail");
+      error_count++;
+   }
+
+   /* The stream keeps going once more data is appended */
+   if (vc_container_io_mem_append(io, mem_stream + appended, MEM_STREAM_SIZE - appended) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Failed to append the last segment");
+      error_count++;
+   }
+   vc_container_io_seek(io, appended);
+   if (vc_container_io_read(io, buffer, MEM_STREAM_SIZE - appended) != MEM_STREAM_SIZE - appended ||
+       io->status != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Reading newly appended data failed");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, appended, MEM_STREAM_SIZE - appended, "Read appended data");
+
+   vc_container_io_seek(io, 0);
+   if (vc_container_io_read(io, buffer, MEM_STREAM_SIZE) != MEM_STREAM_SIZE)
+   {
+      LOG_ERROR(NULL, "*** Reading the whole stream failed");
+      error_count++;
+   }
+   error_count += check_mem_data(buffer, 0, MEM_STREAM_SIZE, "Read of the whole stream");
+
+   if (vc_container_io_mem_append(io, NULL, 1) != VC_CONTAINER_ERROR_INVALID_ARGUMENT)
+   {
+      LOG_ERROR(NULL, "*** Appending a NULL buffer should fail");
+      error_count++;
+   }
+   vc_container_io_close(io);
+
+   /* Only streams from the mem module can be appended to */
+   io = vc_container_io_open("null://", VC_CONTAINER_IO_MODE_READ, &status);
+   if (io)
+   {
+      if (vc_container_io_mem_append(io, mem_stream, 1) != VC_CONTAINER_ERROR_INVALID_ARGUMENT)
+      {
+         LOG_ERROR(NULL, "*** Appending to a non memory i/o should fail");
+         error_count++;
+      }
+      vc_container_io_close(io);
+   }
+
+   return error_count;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   int error_count = 0;
+
+   VC_CONTAINER_PARAM_UNUSED(argc);
+   VC_CONTAINER_PARAM_UNUSED(argv);
+
+   error_count += test_module_registry();
+   error_count += test_mem_io();
+   error_count += test_builtin_modules();
+
+   if (error_count)
+      LOG_ERROR(NULL, "*** %d errors reported", error_count);
+
+   return error_count;
+}
@@ -0,0 +1,344 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+
+/* The stream is made of MPEG-1 layer III frames at 128kbps and 44.1kHz.
+ * Every third frame is padded. */
+#define FRAMES_NUM       300
+#define FRAME_SIZE       417
+#define PACKETS_MAX      (FRAMES_NUM * 8)
+#define BATCH_MAX        32
+#define SMALL_BUFFER     100
+
+typedef struct
+{
+   uint32_t size;
+   uint32_t flags;
+   int64_t pts;
+   int64_t dts;
+   uint64_t hash;
+} PACKET_RECORD_T;
+
+typedef struct
+{
+   unsigned int packets_num;
+   PACKET_RECORD_T packets[PACKETS_MAX];
+} READ_RECORD_T;
+
+static READ_RECORD_T reference, record;
+static uint8_t buffers[BATCH_MAX][FRAME_SIZE + 1];
+
+/*****************************************************************************/
+static int write_stream( const char *path )
+{
+   uint8_t frame[FRAME_SIZE + 1];
+   uint32_t random_state = 1;
+   FILE *file = fopen(path, "wb");
+   size_t ii, jj, size;
+   int ok = 1;
+
+   if (!file)
+      return 0;
+
+   for (ii = 0; ii < FRAMES_NUM && ok; ii++)
+   {
+      size = FRAME_SIZE + (ii % 3 == 2);
+      frame[0] = 0xFF;
+      frame[1] = 0xFB;
+      frame[2] = 0x90 | (ii % 3 == 2 ? 0x02 : 0);
+      frame[3] = 0x00;
+      /* Keep the payload clear of anything looking like a frame sync */
+      for (jj = 4; jj < size; jj++)
+      {
+         random_state = random_state * 1103515245 + 12345;
+         frame[jj] = (uint8_t)((random_state >> 16) % 0xFF);
+      }
+      ok = fwrite(frame, 1, size, file) == size;
+   }
+
+   fclose(file);
+   return ok;
+}
+
+static void record_packet( READ_RECORD_T *rec, const VC_CONTAINER_PACKET_T *packet )
+{
+   PACKET_RECORD_T *entry;
+   uint64_t hash = UINT64_C(14695981039346656037);
+   uint32_t ii;
+
+   if (rec->packets_num >= PACKETS_MAX)
+      return;
+
+   for (ii = 0; ii < packet->size; ii++)
+      hash = (hash ^ packet->data[ii]) * UINT64_C(1099511628211);
+
+   entry = &rec->packets[rec->packets_num++];
+   entry->size = packet->size;
+   entry->flags = packet->flags & ~VC_CONTAINER_PACKET_FLAG_REFERENCE;
+   entry->pts = packet->pts;
+   entry->dts = packet->dts;
+   entry->hash = hash;
+}
+
+/*****************************************************************************/
+/** Reads a whole stream and records the packets.
+ * \param  batch   Number of packets read per call (0 to use vc_container_read)
+ * \param  flags   Read flags
+ * \param  small   Use small buffers for some of the packets
+ * \param  references Returns the number of packets which referenced the stream data */
+static int read_stream( const char *path, READ_RECORD_T *rec, unsigned int batch,
+   VC_CONTAINER_READ_FLAGS_T flags, int small, unsigned int *references )
+{
+   VC_CONTAINER_PACKET_T packets[BATCH_MAX];
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_T *ctx;
+   unsigned int ii, num, read, count = 0;
+   int error_count = 0;
+
+   *references = 0;
+   rec->packets_num = 0;
+   ctx = vc_container_open_reader(path, &status, 0, 0);
+   if (!ctx)
+   {
+      LOG_ERROR(NULL, "*** Failed to open %s (%d)", path, status);
+      return 1;
+   }
+
+   num = batch ? batch : 1;
+   do
+   {
+      memset(packets, 0, sizeof(packets));
+      for (ii = 0; ii < num; ii++)
+      {
+         packets[ii].data = buffers[ii];
+         packets[ii].buffer_size = (small && (count + ii) % 7 == 6) ? SMALL_BUFFER : sizeof(buffers[ii]);
+      }
+
+      if (batch)
+         status = vc_container_read_batch(ctx, packets, num, &read, flags);
+      else
+      {
+         status = vc_container_read(ctx, packets, flags);
+         read = status == VC_CONTAINER_SUCCESS;
+      }
+
+      for (ii = 0; ii < read; ii++)
+      {
+         if (packets[ii].flags & VC_CONTAINER_PACKET_FLAG_REFERENCE)
+         {
+            if (packets[ii].data == buffers[ii])
+            {
+               LOG_ERROR(NULL, "*** Packet flagged as a reference points at the caller's buffer");
+               error_count++;
+            }
+            (*references)++;
+         }
+         record_packet(rec, &packets[ii]);
+         vc_container_packet_release(ctx, &packets[ii]);
+         if (packets[ii].data != buffers[ii])
+         {
+            LOG_ERROR(NULL, "*** Releasing a packet didn't give the caller's buffer back");
+            error_count++;
+         }
+      }
+      count += read;
+   } while (status == VC_CONTAINER_SUCCESS);
+
+   if (status != VC_CONTAINER_ERROR_EOS)
+   {
+      LOG_ERROR(NULL, "*** Reading stopped with status %d instead of EOS", status);
+      error_count++;
+   }
+
+   if (vc_container_close(ctx) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Closing the reader failed");
+      error_count++;
+   }
+   return error_count;
+}
+
+static int compare_records( const READ_RECORD_T *rec, const char *what )
+{
+   unsigned int ii;
+
+   if (rec->packets_num != reference.packets_num)
+   {
+      LOG_ERROR(NULL, "*** %s read %u packets, expected %u", what, rec->packets_num,
+                reference.packets_num);
+      return 1;
+   }
+   for (ii = 0; ii < rec->packets_num; ii++)
+   {
+      if (memcmp(&rec->packets[ii], &reference.packets[ii], sizeof(rec->packets[ii])))
+      {
+         LOG_ERROR(NULL, "*** %s differs from plain reads at packet %u", what, ii);
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/*****************************************************************************/
+static int test_read_modes( const char *path, const char *mapped, int small )
+{
+   static const unsigned int batches[] = { 1, 2, 7, BATCH_MAX };
+   unsigned int ii, references, reference_packets;
+   char what[64];
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing vc_container_read_batch and VC_CONTAINER_READ_FLAG_NO_COPY%s",
+             small ? " with small buffers" : "");
+
+   error_count += read_stream(path, &reference, 0, 0, small, &references);
+   if (reference.packets_num < FRAMES_NUM)
+   {
+      LOG_ERROR(NULL, "*** Only %u packets read from the test stream", reference.packets_num);
+      return error_count + 1;
+   }
+   if (references)
+   {
+      LOG_ERROR(NULL, "*** Packets were returned as references without being asked to");
+      error_count++;
+   }
+
+   for (ii = 0; ii < countof(batches); ii++)
+   {
+      snprintf(what, sizeof(what), "Batches of %u", batches[ii]);
+      error_count += read_stream(path, &record, batches[ii], 0, small, &references);
+      error_count += compare_records(&record, what);
+
+      snprintf(what, sizeof(what), "No-copy batches of %u", batches[ii]);
+      error_count += read_stream(mapped, &record, batches[ii], VC_CONTAINER_READ_FLAG_NO_COPY,
+                                 small, &references);
+      error_count += compare_records(&record, what);
+   }
+
+   error_count += read_stream(mapped, &record, 0, VC_CONTAINER_READ_FLAG_NO_COPY, small,
+                              &reference_packets);
+   error_count += compare_records(&record, "No-copy reads");
+
+   /* The file is memory mapped so most packets should be references */
+   LOG_INFO(NULL, "%u of %u packets read without copy", reference_packets, record.packets_num);
+
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_held_references( const char *path )
+{
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_PACKET_T packet;
+   VC_CONTAINER_T *ctx;
+   unsigned int ii;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing reads into packets which still hold a reference");
+
+   ctx = vc_container_open_reader(path, &status, 0, 0);
+   if (!ctx)
+   {
+      LOG_ERROR(NULL, "*** Failed to open %s (%d)", path, status);
+      return 1;
+   }
+
+   memset(&packet, 0, sizeof(packet));
+   packet.data = buffers[0];
+   packet.buffer_size = sizeof(buffers[0]);
+
+   /* Each read releases the reference the packet still holds */
+   for (ii = 0; ii < 10; ii++)
+   {
+      if (vc_container_read(ctx, &packet, VC_CONTAINER_READ_FLAG_NO_COPY) != VC_CONTAINER_SUCCESS)
+      {
+         LOG_ERROR(NULL, "*** No-copy read %u failed", ii);
+         error_count++;
+      }
+   }
+
+   /* A copied read goes into the caller's buffer, never into the referenced data */
+   if (vc_container_read(ctx, &packet, 0) != VC_CONTAINER_SUCCESS ||
+       packet.data != buffers[0] || (packet.flags & VC_CONTAINER_PACKET_FLAG_REFERENCE))
+   {
+      LOG_ERROR(NULL, "*** Copied read into a packet holding a reference didn't use the caller's buffer");
+      error_count++;
+   }
+
+   /* No reference should be left over */
+   packet.flags |= VC_CONTAINER_PACKET_FLAG_REFERENCE;
+   packet.buffer = buffers[0];
+   if (vc_container_packet_release(ctx, &packet) != VC_CONTAINER_ERROR_INVALID_ARGUMENT)
+   {
+      LOG_ERROR(NULL, "*** References were leaked by reads into packets holding one");
+      error_count++;
+   }
+
+   /* A stale flag on a packet which was never a reference is ignored */
+   packet.flags = VC_CONTAINER_PACKET_FLAG_REFERENCE;
+   packet.data = buffers[0];
+   if (vc_container_read(ctx, &packet, 0) != VC_CONTAINER_SUCCESS || packet.data != buffers[0])
+   {
+      LOG_ERROR(NULL, "*** Read into a packet with a stale reference flag failed");
+      error_count++;
+   }
+
+   vc_container_close(ctx);
+   return error_count;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   const char *path = argc > 1 ? argv[1] : "containers_test_read.mp3";
+   char mapped[256];
+   int error_count = 0;
+
+   if (!write_stream(path))
+   {
+      LOG_ERROR(NULL, "*** Failed to write %s", path);
+      return 1;
+   }
+
+   /* Data can only be returned without copy when the file is memory mapped */
+   snprintf(mapped, sizeof(mapped), "mmap:%s", path);
+   error_count += test_read_modes(path, mapped, 0);
+   error_count += test_read_modes(path, mapped, 1);
+   error_count += test_held_references(mapped);
+
+   remove(path);
+
+   if (error_count)
+      LOG_ERROR(NULL, "*** %d errors reported", error_count);
+
+   return error_count;
+}
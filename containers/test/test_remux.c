@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "containers/containers.h"
+#include "containers/containers_remux.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+
+/* The input is made of MPEG-1 layer III frames at 128kbps and 44.1kHz.
+ * Every third frame is padded. */
+#define FRAMES_NUM       300
+#define FRAME_SIZE       417
+#define STREAM_SIZE      (FRAMES_NUM * FRAME_SIZE + FRAMES_NUM / 3)
+
+#define JOBS_NUM         6
+
+/*****************************************************************************/
+static int write_stream( const char *path )
+{
+   uint8_t frame[FRAME_SIZE + 1];
+   FILE *file = fopen(path, "wb");
+   size_t ii, size;
+   int ok = 1;
+
+   if (!file)
+      return 0;
+
+   memset(frame, 0x55, sizeof(frame));
+   for (ii = 0; ii < FRAMES_NUM && ok; ii++)
+   {
+      size = FRAME_SIZE + (ii % 3 == 2);
+      frame[0] = 0xFF;
+      frame[1] = 0xFB;
+      frame[2] = 0x90 | (ii % 3 == 2 ? 0x02 : 0);
+      frame[3] = 0x00;
+      ok = fwrite(frame, 1, size, file) == size;
+   }
+
+   fclose(file);
+   return ok;
+}
+
+static int file_exists( const char *path )
+{
+   FILE *file = fopen(path, "rb");
+
+   if (file)
+      fclose(file);
+   return file != NULL;
+}
+
+static void job_done( VC_CONTAINER_REMUX_JOB_T *job, void *userdata )
+{
+   VC_CONTAINER_PARAM_UNUSED(userdata);
+   /* Each job is only ever handled by a single worker */
+   job->user_data = job;
+}
+
+/*****************************************************************************/
+/** Checks that an output has all the data of the input. */
+static int check_output( const VC_CONTAINER_REMUX_JOB_T *job )
+{
+   static uint8_t buffer[FRAME_SIZE + 1];
+   VC_CONTAINER_STATUS_T status;
+   VC_CONTAINER_PACKET_T packet;
+   VC_CONTAINER_T *ctx;
+   uint64_t packets = 0, bytes = 0;
+   int error_count = 0;
+
+   if (job->status != VC_CONTAINER_SUCCESS || job->tracks_num != 1 ||
+       job->packets != FRAMES_NUM || job->bytes != STREAM_SIZE)
+   {
+      LOG_ERROR(NULL, "*** Remuxing into %s gave status %d, %u tracks, %u packets, %u bytes",
+                job->output, job->status, job->tracks_num, (unsigned)job->packets,
+                (unsigned)job->bytes);
+      return 1;
+   }
+
+   ctx = vc_container_open_reader(job->output, &status, 0, 0);
+   if (!ctx)
+   {
+      LOG_ERROR(NULL, "*** Failed to open %s (%d)", job->output, status);
+      return 1;
+   }
+
+   memset(&packet, 0, sizeof(packet));
+   do
+   {
+      packet.data = buffer;
+      packet.buffer_size = sizeof(buffer);
+      status = vc_container_read(ctx, &packet, 0);
+      if (status != VC_CONTAINER_SUCCESS)
+         break;
+      packets++;
+      bytes += packet.size;
+   } while (1);
+
+   if (ctx->tracks_num != 1 || packets != job->packets || bytes != job->bytes)
+   {
+      LOG_ERROR(NULL, "*** %s has %u tracks, %u packets and %u bytes", job->output,
+                ctx->tracks_num, (unsigned)packets, (unsigned)bytes);
+      error_count++;
+   }
+
+   vc_container_close(ctx);
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_remux( const char *input )
+{
+   VC_CONTAINER_REMUX_JOB_T jobs[JOBS_NUM];
+   VC_CONTAINER_REMUX_PARAMS_T params;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int ii;
+   int error_count = 0;
+   FILE *file;
+
+   LOG_DEBUG(NULL, "Testing vc_container_remux");
+
+   memset(jobs, 0, sizeof(jobs));
+   jobs[0].input = input;
+   jobs[0].output = "containers_test_remux_0.mp4";
+   jobs[1].input = input;
+   jobs[1].output = "containers_test_remux_1.mp4";
+   jobs[2].input = "containers_test_remux_missing.mp3";
+   jobs[2].output = "containers_test_remux_2.mp4";
+   jobs[3].input = input;
+   jobs[3].output = "containers_test_remux_3.yuv"; /* No writer takes audio in there */
+   jobs[4].input = input;
+   jobs[4].output = "containers_test_remux_4.avi";
+   jobs[5].input = input;
+   jobs[5].output = "direct:containers_test_remux_5.yuv";
+
+   /* Failing to read the input must not touch an existing output */
+   file = fopen(jobs[2].output, "wb");
+   if (file)
+      fclose(file);
+
+   memset(&params, 0, sizeof(params));
+   params.threads = 2;
+   params.pf_done = job_done;
+
+   status = vc_container_remux(jobs, JOBS_NUM, &params);
+   if (status != jobs[2].status)
+   {
+      LOG_ERROR(NULL, "*** Batch returned %d instead of the status of the first failed job", status);
+      error_count++;
+   }
+
+   for (ii = 0; ii < JOBS_NUM; ii++)
+   {
+      if (jobs[ii].user_data != &jobs[ii])
+      {
+         LOG_ERROR(NULL, "*** Completion of job %u wasn't signalled", ii);
+         error_count++;
+      }
+   }
+
+   error_count += check_output(&jobs[0]);
+   error_count += check_output(&jobs[1]);
+   error_count += check_output(&jobs[4]);
+
+   if (jobs[2].status == VC_CONTAINER_SUCCESS || !file_exists(jobs[2].output))
+   {
+      LOG_ERROR(NULL, "*** Job with a missing input gave status %d and removed its output",
+                jobs[2].status);
+      error_count++;
+   }
+   if (jobs[3].status == VC_CONTAINER_SUCCESS || file_exists(jobs[3].output))
+   {
+      LOG_ERROR(NULL, "*** Job without a suitable writer gave status %d and left its output",
+                jobs[3].status);
+      error_count++;
+   }
+   /* Local files opened with another scheme are removed as well */
+   if (jobs[5].status == VC_CONTAINER_SUCCESS || file_exists("containers_test_remux_5.yuv"))
+   {
+      LOG_ERROR(NULL, "*** Job writing to a direct: URI gave status %d and left its output",
+                jobs[5].status);
+      error_count++;
+   }
+
+   for (ii = 0; ii < JOBS_NUM; ii++)
+      remove(jobs[ii].output);
+   remove("containers_test_remux_5.yuv");
+
+   /* An empty batch has nothing to fail */
+   if (vc_container_remux(NULL, 0, NULL) != VC_CONTAINER_SUCCESS)
+   {
+      LOG_ERROR(NULL, "*** Empty batch failed");
+      error_count++;
+   }
+
+   return error_count;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   const char *path = argc > 1 ? argv[1] : "containers_test_remux.mp3";
+   int error_count = 0;
+
+   if (!write_stream(path))
+   {
+      LOG_ERROR(NULL, "*** Failed to write %s", path);
+      return 1;
+   }
+
+   error_count += test_remux(path);
+
+   remove(path);
+
+   if (error_count)
+      LOG_ERROR(NULL, "*** %d errors reported", error_count);
+
+   return error_count;
+}
@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_logging.h"
+#include "containers/core/containers_startcode.h"
+
+/* Build a second copy of the search without SIMD so both versions get checked,
+ * whatever the library was built with */
+size_t find_startcodes_scalar( const uint8_t *data, size_t size, size_t *offsets, size_t offsets_max );
+#define STARTCODE_NO_SIMD
+#define vc_container_find_startcodes find_startcodes_scalar
+#include "containers/core/containers_startcode.c"
+#undef vc_container_find_startcodes
+
+#define BUFFER_SIZE  (64*1024)
+#define OFFSETS_MAX  (BUFFER_SIZE/3 + 1)
+
+typedef size_t (*FIND_STARTCODES_T)( const uint8_t *, size_t, size_t *, size_t );
+
+static const struct
+{
+   const char *name;
+   FIND_STARTCODES_T pf_find;
+} implementations[] =
+{
+   { "library", vc_container_find_startcodes },
+   { "scalar", find_startcodes_scalar },
+};
+
+static uint8_t buffer[BUFFER_SIZE + 16];
+static size_t expected[OFFSETS_MAX];
+static size_t found[OFFSETS_MAX];
+static uint32_t random_state = 1;
+
+/*****************************************************************************/
+static uint32_t next_random(void)
+{
+   random_state = random_state * 1103515245 + 12345;
+   return random_state >> 16;
+}
+
+/** Fills a buffer with mostly zeros and ones so that start codes are frequent.
+ * \param  rarity  1 in that many bytes is neither zero nor one */
+static void fill_buffer( uint8_t *data, size_t size, unsigned int rarity )
+{
+   size_t ii;
+
+   for (ii = 0; ii < size; ii++)
+   {
+      uint32_t r = next_random();
+      data[ii] = (r % rarity) ? (uint8_t)((r >> 8) % 2 ? 0 : (r >> 9) % 2) : (uint8_t)(r >> 8);
+   }
+}
+
+static size_t find_startcodes_brute_force( const uint8_t *data, size_t size, size_t *offsets, size_t offsets_max )
+{
+   size_t ii, num = 0;
+
+   for (ii = 0; ii + 3 <= size && num < offsets_max; ii++)
+      if (!data[ii] && !data[ii + 1] && data[ii + 2] == 1)
+         offsets[num++] = ii;
+   return num;
+}
+
+/*****************************************************************************/
+static int check_search( const uint8_t *data, size_t size, size_t offsets_max )
+{
+   size_t num_expected, num, ii;
+   int error_count = 0;
+
+   num_expected = find_startcodes_brute_force(data, size, expected, offsets_max);
+
+   for (ii = 0; ii < countof(implementations); ii++)
+   {
+      num = implementations[ii].pf_find(data, size, found, offsets_max);
+      if (num != num_expected || memcmp(found, expected, num * sizeof(*found)))
+      {
+         LOG_ERROR(NULL, "*** %s search found %u start codes in %u bytes (max %u), expected %u",
+                   implementations[ii].name, (unsigned)num, (unsigned)size,
+                   (unsigned)offsets_max, (unsigned)num_expected);
+         error_count++;
+      }
+   }
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_small_buffers(void)
+{
+   size_t size, align, offsets_max;
+   int error_count = 0;
+
+   LOG_DEBUG(NULL, "Testing vc_container_find_startcodes on small buffers");
+
+   /* Every size and alignment around the block size, so each part of the search
+    * and the hand over between them is exercised */
+   for (size = 0; size <= 80; size++)
+   {
+      for (align = 0; align < 16; align++)
+      {
+         fill_buffer(buffer + align, size, 8);
+         for (offsets_max = 0; offsets_max <= 4; offsets_max++)
+            error_count += check_search(buffer + align, size, offsets_max);
+         error_count += check_search(buffer + align, size, OFFSETS_MAX);
+      }
+   }
+
+   /* Start codes straddling the end of a block */
+   memset(buffer, 0xFF, 64);
+   for (align = 0; align + 3 <= 64; align++)
+   {
+      buffer[align] = 0;
+      buffer[align + 1] = 0;
+      buffer[align + 2] = 1;
+      error_count += check_search(buffer, 64, OFFSETS_MAX);
+      buffer[align] = buffer[align + 1] = buffer[align + 2] = 0xFF;
+   }
+
+   return error_count;
+}
+
+/*****************************************************************************/
+static int test_large_buffers(void)
+{
+   static const unsigned int rarities[] = { 2, 8, 64, 100000 };
+   int error_count = 0;
+   size_t ii;
+
+   LOG_DEBUG(NULL, "Testing vc_container_find_startcodes on large buffers");
+
+   for (ii = 0; ii < countof(rarities); ii++)
+   {
+      fill_buffer(buffer, BUFFER_SIZE, rarities[ii]);
+      error_count += check_search(buffer, BUFFER_SIZE, OFFSETS_MAX);
+      error_count += check_search(buffer + 1, BUFFER_SIZE - 1, OFFSETS_MAX);
+      error_count += check_search(buffer, BUFFER_SIZE, 100);
+   }
+
+   /* Long runs of zeros only have start codes where a one follows */
+   memset(buffer, 0, BUFFER_SIZE);
+   error_count += check_search(buffer, BUFFER_SIZE, OFFSETS_MAX);
+   buffer[BUFFER_SIZE - 1] = 1;
+   buffer[BUFFER_SIZE / 2] = 1;
+   error_count += check_search(buffer, BUFFER_SIZE, OFFSETS_MAX);
+
+   return error_count;
+}
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+   int error_count = 0;
+
+   VC_CONTAINER_PARAM_UNUSED(argc);
+   VC_CONTAINER_PARAM_UNUSED(argv);
+
+   error_count += test_small_buffers();
+   error_count += test_large_buffers();
+
+   if (error_count)
+      LOG_ERROR(NULL, "*** %d errors reported", error_count);
+
+   return error_count;
+}